@@ -0,0 +1,101 @@
+//
+//  fuse.h
+//  FuseHFS
+//
+//  The high-level API of macFUSE 2.x as fusefs_hfs.c uses it: the operations
+//  table in the real header's order, including macFUSE's extensions and its
+//  positional xattr calls, and the call context. See bench/README.md.
+//
+
+#ifndef _compat_fuse_h
+#define _compat_fuse_h
+
+#include <stdint.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#ifdef __linux__
+#include <sys/vfs.h>
+#else
+#include <sys/mount.h>
+#endif
+
+#include "fuse_common.h"
+
+typedef int (*fuse_fill_dir_t)(void *buf, const char *name, const struct stat *stbuf, off_t off);
+
+struct fuse_operations {
+	int (*getattr)(const char *, struct stat *);
+	int (*readlink)(const char *, char *, size_t);
+	void *getdir;
+	int (*mknod)(const char *, mode_t, dev_t);
+	int (*mkdir)(const char *, mode_t);
+	int (*unlink)(const char *);
+	int (*rmdir)(const char *);
+	int (*symlink)(const char *, const char *);
+	int (*rename)(const char *, const char *);
+	int (*link)(const char *, const char *);
+	int (*chmod)(const char *, mode_t);
+	int (*chown)(const char *, uid_t, gid_t);
+	int (*truncate)(const char *, off_t);
+	void *utime;
+	int (*open)(const char *, struct fuse_file_info *);
+	int (*read)(const char *, char *, size_t, off_t, struct fuse_file_info *);
+	int (*write)(const char *, const char *, size_t, off_t, struct fuse_file_info *);
+	int (*statfs)(const char *, struct statvfs *);
+	int (*flush)(const char *, struct fuse_file_info *);
+	int (*release)(const char *, struct fuse_file_info *);
+	int (*fsync)(const char *, int, struct fuse_file_info *);
+	int (*setxattr)(const char *, const char *, const char *, size_t, int, uint32_t);
+	int (*getxattr)(const char *, const char *, char *, size_t, uint32_t);
+	int (*listxattr)(const char *, char *, size_t);
+	int (*removexattr)(const char *, const char *);
+	int (*opendir)(const char *, struct fuse_file_info *);
+	int (*readdir)(const char *, void *, fuse_fill_dir_t, off_t, struct fuse_file_info *);
+	int (*releasedir)(const char *, struct fuse_file_info *);
+	int (*fsyncdir)(const char *, int, struct fuse_file_info *);
+	void *(*init)(struct fuse_conn_info *conn);
+	void (*destroy)(void *);
+	int (*access)(const char *, int);
+	int (*create)(const char *, mode_t, struct fuse_file_info *);
+	int (*ftruncate)(const char *, off_t, struct fuse_file_info *);
+	int (*fgetattr)(const char *, struct stat *, struct fuse_file_info *);
+	int (*lock)(const char *, struct fuse_file_info *, int cmd, void *);
+	int (*utimens)(const char *, const struct timespec tv[2]);
+	int (*bmap)(const char *, size_t blocksize, uint64_t *idx);
+	unsigned int flag_nullpath_ok : 1;
+	unsigned int flag_nopath : 1;
+	unsigned int flag_utime_omit_ok : 1;
+	unsigned int flag_reserved : 29;
+	int (*ioctl)(const char *, int cmd, void *arg, struct fuse_file_info *, unsigned int flags, void *data);
+	int (*poll)(const char *, struct fuse_file_info *, void *ph, unsigned *reventsp);
+	int (*write_buf)(const char *, struct fuse_bufvec *buf, off_t off, struct fuse_file_info *);
+	int (*read_buf)(const char *, struct fuse_bufvec **bufp, size_t size, off_t off, struct fuse_file_info *);
+	int (*flock)(const char *, struct fuse_file_info *, int op);
+	int (*fallocate)(const char *, int, off_t, off_t, struct fuse_file_info *);
+	int (*reserved00)(void);
+	int (*setvolname)(const char *);
+	int (*exchange)(const char *, const char *, unsigned long);
+	int (*getxtimes)(const char *, struct timespec *bkuptime, struct timespec *crtime);
+	int (*setbkuptime)(const char *, const struct timespec *tv);
+	int (*setchgtime)(const char *, const struct timespec *tv);
+	int (*setcrtime)(const char *, const struct timespec *tv);
+	int (*chflags)(const char *, uint32_t);
+	int (*setattr_x)(const char *, void *);
+	int (*fsetattr_x)(const char *, void *, struct fuse_file_info *);
+	int (*statfs_x)(const char *, struct statfs *);
+};
+
+struct fuse_context {
+	struct fuse *fuse;
+	uid_t uid;
+	gid_t gid;
+	pid_t pid;
+	void *private_data;
+	mode_t umask;
+};
+
+struct fuse_context *fuse_get_context(void);
+
+#endif /* _compat_fuse_h */
@@ -0,0 +1,84 @@
+//
+//  fuse_common.h
+//  FuseHFS
+//
+//  The part of macFUSE 2.x's fuse_common.h that fusefs_hfs.c uses, laid out
+//  as in the real header. See bench/README.md.
+//
+
+#ifndef _compat_fuse_common_h
+#define _compat_fuse_common_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#include "fuse_opt.h"
+
+struct fuse_file_info {
+	int flags;
+	unsigned long fh_old;
+	int writepage;
+	unsigned int direct_io : 1;
+	unsigned int keep_cache : 1;
+	unsigned int flush : 1;
+	unsigned int nonseekable : 1;
+	unsigned int flock_release : 1;
+	unsigned int padding : 27;
+	uint64_t fh;
+	uint64_t lock_owner;
+};
+
+#define FUSE_CAP_BIG_WRITES		(1 << 5)
+#define FUSE_CAP_SPLICE_WRITE	(1 << 7)
+#define FUSE_CAP_SPLICE_MOVE	(1 << 8)
+#define FUSE_CAP_SPLICE_READ	(1 << 9)
+
+struct fuse_conn_info {
+	unsigned proto_major;
+	unsigned proto_minor;
+	unsigned async_read;
+	unsigned max_write;
+	unsigned max_readahead;
+	unsigned capable;
+	unsigned want;
+	unsigned max_background;
+	unsigned congestion_threshold;
+	unsigned reserved[23];
+};
+
+enum fuse_buf_flags {
+	FUSE_BUF_IS_FD    = (1 << 1),
+	FUSE_BUF_FD_SEEK  = (1 << 2),
+	FUSE_BUF_FD_RETRY = (1 << 3),
+};
+
+enum fuse_buf_copy_flags {
+	FUSE_BUF_NO_SPLICE       = (1 << 1),
+	FUSE_BUF_FORCE_SPLICE    = (1 << 2),
+	FUSE_BUF_SPLICE_MOVE     = (1 << 3),
+	FUSE_BUF_SPLICE_NONBLOCK = (1 << 4),
+};
+
+struct fuse_buf {
+	size_t size;
+	enum fuse_buf_flags flags;
+	void *mem;
+	int fd;
+	off_t pos;
+};
+
+struct fuse_bufvec {
+	size_t count;
+	size_t idx;
+	size_t off;
+	struct fuse_buf buf[1];
+};
+
+#define FUSE_BUFVEC_INIT(size__) \
+	((struct fuse_bufvec) { 1, 0, 0, { { size__, (enum fuse_buf_flags) 0, NULL, -1, 0 } } })
+
+size_t fuse_buf_size(const struct fuse_bufvec *bufv);
+ssize_t fuse_buf_copy(struct fuse_bufvec *dst, struct fuse_bufvec *src, enum fuse_buf_copy_flags flags);
+
+#endif /* _compat_fuse_common_h */
@@ -0,0 +1,18 @@
+//
+//  fuse_opt.h
+//  FuseHFS
+//
+//  The part of macFUSE 2.x's fuse_opt.h that fusefs_hfs.h needs, so the
+//  benchmark builds where macFUSE isn't installed. See bench/README.md.
+//
+
+#ifndef _compat_fuse_opt_h
+#define _compat_fuse_opt_h
+
+struct fuse_args {
+	int argc;
+	char **argv;
+	int allocated;
+};
+
+#endif /* _compat_fuse_opt_h */
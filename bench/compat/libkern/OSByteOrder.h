@@ -0,0 +1,38 @@
+//
+//  OSByteOrder.h
+//  FuseHFS
+//
+//  The big-endian accessors fusefs_hfs.c takes from <libkern/OSByteOrder.h>.
+//  See bench/README.md.
+//
+
+#ifndef _compat_OSByteOrder_h
+#define _compat_OSByteOrder_h
+
+#include <stdint.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+static inline uint16_t OSReadBigInt16(const void *base, uintptr_t offset) {
+	uint16_t v;
+	memcpy(&v, (const char *)base + offset, sizeof v);
+	return ntohs(v);
+}
+
+static inline uint32_t OSReadBigInt32(const void *base, uintptr_t offset) {
+	uint32_t v;
+	memcpy(&v, (const char *)base + offset, sizeof v);
+	return ntohl(v);
+}
+
+static inline void OSWriteBigInt16(void *base, uintptr_t offset, uint16_t data) {
+	data = htons(data);
+	memcpy((char *)base + offset, &data, sizeof data);
+}
+
+static inline void OSWriteBigInt32(void *base, uintptr_t offset, uint32_t data) {
+	data = htonl(data);
+	memcpy((char *)base + offset, &data, sizeof data);
+}
+
+#endif /* _compat_OSByteOrder_h */
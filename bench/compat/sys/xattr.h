@@ -0,0 +1,21 @@
+//
+//  xattr.h
+//  FuseHFS
+//
+//  The attribute names and error fusefs_hfs.c takes from macOS's
+//  <sys/xattr.h>. See bench/README.md.
+//
+
+#ifndef _compat_xattr_h
+#define _compat_xattr_h
+
+#include <errno.h>
+
+#define XATTR_FINDERINFO_NAME	"com.apple.FinderInfo"
+#define XATTR_RESOURCEFORK_NAME	"com.apple.ResourceFork"
+
+#ifndef ENOATTR
+#define ENOATTR ENODATA
+#endif
+
+#endif /* _compat_xattr_h */
@@ -0,0 +1,609 @@
+//
+//  fusebench.c
+//  FuseHFS
+//
+//  Drives FuseHFS_operations in-process, the way libfuse would, with no
+//  kernel and no mount: the image is opened with fusehfs_mount() and every
+//  call goes through the operations table, so path conversion, logging and
+//  the timing wrappers are all part of what's measured. Workloads:
+//
+//      tar      extract a synthetic tree (lookup, mkdir, create, write, utimens)
+//      browse   Finder-style storm over it (readdir, getattr, xattrs, probes)
+//      cp       cp -R of the tree (read_buf into write_buf, FinderInfo copied)
+//      stream   one large file written and read back in iosize chunks
+//      rm       rm -rf of everything the others made
+//      replay   operations read from a trace file (-t), one per line
+//
+//  Results are tab-separated: per workload, one line for all its calls
+//  (op "*", rate over wall time) and one per operation (rate over the time
+//  spent in it), with percentiles in microseconds. '#' lines are comments.
+//
+//  Licensed under GPLv2: https://www.gnu.org/licenses/gpl-2.0.html
+//
+#include "common.h"
+
+#include <fuse/fuse.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <sys/xattr.h>
+#include <libhfs/hfs.h>
+
+#include "fusefs_hfs.h"
+#include "log.h"
+#include "stats.h"
+
+#define OPS FuseHFS_operations
+#define CHUNK FUSEHFS_IOSIZE
+
+extern struct fuse_operations FuseHFS_operations;
+
+static struct fusehfs_options _options = { .encoding = "Macintosh" };
+static struct fuse_context _context;
+
+static unsigned long _nfiles = 2000;	// files in the synthetic tree
+static unsigned int _fanout = 8;		// subfolders per folder
+static unsigned int _perdir = 40;		// files per folder
+static unsigned long _streammb = 64;
+static unsigned int _rounds = 3;		// browse passes
+static unsigned long _seed = 1;
+
+#pragma mark libfuse stand-ins
+
+struct fuse_context * fuse_get_context(void) {
+	return &_context;
+}
+
+size_t fuse_buf_size(const struct fuse_bufvec *bv) {
+	size_t n = 0;
+	for (size_t i = bv->idx; i < bv->count; i++)
+		n += bv->buf[i].size;
+	return n - bv->off;
+}
+
+// only what the benchmark needs: memory or fd sources into one memory buffer
+ssize_t fuse_buf_copy(struct fuse_bufvec *dst, struct fuse_bufvec *src, enum fuse_buf_copy_flags flags) {
+	char *out = (char *)dst->buf[0].mem + dst->off;
+	size_t room = dst->buf[0].size - dst->off, n = 0, skip = src->off;
+
+	for (size_t i = src->idx; i < src->count && n < room; i++, skip = 0) {
+		const struct fuse_buf *b = &src->buf[i];
+		size_t len = b->size - skip;
+		if (len > room - n) len = room - n;
+		if (b->flags & FUSE_BUF_IS_FD) {
+			ssize_t got = pread(b->fd, out + n, len, b->pos + skip);
+			if (got < 0) return -errno;
+			len = got;
+		} else {
+			memcpy(out + n, (const char *)b->mem + skip, len);
+		}
+		n += len;
+	}
+	return n;
+}
+
+#pragma mark Samples
+
+typedef struct {
+	uint64_t *ns;
+	size_t n, cap;
+	unsigned long errors;
+} samples;
+
+#define FUSEHFS_OP_NAME(name) #name,
+static const char *_op_names[OP_COUNT] = { FUSEHFS_OPS(FUSEHFS_OP_NAME) };
+
+static samples _samples[OP_COUNT];
+static const char *_workload;
+static uint64_t _wall;
+
+static void sample(int op, uint64_t ns, int ret) {
+	samples *s = &_samples[op];
+	if (s->n == s->cap) {
+		s->cap = s->cap ? 2 * s->cap : 1024;
+		s->ns = realloc(s->ns, s->cap * sizeof s->ns[0]);
+		if (s->ns == NULL) {
+			perror("realloc");
+			exit(1);
+		}
+	}
+	s->ns[s->n++] = ns;
+	if (ret < 0) s->errors++;
+}
+
+// every call goes through here, timed from the caller's side
+#define CALL(op, args...) ({ \
+	uint64_t t0 = stats_now(); \
+	int r = OPS.op(args); \
+	sample(OP_##op, stats_now() - t0, r); \
+	r; \
+})
+
+static int cmp_ns(const void *a, const void *b) {
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+	return x < y ? -1 : x > y;
+}
+
+static double pct(const uint64_t *sorted, size_t n, double q) {
+	size_t i = (size_t)(q * n);
+	return sorted[i < n ? i : n - 1] / 1000.0;
+}
+
+static void print_line(const char *op, uint64_t *ns, size_t n, unsigned long errors, uint64_t secs_ns) {
+	qsort(ns, n, sizeof ns[0], cmp_ns);
+	printf("%s\t%s\t%zu\t%lu\t%.6f\t%.1f\t%.1f\t%.1f\t%.1f\t%.1f\t%.1f\n",
+		   _workload, op, n, errors, secs_ns / 1e9, secs_ns ? n / (secs_ns / 1e9) : 0.0,
+		   pct(ns, n, 0.5), pct(ns, n, 0.9), pct(ns, n, 0.99), pct(ns, n, 0.999), ns[n - 1] / 1000.0);
+}
+
+static void begin(const char *workload) {
+	_workload = workload;
+	for (int op = 0; op < OP_COUNT; op++) {
+		_samples[op].n = 0;
+		_samples[op].errors = 0;
+	}
+	_wall = stats_now();
+}
+
+static void end(void) {
+	uint64_t wall = stats_now() - _wall, *all = NULL;
+	size_t total = 0, at = 0;
+	unsigned long errors = 0;
+
+	for (int op = 0; op < OP_COUNT; op++) {
+		total += _samples[op].n;
+		errors += _samples[op].errors;
+	}
+	if (total == 0) return;
+
+	all = malloc(total * sizeof all[0]);
+	for (int op = 0; op < OP_COUNT; op++) {
+		memcpy(all + at, _samples[op].ns, _samples[op].n * sizeof all[0]);
+		at += _samples[op].n;
+	}
+	print_line("*", all, total, errors, wall);
+	free(all);
+
+	for (int op = 0; op < OP_COUNT; op++) {
+		samples *s = &_samples[op];
+		if (s->n == 0) continue;
+		uint64_t spent = 0;
+		for (size_t i = 0; i < s->n; i++) spent += s->ns[i];
+		print_line(_op_names[op], s->ns, s->n, s->errors, spent);
+	}
+	fflush(stdout);
+}
+
+#pragma mark Helpers
+
+static void die(const char *what, const char *path, int err) {
+	fprintf(stderr, "fusebench: %s %s: %s\n", what, path, strerror(err));
+	exit(1);
+}
+
+static unsigned long rnd(void) {
+	_seed = _seed * 1103515245 + 12345;
+	return (_seed >> 16) & 0x7fffffff;
+}
+
+// mostly small files, as in a source tree, with the occasional large one
+static size_t file_size(void) {
+	if (rnd() % 100 == 0) return 1048576 + rnd() % 4194304;
+	return rnd() % (1 << (rnd() % 17 + 1));
+}
+
+static char _data[CHUNK];
+
+// libfuse prefers write_buf when the filesystem has one, and so does this
+static int put(const char *path, const char *buf, size_t size, off_t off, struct fuse_file_info *fi) {
+	if (OPS.write_buf == NULL) return CALL(write, path, buf, size, off, fi);
+	struct fuse_bufvec bv = FUSE_BUFVEC_INIT(size);
+	bv.buf[0].mem = (void *)buf;
+	return CALL(write_buf, path, &bv, off, fi);
+}
+
+static int get(const char *path, char *buf, size_t size, off_t off, struct fuse_file_info *fi) {
+	if (OPS.read_buf == NULL) return CALL(read, path, buf, size, off, fi);
+	struct fuse_bufvec *src = NULL;
+	int ret = CALL(read_buf, path, &src, size, off, fi);
+	if (ret < 0) return ret;
+	struct fuse_bufvec dst = FUSE_BUFVEC_INIT(size);
+	dst.buf[0].mem = buf;
+	ret = fuse_buf_copy(&dst, src, 0);
+	bufvec_free(src);
+	return ret;
+}
+
+static void write_file(const char *path, size_t size) {
+	struct fuse_file_info fi = { .flags = O_WRONLY | O_CREAT | O_EXCL };
+	struct stat st;
+	int ret;
+
+	CALL(getattr, path, &st);		// the lstat before O_EXCL
+	if ((ret = CALL(create, path, 0644, &fi)) < 0) die("create", path, -ret);
+	for (size_t off = 0; off < size; off += CHUNK) {
+		size_t len = size - off < CHUNK ? size - off : CHUNK;
+		if ((ret = put(path, _data, len, off, &fi)) < 0) die("write", path, -ret);
+	}
+	CALL(release, path, &fi);
+}
+
+// the names in a folder, as the kernel would collect them
+typedef struct {
+	char **names;
+	size_t n, cap;
+} listing;
+
+static int fill(void *buf, const char *name, const struct stat *st, off_t off) {
+	listing *l = buf;
+	if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) return 0;
+	if (l->n == l->cap) {
+		l->cap = l->cap ? 2 * l->cap : 64;
+		l->names = realloc(l->names, l->cap * sizeof l->names[0]);
+	}
+	l->names[l->n++] = strdup(name);
+	return 0;
+}
+
+static void list(const char *path, listing *l) {
+	struct fuse_file_info fi = { .flags = O_RDONLY };
+	int ret;
+
+	l->n = 0;
+	if ((ret = CALL(opendir, path, &fi)) < 0) die("opendir", path, -ret);
+	CALL(readdir, path, l, fill, 0, &fi);
+	CALL(releasedir, path, &fi);
+}
+
+static void unlist(listing *l) {
+	for (size_t i = 0; i < l->n; i++) free(l->names[i]);
+	free(l->names);
+	l->names = NULL;
+	l->n = l->cap = 0;
+}
+
+#pragma mark Workloads
+
+// a breadth-first tree of folders, _perdir files in each, _nfiles in all
+static void build(const char *root, unsigned long *left, unsigned int depth) {
+	char path[PATH_MAX];
+	struct timespec tv[2];
+	int ret;
+
+	clock_gettime(CLOCK_REALTIME, &tv[0]);
+	tv[1] = tv[0];
+
+	for (unsigned int i = 0; i < _perdir && *left; i++, (*left)--) {
+		snprintf(path, sizeof path, "%s/file %04lu.dat", root, *left);
+		write_file(path, file_size());
+		CALL(utimens, path, tv);
+		CALL(chmod, path, 0644);
+	}
+	// split what's left among the subfolders; each hands back what it didn't use
+	for (unsigned int i = 0; i < _fanout && *left; i++) {
+		struct stat st;
+		unsigned long share = *left / (_fanout - i);
+		if (share == 0) share = 1;
+		snprintf(path, sizeof path, "%s/folder %u.%u", root, depth, i);
+		CALL(getattr, path, &st);
+		if ((ret = CALL(mkdir, path, 0755)) < 0) die("mkdir", path, -ret);
+		*left -= share;
+		build(path, &share, depth + 1);
+		*left += share;
+		CALL(utimens, path, tv);
+	}
+}
+
+static void tar(void) {
+	unsigned long left = _nfiles;
+	int ret;
+	begin("tar");
+	if ((ret = CALL(mkdir, "/tar", 0755)) < 0) die("mkdir", "/tar", -ret);
+	build("/tar", &left, 0);
+	end();
+}
+
+// what the Finder asks about each item of each window it opens
+static void browse_dir(const char *dir) {
+	char path[PATH_MAX], probe[PATH_MAX], finfo[32];
+	listing l = { 0 };
+	struct stat st;
+
+	list(dir, &l);
+	snprintf(probe, sizeof probe, "%s/.DS_Store", dir);
+	CALL(getattr, probe, &st);
+	for (size_t i = 0; i < l.n; i++) {
+		snprintf(path, sizeof path, "%s/%s", dir, l.names[i]);
+		int isdir = CALL(getattr, path, &st) == 0 && S_ISDIR(st.st_mode);
+		CALL(listxattr, path, NULL, 0);
+		CALL(getxattr, path, XATTR_FINDERINFO_NAME, finfo, sizeof finfo, 0);
+		CALL(getxattr, path, XATTR_RESOURCEFORK_NAME, NULL, 0, 0);
+		snprintf(probe, sizeof probe, "%s/._%s", dir, l.names[i]);
+		CALL(getattr, probe, &st);
+		if (isdir) browse_dir(path);
+	}
+	unlist(&l);
+}
+
+static void browse(void) {
+	begin("browse");
+	for (unsigned int i = 0; i < _rounds; i++)
+		browse_dir("/tar");
+	end();
+}
+
+static void copy_tree(const char *from, const char *to) {
+	char src[PATH_MAX], dst[PATH_MAX], finfo[32];
+	static char buf[CHUNK];
+	listing l = { 0 };
+	struct stat st;
+	int ret;
+
+	if ((ret = CALL(mkdir, to, 0755)) < 0) die("mkdir", to, -ret);
+	list(from, &l);
+	for (size_t i = 0; i < l.n; i++) {
+		snprintf(src, sizeof src, "%s/%s", from, l.names[i]);
+		snprintf(dst, sizeof dst, "%s/%s", to, l.names[i]);
+		if ((ret = CALL(getattr, src, &st)) < 0) die("getattr", src, -ret);
+		if (S_ISDIR(st.st_mode)) {
+			copy_tree(src, dst);
+			continue;
+		}
+
+		struct fuse_file_info in = { .flags = O_RDONLY }, out = { .flags = O_WRONLY | O_CREAT | O_EXCL };
+		if ((ret = CALL(open, src, &in)) < 0) die("open", src, -ret);
+		if ((ret = CALL(create, dst, st.st_mode & 07777, &out)) < 0) die("create", dst, -ret);
+		for (off_t off = 0; off < st.st_size; off += CHUNK) {
+			int got = get(src, buf, CHUNK, off, &in);
+			if (got <= 0) die("read", src, got ? -got : EIO);
+			if ((ret = put(dst, buf, got, off, &out)) < 0) die("write", dst, -ret);
+		}
+		CALL(release, src, &in);
+		CALL(release, dst, &out);
+
+		// copyfile() carries the Finder info across
+		if (CALL(getxattr, src, XATTR_FINDERINFO_NAME, finfo, sizeof finfo, 0) == sizeof finfo)
+			CALL(setxattr, dst, XATTR_FINDERINFO_NAME, finfo, sizeof finfo, 0, 0);
+		struct timespec tv[2] = { { st.st_atime, 0 }, { st.st_mtime, 0 } };
+		CALL(utimens, dst, tv);
+	}
+	unlist(&l);
+}
+
+static void cp(void) {
+	begin("cp");
+	copy_tree("/tar", "/copy");
+	end();
+}
+
+static void stream(void) {
+	struct fuse_file_info fi = { .flags = O_RDONLY };
+	static char buf[CHUNK];
+	size_t size = _streammb << 20;
+	int ret;
+
+	begin("stream");
+	write_file("/stream.bin", size);
+	if ((ret = CALL(open, "/stream.bin", &fi)) < 0) die("open", "/stream.bin", -ret);
+	for (off_t off = 0; off < (off_t)size; off += CHUNK)
+		if ((ret = get("/stream.bin", buf, CHUNK, off, &fi)) <= 0) die("read", "/stream.bin", ret ? -ret : EIO);
+	CALL(release, "/stream.bin", &fi);
+	end();
+}
+
+static void remove_tree(const char *dir) {
+	char path[PATH_MAX];
+	listing l = { 0 };
+	struct stat st;
+
+	list(dir, &l);
+	for (size_t i = 0; i < l.n; i++) {
+		snprintf(path, sizeof path, "%s/%s", dir, l.names[i]);
+		if (CALL(getattr, path, &st) == 0 && S_ISDIR(st.st_mode)) remove_tree(path);
+		else CALL(unlink, path);
+	}
+	unlist(&l);
+	CALL(rmdir, dir);
+}
+
+static void rm(void) {
+	struct stat st;
+	begin("rm");
+	if (CALL(getattr, "/tar", &st) == 0) remove_tree("/tar");
+	if (CALL(getattr, "/copy", &st) == 0) remove_tree("/copy");
+	if (CALL(getattr, "/stream.bin", &st) == 0) CALL(unlink, "/stream.bin");
+	end();
+}
+
+#pragma mark Replay
+
+// open handles by path, for trace lines that read or write
+typedef struct handle {
+	struct handle *next;
+	char *path;
+	struct fuse_file_info fi;
+} handle;
+
+static handle *_handles;
+
+static struct fuse_file_info * handle_get(const char *path, int flags) {
+	for (handle *h = _handles; h; h = h->next)
+		if (strcmp(h->path, path) == 0) return &h->fi;
+	handle *h = calloc(1, sizeof *h);
+	h->path = strdup(path);
+	h->fi.flags = flags;
+	if (CALL(open, path, &h->fi) < 0) {
+		free(h->path);
+		free(h);
+		return NULL;
+	}
+	h->next = _handles;
+	_handles = h;
+	return &h->fi;
+}
+
+// release one path's handle, or all of them
+static void handle_put(const char *path) {
+	handle **p = &_handles;
+	while (*p) {
+		handle *h = *p;
+		if (path && strcmp(h->path, path) != 0) {
+			p = &h->next;
+			continue;
+		}
+		CALL(release, h->path, &h->fi);
+		*p = h->next;
+		free(h->path);
+		free(h);
+	}
+}
+
+// One operation per line; paths are absolute, with no spaces:
+//   getattr P | readdir P | mkdir P | rmdir P | unlink P | create P | statfs
+//   read P OFFSET SIZE | write P OFFSET SIZE | release P | truncate P SIZE
+//   rename P Q | getxattr P NAME | listxattr P
+static void replay(const char *trace) {
+	FILE *in = strcmp(trace, "-") ? fopen(trace, "r") : stdin;
+	char line[2 * PATH_MAX], op[32], a[PATH_MAX], b[PATH_MAX];
+	static char buf[CHUNK];
+	unsigned long lineno = 0;
+
+	if (in == NULL) die("open", trace, errno);
+	begin("replay");
+	while (fgets(line, sizeof line, in)) {
+		struct stat st;
+		struct statvfs sv;
+		long long x = 0, y = 0;
+		int n = sscanf(line, "%31s %4095s %4095s", op, a, b);
+		lineno++;
+		if (n < 1 || op[0] == '#') continue;
+		if (n >= 3) {
+			x = strtoll(b, NULL, 0);
+			sscanf(line, "%*s %*s %*s %lld", &y);
+		}
+
+		if (strcmp(op, "getattr") == 0) CALL(getattr, a, &st);
+		else if (strcmp(op, "readdir") == 0) {
+			listing l = { 0 };
+			list(a, &l);
+			unlist(&l);
+		}
+		else if (strcmp(op, "mkdir") == 0) CALL(mkdir, a, 0755);
+		else if (strcmp(op, "rmdir") == 0) CALL(rmdir, a);
+		else if (strcmp(op, "unlink") == 0) CALL(unlink, a);
+		else if (strcmp(op, "statfs") == 0) CALL(statfs, "/", &sv);
+		else if (strcmp(op, "create") == 0) {
+			handle_put(a);
+			handle *h = calloc(1, sizeof *h);
+			h->path = strdup(a);
+			h->fi.flags = O_RDWR | O_CREAT;
+			if (CALL(create, a, 0644, &h->fi) < 0) {
+				free(h->path);
+				free(h);
+			} else {
+				h->next = _handles;
+				_handles = h;
+			}
+		}
+		else if (strcmp(op, "read") == 0 || strcmp(op, "write") == 0) {
+			struct fuse_file_info *fi = handle_get(a, op[0] == 'r' ? O_RDONLY : O_RDWR);
+			if (fi == NULL) continue;
+			for (long long done = 0; done < y; done += CHUNK) {
+				size_t len = y - done < CHUNK ? y - done : CHUNK;
+				if (op[0] == 'r') get(a, buf, len, x + done, fi);
+				else put(a, _data, len, x + done, fi);
+			}
+		}
+		else if (strcmp(op, "release") == 0) handle_put(a);
+		else if (strcmp(op, "truncate") == 0) CALL(truncate, a, x);
+		else if (strcmp(op, "rename") == 0) CALL(rename, a, b);
+		else if (strcmp(op, "getxattr") == 0) CALL(getxattr, a, b, buf, sizeof buf, 0);
+		else if (strcmp(op, "listxattr") == 0) CALL(listxattr, a, buf, sizeof buf);
+		else fprintf(stderr, "fusebench: %s:%lu: unknown operation %s\n", trace, lineno, op);
+	}
+	while (_handles) handle_put(NULL);
+	if (in != stdin) fclose(in);
+	end();
+}
+
+#pragma mark main
+
+static void usage(void) {
+	fprintf(stderr, "usage: fusebench [-u] [-k] [-s image-MB] [-n files] [-f fanout] [-p files-per-folder]\n"
+			"                 [-z stream-MB] [-r browse-rounds] [-L loglevel] [-R reject-patterns]\n"
+			"                 [-w tar,browse,cp,stream,rm] [-t trace] image\n"
+			"  -u  use the image as it is rather than formatting it; -k keep it afterwards\n");
+	exit(1);
+}
+
+int main(int argc, char *argv[]) {
+	const char *workloads = "tar,browse,cp,stream,rm", *trace = NULL;
+	unsigned long imagemb = 256;
+	int opt, reuse = 0, keep = 0, chosen = 0;
+
+	while ((opt = getopt(argc, argv, "uks:n:f:p:z:r:L:R:w:t:")) != -1) {
+		switch (opt) {
+			case 'u': reuse = keep = 1; break;
+			case 'k': keep = 1; break;
+			case 's': imagemb = strtoul(optarg, NULL, 0); break;
+			case 'n': _nfiles = strtoul(optarg, NULL, 0); break;
+			case 'f': _fanout = strtoul(optarg, NULL, 0); break;
+			case 'p': _perdir = strtoul(optarg, NULL, 0); break;
+			case 'z': _streammb = strtoul(optarg, NULL, 0); break;
+			case 'r': _rounds = strtoul(optarg, NULL, 0); break;
+			case 'L':
+				if (log_parse_level(optarg) == -1) usage();
+				log_set_level(log_parse_level(optarg));
+				break;
+			case 'R': _options.reject = optarg; break;
+			case 'w': workloads = optarg; chosen = 1; break;
+			case 't': trace = optarg; break;
+			default: usage();
+		}
+	}
+	if (argc - optind != 1 || _fanout == 0 || _perdir == 0) usage();
+	_options.path = argv[optind];
+
+	if (!reuse) {
+		int fd = open(_options.path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (fd == -1 || ftruncate(fd, (off_t)imagemb << 20) == -1) die("create", _options.path, errno);
+		close(fd);
+		if (hfs_format(_options.path, 0, 0, "Bench", 0, NULL) == -1) die("hfs_format", _options.path, errno);
+	}
+
+	_context.uid = getuid();
+	_context.gid = getgid();
+	_context.private_data = &_options;
+	memset(_data, 0x5a, sizeof _data);
+
+	struct fuse_conn_info conn = { .max_write = CHUNK, .max_readahead = CHUNK };
+	fusehfs_conn(&conn);
+	fusehfs_mount(&_options);
+
+	printf("# fusebench: image %s%s, %lu files (fanout %u, %u per folder), stream %luM, "
+		   "%u browse rounds, log level %s\n", _options.path, reuse ? "" : " (formatted)",
+		   _nfiles, _fanout, _perdir, _streammb, _rounds, log_level_name(log_level));
+	printf("# workload\top\tcalls\terrors\tseconds\tops_per_sec\tp50_us\tp90_us\tp99_us\tp999_us\tmax_us\n");
+
+	// a trace replaces the built-in workloads unless -w asks for them too
+	char *list = strdup(trace && !chosen ? "" : workloads), *save = NULL;
+	for (char *w = strtok_r(list, ",", &save); w; w = strtok_r(NULL, ",", &save)) {
+		if (strcmp(w, "tar") == 0) tar();
+		else if (strcmp(w, "browse") == 0) browse();
+		else if (strcmp(w, "cp") == 0) cp();
+		else if (strcmp(w, "stream") == 0) stream();
+		else if (strcmp(w, "rm") == 0) rm();
+		else fprintf(stderr, "fusebench: unknown workload %s\n", w);
+	}
+	free(list);
+	if (trace) replay(trace);
+
+	fusehfs_unmount();
+	if (!keep) unlink(_options.path);
+	return 0;
+}
@@ -26,100 +26,242 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stddef.h>
+#include <stdint.h>
+#include <limits.h>
 #include <sys/stat.h>
 #include <libhfs/hfs.h>
 #include <libhfs/apple.h>
 #include <iconv.h>
 #include <unistd.h>
 #include <assert.h>
+#include <pthread.h>
+#include <time.h>
+#include <fnmatch.h>
+#include <fcntl.h>
 #include <libkern/OSByteOrder.h>
 #include <sys/xattr.h>
 
 #include "fusefs_hfs.h"
 #include "log.h"
+#include "stats.h"
 
 #define FILENAME "[fusefs_hfs.c]\t"
 
-#ifdef DEBUG
-#define dprintf(args...) fprintf(stderr, args)
-#else
-#define dprintf(fmt, args...)
-#endif
+// compiled in always; log_level (--loglevel, or "loglevel" in /.fusehfs/ctl) decides
+#define dprintf(args...) log_debug(args)
 
 // globals
 iconv_t iconv_to_utf8, iconv_to_mac;
 char _volname[HFS_MAX_VLEN+1];
 int _readonly;
+// hfs_open() hands every opener of a file the same hfsfile, so the fork and seek
+// pointer it carries are shared; hold this from hfs_setfork() to the call using it.
+// Reads and writes go through hfs_pread()/hfs_pwrite() and don't need it.
+pthread_mutex_t _fork_lock = PTHREAD_MUTEX_INITIALIZER;
+// an iconv descriptor converts one string at a time
+static pthread_mutex_t _iconv_lock = PTHREAD_MUTEX_INITIALIZER;
 
 #pragma mark Character set conversion
-char * hfs_to_utf8 (const char * in, char * out, size_t outlen) {
+
+// Single-byte encodings (MacRoman, MacCyrillic, ...) are converted through
+// tables built from iconv at mount time, so path translation is one pass with
+// no allocation. Multibyte encodings, and strings the tables can't represent,
+// go through iconv. Both paths swap '/' and ':'.
+static int _bytetables;
+static char _byte_to_utf8[256][4];
+static unsigned char _byte_to_utf8_len[256];    // 0: not convertible by table
+static short _ascii_to_byte[128];               // -1: not convertible by table
+static struct ucs_byte {
+    uint32_t ucs;
+    unsigned char byte;
+} _ucs_to_byte[256];
+static int _ucs_to_byte_count;
+
+static inline unsigned char swap_separator(unsigned char c) {
+    if (c == ':') return '/';
+    if (c == '/') return ':';
+    return c;
+}
+
+static int utf8_decode(const char **in, uint32_t *ucs) {
+    const unsigned char *s = (const unsigned char *)*in;
+    uint32_t c = *s++;
+    int n;
+    if (c < 0x80) n = 0;
+    else if ((c & 0xE0) == 0xC0) { c &= 0x1F; n = 1; }
+    else if ((c & 0xF0) == 0xE0) { c &= 0x0F; n = 2; }
+    else if ((c & 0xF8) == 0xF0) { c &= 0x07; n = 3; }
+    else return -1;
+    while (n--) {
+        if ((*s & 0xC0) != 0x80) return -1;
+        c = (c << 6) | (*s++ & 0x3F);
+    }
+    *in = (const char *)s;
+    *ucs = c;
+    return 0;
+}
+
+static int ucs_byte_cmp(const void *a, const void *b) {
+    uint32_t x = ((const struct ucs_byte *)a)->ucs, y = ((const struct ucs_byte *)b)->ucs;
+    return (x > y) - (x < y);
+}
+
+static void init_byte_tables(void) {
+    int i, j;
+    _bytetables = 0;
+    _ucs_to_byte_count = 0;
+    memset(_byte_to_utf8_len, 0, sizeof _byte_to_utf8_len);
+    for (i = 0; i < 128; i++) _ascii_to_byte[i] = -1;
+
+    for (i = 1; i < 256; i++) {
+        char in = i, *inp = &in, *outp = _byte_to_utf8[i];
+        size_t inleft = 1, outleft = sizeof _byte_to_utf8[i];
+        size_t r = iconv(iconv_to_utf8, &inp, &inleft, &outp, &outleft);
+        int err = errno;
+        iconv(iconv_to_utf8, NULL, NULL, NULL, NULL);
+        if (r == (size_t)-1) {
+            if (err == EINVAL) return; // lead byte, this is a multibyte encoding
+            continue; // unassigned byte, left to iconv
+        }
+
+        // only bytes that become exactly one character go in the tables
+        const char *p = _byte_to_utf8[i];
+        uint32_t ucs;
+        if (outp == p || utf8_decode(&p, &ucs) || p != outp) continue;
+
+        // map the character back the way iconv would, which may not be byte i
+        char back, *backp = &back;
+        inp = _byte_to_utf8[i];
+        inleft = outp - inp;
+        outleft = 1;
+        r = iconv(iconv_to_mac, &inp, &inleft, &backp, &outleft);
+        iconv(iconv_to_mac, NULL, NULL, NULL, NULL);
+        if (r == (size_t)-1 || inleft || outleft) continue;
+
+        _byte_to_utf8_len[i] = outp - _byte_to_utf8[i];
+        for (j = 0; j < _byte_to_utf8_len[i]; j++)
+            _byte_to_utf8[i][j] = swap_separator(_byte_to_utf8[i][j]);
+        _ucs_to_byte[_ucs_to_byte_count].ucs = ucs;
+        _ucs_to_byte[_ucs_to_byte_count].byte = swap_separator(back);
+        _ucs_to_byte_count++;
+    }
+
+    // sort for lookup, dropping characters reached from more than one byte
+    qsort(_ucs_to_byte, _ucs_to_byte_count, sizeof _ucs_to_byte[0], ucs_byte_cmp);
+    for (i = j = 0; i < _ucs_to_byte_count; i++) {
+        if (j && _ucs_to_byte[j-1].ucs == _ucs_to_byte[i].ucs) continue;
+        _ucs_to_byte[j++] = _ucs_to_byte[i];
+    }
+    _ucs_to_byte_count = j;
+    for (i = 0; i < _ucs_to_byte_count && _ucs_to_byte[i].ucs < 128; i++)
+        _ascii_to_byte[_ucs_to_byte[i].ucs] = _ucs_to_byte[i].byte;
+
+    _bytetables = 1;
+}
+
+// these return the output length, or (size_t)-1 with errno set like iconv
+static size_t table_to_utf8(const char *in, char *out, size_t outlen) {
+    const unsigned char *s;
+    size_t n = 0;
+    for (s = (const unsigned char *)in; *s; s++) {
+        size_t len = _byte_to_utf8_len[*s];
+        if (len == 0) {
+            errno = EILSEQ;
+            return (size_t)-1;
+        }
+        if (n + len >= outlen) {
+            errno = E2BIG;
+            return (size_t)-1;
+        }
+        memcpy(out + n, _byte_to_utf8[*s], len);
+        n += len;
+    }
+    out[n] = '\0';
+    return n;
+}
+
+static size_t table_to_mac(const char *in, char *out, size_t outlen) {
+    size_t n = 0;
+    while (*in) {
+        uint32_t ucs;
+        int byte = -1;
+        if ((unsigned char)*in < 0x80) {
+            byte = _ascii_to_byte[(unsigned char)*in++];
+        } else if (utf8_decode(&in, &ucs) == 0) {
+            struct ucs_byte key = { ucs, 0 };
+            struct ucs_byte *hit = bsearch(&key, _ucs_to_byte, _ucs_to_byte_count, sizeof key, ucs_byte_cmp);
+            if (hit) byte = hit->byte;
+        }
+        if (byte == -1) {
+            errno = EILSEQ; // e.g. decomposed accents, which iconv composes
+            return (size_t)-1;
+        }
+        if (n + 1 >= outlen) {
+            errno = E2BIG;
+            return (size_t)-1;
+        }
+        out[n++] = byte;
+    }
+    out[n] = '\0';
+    return n;
+}
+
+static size_t iconv_string(iconv_t cd, const char *in, char *out, size_t outlen) {
     size_t len = strlen(in);
-    size_t outleft;
+    size_t outleft = outlen-1;
     char * outp = out;
-    if (out == NULL) {
-        outlen = (len*4)+1; // *3 is ok for MacRoman, what about Shift-JIS and others?
-        out = malloc(outlen);
-    }
-    outleft = outlen-1;
-    iconv(iconv_to_utf8, (char **restrict)&in, &len, &outp, &outleft);
-    iconv(iconv_to_utf8, NULL, NULL, NULL, NULL);
-    out[outlen-outleft-1] = '\0';
-    
+    pthread_mutex_lock(&_iconv_lock);
+    size_t r = iconv(cd, (char **restrict)&in, &len, &outp, &outleft);
+    int err = errno;
+    iconv(cd, NULL, NULL, NULL, NULL);
+    pthread_mutex_unlock(&_iconv_lock);
+    *outp = '\0';
+
     // swap / and :
     for(outp=out;*outp;outp++) {
         if (*outp == ':') *outp = '/';
         else if (*outp == '/') *outp = ':';
     }
-    
+
+    errno = err;
+    return (r == (size_t)-1) ? r : (size_t)(outp - out);
+}
+
+char * hfs_to_utf8 (const char * in, char * out, size_t outlen) {
+    if (out == NULL) {
+        outlen = (strlen(in)*4)+1; // *3 is ok for MacRoman, what about Shift-JIS and others?
+        out = malloc(outlen);
+        if (out == NULL) return NULL;
+    }
+    if (_bytetables && table_to_utf8(in, out, outlen) != (size_t)-1) return out;
+    iconv_string(iconv_to_utf8, in, out, outlen);
     return out;
 }
 
-char * utf8_to_hfs (const char * in) {
-    size_t len, outlen, outleft;
-    len = outleft = strlen(in);
-    outlen = len+1;
-    char * out = malloc(outlen);
-    char * outp = out;
-    iconv(iconv_to_mac, (char **restrict)&in, &len, &outp, &outleft);
-    iconv(iconv_to_mac, NULL, NULL, NULL, NULL);
-    out[outlen-outleft-1] = '\0';
-    
-    // swap / and :
-    for(outp=out;*outp;outp++) {
-        if (*outp == ':') *outp = '/';
-        else if (*outp == '/') *outp = ':';
+// returns NULL if the result doesn't fit in outlen bytes
+char * utf8_to_hfs (const char * in, char * out, size_t outlen) {
+    if (_bytetables) {
+        if (table_to_mac(in, out, outlen) != (size_t)-1) return out;
+        if (errno == E2BIG) return NULL;
     }
-    
+    if (iconv_string(iconv_to_mac, in, out, outlen) == (size_t)-1 && errno == E2BIG) return NULL;
     return out;
 }
 
-char * mkhfspath(const char *in) {
+char * mkhfspath(const char *in, char *out, size_t outlen) {
 	assert(in[0] == '/');
-	size_t len, vollen,outlen, outleft;
-    len = outleft = strlen(in);
-	vollen = strlen(_volname);
-    outlen = vollen+len+1;
-    char * out = malloc(outlen);
-    char * outp = out + vollen;
+	size_t vollen = strlen(_volname);
+	if (vollen >= outlen) return NULL;
 	// prepend volume name
-	strcpy(out, _volname);
+	memcpy(out, _volname, vollen);
 	// convert path
-    iconv(iconv_to_mac, (char **restrict)&in, &len, &outp, &outleft);
-    iconv(iconv_to_mac, NULL, NULL, NULL, NULL);
-    out[outlen-outleft-1] = '\0';
-    
-    // swap / and :
-    for(outp=out+vollen;*outp;outp++) {
-        if (*outp == ':') *outp = '/';
-        else if (*outp == '/') *outp = ':';
-    }
-    
-    return out;
+	if (utf8_to_hfs(in, out+vollen, outlen-vollen) == NULL) return NULL;
+	return out;
 }
 
 #pragma mark Misc
 
-static int dirent_to_stbuf(const hfsdirent *ent, struct stat *stbuf) {
+int dirent_to_stbuf(const hfsdirent *ent, struct stat *stbuf) {
 	if (ent == NULL || stbuf == NULL) return -1;
 	memset(stbuf, 0, sizeof(struct stat));
 	stbuf->st_ino = ent->cnid;
@@ -141,37 +283,656 @@ static int dirent_to_stbuf(const hfsdirent *ent, struct stat *stbuf) {
 	return 0;
 }
 
+// pack the 32-byte com.apple.FinderInfo attribute
+void finderinfo_get(const hfsdirent *ent, char *value) {
+	if (ent->flags & HFS_ISDIR) {
+		// directory info
+		OSWriteBigInt16(value, 0, ent->u.dir.rect.top);
+		OSWriteBigInt16(value, 2, ent->u.dir.rect.left);
+		OSWriteBigInt16(value, 4, ent->u.dir.rect.bottom);
+		OSWriteBigInt16(value, 6, ent->u.dir.rect.right);
+		OSWriteBigInt16(value, 8, ent->fdflags);
+		OSWriteBigInt16(value, 10, ent->fdlocation.v);
+		OSWriteBigInt16(value, 12, ent->fdlocation.h);
+		OSWriteBigInt16(value, 14, ent->u.dir.view);
+		// DXInfo
+		OSWriteBigInt16(value, 16, ((DXInfo*)(ent->u.dir.xinfo))->frScroll.v);
+		OSWriteBigInt16(value, 18, ((DXInfo*)(ent->u.dir.xinfo))->frScroll.h);
+		OSWriteBigInt32(value, 20, ((DXInfo*)(ent->u.dir.xinfo))->frOpenChain);
+		OSWriteBigInt16(value, 24, ((DXInfo*)(ent->u.dir.xinfo))->frUnused);
+		OSWriteBigInt16(value, 26, ((DXInfo*)(ent->u.dir.xinfo))->frComment);
+		OSWriteBigInt32(value, 28, ((DXInfo*)(ent->u.dir.xinfo))->frPutAway);		
+	} else {
+		// file info
+		memcpy(value, ent->u.file.type, 4);
+		memcpy(value+4, ent->u.file.creator, 4);
+		OSWriteBigInt16(value, 8, ent->fdflags);
+		OSWriteBigInt16(value, 10, ent->fdlocation.v);
+		OSWriteBigInt16(value, 12, ent->fdlocation.h);
+		OSWriteBigInt16(value, 14, ent->u.file.window);
+		// FXInfo
+		OSWriteBigInt16(value, 16, ((FXInfo*)(ent->u.file.xinfo))->fdIconID);
+		OSWriteBigInt16(value, 18, ((FXInfo*)(ent->u.file.xinfo))->fdUnused[0]);
+		OSWriteBigInt16(value, 20, ((FXInfo*)(ent->u.file.xinfo))->fdUnused[1]);
+		OSWriteBigInt16(value, 22, ((FXInfo*)(ent->u.file.xinfo))->fdUnused[2]);
+		OSWriteBigInt16(value, 24, ((FXInfo*)(ent->u.file.xinfo))->fdUnused[3]);
+		OSWriteBigInt16(value, 26, ((FXInfo*)(ent->u.file.xinfo))->fdComment);
+		OSWriteBigInt32(value, 28, ((FXInfo*)(ent->u.file.xinfo))->fdPutAway);
+	}
+}
+
+// unpack the 32-byte com.apple.FinderInfo attribute
+void finderinfo_set(hfsdirent *ent, const char *value) {
+	if (ent->flags & HFS_ISDIR) {
+		// directory
+		ent->u.dir.rect.top =		OSReadBigInt16(value, 0);
+		ent->u.dir.rect.left =		OSReadBigInt16(value, 2);
+		ent->u.dir.rect.bottom =		OSReadBigInt16(value, 4);
+		ent->u.dir.rect.right =		OSReadBigInt16(value, 6);
+		ent->fdflags =				OSReadBigInt16(value, 8);
+		ent->fdlocation.v =			OSReadBigInt16(value, 10);
+		ent->fdlocation.h =			OSReadBigInt16(value, 12);
+		ent->u.dir.view =			OSReadBigInt16(value, 14);
+		// DXInfo
+		((DXInfo*)(ent->u.dir.xinfo))->frScroll.v   = OSReadBigInt16(value, 16);
+		((DXInfo*)(ent->u.dir.xinfo))->frScroll.h   = OSReadBigInt16(value, 18);
+		((DXInfo*)(ent->u.dir.xinfo))->frOpenChain  = OSReadBigInt32(value, 20);
+		((DXInfo*)(ent->u.dir.xinfo))->frUnused     = OSReadBigInt16(value, 24);
+		((DXInfo*)(ent->u.dir.xinfo))->frComment    = OSReadBigInt16(value, 26);
+		((DXInfo*)(ent->u.dir.xinfo))->frPutAway    = OSReadBigInt32(value, 28);
+	} else {
+		// regular file
+		memcpy(ent->u.file.type, value, 4);
+		memcpy(ent->u.file.creator, value+4, 4);
+		ent->u.file.type[4] = ent->u.file.creator[4] = '\0';
+		ent->fdflags       = OSReadBigInt16(value, 8);
+		ent->fdlocation.v  = OSReadBigInt16(value, 10);
+		ent->fdlocation.h  = OSReadBigInt16(value, 12);
+		ent->u.file.window = OSReadBigInt16(value, 14);
+		// FXInfo
+		((FXInfo*)(ent->u.file.xinfo))->fdIconID    = OSReadBigInt16(value, 16);
+		((FXInfo*)(ent->u.file.xinfo))->fdUnused[0] = OSReadBigInt16(value, 18);
+		((FXInfo*)(ent->u.file.xinfo))->fdUnused[1] = OSReadBigInt16(value, 20);
+		((FXInfo*)(ent->u.file.xinfo))->fdUnused[2] = OSReadBigInt16(value, 22);
+		((FXInfo*)(ent->u.file.xinfo))->fdUnused[3] = OSReadBigInt16(value, 24);
+		((FXInfo*)(ent->u.file.xinfo))->fdComment   = OSReadBigInt16(value, 26);
+		((FXInfo*)(ent->u.file.xinfo))->fdPutAway   = OSReadBigInt32(value, 28);
+	}
+}
+
+// bless the parent folder if this is a system file
+void bless_system_folder(const hfsdirent *ent) {
+	if (ent->flags & HFS_ISDIR) return;
+	if ((strcmp(ent->u.file.type, "zsys") == 0) && (strcmp(ent->u.file.creator, "MACS") == 0) && (strcmp(ent->name, "System") == 0)) {
+		// bless
+		dprintf("blessing folder %lu\n", ent->parid);
+		hfsvolent volent;
+		hfs_vstat(NULL, &volent);
+		volent.blessed = ent->parid;
+		hfs_vsetattr(NULL, &volent);
+	}
+}
+
+#pragma mark Probe names
+
+// Names macOS looks for on every volume (AppleDouble files, Spotlight and
+// Trash folders) that a classic HFS volume never has. With --reject they are
+// answered here, before any name conversion or catalog search: lookups find
+// nothing and creating them is refused.
+static char **_reject;          // fnmatch() patterns for one path component
+static int _nreject;
+static int _reject_dotted;      // every pattern starts with a dot
+static unsigned long _rejects;  // names turned away so far
+
+// set up the table from a comma-separated pattern list
+void reject_init(const char *patterns) {
+	if (patterns == NULL || *patterns == '\0') return;
+	char *list = strdup(patterns), *save = NULL;
+	_reject_dotted = 1;
+	for (char *pat = strtok_r(list, ",", &save); pat; pat = strtok_r(NULL, ",", &save)) {
+		char **grown = realloc(_reject, (_nreject + 1) * sizeof *_reject);
+		if (grown == NULL) break;
+		_reject = grown;
+		_reject[_nreject++] = pat;
+		if (pat[0] != '.') _reject_dotted = 0;
+	}
+}
+
+// true if the last component of a path (or a bare name) is in the table
+int rejected(const char *path) {
+	if (_nreject == 0) return 0;
+	const char *name = strrchr(path, '/');
+	name = name ? name + 1 : path;
+	if (_reject_dotted && name[0] != '.') return 0;
+	for (int i = 0; i < _nreject; i++) {
+		if (fnmatch(_reject[i], name, 0) == 0) {
+			__sync_fetch_and_add(&_rejects, 1);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+#pragma mark Attribute cache
+
+// Catalog entries by CNID, shared by getattr, listxattr and getxattr so that
+// Finder's run of calls on one file resolves its path once. They are found by
+// the FUSE path they were last looked up by. Both tables are direct-mapped, so
+// a collision just replaces. Callbacks that change the volume forget what they
+// touched; attr_forget_all() empties both tables by starting a new generation.
+#define ATTR_CACHE_SIZE 1024
+
+static struct {
+	unsigned long gen;
+	hfsdirent ent;
+} _attr_by_cnid[ATTR_CACHE_SIZE];
+
+static struct {
+	unsigned long gen;
+	unsigned long cnid;
+	char *path;
+} _attr_by_path[ATTR_CACHE_SIZE];
+
+static unsigned long _attr_gen = 1;     // slots from older generations are empty
+static unsigned long _attr_seq;         // counts forgets, see attr_put()
+static pthread_mutex_t _attr_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static unsigned int path_hash(const char *path) {
+	unsigned int h = 2166136261u;
+	while (*path) h = (h ^ (unsigned char)*path++) * 16777619u;
+	return h & (ATTR_CACHE_SIZE-1);
+}
+
+#define CNID_SLOT(cnid) (&_attr_by_cnid[(cnid) & (ATTR_CACHE_SIZE-1)])
+#define PATH_SLOT(path) (&_attr_by_path[path_hash(path)])
+
+static int attr_get(const char *path, hfsdirent *ent) {
+	int found = 0;
+	pthread_mutex_lock(&_attr_lock);
+	if (PATH_SLOT(path)->gen == _attr_gen && strcmp(PATH_SLOT(path)->path, path) == 0) {
+		unsigned long cnid = PATH_SLOT(path)->cnid;
+		if (CNID_SLOT(cnid)->gen == _attr_gen && CNID_SLOT(cnid)->ent.cnid == cnid) {
+			*ent = CNID_SLOT(cnid)->ent;
+			found = 1;
+		}
+	}
+	pthread_mutex_unlock(&_attr_lock);
+	return found ? 0 : -1;
+}
+
+static unsigned long attr_seq(void) {
+	pthread_mutex_lock(&_attr_lock);
+	unsigned long seq = _attr_seq;
+	pthread_mutex_unlock(&_attr_lock);
+	return seq;
+}
+
+// remember an entry read from the catalog, unless something was forgotten since
+// attr_seq() was taken before reading it
+static void attr_put(const char *path, const hfsdirent *ent, unsigned long seq) {
+	pthread_mutex_lock(&_attr_lock);
+	if (seq == _attr_seq) {
+		CNID_SLOT(ent->cnid)->gen = _attr_gen;
+		CNID_SLOT(ent->cnid)->ent = *ent;
+		char **slotpath = &PATH_SLOT(path)->path;
+		if (*slotpath == NULL || strcmp(*slotpath, path) != 0) {
+			free(*slotpath);
+			*slotpath = strdup(path);
+		}
+		if (*slotpath) {
+			PATH_SLOT(path)->gen = _attr_gen;
+			PATH_SLOT(path)->cnid = ent->cnid;
+		}
+	}
+	pthread_mutex_unlock(&_attr_lock);
+}
+
+// refresh a cached entry from an open file, which is always current
+static void attr_update(hfsfile *file) {
+	hfsdirent ent;
+	if (hfs_fstat(file, &ent) == -1) return;
+	pthread_mutex_lock(&_attr_lock);
+	if (CNID_SLOT(ent.cnid)->gen == _attr_gen && CNID_SLOT(ent.cnid)->ent.cnid == ent.cnid)
+		CNID_SLOT(ent.cnid)->ent = ent;
+	pthread_mutex_unlock(&_attr_lock);
+}
+
+static void attr_forget_all(void) {
+	pthread_mutex_lock(&_attr_lock);
+	_attr_seq++;
+	_attr_gen++;
+	pthread_mutex_unlock(&_attr_lock);
+}
+
+// Forget the entry at path. If it wasn't cached under this spelling, it may be
+// under another (names are case-insensitive), so everything goes.
+static void attr_forget(const char *path) {
+	pthread_mutex_lock(&_attr_lock);
+	_attr_seq++;
+	if (PATH_SLOT(path)->gen == _attr_gen && strcmp(PATH_SLOT(path)->path, path) == 0) {
+		CNID_SLOT(PATH_SLOT(path)->cnid)->gen = 0;
+		PATH_SLOT(path)->gen = 0;
+	} else {
+		_attr_gen++;
+	}
+	pthread_mutex_unlock(&_attr_lock);
+}
+
+// forget the directory containing path, whose valence and dates have changed
+static void attr_forget_parent(const char *path) {
+	char parent[PATH_MAX];
+	const char *slash = strrchr(path, '/');
+	size_t len = slash && slash != path ? slash - path : 1;
+	if (len >= sizeof parent) {
+		attr_forget_all();
+		return;
+	}
+	memcpy(parent, path, len);
+	parent[len] = '\0';
+	attr_forget(parent);
+}
+
+// find the entry at a FUSE path, through the attribute cache
+static int stat_path(const char *path, hfsdirent *ent) {
+	char hfspath[HFSPATH_MAX];
+	if (rejected(path)) {
+		errno = ENOENT;
+		return -1;
+	}
+	if (attr_get(path, ent) == 0) return 0;
+	unsigned long seq = attr_seq();
+	if (mkhfspath(path, hfspath, sizeof hfspath) == NULL) {
+		errno = ENOENT;
+		return -1;
+	}
+	if (hfs_stat(NULL, hfspath, ent) == -1) return -1;
+	attr_put(path, ent, seq);
+	return 0;
+}
+
+#pragma mark Resource fork handles
+
+// Open files whose resource fork is being read or written as the
+// com.apple.ResourceFork attribute. macOS moves a large fork in positional
+// chunks, one xattr call each, so the handle is kept (by CNID) between calls
+// instead of being looked up, opened and closed for every chunk. Shared by
+// both frontends. Handles are taken with rsrc_get() or rsrc_keep() and given
+// back with rsrc_put(); the least recently used idle handle is closed when a
+// new one needs its slot.
+#define RSRC_CACHE_SIZE 8
+
+static struct {
+	unsigned long cnid;     // 0 once forgotten, closed when the last user is done
+	hfsfile *file;
+	int users;
+	unsigned long used;
+} _rsrc[RSRC_CACHE_SIZE];
+
+static unsigned long _rsrc_clock;
+static pthread_mutex_t _rsrc_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// the cached handle for a file, or NULL
+hfsfile * rsrc_get(unsigned long cnid) {
+	hfsfile *file = NULL;
+	pthread_mutex_lock(&_rsrc_lock);
+	for (int i = 0; i < RSRC_CACHE_SIZE; i++) {
+		if (_rsrc[i].file && _rsrc[i].cnid == cnid) {
+			_rsrc[i].users++;
+			_rsrc[i].used = ++_rsrc_clock;
+			file = _rsrc[i].file;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&_rsrc_lock);
+	return file;
+}
+
+// cache a handle just opened after rsrc_get() missed; passes NULL through
+hfsfile * rsrc_keep(unsigned long cnid, hfsfile *file) {
+	if (file == NULL) return NULL;
+	hfsfile *drop = NULL;
+	int slot = -1, found = 0;
+	pthread_mutex_lock(&_rsrc_lock);
+	for (int i = 0; i < RSRC_CACHE_SIZE && !found; i++) {
+		if (_rsrc[i].file && _rsrc[i].cnid == cnid) {
+			// another thread got here first; hfs_open() gave us the same handle
+			_rsrc[i].users++;
+			_rsrc[i].used = ++_rsrc_clock;
+			drop = file;
+			found = 1;
+		} else if (_rsrc[i].file == NULL) {
+			if (slot == -1 || _rsrc[slot].file) slot = i;
+		} else if (_rsrc[i].users == 0) {
+			if (slot == -1 || (_rsrc[slot].file && _rsrc[i].used < _rsrc[slot].used)) slot = i;
+		}
+	}
+	if (!found && slot != -1) {
+		drop = _rsrc[slot].file;
+		_rsrc[slot].cnid = cnid;
+		_rsrc[slot].file = file;
+		_rsrc[slot].users = 1;
+		_rsrc[slot].used = ++_rsrc_clock;
+	}
+	pthread_mutex_unlock(&_rsrc_lock);
+	// when every slot is busy the handle goes uncached, and rsrc_put() closes it
+	if (drop) hfs_close(drop);
+	return file;
+}
+
+void rsrc_put(hfsfile *file) {
+	int cached = 0, last = 0;
+	pthread_mutex_lock(&_rsrc_lock);
+	for (int i = 0; i < RSRC_CACHE_SIZE; i++) {
+		if (_rsrc[i].file == file && _rsrc[i].users) {
+			cached = 1;
+			_rsrc[i].users--;
+			if (_rsrc[i].cnid == 0 && _rsrc[i].users == 0) {
+				_rsrc[i].file = NULL;
+				last = 1;
+			}
+			break;
+		}
+	}
+	pthread_mutex_unlock(&_rsrc_lock);
+	if (!cached || last) hfs_close(file);
+}
+
+// Close every handle, before a file is deleted or renamed (a handle writes its
+// catalog record back by parent and name) and at unmount. Handles in use are
+// closed by their last rsrc_put().
+void rsrc_forget_all(void) {
+	hfsfile *drop[RSRC_CACHE_SIZE];
+	int n = 0;
+	pthread_mutex_lock(&_rsrc_lock);
+	for (int i = 0; i < RSRC_CACHE_SIZE; i++) {
+		if (_rsrc[i].file == NULL) continue;
+		_rsrc[i].cnid = 0;
+		if (_rsrc[i].users == 0) {
+			drop[n++] = _rsrc[i].file;
+			_rsrc[i].file = NULL;
+		}
+	}
+	pthread_mutex_unlock(&_rsrc_lock);
+	while (n) hfs_close(drop[--n]);
+}
+
+// cut a resource fork to length; a setxattr at position 0 rewrites the whole fork
+int rsrc_truncate(hfsfile *file, unsigned long length) {
+	pthread_mutex_lock(&_fork_lock);
+	hfs_setfork(file, 1);
+	int err = hfs_truncate(file, length) == -1 ? errno : 0;
+	hfs_setfork(file, 0);
+	pthread_mutex_unlock(&_fork_lock);
+	errno = err;
+	return err ? -1 : 0;
+}
+
+#pragma mark Write-back
+
+// libhfs keeps attribute changes (Finder info, dates) in memory until the
+// volume is flushed or the file closed, so that a burst of metadata calls on
+// one file writes its catalog record once. This thread flushes every
+// FLUSH_INTERVAL seconds so that they don't stay there indefinitely.
+#define FLUSH_INTERVAL 5
+
+static pthread_t _flusher;
+static int _flusher_running;
+static pthread_mutex_t _flusher_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t _flusher_stop = PTHREAD_COND_INITIALIZER;
+
+static void * flusher(void *arg) {
+	pthread_mutex_lock(&_flusher_lock);
+	while (_flusher_running) {
+		struct timespec until = { .tv_sec = time(NULL) + FLUSH_INTERVAL };
+		pthread_cond_timedwait(&_flusher_stop, &_flusher_lock, &until);
+		if (!_flusher_running) break;
+		pthread_mutex_unlock(&_flusher_lock);
+		hfs_flush(NULL);
+		pthread_mutex_lock(&_flusher_lock);
+	}
+	pthread_mutex_unlock(&_flusher_lock);
+	return NULL;
+}
+
+static void flusher_start(void) {
+	_flusher_running = 1;
+	if (pthread_create(&_flusher, NULL, flusher, NULL) != 0) {
+		perror("pthread_create");
+		_flusher_running = 0;
+	}
+}
+
+static void flusher_stop(void) {
+	pthread_mutex_lock(&_flusher_lock);
+	int running = _flusher_running;
+	_flusher_running = 0;
+	pthread_cond_signal(&_flusher_stop);
+	pthread_mutex_unlock(&_flusher_lock);
+	if (running) pthread_join(_flusher, NULL);
+}
+
+#pragma mark Control files
+
+// A hidden /.fusehfs directory, answered here and never looked up in the
+// catalog, lets a live mount be inspected and tuned:
+//
+//     cat /Volumes/X/.fusehfs/stats           call latencies, caches, allocator
+//     echo cache 1024 > /Volumes/X/.fusehfs/ctl
+//
+// ctl takes one command per line: "cache N" (block cache size in 512-byte
+// blocks), "readahead N" (blocks read past a miss), "flush", "drop", which
+// writes everything out and empties every cache, and "blocktrace NAME|off",
+// which records every block request for hfscachesim to a new file NAME in the
+// trace directory ($TMPDIR, or /tmp). Reading ctl shows the current settings. Each open takes a snapshot, so a reader sees one
+// consistent report however it splits its reads.
+static const char *_ctl_names[CTL_COUNT] = { NULL, CTL_NAME, "stats", "ctl" };
+
+typedef struct {
+	size_t len;
+	char text[];
+} ctlfile;
+
+// where the block trace is going, if anywhere
+static char *_blocktrace;
+static pthread_mutex_t _blocktrace_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// A trace file is only ever created new, and only in the trace directory, so
+// a ctl command can't get the daemon to overwrite a file or follow a link.
+static FILE * blocktrace_open(const char *name, char **path) {
+	const char *dir = getenv("TMPDIR");
+	if (dir == NULL || *dir == '\0') dir = "/tmp";
+	if (*name == '\0' || strchr(name, '/') || strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+		errno = EINVAL;
+		return NULL;
+	}
+	if (asprintf(path, "%s%s%s", dir, dir[strlen(dir)-1] == '/' ? "" : "/", name) == -1) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	int fd = open(*path, O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW, 0600);
+	FILE *file = fd == -1 ? NULL : fdopen(fd, "wb");
+	if (file == NULL) {
+		int err = errno;
+		if (fd != -1) close(fd);
+		free(*path);
+		errno = err;
+	}
+	return file;
+}
+
+// the node for name in dir, where CTL_NONE is the volume root
+int ctl_lookup(int dir, const char *name) {
+	if (dir == CTL_NONE) return strcmp(name, CTL_NAME) == 0 ? CTL_DIR : CTL_NONE;
+	if (dir != CTL_DIR) return CTL_NONE;
+	for (int node = CTL_STATS; node < CTL_COUNT; node++)
+		if (strcmp(name, _ctl_names[node]) == 0) return node;
+	return CTL_NONE;
+}
+
+int ctl_path(const char *path) {
+	if (strncmp(path, "/" CTL_NAME, sizeof CTL_NAME) != 0) return CTL_NONE;
+	path += sizeof CTL_NAME;
+	if (*path == '\0') return CTL_DIR;
+	return *path == '/' ? ctl_lookup(CTL_DIR, path + 1) : CTL_NONE;
+}
+
+const char * ctl_name(int node) {
+	return _ctl_names[node];
+}
+
+void ctl_stbuf(int node, struct stat *stbuf) {
+	memset(stbuf, 0, sizeof(struct stat));
+	stbuf->st_ino = CTL_INO(node);
+	stbuf->st_uid = getuid();
+	stbuf->st_gid = getgid();
+	stbuf->st_atime = stbuf->st_mtime = stbuf->st_ctime = time(NULL);
+	if (node == CTL_DIR) {
+		stbuf->st_mode = S_IFDIR | 0555;
+		stbuf->st_nlink = 2;
+	} else {
+		stbuf->st_mode = S_IFREG | (node == CTL_CTL ? 0600 : 0444);
+		stbuf->st_nlink = 1;
+	}
+}
+
+static void ctl_settings(FILE *out) {
+	hfsvolstats vs;
+	if (hfs_vstats(NULL, &vs) == -1) return;
+	fprintf(out, "cache %u\nreadahead %u\n", vs.cachesz, vs.readahead);
+	fprintf(out, "loglevel %s\n", log_level_name(log_level));
+	pthread_mutex_lock(&_blocktrace_lock);
+	fprintf(out, "blocktrace %s\n", _blocktrace ? _blocktrace : "off");
+	pthread_mutex_unlock(&_blocktrace_lock);
+}
+
+// The contents are generated here; the size is unknown beforehand, so reads bypass the page cache.
+// The mount defers permissions to us, and may allow other users, so the kernel
+// doesn't keep them from writing ctl: only whoever mounted the volume, or root, may.
+int ctl_open(int node, struct fuse_file_info *fi, uid_t uid) {
+	char *text = NULL;
+	size_t len = 0;
+
+	if ((fi->flags & O_ACCMODE) != O_RDONLY) {
+		if (node == CTL_STATS) return -EACCES;
+		if (uid != getuid() && uid != 0) return -EACCES;
+	}
+	FILE *out = open_memstream(&text, &len);
+	if (out == NULL) return -errno;
+	if (node == CTL_STATS) stats_print(out, "");
+	else ctl_settings(out);
+	fclose(out);
+
+	ctlfile *f = malloc(sizeof(ctlfile) + len);
+	if (f == NULL) {
+		free(text);
+		return -ENOMEM;
+	}
+	f->len = len;
+	memcpy(f->text, text, len);
+	free(text);
+
+	fi->fh = (uint64_t)f;
+	fi->direct_io = 1;
+	return 0;
+}
+
+int ctl_read(struct fuse_file_info *fi, char *buf, size_t size, off_t offset) {
+	ctlfile *f = (ctlfile*)fi->fh;
+	if (offset >= (off_t)f->len) return 0;
+	if (size > f->len - offset) size = f->len - offset;
+	memcpy(buf, f->text + offset, size);
+	return size;
+}
+
+static int ctl_command(char *line) {
+	char *arg = line + strcspn(line, " \t");
+	unsigned long n = 0;
+	if (*arg) {
+		*arg++ = '\0';
+		n = strtoul(arg, NULL, 0);
+	}
+
+	if (strcmp(line, "flush") == 0) {
+		if (!_readonly && hfs_flush(NULL) == -1) return -errno;
+	} else if (strcmp(line, "drop") == 0) {
+		attr_forget_all();
+		rsrc_forget_all();
+		if (hfs_dropcaches(NULL) == -1) return -errno;
+	} else if (strcmp(line, "cache") == 0 || strcmp(line, "readahead") == 0) {
+		hfsvolstats vs;
+		if (hfs_vstats(NULL, &vs) == -1) return -errno;
+		if (line[0] == 'c') vs.cachesz = n;
+		else vs.readahead = n;
+		if (hfs_setcache(NULL, vs.cachesz, vs.readahead) == -1) return -errno;
+	} else if (strcmp(line, "blocktrace") == 0) {
+		int off = *arg == '\0' || strcmp(arg, "off") == 0;
+		char *path = NULL;
+		FILE *file = off ? NULL : blocktrace_open(arg, &path);
+		if (!off && file == NULL) return -errno;
+		pthread_mutex_lock(&_blocktrace_lock);
+		int err = hfs_settracefile(NULL, file) == -1 ? errno : 0;
+		free(_blocktrace);
+		_blocktrace = err ? NULL : path;	// any earlier trace is finished either way
+		pthread_mutex_unlock(&_blocktrace_lock);
+		if (err) {
+			free(path);
+			return -err;
+		}
+	} else if (strcmp(line, "loglevel") == 0) {
+		int level = log_parse_level(arg);
+		if (level == -1) return -EINVAL;
+		log_set_level(level);
+	} else if (*line) {
+		return -EINVAL;
+	}
+	log_info(FILENAME "ctl: %s %s\n", line, arg);
+	return 0;
+}
+
+// offsets are ignored; every write is taken as whole lines of commands
+int ctl_write(const char *buf, size_t size) {
+	char *text = strndup(buf, size), *save = NULL;
+	int err = 0;
+	if (text == NULL) return -ENOMEM;
+	for (char *line = strtok_r(text, "\n", &save); line && err == 0; line = strtok_r(NULL, "\n", &save))
+		err = ctl_command(line);
+	free(text);
+	return err ? err : (int)size;
+}
+
+void ctl_release(struct fuse_file_info *fi) {
+	free((ctlfile*)fi->fh);
+}
+
 #pragma mark FUSE Callbacks
 
 static int FuseHFS_fgetattr(const char *path, struct stat *stbuf,
                   struct fuse_file_info *fi) {
 	hfsdirent ent;
-	    
+	int node = ctl_path(path);
+	
+	if (node != CTL_NONE) {
+		ctl_stbuf(node, stbuf);
+		return 0;
+	}
 	if (fi && (hfs_fstat((hfsfile*)fi->fh, &ent) == 0)) {
 		// open file
 		dirent_to_stbuf(&ent, stbuf);
-        fprintf(stderr, "FuseHFS_fgetattr(): [%llx] %s \n", fi->fh, path);
-        fprintf(stderr, "stbuf->st_size: %llu, \n", stbuf->st_size);
+        dprintf("FuseHFS_fgetattr(): [%llx] %s \n", fi->fh, path);
+        dprintf("stbuf->st_size: %llu, \n", stbuf->st_size);
 		return 0;
 	}
 	
-	// convert to hfs path
-	char *hfspath = mkhfspath(path);
-	if (hfspath == NULL) return -ENOENT;
-	
 	// get file info
-	
-	if (hfs_stat(NULL, hfspath, &ent) == 0) {
+	if (stat_path(path, &ent) == 0) {
 		// file
 		dirent_to_stbuf(&ent, stbuf);
-        fprintf(stderr, "FuseHFS_fgetattr(): [%d] %s \n", 0, path);
-        fprintf(stderr, "stbuf->st_size: %llu, \n", stbuf->st_size);
-		free(hfspath);
+        dprintf("FuseHFS_fgetattr(): [%d] %s \n", 0, path);
+        dprintf("stbuf->st_size: %llu, \n", stbuf->st_size);
 		return 0;
 	}
 	
 	dprintf("fgetattr: ENOENT (%s)\n", path);
-	free(hfspath);
 	return -ENOENT;
 }
 
@@ -179,49 +940,114 @@ static int FuseHFS_getattr(const char *path, struct stat *stbuf) {
 	return FuseHFS_fgetattr(path, stbuf, NULL);
 }
 
+// an open directory, which keeps its place between readdir calls
+typedef struct hldir {
+	hfsdir *dir;
+	unsigned long cnid;
+	off_t pos;          // entries returned so far, counting . and ..
+	int pending;        // ent was read but didn't fit in the last reply
+	hfsdirent ent;
+} hldir;
+
+static int FuseHFS_opendir(const char *path, struct fuse_file_info *fi) {
+	dprintf("opendir %s\n", path);
+	if (rejected(path)) return -ENOENT;
+	switch (ctl_path(path)) {
+		case CTL_NONE: break;
+		case CTL_DIR: fi->fh = 0; return 0;
+		default: return -ENOTDIR;
+	}
+	// convert to hfs path
+	char hfspath[HFSPATH_MAX];
+	if (mkhfspath(path, hfspath, sizeof hfspath) == NULL) return -ENOENT;
+	
+	// find directory
+	hfsdirent ent;
+	if (hfs_stat(NULL, hfspath, &ent) == -1) return -errno;
+	if (!(ent.flags & HFS_ISDIR)) return -ENOTDIR;
+	
+	hldir *d = calloc(1, sizeof(hldir));
+	if (d == NULL) return -ENOMEM;
+	d->cnid = ent.cnid;
+	d->dir = hfs_opendirid(NULL, d->cnid);
+	if (d->dir == NULL) {
+		int err = errno;
+		free(d);
+		return -err;
+	}
+	fi->fh = (uint64_t)d;
+	return 0;
+}
+
 static int FuseHFS_readdir(const char *path, void *buf, fuse_fill_dir_t filler,
                  off_t offset, struct fuse_file_info *fi) {
-	dprintf("readdir %s\n", path);
-	// convert to hfs path
-	char *hfspath = mkhfspath(path);
-	if (hfspath == NULL) return -ENOENT;
-	
-	// default directories
-	filler(buf, ".", NULL, 0);           /* Current directory (.)  */
-	filler(buf, "..", NULL, 0);          /* Parent directory (..)  */
-	
-	// open directory
-	hfsdir *dir = hfs_opendir(NULL, hfspath);
-	if (dir == NULL) {
-		free(hfspath);
-		dprintf("readdir: ENOENT\n");
-		return -ENOENT;
+	dprintf("readdir %s %lld\n", path, (long long)offset);
+	hldir *d = (hldir*)fi->fh;
+	
+	if (d == NULL) {
+		// the control directory
+		const char *names[] = { ".", "..", ctl_name(CTL_STATS), ctl_name(CTL_CTL) };
+		for (off_t n = offset; n < 4; n++)
+			if (filler(buf, names[n], NULL, n + 1)) break;
+		return 0;
 	}
 	
-	// read contents
-	hfsdirent ent;
-	struct stat stbuf;
-	char dname[4*HFS_MAX_FLEN+3];
-	while (hfs_readdir(dir, &ent) == 0) {
-		// File or directory
-		dirent_to_stbuf(&ent, &stbuf);
-		hfs_to_utf8(ent.name, dname, 4*HFS_MAX_FLEN);
-		filler(buf, dname, &stbuf, 0);
-	}
-	
-	// close
-	hfs_closedir(dir);
-	free(hfspath);
+	// start over if the kernel went back
+	if (offset < d->pos) {
+		hfs_closedir(d->dir);
+		d->dir = hfs_opendirid(NULL, d->cnid);
+		d->pos = 0;
+		d->pending = 0;
+		if (d->dir == NULL) return -errno;
+	}
+	
+	while (1) {
+		char dname[4*HFS_MAX_FLEN+3];
+		const char *name = dname;
+		struct stat stbuf, *st = NULL;
+		
+		if (d->pos == 0) {
+			name = ".";
+		} else if (d->pos == 1) {
+			name = "..";
+		} else {
+			if (!d->pending) {
+				if (hfs_readdir(d->dir, &d->ent) == -1) {
+					if (errno != ENOENT) return -errno;	// not the end, so don't pretend it is
+					break;
+				}
+				d->pending = 1;
+			}
+			dirent_to_stbuf(&d->ent, &stbuf);
+			st = &stbuf;
+			hfs_to_utf8(d->ent.name, dname, 4*HFS_MAX_FLEN);
+		}
+		
+		// skip entries before the requested offset; stop when the buffer is full
+		if (d->pos >= offset && filler(buf, name, st, d->pos + 1)) break;
+		d->pos++;
+		d->pending = 0;
+	}
+	return 0;
+}
+
+static int FuseHFS_releasedir(const char *path, struct fuse_file_info *fi) {
+	dprintf("releasedir %s\n", path);
+	hldir *d = (hldir*)fi->fh;
+	if (d == NULL) return 0;
+	hfs_closedir(d->dir);
+	free(d);
 	return 0;
 }
 
 static int FuseHFS_mknod(const char *path, mode_t mode, dev_t rdev) {
 	dprintf("mknod %s\n", path);
 	if (_readonly) return -EPERM;
+	if (rejected(path) || ctl_path(path)) return -EPERM;
 	
 	// convert to hfs path
-	char *hfspath = mkhfspath(path);
-	if (hfspath == NULL) return -ENOENT;
+	char hfspath[HFSPATH_MAX];
+	if (mkhfspath(path, hfspath, sizeof hfspath) == NULL) return -ENOENT;
 	
 	// open file
 	hfsfile *file;
@@ -229,30 +1055,29 @@ static int FuseHFS_mknod(const char *path, mode_t mode, dev_t rdev) {
 		// file
 		hfs_close(file);
 		hfs_flush(NULL);
-		free(hfspath);
+		attr_forget_parent(path);
 		return 0;
 	}
 	
 	dprintf("mknod: EPERM\n");
-	free(hfspath);
 	return -EPERM;
 }
 
 static int FuseHFS_mkdir(const char *path, mode_t mode) {
 	dprintf("mkdir %s\n", path);
 	if (_readonly) return -EPERM;
+	if (rejected(path) || ctl_path(path)) return -EPERM;
 	
 	// convert to hfs path
-	char *hfspath = mkhfspath(path);
-	if (hfspath == NULL) return -ENOENT;
+	char hfspath[HFSPATH_MAX];
+	if (mkhfspath(path, hfspath, sizeof hfspath) == NULL) return -ENOENT;
 	
 	if (hfs_mkdir(NULL, hfspath) == -1) {
-		free(hfspath);
 		perror("mkdir");
 		return -errno;
 	}
+	attr_forget_parent(path);
 	
-	free(hfspath);
 	return 0;
 }
 
@@ -261,32 +1086,31 @@ static int FuseHFS_unlink(const char *path) {
 	if (_readonly) return -EPERM;
 	
 	// convert to hfs path
-	char *hfspath = mkhfspath(path);
-	if (hfspath == NULL) return -ENOENT;
+	char hfspath[HFSPATH_MAX];
+	if (mkhfspath(path, hfspath, sizeof hfspath) == NULL) return -ENOENT;
 	
 	// check that file exists
 	hfsdirent ent;
 	if (hfs_stat(NULL, hfspath, &ent) == -1) {
-		free(hfspath);
 		dprintf("unlink: ENOENT\n");
 		return -ENOENT;
 	}
 	
 	// check that it's a file
 	if (ent.flags & HFS_ISDIR) {
-		free(hfspath);
 		dprintf("unlink: EISDIR\n");
 		return -EISDIR;
 	}
 	
 	// delete it
+	rsrc_forget_all();
 	if (hfs_delete(NULL, hfspath) == -1) {
-		free(hfspath);
 		perror("unlink(2)");
 		return -errno;
 	}
+	attr_forget(path);
+	attr_forget_parent(path);
 	
-	free(hfspath);
 	return 0;
 }
 
@@ -295,98 +1119,89 @@ static int FuseHFS_rmdir(const char *path) {
 	if (_readonly) return -EPERM;
 	
 	// convert to hfs path
-	char *hfspath = mkhfspath(path);
-	if (hfspath == NULL) return -ENOENT;
+	char hfspath[HFSPATH_MAX];
+	if (mkhfspath(path, hfspath, sizeof hfspath) == NULL) return -ENOENT;
 	
 	// check that file exists
 	hfsdirent ent;
 	if (hfs_stat(NULL, hfspath, &ent) == -1) {
-		free(hfspath);
 		dprintf("rmdir: ENOENT\n");
 		return -ENOENT;
 	}
 	
 	// check that it's a directory
 	if (!(ent.flags & HFS_ISDIR)) {
-		free(hfspath);
 		dprintf("rmdir: ENOTDIR\n");
 		return -ENOTDIR;
 	}
 	
 	// delete it
 	if (hfs_rmdir(NULL, hfspath) == -1) {
-		free(hfspath);
 		perror("rmdir(2)");
 		return -errno;
 	}
+	attr_forget(path);
+	attr_forget_parent(path);
 	
-	free(hfspath);
 	return 0;
 }
 
 static int FuseHFS_rename(const char *from, const char *to) {
 	dprintf("rename %s %s\n", from, to);
 	if (_readonly) return -EPERM;
+	if (rejected(to) || ctl_path(to) || ctl_path(from)) return -EPERM;
 	
 	// convert to hfs paths
-	char *hfspath1 = mkhfspath(from);
-	char *hfspath2 = mkhfspath(to);
+	char hfspath1[HFSPATH_MAX], hfspath2[HFSPATH_MAX];
+	if (mkhfspath(from, hfspath1, sizeof hfspath1) == NULL ||
+		mkhfspath(to, hfspath2, sizeof hfspath2) == NULL) return -ENOENT;
 	
 	// delete destination file if it exists
+	rsrc_forget_all();
 	hfsdirent ent;
 	if (hfs_stat(NULL, hfspath2, &ent) == 0)
 		if (!(ent.flags & HFS_ISDIR)) hfs_delete(NULL, hfspath2);
 	
-	// rename
-	if (hfs_rename(NULL, hfspath1, hfspath2) != 0) {
-		free(hfspath1);
-		free(hfspath2);
+	// rename; everything below a renamed directory has a new path
+	int err = hfs_rename(NULL, hfspath1, hfspath2) != 0 ? errno : 0;
+	attr_forget_all();
+	if (err) {
+		errno = err;
 		perror("hfs_rename");
-		return -errno;
+		return -err;
 	}
 	
 	// bless parent folder if it's a system file
 	if (hfs_stat(NULL, hfspath2, &ent) == -1) {
-		free(hfspath1);
-		free(hfspath2);
 		return -ENOENT;
 	}
 	
-	if ((strcmp(ent.u.file.type, "zsys") == 0) && (strcmp(ent.u.file.creator, "MACS") == 0) && (strcmp(ent.name, "System") == 0)) {
-		// bless
-		dprintf("rename: blessing folder %lu\n", ent.parid);
-		hfsvolent volent;
-		hfs_vstat(NULL, &volent);
-		volent.blessed = ent.parid;
-		hfs_vsetattr(NULL, &volent);
-	}
+	bless_system_folder(&ent);
 	
 	// success
-	free(hfspath1);
-	free(hfspath2);
 	return 0;
 }
 
 static int FuseHFS_create(const char *path, mode_t mode, struct fuse_file_info *fi) {
 	dprintf("create %s\n", path);
 	if (_readonly) return -EPERM;
+	if (rejected(path) || ctl_path(path)) return -EPERM;
 	
 	// convert to hfs path
-	char *hfspath = mkhfspath(path);
-	if (hfspath == NULL) return -ENOENT;
+	char hfspath[HFSPATH_MAX];
+	if (mkhfspath(path, hfspath, sizeof hfspath) == NULL) return -ENOENT;
 	
 	// open file
 	hfsfile *file;
 	if ((file = hfs_create(NULL, hfspath, "TEXT", "FUSE"))) {
 		// close and reopen, because it won't exist until it's closed
 		hfs_close(file);
+		attr_forget_parent(path);
 		file = hfs_open(NULL, hfspath);
 		fi->fh = (uint64_t)file;
-		free(hfspath);
 		return 0;
 	}
 	
-	free(hfspath);
 	perror("hfs_create");
 	return -errno;
 }
@@ -394,21 +1209,23 @@ static int FuseHFS_create(const char *path, mode_t mode, struct fuse_file_info *
 static int FuseHFS_open(const char *path, struct fuse_file_info *fi) {
 	dprintf("open %s\n", path);
 	// apparently, MacFUSE won't open the same file more than once. This won't break if it stays this way.
+	if (rejected(path)) return -ENOENT;
+	int node = ctl_path(path);
+	if (node == CTL_DIR) return -EISDIR;
+	if (node != CTL_NONE) return ctl_open(node, fi, fuse_get_context()->uid);
 	
 	// convert to hfs path
-	char *hfspath = mkhfspath(path);
-	if (hfspath == NULL) return -ENOENT;
+	char hfspath[HFSPATH_MAX];
+	if (mkhfspath(path, hfspath, sizeof hfspath) == NULL) return -ENOENT;
 	
 	// open file
 	hfsfile *file = NULL;
 	if ((file = hfs_open(NULL, hfspath))) {
 		// file
 		fi->fh = (uint64_t)file;
-		free(hfspath);
 		return 0;
 	}
 	
-	free(hfspath);
 	perror("hfs_open");
 	return -errno;
 }
@@ -416,11 +1233,10 @@ static int FuseHFS_open(const char *path, struct fuse_file_info *fi) {
 static int FuseHFS_read(const char *path, char *buf, size_t size, off_t offset,
               struct fuse_file_info *fi) {
 	dprintf("read %s\n", path);
+	if (ctl_path(path)) return ctl_read(fi, buf, size, offset);
 	
 	hfsfile *file = (hfsfile*)fi->fh;
-	hfs_setfork(file, 0);
-	hfs_seek(file, offset, SEEK_SET);
-    int read = hfs_read(file, buf, size);
+    int read = hfs_pread(file, 0, buf, size, offset);
     dprintf("FuseHFS_read(): [%llx] %s returning %d bytes \n", fi->fh, path, read);
 	return read;
 }
@@ -428,19 +1244,208 @@ static int FuseHFS_read(const char *path, char *buf, size_t size, off_t offset,
 static int FuseHFS_write(const char *path, const char *buf, size_t size,
                off_t offset, struct fuse_file_info *fi) {
 	dprintf("write %s\n", path);
+	if (ctl_path(path)) return ctl_write(buf, size);
     if (_readonly)
         return -EPERM;
     if (offset + size > MAX_FILE_SIZE)
         return -EFBIG;
 	
     dprintf("FuseHFS_write() file %s (%llx) %lu at offset %llu data: %x%x%x%x \n", path, (unsigned long long)fi->fh, size, offset, buf[0], buf[1], buf[2], buf[3]);
-    fflush(stderr);
     
 	hfsfile *file = (hfsfile*)fi->fh;
-	hfs_setfork(file, 0);
-    if (hfs_seek(file, offset, SEEK_SET) < 0)
-        return -EINVAL;
-	return (hfs_write(file, buf, size));
+	int written = hfs_pwrite(file, 0, buf, size, offset);
+	if (written == -1) return -errno;
+	attr_update(file);
+	return written;
+}
+
+// a read copied into memory, in the form read_buf returns
+struct fuse_bufvec * memory_bufvec(hfsfile *file, int fork, size_t size, off_t offset) {
+	struct fuse_bufvec *bv = malloc(sizeof *bv);
+	char *mem = malloc(size ? size : 1);
+	unsigned long read;
+	if (bv == NULL || mem == NULL ||
+		(read = hfs_pread(file, fork, mem, size, offset)) == (unsigned long)-1) {
+		int err = bv && mem ? errno : ENOMEM;
+		free(bv);
+		free(mem);
+		errno = err;
+		return NULL;
+	}
+	*bv = FUSE_BUFVEC_INIT(read);
+	bv->buf[0].mem = mem;
+	return bv;
+}
+
+// Describe a read as runs of the image file, so libfuse copies (or splices) it
+// straight from the medium rather than through the block cache and our buffer.
+// The file stays pinned until bufvec_release(), so nothing can move or rewrite
+// the runs before they are read. Falls back to reading into memory if the
+// medium can't be read directly.
+struct fuse_bufvec * fork_bufvec(hfsfile *file, int fork, size_t size, off_t offset) {
+	size_t count = 0, alloc = 4, total = 0;
+	struct fuse_bufvec *bv = malloc(sizeof *bv + (alloc-1) * sizeof bv->buf[0]);
+	if (bv == NULL) return NULL;
+
+	hfs_pin(file);
+	while (total < size) {
+		int fd;
+		unsigned long long where;
+		unsigned long run = hfs_pmap(file, fork, size-total, offset+total, &fd, &where);
+		if (run == (unsigned long)-1) {
+			hfs_unpin(file);
+			free(bv);
+			return memory_bufvec(file, fork, size, offset);
+		}
+		if (run == 0) break;
+		if (count == alloc) {
+			struct fuse_bufvec *grown = realloc(bv, sizeof *bv + (2*alloc-1) * sizeof bv->buf[0]);
+			if (grown == NULL) {
+				hfs_unpin(file);
+				free(bv);
+				errno = ENOMEM;
+				return NULL;
+			}
+			bv = grown;
+			alloc *= 2;
+		}
+		bv->buf[count].size = run;
+		bv->buf[count].flags = FUSE_BUF_IS_FD | FUSE_BUF_FD_SEEK | FUSE_BUF_FD_RETRY;
+		bv->buf[count].mem = NULL;
+		bv->buf[count].fd = fd;
+		bv->buf[count].pos = where;
+		count++;
+		total += run;
+	}
+
+	if (count == 0) {
+		hfs_unpin(file);
+		*bv = FUSE_BUFVEC_INIT(0);
+		return bv;
+	}
+	bv->count = count;
+	bv->idx = 0;
+	bv->off = 0;
+	return bv;
+}
+
+// once a fork_bufvec() result has been read, let the file change again
+void bufvec_release(hfsfile *file, struct fuse_bufvec *bv) {
+	if (bv->buf[0].flags & FUSE_BUF_IS_FD) hfs_unpin(file);
+	bufvec_free(bv);
+}
+
+// A read for libfuse to hold after read_buf returns, when nothing would unpin
+// the file: the runs are copied into memory while it is still pinned.
+struct fuse_bufvec * fork_copy(hfsfile *file, int fork, size_t size, off_t offset) {
+	struct fuse_bufvec *src = fork_bufvec(file, fork, size, offset);
+	if (src == NULL || !(src->buf[0].flags & FUSE_BUF_IS_FD)) return src;
+
+	size_t len = fuse_buf_size(src);
+	struct fuse_bufvec *bv = malloc(sizeof *bv);
+	char *mem = malloc(len ? len : 1);
+	ssize_t copied = -ENOMEM;
+	if (bv != NULL && mem != NULL) {
+		*bv = FUSE_BUFVEC_INIT(len);
+		bv->buf[0].mem = mem;
+		copied = fuse_buf_copy(bv, src, 0);
+	}
+	bufvec_release(file, src);
+	if (copied < 0) {
+		free(bv);
+		free(mem);
+		errno = (int)-copied;
+		return NULL;
+	}
+	bv->buf[0].size = copied;
+	return bv;
+}
+
+// what libfuse does with the bufvec returned from read_buf
+void bufvec_free(struct fuse_bufvec *bv) {
+	size_t i;
+	for (i = 0; i < bv->count; i++) {
+		if (!(bv->buf[i].flags & FUSE_BUF_IS_FD)) free(bv->buf[i].mem);
+	}
+	free(bv);
+}
+
+// Write each piece of a request where it lies: memory goes straight to
+// hfs_pwrite(), and only a piece that arrives as a descriptor is copied out.
+ssize_t bufvec_write(hfsfile *file, struct fuse_bufvec *buf, off_t offset) {
+	ssize_t total = 0;
+	size_t i, skip = buf->off;
+
+	for (i = buf->idx; i < buf->count; i++, skip = 0) {
+		struct fuse_buf *b = &buf->buf[i];
+		size_t len = b->size - skip;
+		unsigned long written;
+
+		if (b->flags & FUSE_BUF_IS_FD) {
+			struct fuse_bufvec src = FUSE_BUFVEC_INIT(len);
+			struct fuse_bufvec dst = FUSE_BUFVEC_INIT(len);
+			src.buf[0] = *b;
+			src.buf[0].size = len;
+			if (b->flags & FUSE_BUF_FD_SEEK) src.buf[0].pos += skip;
+			dst.buf[0].mem = malloc(len ? len : 1);
+			if (dst.buf[0].mem == NULL) return total ? total : -ENOMEM;
+			ssize_t copied = fuse_buf_copy(&dst, &src, 0);
+			written = copied < 0 ? (unsigned long)-1 : hfs_pwrite(file, 0, dst.buf[0].mem, copied, offset + total);
+			free(dst.buf[0].mem);
+			if (copied < 0) return total ? total : copied;
+		} else {
+			written = hfs_pwrite(file, 0, (char *)b->mem + skip, len, offset + total);
+		}
+		if (written == (unsigned long)-1) return total ? total : -errno;
+		total += written;
+		if (written < len) break;
+	}
+	return total;
+}
+
+static int FuseHFS_read_buf(const char *path, struct fuse_bufvec **bufp, size_t size, off_t offset,
+				struct fuse_file_info *fi) {
+	dprintf("read_buf %s %lu at %lld\n", path, size, (long long)offset);
+	if (ctl_path(path)) {
+		struct fuse_bufvec *bv = malloc(sizeof *bv);
+		char *mem = malloc(size ? size : 1);
+		if (bv == NULL || mem == NULL) {
+			free(bv);
+			free(mem);
+			return -ENOMEM;
+		}
+		*bv = FUSE_BUFVEC_INIT(ctl_read(fi, mem, size, offset));
+		bv->buf[0].mem = mem;
+		*bufp = bv;
+		return 0;
+	}
+	// libfuse frees the bufvec itself, so it must not hold runs of a pinned file
+	struct fuse_bufvec *bv = fork_copy((hfsfile*)fi->fh, 0, size, offset);
+	if (bv == NULL) return -errno;
+	*bufp = bv;
+	return 0;
+}
+
+static int FuseHFS_write_buf(const char *path, struct fuse_bufvec *buf, off_t offset,
+				 struct fuse_file_info *fi) {
+	size_t size = fuse_buf_size(buf);
+	dprintf("write_buf %s %lu at %lld\n", path, size, (long long)offset);
+	if (ctl_path(path)) {
+		struct fuse_bufvec dst = FUSE_BUFVEC_INIT(size);
+		dst.buf[0].mem = malloc(size ? size : 1);
+		if (dst.buf[0].mem == NULL) return -ENOMEM;
+		ssize_t copied = fuse_buf_copy(&dst, buf, 0);
+		int ret = copied < 0 ? (int)copied : ctl_write(dst.buf[0].mem, copied);
+		free(dst.buf[0].mem);
+		return ret;
+	}
+	if (_readonly)
+		return -EPERM;
+	if (offset + size > MAX_FILE_SIZE)
+		return -EFBIG;
+	ssize_t written = bufvec_write((hfsfile*)fi->fh, buf, offset);
+	attr_update((hfsfile*)fi->fh);
+	return written;
 }
 
 unsigned long power_of_2_factor(unsigned long blocksize) {
@@ -460,7 +1465,7 @@ unsigned long power_of_2_factor(unsigned long blocksize) {
  instead of struct statvfs to get the size right, but it's probably possible here too if we're
  careful about how big the fields actually are. I'm just lazy and leaving this note instead. */
 static int FuseHFS_statfs(const char *path, struct statvfs *stbuf) {
-    fprintf(stderr, "FuseHFS_statfs()\n");
+    dprintf("FuseHFS_statfs()\n");
 	memset(stbuf, 0, sizeof(struct statvfs));
 	hfsvolent vstat;
 	hfs_vstat(NULL, &vstat);
@@ -517,32 +1522,22 @@ static int FuseHFS_flush(const char *path, struct fuse_file_info *fi) {
 
 static int FuseHFS_release(const char *path, struct fuse_file_info *fi) {
 	dprintf("close %s\n", path);
+	if (ctl_path(path)) {
+		ctl_release(fi);
+		return 0;
+	}
 	
 	// convert to hfs path
-	char *hfspath = mkhfspath(path);
-	if (hfspath == NULL) return -ENOENT;
+	char hfspath[HFSPATH_MAX];
+	if (mkhfspath(path, hfspath, sizeof hfspath) == NULL) return -ENOENT;
 	
 	hfsfile *file = (hfsfile*)fi->fh;
-	hfs_setfork(file, 0);
 	hfs_close(file);
-	free(hfspath);
 	return 0;
 }
 
-void * FuseHFS_init(struct fuse_conn_info *conn) {
-	struct fuse_context *cntx=fuse_get_context();
-	struct fusehfs_options *options = cntx->private_data;
-	
-#if (__FreeBSD__ >= 10)
-	FUSE_ENABLE_SETVOLNAME(conn); // this actually doesn't do anything
-	FUSE_ENABLE_XTIMES(conn); // and apparently this doesn't either
-#endif
-
-	log_to_file();
-	
-	dprintf("FuseHFS_init\n");
-	fflush(stderr);
-	
+// set up character set conversion and mount the volume, for either frontend
+void fusehfs_mount(struct fusehfs_options *options) {
 	// create iconv
 	iconv_to_utf8 = iconv_open("UTF-8", options->encoding);
 	if (iconv_to_utf8 == (iconv_t)-1) {
@@ -554,6 +1549,8 @@ void * FuseHFS_init(struct fuse_conn_info *conn) {
 		perror("iconv_open");
 		exit(1);
 	}
+	init_byte_tables();
+	dprintf("character set tables %s\n", _bytetables ? "enabled" : "disabled");
 	
 	// mount volume
 	int mode = options->readonly?HFS_MODE_RDONLY:HFS_MODE_ANY;
@@ -564,34 +1561,72 @@ void * FuseHFS_init(struct fuse_conn_info *conn) {
 	
 	// initialize some globals
 	_readonly = options->readonly;
+	reject_init(options->reject);
 	hfsvolent vstat;
 	hfs_vstat(NULL, &vstat);
 	strcpy(_volname, vstat.name);
+	if (!_readonly) flusher_start();
+	stats_start();
+	log_start();
+}
+
+void fusehfs_unmount(void) {
+	if (_nreject) log_info(FILENAME "rejected %lu probe names\n", _rejects);
+	flusher_stop();
+	rsrc_forget_all();
+	stats_stop();
+	iconv_close(iconv_to_mac);
+	iconv_close(iconv_to_utf8);
+	hfs_umountall();
+	log_stop();
+}
+
+// ask for large requests, and for splicing where the kernel offers it
+void fusehfs_conn(struct fuse_conn_info *conn) {
+	conn->max_write = FUSEHFS_IOSIZE;
+	conn->max_readahead = FUSEHFS_IOSIZE;
+#ifdef FUSE_CAP_BIG_WRITES
+	conn->want |= conn->capable & FUSE_CAP_BIG_WRITES;
+#endif
+#ifdef FUSE_CAP_SPLICE_READ
+	conn->want |= conn->capable & (FUSE_CAP_SPLICE_READ | FUSE_CAP_SPLICE_WRITE);
+#endif
+}
+
+void * FuseHFS_init(struct fuse_conn_info *conn) {
+	struct fuse_context *cntx=fuse_get_context();
+	struct fusehfs_options *options = cntx->private_data;
+	
+#if (__FreeBSD__ >= 10)
+	FUSE_ENABLE_SETVOLNAME(conn); // this actually doesn't do anything
+	FUSE_ENABLE_XTIMES(conn); // and apparently this doesn't either
+#endif
+
+	log_to_file();
+	
+	dprintf("FuseHFS_init\n");
+	fflush(stderr);
+	
+	fusehfs_conn(conn);
+	fusehfs_mount(options);
 	
 	return NULL;
 }
 
 void FuseHFS_destroy(void *userdata) {
 	dprintf("FuseHFS_destroy\n");
-	iconv_close(iconv_to_mac);
-	iconv_close(iconv_to_utf8);
-	hfs_umountall();
+	fusehfs_unmount();
 }
 
 static int FuseHFS_listxattr(const char *path, char *list, size_t size) {
 	dprintf("listxattr %s %p %lu\n", path, list, size);
-	
-	// convert to hfs path
-	char *hfspath = mkhfspath(path);
-	if (hfspath == NULL) return -ENOENT;
+	if (ctl_path(path)) return 0;
 	
 	// find file
 	hfsdirent ent;
-	if (hfs_stat(NULL, hfspath, &ent) == -1) {
-		free(hfspath);
+	if (stat_path(path, &ent) == -1) {
 		return -ENOENT;
 	}
-	free(hfspath);
 	
 	int needSize = sizeof XATTR_FINDERINFO_NAME;
 	int haveRsrcFork = 0;
@@ -612,85 +1647,46 @@ static int FuseHFS_listxattr(const char *path, char *list, size_t size) {
 static int FuseHFS_getxattr(const char *path, const char *name, char *value, size_t size,
 				uint32_t position) {
 	//dprintf("getxattr %s %s %p %lu %u\n", path, name, value, size, position);
-	
-	// convert to hfs path
-	char *hfspath = mkhfspath(path);
-	if (hfspath == NULL) return -ENOENT;
+	if (ctl_path(path)) return -ENOATTR;
 	
 	// find file
 	hfsdirent ent;
-	if (hfs_stat(NULL, hfspath, &ent) == -1) {
-		free(hfspath);
+	if (stat_path(path, &ent) == -1) {
 		return -ENOENT;
 	}
 	
 	
 	if (strcmp(name, XATTR_FINDERINFO_NAME) == 0) {
 		if (value == NULL) {
-			free(hfspath);
 			return 32;
 		}
 		if (size < 32) {
-			free(hfspath);
 			return -ERANGE;
 		}
 		// return finder info
-		if (ent.flags & HFS_ISDIR) {
-			// directory info
-			OSWriteBigInt16(value, 0, ent.u.dir.rect.top);
-			OSWriteBigInt16(value, 2, ent.u.dir.rect.left);
-			OSWriteBigInt16(value, 4, ent.u.dir.rect.bottom);
-			OSWriteBigInt16(value, 6, ent.u.dir.rect.right);
-			OSWriteBigInt16(value, 8, ent.fdflags);
-			OSWriteBigInt16(value, 10, ent.fdlocation.v);
-			OSWriteBigInt16(value, 12, ent.fdlocation.h);
-			OSWriteBigInt16(value, 14, ent.u.dir.view);
-			// DXInfo
-			OSWriteBigInt16(value, 16, ((DXInfo*)(ent.u.dir.xinfo))->frScroll.v);
-			OSWriteBigInt16(value, 18, ((DXInfo*)(ent.u.dir.xinfo))->frScroll.h);
-			OSWriteBigInt32(value, 20, ((DXInfo*)(ent.u.dir.xinfo))->frOpenChain);
-			OSWriteBigInt16(value, 24, ((DXInfo*)(ent.u.dir.xinfo))->frUnused);
-			OSWriteBigInt16(value, 26, ((DXInfo*)(ent.u.dir.xinfo))->frComment);
-			OSWriteBigInt32(value, 28, ((DXInfo*)(ent.u.dir.xinfo))->frPutAway);		
-		} else {
-			// file info
-			memcpy(value, ent.u.file.type, 4);
-			memcpy(value+4, ent.u.file.creator, 4);
-			OSWriteBigInt16(value, 8, ent.fdflags);
-			OSWriteBigInt16(value, 10, ent.fdlocation.v);
-			OSWriteBigInt16(value, 12, ent.fdlocation.h);
-			OSWriteBigInt16(value, 14, ent.u.file.window);
-			// FXInfo
-			OSWriteBigInt16(value, 16, ((FXInfo*)(ent.u.file.xinfo))->fdIconID);
-			OSWriteBigInt16(value, 18, ((FXInfo*)(ent.u.file.xinfo))->fdUnused[0]);
-			OSWriteBigInt16(value, 20, ((FXInfo*)(ent.u.file.xinfo))->fdUnused[1]);
-			OSWriteBigInt16(value, 22, ((FXInfo*)(ent.u.file.xinfo))->fdUnused[2]);
-			OSWriteBigInt16(value, 24, ((FXInfo*)(ent.u.file.xinfo))->fdUnused[3]);
-			OSWriteBigInt16(value, 26, ((FXInfo*)(ent.u.file.xinfo))->fdComment);
-			OSWriteBigInt32(value, 28, ((FXInfo*)(ent.u.file.xinfo))->fdPutAway);
-		}
-		free(hfspath);
+		finderinfo_get(&ent, value);
 		return 32;
 	} else if (strcmp(name, XATTR_RESOURCEFORK_NAME) == 0 && (!(ent.flags & HFS_ISDIR)) && ent.u.file.rsize) {
 		// resource fork
 		if (value == NULL) {
-			free(hfspath);
 			return ent.u.file.rsize-position;
 		}
 		int bw = ent.u.file.rsize-position;
 		if (bw > size) bw = size;
 		// copy resource fork
-		hfsfile *fp = hfs_open(NULL, hfspath);
-		hfs_setfork(fp, 1);
-		hfs_seek(fp, position, SEEK_SET);
-		hfs_read(fp, value, bw);
-		hfs_close(fp);
+		hfsfile *fp = rsrc_get(ent.cnid);
+		if (fp == NULL) {
+			char hfspath[HFSPATH_MAX];
+			if (mkhfspath(path, hfspath, sizeof hfspath) == NULL) return -ENOENT;
+			fp = rsrc_keep(ent.cnid, hfs_open(NULL, hfspath));
+			if (fp == NULL) return -errno;
+		}
+		hfs_pread(fp, 1, value, bw, position);
+		rsrc_put(fp);
 		// the end
-		free(hfspath);
 		return bw;
 	}
 	
-	free(hfspath);
 	dprintf("getxattr: ENOATTR\n");
 	return -ENOATTR;
 }
@@ -701,88 +1697,44 @@ static int FuseHFS_setxattr(const char *path, const char *name, const char *valu
 	if (_readonly) return -EPERM;
 	
 	// convert to hfs path
-	char *hfspath = mkhfspath(path);
-	if (hfspath == NULL) return -ENOENT;
+	char hfspath[HFSPATH_MAX];
+	if (mkhfspath(path, hfspath, sizeof hfspath) == NULL) return -ENOENT;
 	
 	// find file
 	hfsdirent ent;
-	if (hfs_stat(NULL, hfspath, &ent) == -1) {
-		free(hfspath);
+	if (stat_path(path, &ent) == -1) {
 		return -ENOENT;
 	}
 	
 	if (strcmp(name, XATTR_FINDERINFO_NAME) == 0) {
 		if (size != 32) {
 			dprintf("setxattr: finder info is not 32 bytes\n");
-			free(hfspath);
 			return -ERANGE;
 		}
 		// write finder info to dirent
-		if (ent.flags & HFS_ISDIR) {
-			// directory
-			ent.u.dir.rect.top =		OSReadBigInt16(value, 0);
-			ent.u.dir.rect.left =		OSReadBigInt16(value, 2);
-			ent.u.dir.rect.bottom =		OSReadBigInt16(value, 4);
-			ent.u.dir.rect.right =		OSReadBigInt16(value, 6);
-			ent.fdflags =				OSReadBigInt16(value, 8);
-			ent.fdlocation.v =			OSReadBigInt16(value, 10);
-			ent.fdlocation.h =			OSReadBigInt16(value, 12);
-			ent.u.dir.view =			OSReadBigInt16(value, 14);
-			// DXInfo
-			((DXInfo*)(ent.u.dir.xinfo))->frScroll.v   = OSReadBigInt16(value, 16);
-			((DXInfo*)(ent.u.dir.xinfo))->frScroll.h   = OSReadBigInt16(value, 18);
-			((DXInfo*)(ent.u.dir.xinfo))->frOpenChain  = OSReadBigInt32(value, 20);
-			((DXInfo*)(ent.u.dir.xinfo))->frUnused     = OSReadBigInt16(value, 24);
-			((DXInfo*)(ent.u.dir.xinfo))->frComment    = OSReadBigInt16(value, 26);
-			((DXInfo*)(ent.u.dir.xinfo))->frPutAway    = OSReadBigInt32(value, 28);
-		} else {
-			// regular file
-			memcpy(ent.u.file.type, value, 4);
-			memcpy(ent.u.file.creator, value+4, 4);
-			ent.u.file.type[4] = ent.u.file.type[4] = '\0';
-			ent.fdflags       = OSReadBigInt16(value, 8);
-			ent.fdlocation.v  = OSReadBigInt16(value, 10);
-			ent.fdlocation.h  = OSReadBigInt16(value, 12);
-			ent.u.file.window = OSReadBigInt16(value, 14);
-			// FXInfo
-			((FXInfo*)(ent.u.file.xinfo))->fdIconID    = OSReadBigInt16(value, 16);
-			((FXInfo*)(ent.u.file.xinfo))->fdUnused[0] = OSReadBigInt16(value, 18);
-			((FXInfo*)(ent.u.file.xinfo))->fdUnused[1] = OSReadBigInt16(value, 20);
-			((FXInfo*)(ent.u.file.xinfo))->fdUnused[2] = OSReadBigInt16(value, 22);
-			((FXInfo*)(ent.u.file.xinfo))->fdUnused[3] = OSReadBigInt16(value, 24);
-			((FXInfo*)(ent.u.file.xinfo))->fdComment   = OSReadBigInt16(value, 26);
-			((FXInfo*)(ent.u.file.xinfo))->fdPutAway   = OSReadBigInt32(value, 28);
-			// bless parent folder if it's a system file
-			if ((strcmp(ent.u.file.type, "zsys") == 0) && (strcmp(ent.u.file.creator, "MACS") == 0) && (strcmp(ent.name, "System") == 0)) {
-				// bless
-				dprintf("setxattr: blessing folder %lu\n", ent.parid);
-				hfsvolent volent;
-				hfs_vstat(NULL, &volent);
-				volent.blessed = ent.parid;
-				hfs_vsetattr(NULL, &volent);
-			}
-		}
+		finderinfo_set(&ent, value);
+		// bless parent folder if it's a system file
+		bless_system_folder(&ent);
 		// update file
 		hfs_setattr(NULL, hfspath, &ent);
-		free(hfspath);
+		attr_forget(path);
 		return 0;
 	} else if (strcmp(name, XATTR_RESOURCEFORK_NAME) == 0 && (!(ent.flags & HFS_ISDIR))) {
 		// resource fork
-		// TODO: how are resource forks truncated?
-		hfsfile *fp = hfs_open(NULL, hfspath);
-		hfs_setfork(fp, 1);
-		hfs_seek(fp, position, SEEK_SET);
-		hfs_write(fp, value, size);
-		hfs_close(fp);
+		hfsfile *fp = rsrc_get(ent.cnid);
+		if (fp == NULL) fp = rsrc_keep(ent.cnid, hfs_open(NULL, hfspath));
+		if (fp == NULL) return -errno;
+		int err = hfs_pwrite(fp, 1, value, size, position) == (unsigned long)-1 ? errno : 0;
+		// a write from the start replaces the fork, later chunks extend it
+		if (!err && position == 0 && rsrc_truncate(fp, size) == -1) err = errno;
+		rsrc_put(fp);
+		attr_forget(path);
 		// the end
-		free(hfspath);
-		return 0;
+		return -err;
 	} else {
-		free(hfspath);
 		return 0;
 	}
 	
-	free(hfspath);
 	return -ENOATTR;
 	
 }
@@ -792,32 +1744,29 @@ static int FuseHFS_removexattr(const char *path, const char *name) {
 	if (_readonly) return -EPERM;
 	
 	// convert to hfs path
-	char *hfspath = mkhfspath(path);
-	if (hfspath == NULL) return -ENOENT;
+	char hfspath[HFSPATH_MAX];
+	if (mkhfspath(path, hfspath, sizeof hfspath) == NULL) return -ENOENT;
 	
 	// find file
 	hfsdirent ent;
-	if (hfs_stat(NULL, hfspath, &ent) == -1) {
-		free(hfspath);
+	if (stat_path(path, &ent) == -1) {
 		return -ENOENT;
 	}
 	
 	if (strcmp(name, XATTR_FINDERINFO_NAME) == 0) {
-		free(hfspath);
 		// not really removing it
 		return 0;
 	} else if (strcmp(name, XATTR_RESOURCEFORK_NAME) == 0 && (!(ent.flags & HFS_ISDIR))) {
 		// resource fork
-		hfsfile *fp = hfs_open(NULL, hfspath);
-		hfs_setfork(fp, 1);
-		hfs_seek(fp, 0, SEEK_SET);
-		hfs_truncate(fp, 0);
-		hfs_close(fp);
-		free(hfspath);
-		return 0;
+		hfsfile *fp = rsrc_get(ent.cnid);
+		if (fp == NULL) fp = rsrc_keep(ent.cnid, hfs_open(NULL, hfspath));
+		if (fp == NULL) return -errno;
+		int err = rsrc_truncate(fp, 0) == -1 ? errno : 0;
+		rsrc_put(fp);
+		attr_forget(path);
+		return -err;
 	}
 	
-	free(hfspath);
 	return -ENOATTR;	
 }
 
@@ -826,17 +1775,15 @@ static int FuseHFS_chmod (const char *path, mode_t newmod) {
 	if (_readonly) return -EPERM;
 	
 	// convert to hfs path
-	char *hfspath = mkhfspath(path);
-	if (hfspath == NULL) return -ENOENT;
+	char hfspath[HFSPATH_MAX];
+	if (mkhfspath(path, hfspath, sizeof hfspath) == NULL) return -ENOENT;
 	
 	// check that file exists
 	hfsdirent ent;
 	if (hfs_stat(NULL, hfspath, &ent) == -1) {
-		free(hfspath);
 		return -ENOENT;
 	}
 	
-	free(hfspath);
 	return 0;
 }
 
@@ -845,50 +1792,60 @@ static int FuseHFS_chown (const char *path, uid_t newuid, gid_t newgid) {
 	if (_readonly) return -EPERM;
 	
 	// convert to hfs path
-	char *hfspath = mkhfspath(path);
-	if (hfspath == NULL) return -ENOENT;
+	char hfspath[HFSPATH_MAX];
+	if (mkhfspath(path, hfspath, sizeof hfspath) == NULL) return -ENOENT;
 	
 	// check that file exists
 	hfsdirent ent;
 	if (hfs_stat(NULL, hfspath, &ent) == -1) {
-		free(hfspath);
 		perror("chown");
 		return -errno;
 	}
 	
-	free(hfspath);
 	return 0;
 }
 
 static int FuseHFS_ftruncate (const char *path, off_t length, struct fuse_file_info *fi) {
 	dprintf("ftruncate %s %lu\n", path, length);
+	if (ctl_path(path)) return 0;
 	if (_readonly) return -EPERM;
 	
 	hfsfile *file = (hfsfile*)fi->fh;
-	if (hfs_truncate(file, length) == -1) {
+	pthread_mutex_lock(&_fork_lock);
+	hfs_setfork(file, 0);
+	int err = hfs_truncate(file, length) == -1 ? errno : 0;
+	pthread_mutex_unlock(&_fork_lock);
+	attr_update(file);
+	if (err) {
 		perror("truncate");
-		return -errno;
+		return -err;
 	}
 	return 0;
 }
 
 static int FuseHFS_truncate (const char *path, off_t length) {
 	dprintf("truncate %s %lu\n", path, length);
+	if (ctl_path(path)) return 0;
 	if (_readonly) return -EPERM;
 	
 	// convert to hfs path
-	char *hfspath = mkhfspath(path);
-	if (hfspath == NULL) return -ENOENT;
+	char hfspath[HFSPATH_MAX];
+	if (mkhfspath(path, hfspath, sizeof hfspath) == NULL) return -ENOENT;
 	
+	pthread_mutex_lock(&_fork_lock);
 	hfsfile *file = hfs_open(NULL, hfspath);
-	free(hfspath);
-	if (file == NULL) return -errno;
-	if (hfs_truncate(file, length) == -1) {
+	int err = file == NULL ? errno : 0;
+	if (file) {
+		hfs_setfork(file, 0);
+		if (hfs_truncate(file, length) == -1) err = errno;
 		hfs_close(file);
+	}
+	pthread_mutex_unlock(&_fork_lock);
+	attr_forget(path);
+	if (err) {
 		perror("truncate");
-		return -errno;
-	}    
-	hfs_close(file);
+		return -err;
+	}
 	return 0;
 }
 
@@ -904,16 +1861,14 @@ static int FuseHFS_setvolname (const char *name) {
 	if (_readonly) return -EPERM;
 	
 	// convert to hfs
-	char *hfsname = utf8_to_hfs(name);
-	if (strlen(hfsname) > HFS_MAX_VLEN) {
-		free(hfsname);
-		return -E2BIG;
-	}
+	char hfsname[HFS_MAX_VLEN+1];
+	if (utf8_to_hfs(name, hfsname, sizeof hfsname) == NULL) return -E2BIG;
 	
 	// rename volume
 	if (hfs_rename(NULL, _volname, hfsname)) return -EPERM;
 	// update
-	strcpy(hfsname, _volname);
+	strcpy(_volname, hfsname);
+	attr_forget_all();
 	return 0;
 }
 
@@ -921,24 +1876,18 @@ static int FuseHFS_getxtimes(const char *path, struct timespec *bkuptime,
                    struct timespec *crtime) {
 	dprintf("getxtimes %s\n", path);
 	
-	// convert to hfs path
-	char *hfspath = mkhfspath(path);
-	if (hfspath == NULL) return -ENOENT;
-	
 	// get file info
 	hfsdirent ent;
 	
-	if (hfs_stat(NULL, hfspath, &ent) == 0) {
+	if (stat_path(path, &ent) == 0) {
 		// file
 		crtime->tv_sec = ent.crdate;
 		crtime->tv_nsec = 0;
 		bkuptime->tv_sec = ent.bkdate;
 		bkuptime->tv_nsec = 0;
-		free(hfspath);
 		return 0;
 	}
 	
-	free(hfspath);
 	perror("getxtimes:hfs_stat");
 	return -errno;
 }
@@ -948,8 +1897,8 @@ static int FuseHFS_setbkuptime (const char *path, const struct timespec *tv) {
 	if (_readonly) return -EPERM;
 	
 	// convert to hfs path
-	char *hfspath = mkhfspath(path);
-	if (hfspath == NULL) return -ENOENT;
+	char hfspath[HFSPATH_MAX];
+	if (mkhfspath(path, hfspath, sizeof hfspath) == NULL) return -ENOENT;
 	int err;
 	
 	// get file info
@@ -958,13 +1907,12 @@ static int FuseHFS_setbkuptime (const char *path, const struct timespec *tv) {
 	if (hfs_stat(NULL, hfspath, &ent) == 0) {
 		ent.bkdate = tv->tv_sec;
 		err = hfs_setattr(NULL, hfspath, &ent);
-		free(hfspath);
+		attr_forget(path);
 		if (!err) return 0;
 		perror("hfs_setattr");
 		return -errno;
 	}
 	
-	free(hfspath);
 	perror("hfs_stat");
 	return -errno;
 }
@@ -974,8 +1922,8 @@ static int FuseHFS_setchgtime (const char *path, const struct timespec *tv) {
 	if (_readonly) return -EPERM;
 	
 	// convert to hfs path
-	char *hfspath = mkhfspath(path);
-	if (hfspath == NULL) return -ENOENT;
+	char hfspath[HFSPATH_MAX];
+	if (mkhfspath(path, hfspath, sizeof hfspath) == NULL) return -ENOENT;
 	int err;
 	
 	// get file info
@@ -984,13 +1932,12 @@ static int FuseHFS_setchgtime (const char *path, const struct timespec *tv) {
 	if (hfs_stat(NULL, hfspath, &ent) == 0) {
 		ent.mddate = tv->tv_sec;
 		err = hfs_setattr(NULL, hfspath, &ent);
-		free(hfspath);
+		attr_forget(path);
 		if (!err) return 0;
 		perror("hfs_setattr");
 		return -errno;
 	}
 	
-	free(hfspath);
 	perror("hfs_stat");
 	return -errno;
 }
@@ -1000,8 +1947,8 @@ static int FuseHFS_setcrtime (const char *path, const struct timespec *tv) {
 	if (_readonly) return -EPERM;
 	
 	// convert to hfs path
-	char *hfspath = mkhfspath(path);
-	if (hfspath == NULL) return -ENOENT;
+	char hfspath[HFSPATH_MAX];
+	if (mkhfspath(path, hfspath, sizeof hfspath) == NULL) return -ENOENT;
 	int err;
 	
 	// get file info
@@ -1010,52 +1957,116 @@ static int FuseHFS_setcrtime (const char *path, const struct timespec *tv) {
 	if (hfs_stat(NULL, hfspath, &ent) == 0) {
 		ent.crdate = tv->tv_sec;
 		err = hfs_setattr(NULL, hfspath, &ent);
-		free(hfspath);
+		attr_forget(path);
 		if (!err) return 0;
 		perror("hfs_setattr");
 		return -errno;
 	}
 	
-	free(hfspath);
 	perror("hfs_stat");
 	return -errno;
 }
 
 #endif
+
+#pragma mark Timing
+
+// each callback is wrapped to feed its latency and outcome to stats.c and the
+// tracepoints; the start probe carries the first argument, the path in all but setvolname
+#define FIRST(first, rest...) first
+#define TIMED(op, params, args) \
+static int timed_##op params { \
+	FUSEHFS_TRACE(op##__start, OP_##op, FIRST args); \
+	uint64_t start = stats_now(); \
+	int ret = FuseHFS_##op args; \
+	stats_record(OP_##op, start, ret < 0); \
+	FUSEHFS_TRACE(op##__done, OP_##op, ret); \
+	return ret; \
+}
+#define OP_statfs_x OP_statfs
+
+TIMED(getattr, (const char *path, struct stat *stbuf), (path, stbuf))
+TIMED(fgetattr, (const char *path, struct stat *stbuf, struct fuse_file_info *fi), (path, stbuf, fi))
+TIMED(opendir, (const char *path, struct fuse_file_info *fi), (path, fi))
+TIMED(readdir, (const char *path, void *buf, fuse_fill_dir_t filler, off_t offset,
+				struct fuse_file_info *fi), (path, buf, filler, offset, fi))
+TIMED(releasedir, (const char *path, struct fuse_file_info *fi), (path, fi))
+TIMED(mknod, (const char *path, mode_t mode, dev_t rdev), (path, mode, rdev))
+TIMED(mkdir, (const char *path, mode_t mode), (path, mode))
+TIMED(unlink, (const char *path), (path))
+TIMED(rmdir, (const char *path), (path))
+TIMED(rename, (const char *from, const char *to), (from, to))
+TIMED(create, (const char *path, mode_t mode, struct fuse_file_info *fi), (path, mode, fi))
+TIMED(open, (const char *path, struct fuse_file_info *fi), (path, fi))
+TIMED(read, (const char *path, char *buf, size_t size, off_t offset,
+			 struct fuse_file_info *fi), (path, buf, size, offset, fi))
+TIMED(write, (const char *path, const char *buf, size_t size, off_t offset,
+			  struct fuse_file_info *fi), (path, buf, size, offset, fi))
+TIMED(read_buf, (const char *path, struct fuse_bufvec **bufp, size_t size, off_t offset,
+				 struct fuse_file_info *fi), (path, bufp, size, offset, fi))
+TIMED(write_buf, (const char *path, struct fuse_bufvec *buf, off_t offset,
+				  struct fuse_file_info *fi), (path, buf, offset, fi))
+TIMED(statfs, (const char *path, struct statvfs *stbuf), (path, stbuf))
+TIMED(statfs_x, (const char *path, struct statfs *stbuf), (path, stbuf))
+TIMED(release, (const char *path, struct fuse_file_info *fi), (path, fi))
+TIMED(listxattr, (const char *path, char *list, size_t size), (path, list, size))
+TIMED(getxattr, (const char *path, const char *name, char *value, size_t size,
+				 uint32_t position), (path, name, value, size, position))
+TIMED(setxattr, (const char *path, const char *name, const char *value, size_t size,
+				 int flags, uint32_t position), (path, name, value, size, flags, position))
+TIMED(removexattr, (const char *path, const char *name), (path, name))
+TIMED(truncate, (const char *path, off_t length), (path, length))
+TIMED(ftruncate, (const char *path, off_t length, struct fuse_file_info *fi), (path, length, fi))
+TIMED(chmod, (const char *path, mode_t newmod), (path, newmod))
+TIMED(chown, (const char *path, uid_t newuid, gid_t newgid), (path, newuid, newgid))
+TIMED(utimens, (const char *path, const struct timespec tv[2]), (path, tv))
+#if (__FreeBSD__ >= 10)
+TIMED(setvolname, (const char *name), (name))
+TIMED(getxtimes, (const char *path, struct timespec *bkuptime, struct timespec *crtime),
+	  (path, bkuptime, crtime))
+TIMED(setcrtime, (const char *path, const struct timespec *tv), (path, tv))
+TIMED(setchgtime, (const char *path, const struct timespec *tv), (path, tv))
+TIMED(setbkuptime, (const char *path, const struct timespec *tv), (path, tv))
+#endif
+
 struct fuse_operations FuseHFS_operations = {
 	.init        = FuseHFS_init,
 	.destroy     = FuseHFS_destroy,
-	.getattr     = FuseHFS_getattr,
-	.fgetattr    = FuseHFS_fgetattr,
-	.readdir     = FuseHFS_readdir,
-	.mknod       = FuseHFS_mknod,
-	.mkdir       = FuseHFS_mkdir,
-	.unlink      = FuseHFS_unlink,
-	.rmdir       = FuseHFS_rmdir,
-	.rename      = FuseHFS_rename,
-	.create      = FuseHFS_create,
-	.open        = FuseHFS_open,
-	.read        = FuseHFS_read,
-	.write       = FuseHFS_write,
-	.statfs      = FuseHFS_statfs,
-    .statfs_x    = FuseHFS_statfs_x,
+	.getattr     = timed_getattr,
+	.fgetattr    = timed_fgetattr,
+	.opendir     = timed_opendir,
+	.readdir     = timed_readdir,
+	.releasedir  = timed_releasedir,
+	.mknod       = timed_mknod,
+	.mkdir       = timed_mkdir,
+	.unlink      = timed_unlink,
+	.rmdir       = timed_rmdir,
+	.rename      = timed_rename,
+	.create      = timed_create,
+	.open        = timed_open,
+	.read        = timed_read,
+	.write       = timed_write,
+	.read_buf    = timed_read_buf,
+	.write_buf   = timed_write_buf,
+	.statfs      = timed_statfs,
+    .statfs_x    = timed_statfs_x,
 	//.flush       = FuseHFS_flush,
-	.release     = FuseHFS_release,
+	.release     = timed_release,
 	//.fsync       = FuseHFS_fsync,
-	.listxattr   = FuseHFS_listxattr,
-	.getxattr    = FuseHFS_getxattr,
-	.setxattr    = FuseHFS_setxattr,
-	.removexattr = FuseHFS_removexattr,
-	.truncate    = FuseHFS_truncate,
-	.ftruncate   = FuseHFS_ftruncate,
-	.chmod		 = FuseHFS_chmod,
-	.chown       = FuseHFS_chown,
-	.utimens     = FuseHFS_utimens,
+	.listxattr   = timed_listxattr,
+	.getxattr    = timed_getxattr,
+	.setxattr    = timed_setxattr,
+	.removexattr = timed_removexattr,
+	.truncate    = timed_truncate,
+	.ftruncate   = timed_ftruncate,
+	.chmod		 = timed_chmod,
+	.chown       = timed_chown,
+	.utimens     = timed_utimens,
 #if (__FreeBSD__ >= 10)
-	.setvolname  = FuseHFS_setvolname,
-	.getxtimes   = FuseHFS_getxtimes,
-	.setcrtime   = FuseHFS_setcrtime,
-	.setchgtime  = FuseHFS_setchgtime,
-	.setbkuptime = FuseHFS_setbkuptime,
+	.setvolname  = timed_setvolname,
+	.getxtimes   = timed_getxtimes,
+	.setcrtime   = timed_setcrtime,
+	.setchgtime  = timed_setchgtime,
+	.setbkuptime = timed_setbkuptime,
 #endif
 };
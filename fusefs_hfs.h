@@ -10,9 +10,81 @@
 
 #define MAX_FILE_SIZE 0x7FFFFFFF
 
+// largest read or write the kernel is asked to send (macFUSE's iosize)
+#define FUSEHFS_IOSIZE 1048576
+#define FUSEHFS_IOSIZE_STR "1048576"
+
+// how long the kernel may keep attributes and lookups; every change goes through
+// us and invalidates our own caches, so only other mounts of the image could go stale
+#define ATTR_TIMEOUT  5.0
+#define ENTRY_TIMEOUT 5.0
+#define ATTR_TIMEOUT_STR  "5"
+#define ENTRY_TIMEOUT_STR "5"
+
+// --reject without a list: AppleDouble files and the folders Spotlight,
+// the Trash and fseventsd keep at the root of every volume they touch
+#define FUSEHFS_REJECT_DEFAULT "._*,.DS_Store,.Spotlight-V100,.Trashes,.fseventsd," \
+	".TemporaryItems,.metadata_never_index,.metadata_never_index_unless_rootfs"
+
+// the hidden control directory and its files, see fusefs_hfs.c
+#define CTL_NAME ".fusehfs"
+enum { CTL_NONE, CTL_DIR, CTL_STATS, CTL_CTL, CTL_COUNT };
+// inode numbers past any 32-bit catalog node ID
+#define CTL_INO(node) (0x100000000ULL + (node))
+
+// volume name plus a converted path; conversion never makes a path longer
+#define HFSPATH_MAX (HFS_MAX_VLEN + PATH_MAX)
+
 struct fusehfs_options {
     char    *path;
     char	*encoding;
 	char	*mountpoint;
 	int		readonly;
+	int		highlevel;
+	char	*reject;
 };
+
+// shared by the high-level (fusefs_hfs.c) and low-level (fusefs_hfs_ll.c) frontends
+extern char _volname[];
+extern int _readonly;
+extern pthread_mutex_t _fork_lock;
+
+char * hfs_to_utf8 (const char * in, char * out, size_t outlen);
+char * utf8_to_hfs (const char * in, char * out, size_t outlen);
+char * mkhfspath(const char *in, char *out, size_t outlen);
+
+int dirent_to_stbuf(const hfsdirent *ent, struct stat *stbuf);
+void finderinfo_get(const hfsdirent *ent, char *value);
+void finderinfo_set(hfsdirent *ent, const char *value);
+void bless_system_folder(const hfsdirent *ent);
+unsigned long power_of_2_factor(unsigned long blocksize);
+void reject_init(const char *patterns);
+int rejected(const char *path);
+
+struct fuse_bufvec * fork_bufvec(hfsfile *file, int fork, size_t size, off_t offset);
+struct fuse_bufvec * memory_bufvec(hfsfile *file, int fork, size_t size, off_t offset);
+struct fuse_bufvec * fork_copy(hfsfile *file, int fork, size_t size, off_t offset);
+void bufvec_release(hfsfile *file, struct fuse_bufvec *bv);
+void bufvec_free(struct fuse_bufvec *bv);
+ssize_t bufvec_write(hfsfile *file, struct fuse_bufvec *buf, off_t offset);
+
+hfsfile * rsrc_get(unsigned long cnid);
+hfsfile * rsrc_keep(unsigned long cnid, hfsfile *file);
+void rsrc_put(hfsfile *file);
+void rsrc_forget_all(void);
+int rsrc_truncate(hfsfile *file, unsigned long length);
+
+int ctl_lookup(int dir, const char *name);
+int ctl_path(const char *path);
+const char * ctl_name(int node);
+void ctl_stbuf(int node, struct stat *stbuf);
+int ctl_open(int node, struct fuse_file_info *fi, uid_t uid);
+int ctl_read(struct fuse_file_info *fi, char *buf, size_t size, off_t offset);
+int ctl_write(const char *buf, size_t size);
+void ctl_release(struct fuse_file_info *fi);
+
+void fusehfs_conn(struct fuse_conn_info *conn);
+void fusehfs_mount(struct fusehfs_options *options);
+void fusehfs_unmount(void);
+
+int FuseHFS_ll_main(struct fuse_args *args, struct fusehfs_options *options);
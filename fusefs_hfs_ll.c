@@ -0,0 +1,1202 @@
+/*
+ * fusefs_hfs_ll.c
+ * FuseHFS
+ *
+ * The low-level FUSE frontend. macFUSE hands us inode numbers instead of
+ * paths, and we use the HFS catalog node ID as the inode number. The kernel
+ * looks names up one directory at a time, so every inode it knows about
+ * was introduced by a lookup of (parent CNID, name), which we remember
+ * until it forgets the inode again. getattr, open, read and the xattr ops
+ * go straight to the catalog record with that key; no path is converted
+ * or resolved from the volume root. Whatever the key finds is checked against
+ * the inode's CNID, so once its file is deleted or renamed over, the inode
+ * answers ESTALE instead of standing for whatever now has that name.
+ *
+ * Operations that change the namespace (create, mkdir, unlink, rmdir,
+ * rename) still go through the path-based libhfs calls, with the path
+ * built from the parent directory's thread records.
+ *
+ * The path-based high-level frontend in fusefs_hfs.c is used instead when
+ * mounting with --highlevel.
+ *
+ * Licensed under GPLv2: https://www.gnu.org/licenses/gpl-2.0.html
+ */
+#include "common.h"
+
+#include <fuse/fuse_lowlevel.h>
+#include <string.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <libhfs/hfs.h>
+#include <libhfs/apple.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/xattr.h>
+
+#include "fusefs_hfs.h"
+#include "log.h"
+#include "stats.h"
+
+#define FILENAME "[fusefs_hfs_ll.c]\t"
+
+// compiled in always; log_level (--loglevel, or "loglevel" in /.fusehfs/ctl) decides
+#define dprintf(args...) log_debug(args)
+
+#pragma mark Inode table
+
+// where the catalog record for an inode the kernel knows about lives
+typedef struct llnode {
+	struct llnode *next;
+	unsigned long cnid;
+	unsigned long parid;
+	char name[HFS_MAX_FLEN+1];
+	uint64_t nlookup;
+	int stale;	// the file was deleted or replaced, and (parid, name) may be another's
+} llnode;
+
+#define NODE_HASHSZ 1024
+static llnode *_nodes[NODE_HASHSZ];
+// requests run on several threads, so nodes are only touched with this held
+static pthread_mutex_t _nodes_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// the kernel's root inode is 1, which HFS uses for the root's parent
+static inline unsigned long ino_to_cnid(fuse_ino_t ino) {
+	return ino == FUSE_ROOT_ID ? HFS_CNID_ROOTDIR : ino;
+}
+
+static inline fuse_ino_t cnid_to_ino(unsigned long cnid) {
+	return cnid == HFS_CNID_ROOTDIR ? FUSE_ROOT_ID : cnid;
+}
+
+// with _nodes_lock held
+static llnode *node_find(unsigned long cnid) {
+	llnode *node;
+	for (node = _nodes[cnid % NODE_HASHSZ]; node; node = node->next) {
+		if (node->cnid == cnid) return node;
+	}
+	return NULL;
+}
+
+// record a lookup of cnid as (parid, name)
+static int node_lookup(unsigned long cnid, unsigned long parid, const char *name) {
+	pthread_mutex_lock(&_nodes_lock);
+	llnode *node = node_find(cnid);
+	if (node == NULL) {
+		node = calloc(1, sizeof(llnode));
+		if (node == NULL) {
+			pthread_mutex_unlock(&_nodes_lock);
+			return -1;
+		}
+		node->cnid = cnid;
+		node->next = _nodes[cnid % NODE_HASHSZ];
+		_nodes[cnid % NODE_HASHSZ] = node;
+	}
+	node->parid = parid;
+	strcpy(node->name, name);
+	node->nlookup++;
+	node->stale = 0;
+	pthread_mutex_unlock(&_nodes_lock);
+	return 0;
+}
+
+// an unlink or a rename over it took cnid out of the catalog, but the kernel
+// keeps the inode until it forgets it
+static void node_stale(unsigned long cnid) {
+	pthread_mutex_lock(&_nodes_lock);
+	llnode *node = node_find(cnid);
+	if (node) node->stale = 1;
+	pthread_mutex_unlock(&_nodes_lock);
+}
+
+// a rename moves an inode in the catalog without the kernel looking it up again
+static void node_move(unsigned long cnid, unsigned long parid, const char *name) {
+	pthread_mutex_lock(&_nodes_lock);
+	llnode *node = node_find(cnid);
+	if (node) {
+		node->parid = parid;
+		strcpy(node->name, name);
+	}
+	pthread_mutex_unlock(&_nodes_lock);
+}
+
+static void node_forget(unsigned long cnid, uint64_t nlookup) {
+	llnode **prev, *node;
+	pthread_mutex_lock(&_nodes_lock);
+	for (prev = &_nodes[cnid % NODE_HASHSZ]; (node = *prev); prev = &node->next) {
+		if (node->cnid != cnid) continue;
+		node->nlookup -= nlookup < node->nlookup ? nlookup : node->nlookup;
+		// the root is never forgotten
+		if (node->nlookup || cnid == HFS_CNID_ROOTDIR) break;
+		*prev = node->next;
+		free(node);
+		break;
+	}
+	pthread_mutex_unlock(&_nodes_lock);
+}
+
+static void node_forget_all(void) {
+	int i;
+	pthread_mutex_lock(&_nodes_lock);
+	for (i = 0; i < NODE_HASHSZ; i++) {
+		while (_nodes[i]) {
+			llnode *node = _nodes[i];
+			_nodes[i] = node->next;
+			free(node);
+		}
+	}
+	pthread_mutex_unlock(&_nodes_lock);
+}
+
+// copy out an inode's node, which a forget may free as soon as the lock is
+// dropped, setting errno if the kernel never looked it up
+static int node_get(fuse_ino_t ino, llnode *copy) {
+	pthread_mutex_lock(&_nodes_lock);
+	llnode *node = node_find(ino_to_cnid(ino));
+	if (node) *copy = *node;
+	pthread_mutex_unlock(&_nodes_lock);
+	if (node == NULL || copy->stale) {
+		errno = ESTALE;
+		return -1;
+	}
+	return 0;
+}
+
+// look a node's record up by its key, making sure it is still the same file
+static int node_statat(const llnode *node, hfsdirent *ent) {
+	if (hfs_statat(NULL, node->parid, node->name, ent) == -1) return -1;
+	if (ent->cnid != node->cnid) {
+		errno = ESTALE;
+		return -1;
+	}
+	return 0;
+}
+
+static hfsfile *node_openat(const llnode *node) {
+	hfsfile *file = hfs_openat(NULL, node->parid, node->name);
+	hfsdirent ent;
+	if (file == NULL) return NULL;
+	hfs_fstat(file, &ent);
+	if (ent.cnid != node->cnid) {
+		hfs_close(file);
+		errno = ESTALE;
+		return NULL;
+	}
+	return file;
+}
+
+static int node_stat(fuse_ino_t ino, hfsdirent *ent) {
+	llnode node;
+	if (node_get(ino, &node) == -1) return -1;
+	return node_statat(&node, ent);
+}
+
+#pragma mark Helpers
+
+// convert a name from the kernel, setting errno if it can't be an HFS name
+static char *ll_name(const char *name, char *out) {
+	if (utf8_to_hfs(name, out, HFS_MAX_FLEN+1) == NULL) {
+		errno = ENAMETOOLONG;
+		return NULL;
+	}
+	return out;
+}
+
+// build the absolute HFS path of a directory from its thread records
+static size_t ll_dirpath(unsigned long dirid, char *buf, size_t len) {
+	char name[HFS_MAX_FLEN+1];
+	unsigned long parid = dirid;
+	size_t n = 0;
+	if (hfs_dirinfo(NULL, &parid, name) == -1) return (size_t)-1;
+	if (parid != HFS_CNID_ROOTPAR) {
+		n = ll_dirpath(parid, buf, len);
+		if (n == (size_t)-1) return n;
+	}
+	if (n + strlen(name) + 2 > len) {
+		errno = ENAMETOOLONG;
+		return (size_t)-1;
+	}
+	n += sprintf(buf + n, "%s:", name);
+	return n;
+}
+
+static char *ll_path(unsigned long dirid, const char *name, char *buf, size_t len) {
+	size_t n = ll_dirpath(dirid, buf, len);
+	if (n == (size_t)-1) return NULL;
+	if (n + strlen(name) + 1 > len) {
+		errno = ENAMETOOLONG;
+		return NULL;
+	}
+	strcpy(buf + n, name);
+	return buf;
+}
+
+// every error reply goes through here so the request is counted as failed
+static int ll_reply_err(fuse_req_t req, int err) {
+	if (err) stats_error();
+	return fuse_reply_err(req, err);
+}
+
+static void ll_stbuf(const hfsdirent *ent, struct stat *stbuf) {
+	dirent_to_stbuf(ent, stbuf);
+	stbuf->st_ino = cnid_to_ino(ent->cnid);
+}
+
+// the control file an inode stands for, if any
+static int ll_ctl(fuse_ino_t ino) {
+	return ino > CTL_INO(CTL_NONE) && ino < CTL_INO(CTL_COUNT) ? (int)(ino - CTL_INO(CTL_NONE)) : CTL_NONE;
+}
+
+// true if name in parent would hide or land among the control files
+static int ll_shadows(fuse_ino_t parent, const char *name) {
+	return ll_ctl(parent) != CTL_NONE ||
+		(parent == FUSE_ROOT_ID && ctl_lookup(CTL_NONE, name) != CTL_NONE);
+}
+
+// answer a lookup-like request, which counts as a lookup of the entry
+static void ll_reply_entry(fuse_req_t req, const hfsdirent *ent, struct fuse_file_info *fi) {
+	struct fuse_entry_param e;
+	memset(&e, 0, sizeof e);
+	if (node_lookup(ent->cnid, ent->parid, ent->name) == -1) {
+		ll_reply_err(req, ENOMEM);
+		return;
+	}
+	e.ino = cnid_to_ino(ent->cnid);
+	e.attr_timeout = ATTR_TIMEOUT;
+	e.entry_timeout = ENTRY_TIMEOUT;
+	ll_stbuf(ent, &e.attr);
+	if (fi) fuse_reply_create(req, &e, fi);
+	else fuse_reply_entry(req, &e);
+}
+
+#pragma mark FUSE Callbacks
+
+static void FuseHFS_ll_init(void *userdata, struct fuse_conn_info *conn) {
+	struct fusehfs_options *options = userdata;
+
+	log_to_file();
+
+	dprintf("FuseHFS_ll_init\n");
+	fflush(stderr);
+
+	fusehfs_conn(conn);
+	fusehfs_mount(options);
+
+	// the root directory is keyed by its name in the root's parent
+	node_lookup(HFS_CNID_ROOTDIR, HFS_CNID_ROOTPAR, _volname);
+}
+
+static void FuseHFS_ll_destroy(void *userdata) {
+	dprintf("FuseHFS_ll_destroy\n");
+	node_forget_all();
+	fusehfs_unmount();
+}
+
+static void FuseHFS_ll_lookup(fuse_req_t req, fuse_ino_t parent, const char *name) {
+	dprintf("lookup %lu %s\n", parent, name);
+	char hfsname[HFS_MAX_FLEN+1];
+	hfsdirent ent;
+
+	if (rejected(name)) {
+		// a negative entry, which the kernel remembers for ENTRY_TIMEOUT
+		struct fuse_entry_param e = { .ino = 0, .entry_timeout = ENTRY_TIMEOUT };
+		fuse_reply_entry(req, &e);
+		return;
+	}
+	if (ll_shadows(parent, name)) {
+		int ctl = ctl_lookup(parent == FUSE_ROOT_ID ? CTL_NONE : ll_ctl(parent), name);
+		struct fuse_entry_param e;
+		if (ctl == CTL_NONE) {
+			ll_reply_err(req, ENOENT);
+			return;
+		}
+		memset(&e, 0, sizeof e);
+		e.ino = CTL_INO(ctl);
+		e.attr_timeout = ATTR_TIMEOUT;
+		e.entry_timeout = ENTRY_TIMEOUT;
+		ctl_stbuf(ctl, &e.attr);
+		fuse_reply_entry(req, &e);
+		return;
+	}
+	if (ll_name(name, hfsname) == NULL ||
+		hfs_statat(NULL, ino_to_cnid(parent), hfsname, &ent) == -1) {
+		ll_reply_err(req, errno);
+		return;
+	}
+	ll_reply_entry(req, &ent, NULL);
+}
+
+static void FuseHFS_ll_forget(fuse_req_t req, fuse_ino_t ino, unsigned long nlookup) {
+	node_forget(ino_to_cnid(ino), nlookup);
+	fuse_reply_none(req);
+}
+
+static void FuseHFS_ll_getattr(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi) {
+	hfsdirent ent;
+	struct stat stbuf;
+
+	if (ll_ctl(ino)) {
+		ctl_stbuf(ll_ctl(ino), &stbuf);
+		fuse_reply_attr(req, &stbuf, ATTR_TIMEOUT);
+		return;
+	}
+	if (fi && fi->fh) {
+		// open file
+		hfs_fstat((hfsfile*)fi->fh, &ent);
+	} else if (node_stat(ino, &ent) == -1) {
+		dprintf("getattr: %lu %s\n", ino, strerror(errno));
+		ll_reply_err(req, errno);
+		return;
+	}
+	ll_stbuf(&ent, &stbuf);
+	fuse_reply_attr(req, &stbuf, ATTR_TIMEOUT);
+}
+
+// The size, and the creation, change and backup times, which like the
+// high-level frontend's setcrtime, setchgtime and setbkuptime go to the
+// catalog's creation, modification and backup dates. Anything else is ignored,
+// as the high-level frontend ignores chmod, chown and utimens.
+static void ll_setattr(fuse_req_t req, fuse_ino_t ino, int to_set, off_t size,
+					   const struct timespec *crtime, const struct timespec *chgtime,
+					   const struct timespec *bkuptime, struct fuse_file_info *fi) {
+	llnode node;
+	hfsdirent ent;
+	struct stat stbuf;
+
+	// nothing about a control file can change, but truncating ctl before a write is fine
+	if (ll_ctl(ino)) {
+		ctl_stbuf(ll_ctl(ino), &stbuf);
+		fuse_reply_attr(req, &stbuf, ATTR_TIMEOUT);
+		return;
+	}
+	if (node_get(ino, &node) == -1) {
+		ll_reply_err(req, errno);
+		return;
+	}
+
+	if (_readonly && ((to_set & FUSE_SET_ATTR_SIZE) || crtime || chgtime || bkuptime)) {
+		ll_reply_err(req, EPERM);
+		return;
+	}
+	if (to_set & FUSE_SET_ATTR_SIZE) {
+		pthread_mutex_lock(&_fork_lock);
+		hfsfile *file = fi ? (hfsfile*)fi->fh : node_openat(&node);
+		int err = file == NULL ? errno : 0;
+		if (file) {
+			hfs_setfork(file, 0);
+			if (hfs_truncate(file, size) == -1) err = errno;
+			if (!fi) hfs_close(file);
+		}
+		pthread_mutex_unlock(&_fork_lock);
+		if (err) {
+			ll_reply_err(req, err);
+			return;
+		}
+	}
+
+	if (node_statat(&node, &ent) == -1) {
+		ll_reply_err(req, errno);
+		return;
+	}
+	if (crtime || chgtime || bkuptime) {
+		if (crtime) ent.crdate = crtime->tv_sec;
+		if (chgtime) ent.mddate = chgtime->tv_sec;
+		if (bkuptime) ent.bkdate = bkuptime->tv_sec;
+		if (hfs_setattrat(NULL, node.parid, node.name, &ent) == -1) {
+			ll_reply_err(req, errno);
+			return;
+		}
+	}
+	ll_stbuf(&ent, &stbuf);
+	fuse_reply_attr(req, &stbuf, ATTR_TIMEOUT);
+}
+
+static void FuseHFS_ll_setattr(fuse_req_t req, fuse_ino_t ino, struct stat *attr,
+							   int to_set, struct fuse_file_info *fi) {
+	dprintf("setattr %lu %x\n", ino, to_set);
+	ll_setattr(req, ino, to_set, attr->st_size, NULL, NULL, NULL, fi);
+}
+
+#if (__FreeBSD__ >= 10)
+
+// macFUSE's setattr, which also carries the times that only Mac OS has
+static void FuseHFS_ll_setattr_x(fuse_req_t req, fuse_ino_t ino, struct setattr_x *attr,
+								 int to_set, struct fuse_file_info *fi) {
+	dprintf("setattr_x %lu %x\n", ino, attr->valid);
+	ll_setattr(req, ino, SETATTR_WANTS_SIZE(attr) ? FUSE_SET_ATTR_SIZE : 0, attr->size,
+			   SETATTR_WANTS_CRTIME(attr) ? &attr->crtime : NULL,
+			   SETATTR_WANTS_CHGTIME(attr) ? &attr->chgtime : NULL,
+			   SETATTR_WANTS_BKUPTIME(attr) ? &attr->bkuptime : NULL, fi);
+}
+
+#endif
+
+// an open directory, which keeps its place between readdir calls
+typedef struct lldir {
+	hfsdir *dir;
+	unsigned long cnid;
+	unsigned long parid;
+	off_t pos;          // entries returned so far, counting . and ..
+	int pending;        // ent was read but didn't fit in the last reply
+	hfsdirent ent;
+} lldir;
+
+static void FuseHFS_ll_opendir(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi) {
+	dprintf("opendir %lu\n", ino);
+	llnode node;
+	lldir *d;
+
+	if (ll_ctl(ino)) {
+		fi->fh = 0;
+		if (ll_ctl(ino) == CTL_DIR) fuse_reply_open(req, fi);
+		else ll_reply_err(req, ENOTDIR);
+		return;
+	}
+	if (node_get(ino, &node) == -1) {
+		ll_reply_err(req, errno);
+		return;
+	}
+	d = calloc(1, sizeof(lldir));
+	if (d == NULL) {
+		ll_reply_err(req, ENOMEM);
+		return;
+	}
+	d->cnid = node.cnid;
+	d->parid = node.parid;
+	d->dir = hfs_opendirid(NULL, d->cnid);
+	if (d->dir == NULL) {
+		free(d);
+		ll_reply_err(req, errno);
+		return;
+	}
+	fi->fh = (uint64_t)d;
+	fuse_reply_open(req, fi);
+}
+
+static void FuseHFS_ll_readdir(fuse_req_t req, fuse_ino_t ino, size_t size, off_t off,
+							   struct fuse_file_info *fi) {
+	dprintf("readdir %lu %lld\n", ino, (long long)off);
+	lldir *d = (lldir*)fi->fh;
+	char *buf = malloc(size);
+	size_t len = 0;
+
+	if (buf == NULL) {
+		ll_reply_err(req, ENOMEM);
+		return;
+	}
+
+	if (d == NULL) {
+		// the control directory
+		const char *names[] = { ".", "..", ctl_name(CTL_STATS), ctl_name(CTL_CTL) };
+		const int nodes[] = { CTL_DIR, CTL_NONE, CTL_STATS, CTL_CTL };
+		for (off_t n = off; n < 4; n++) {
+			struct stat stbuf;
+			if (nodes[n] == CTL_NONE) {
+				memset(&stbuf, 0, sizeof stbuf);
+				stbuf.st_ino = FUSE_ROOT_ID;
+				stbuf.st_mode = S_IFDIR;
+			} else {
+				ctl_stbuf(nodes[n], &stbuf);
+			}
+			size_t entlen = fuse_add_direntry(req, buf + len, size - len, names[n], &stbuf, n + 1);
+			if (entlen > size - len) break;
+			len += entlen;
+		}
+		fuse_reply_buf(req, buf, len);
+		free(buf);
+		return;
+	}
+
+	// start over if the kernel went back
+	if (off < d->pos) {
+		hfs_closedir(d->dir);
+		d->dir = hfs_opendirid(NULL, d->cnid);
+		d->pos = 0;
+		d->pending = 0;
+		if (d->dir == NULL) {
+			free(buf);
+			ll_reply_err(req, errno);
+			return;
+		}
+	}
+
+	while (1) {
+		char dname[4*HFS_MAX_FLEN+3];
+		const char *name = dname;
+		struct stat stbuf;
+
+		memset(&stbuf, 0, sizeof stbuf);
+		if (d->pos == 0) {
+			name = ".";
+			stbuf.st_ino = cnid_to_ino(d->cnid);
+			stbuf.st_mode = S_IFDIR;
+		} else if (d->pos == 1) {
+			name = "..";
+			stbuf.st_ino = d->parid == HFS_CNID_ROOTPAR ? FUSE_ROOT_ID : cnid_to_ino(d->parid);
+			stbuf.st_mode = S_IFDIR;
+		} else {
+			if (!d->pending) {
+				if (hfs_readdir(d->dir, &d->ent) == -1) {
+					if (errno != ENOENT) {	// not the end, so don't pretend it is
+						free(buf);
+						ll_reply_err(req, errno);
+						return;
+					}
+					break;
+				}
+				d->pending = 1;
+			}
+			ll_stbuf(&d->ent, &stbuf);
+			hfs_to_utf8(d->ent.name, dname, 4*HFS_MAX_FLEN);
+		}
+
+		// skip entries before the requested offset
+		if (d->pos >= off) {
+			size_t entlen = fuse_add_direntry(req, buf + len, size - len, name, &stbuf, d->pos + 1);
+			if (entlen > size - len) break;
+			len += entlen;
+		}
+		d->pos++;
+		d->pending = 0;
+	}
+
+	fuse_reply_buf(req, buf, len);
+	free(buf);
+}
+
+static void FuseHFS_ll_releasedir(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi) {
+	lldir *d = (lldir*)fi->fh;
+	if (d) {
+		hfs_closedir(d->dir);
+		free(d);
+	}
+	ll_reply_err(req, 0);
+}
+
+// create a file and reply with its entry, and open it if fi is given
+static void ll_create(fuse_req_t req, fuse_ino_t parent, const char *name,
+					  struct fuse_file_info *fi) {
+	char hfsname[HFS_MAX_FLEN+1], hfspath[HFSPATH_MAX];
+	unsigned long parid = ino_to_cnid(parent);
+	hfsfile *file;
+	hfsdirent ent;
+
+	if (_readonly || rejected(name) || ll_shadows(parent, name)) {
+		ll_reply_err(req, EPERM);
+		return;
+	}
+	if (ll_name(name, hfsname) == NULL ||
+		ll_path(parid, hfsname, hfspath, sizeof hfspath) == NULL ||
+		(file = hfs_create(NULL, hfspath, "TEXT", "FUSE")) == NULL) {
+		ll_reply_err(req, errno);
+		return;
+	}
+
+	// close and reopen, because it won't exist until it's closed
+	hfs_close(file);
+	if (fi) {
+		file = hfs_openat(NULL, parid, hfsname);
+		if (file == NULL) {
+			ll_reply_err(req, errno);
+			return;
+		}
+		fi->fh = (uint64_t)file;
+		hfs_fstat(file, &ent);
+	} else {
+		hfs_flush(NULL);
+		if (hfs_statat(NULL, parid, hfsname, &ent) == -1) {
+			ll_reply_err(req, errno);
+			return;
+		}
+	}
+	ll_reply_entry(req, &ent, fi);
+}
+
+static void FuseHFS_ll_mknod(fuse_req_t req, fuse_ino_t parent, const char *name,
+							 mode_t mode, dev_t rdev) {
+	dprintf("mknod %lu %s\n", parent, name);
+	if (!S_ISREG(mode)) {
+		ll_reply_err(req, EPERM);
+		return;
+	}
+	ll_create(req, parent, name, NULL);
+}
+
+static void FuseHFS_ll_create(fuse_req_t req, fuse_ino_t parent, const char *name,
+							  mode_t mode, struct fuse_file_info *fi) {
+	dprintf("create %lu %s\n", parent, name);
+	ll_create(req, parent, name, fi);
+}
+
+static void FuseHFS_ll_mkdir(fuse_req_t req, fuse_ino_t parent, const char *name, mode_t mode) {
+	dprintf("mkdir %lu %s\n", parent, name);
+	char hfsname[HFS_MAX_FLEN+1], hfspath[HFSPATH_MAX];
+	hfsdirent ent;
+
+	if (_readonly || rejected(name) || ll_shadows(parent, name)) {
+		ll_reply_err(req, EPERM);
+		return;
+	}
+	if (ll_name(name, hfsname) == NULL ||
+		ll_path(ino_to_cnid(parent), hfsname, hfspath, sizeof hfspath) == NULL ||
+		hfs_mkdir(NULL, hfspath) == -1 ||
+		hfs_statat(NULL, ino_to_cnid(parent), hfsname, &ent) == -1) {
+		ll_reply_err(req, errno);
+		return;
+	}
+	ll_reply_entry(req, &ent, NULL);
+}
+
+// remove a file or an empty directory
+static void ll_remove(fuse_req_t req, fuse_ino_t parent, const char *name, int isdir) {
+	char hfsname[HFS_MAX_FLEN+1], hfspath[HFSPATH_MAX];
+	hfsdirent ent;
+
+	if (_readonly) {
+		ll_reply_err(req, EPERM);
+		return;
+	}
+	if (ll_name(name, hfsname) == NULL ||
+		hfs_statat(NULL, ino_to_cnid(parent), hfsname, &ent) == -1) {
+		ll_reply_err(req, errno);
+		return;
+	}
+	if (isdir && !(ent.flags & HFS_ISDIR)) {
+		ll_reply_err(req, ENOTDIR);
+		return;
+	}
+	if (!isdir && (ent.flags & HFS_ISDIR)) {
+		ll_reply_err(req, EISDIR);
+		return;
+	}
+	if (!isdir) rsrc_forget_all();
+	if (ll_path(ino_to_cnid(parent), hfsname, hfspath, sizeof hfspath) == NULL ||
+		(isdir ? hfs_rmdir(NULL, hfspath) : hfs_delete(NULL, hfspath)) == -1) {
+		ll_reply_err(req, errno);
+		return;
+	}
+	// the kernel still forgets the inode, and until then it is stale
+	node_stale(ent.cnid);
+	ll_reply_err(req, 0);
+}
+
+static void FuseHFS_ll_unlink(fuse_req_t req, fuse_ino_t parent, const char *name) {
+	dprintf("unlink %lu %s\n", parent, name);
+	ll_remove(req, parent, name, 0);
+}
+
+static void FuseHFS_ll_rmdir(fuse_req_t req, fuse_ino_t parent, const char *name) {
+	dprintf("rmdir %lu %s\n", parent, name);
+	ll_remove(req, parent, name, 1);
+}
+
+static void FuseHFS_ll_rename(fuse_req_t req, fuse_ino_t parent, const char *name,
+							  fuse_ino_t newparent, const char *newname) {
+	dprintf("rename %lu %s %lu %s\n", parent, name, newparent, newname);
+	char hfsname1[HFS_MAX_FLEN+1], hfsname2[HFS_MAX_FLEN+1];
+	char hfspath1[HFSPATH_MAX], hfspath2[HFSPATH_MAX];
+	unsigned long parid2 = ino_to_cnid(newparent);
+	hfsdirent ent;
+
+	if (_readonly || rejected(newname) || ll_shadows(newparent, newname) || ll_shadows(parent, name)) {
+		ll_reply_err(req, EPERM);
+		return;
+	}
+	if (ll_name(name, hfsname1) == NULL || ll_name(newname, hfsname2) == NULL ||
+		ll_path(ino_to_cnid(parent), hfsname1, hfspath1, sizeof hfspath1) == NULL ||
+		ll_path(parid2, hfsname2, hfspath2, sizeof hfspath2) == NULL) {
+		ll_reply_err(req, errno);
+		return;
+	}
+
+	// delete destination file if it exists
+	rsrc_forget_all();
+	if (hfs_statat(NULL, parid2, hfsname2, &ent) == 0)
+		if (!(ent.flags & HFS_ISDIR) && hfs_delete(NULL, hfspath2) == 0) node_stale(ent.cnid);
+
+	// rename
+	if (hfs_rename(NULL, hfspath1, hfspath2) != 0 ||
+		hfs_statat(NULL, parid2, hfsname2, &ent) == -1) {
+		ll_reply_err(req, errno);
+		return;
+	}
+
+	// the inode keeps its number but moves in the catalog
+	node_move(ent.cnid, ent.parid, ent.name);
+
+	bless_system_folder(&ent);
+	ll_reply_err(req, 0);
+}
+
+static void FuseHFS_ll_open(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi) {
+	dprintf("open %lu\n", ino);
+	llnode node;
+	hfsfile *file;
+
+	if (ll_ctl(ino)) {
+		int err = ll_ctl(ino) == CTL_DIR ? -EISDIR : ctl_open(ll_ctl(ino), fi, fuse_req_ctx(req)->uid);
+		if (err) ll_reply_err(req, -err);
+		else fuse_reply_open(req, fi);
+		return;
+	}
+	if (node_get(ino, &node) == -1 || (file = node_openat(&node)) == NULL) {
+		ll_reply_err(req, errno);
+		return;
+	}
+	fi->fh = (uint64_t)file;
+	fuse_reply_open(req, fi);
+}
+
+static void FuseHFS_ll_read(fuse_req_t req, fuse_ino_t ino, size_t size, off_t off,
+							struct fuse_file_info *fi) {
+	dprintf("read %lu %lu %lld\n", ino, size, (long long)off);
+	struct fuse_bufvec *bv;
+
+	if (ll_ctl(ino)) {
+		char *buf = malloc(size ? size : 1);
+		if (buf == NULL) {
+			ll_reply_err(req, ENOMEM);
+			return;
+		}
+		fuse_reply_buf(req, buf, ctl_read(fi, buf, size, off));
+		free(buf);
+		return;
+	}
+	bv = fork_bufvec((hfsfile*)fi->fh, 0, size, off);
+	if (bv == NULL) {
+		ll_reply_err(req, errno);
+		return;
+	}
+	fuse_reply_data(req, bv, FUSE_BUF_SPLICE_MOVE);
+	bufvec_release((hfsfile*)fi->fh, bv);
+}
+
+static void FuseHFS_ll_write(fuse_req_t req, fuse_ino_t ino, const char *buf, size_t size,
+							 off_t off, struct fuse_file_info *fi) {
+	dprintf("write %lu %lu %lld\n", ino, size, (long long)off);
+	hfsfile *file = (hfsfile*)fi->fh;
+	unsigned long written;
+
+	if (ll_ctl(ino)) {
+		int ret = ctl_write(buf, size);
+		if (ret < 0) ll_reply_err(req, -ret);
+		else fuse_reply_write(req, ret);
+		return;
+	}
+	if (_readonly) {
+		ll_reply_err(req, EPERM);
+		return;
+	}
+	if (off + size > MAX_FILE_SIZE) {
+		ll_reply_err(req, EFBIG);
+		return;
+	}
+	written = hfs_pwrite(file, 0, buf, size, off);
+	if (written == (unsigned long)-1) ll_reply_err(req, errno);
+	else fuse_reply_write(req, written);
+}
+
+static void FuseHFS_ll_write_buf(fuse_req_t req, fuse_ino_t ino, struct fuse_bufvec *bufv,
+								 off_t off, struct fuse_file_info *fi) {
+	size_t size = fuse_buf_size(bufv);
+	dprintf("write_buf %lu %lu %lld\n", ino, size, (long long)off);
+	ssize_t written;
+
+	if (ll_ctl(ino)) {
+		struct fuse_bufvec dst = FUSE_BUFVEC_INIT(size);
+		dst.buf[0].mem = malloc(size ? size : 1);
+		written = dst.buf[0].mem ? fuse_buf_copy(&dst, bufv, 0) : -ENOMEM;
+		if (written >= 0) written = ctl_write(dst.buf[0].mem, written);
+		free(dst.buf[0].mem);
+		if (written < 0) ll_reply_err(req, -written);
+		else fuse_reply_write(req, written);
+		return;
+	}
+	if (_readonly) {
+		ll_reply_err(req, EPERM);
+		return;
+	}
+	if (off + size > MAX_FILE_SIZE) {
+		ll_reply_err(req, EFBIG);
+		return;
+	}
+	written = bufvec_write((hfsfile*)fi->fh, bufv, off);
+	if (written < 0) ll_reply_err(req, -written);
+	else fuse_reply_write(req, written);
+}
+
+static void FuseHFS_ll_release(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi) {
+	dprintf("close %lu\n", ino);
+	hfsfile *file = (hfsfile*)fi->fh;
+	if (ll_ctl(ino)) ctl_release(fi);
+	else hfs_close(file);
+	ll_reply_err(req, 0);
+}
+
+static void FuseHFS_ll_statfs(fuse_req_t req, fuse_ino_t ino) {
+	struct statvfs stbuf;
+	hfsvolent vstat;
+
+	memset(&stbuf, 0, sizeof stbuf);
+	hfs_vstat(NULL, &vstat);
+
+	// report in power-of-2 blocks, for the reason given at FuseHFS_statfs_x()
+	unsigned long blocksize_power_of_2 = power_of_2_factor(vstat.alblocksz);
+	unsigned long blocksize_multiple = vstat.alblocksz / blocksize_power_of_2;
+	stbuf.f_bsize = stbuf.f_frsize = blocksize_power_of_2;
+	stbuf.f_blocks = blocksize_multiple * (vstat.totbytes / vstat.alblocksz);
+	stbuf.f_bfree = stbuf.f_bavail = blocksize_multiple * (vstat.freebytes / vstat.alblocksz);
+	stbuf.f_files = vstat.numfiles + vstat.numdirs + 1;
+	stbuf.f_namemax = HFS_MAX_FLEN;
+
+	fuse_reply_statfs(req, &stbuf);
+}
+
+// reply to a getxattr or listxattr with len bytes of value
+static void ll_reply_xattr(fuse_req_t req, size_t size, const char *value, size_t len) {
+	if (size == 0) fuse_reply_xattr(req, len);
+	else if (size < len) ll_reply_err(req, ERANGE);
+	else fuse_reply_buf(req, value, len);
+}
+
+static void FuseHFS_ll_listxattr(fuse_req_t req, fuse_ino_t ino, size_t size) {
+	dprintf("listxattr %lu %lu\n", ino, size);
+	char list[sizeof XATTR_FINDERINFO_NAME + sizeof XATTR_RESOURCEFORK_NAME];
+	size_t len = sizeof XATTR_FINDERINFO_NAME;
+	hfsdirent ent;
+
+	if (ll_ctl(ino)) {
+		ll_reply_xattr(req, size, list, 0);
+		return;
+	}
+	if (node_stat(ino, &ent) == -1) {
+		ll_reply_err(req, errno);
+		return;
+	}
+	strcpy(list, XATTR_FINDERINFO_NAME);
+	if ((!(ent.flags & HFS_ISDIR)) && ent.u.file.rsize) {
+		strcpy(list + len, XATTR_RESOURCEFORK_NAME);
+		len += sizeof XATTR_RESOURCEFORK_NAME;
+	}
+	ll_reply_xattr(req, size, list, len);
+}
+
+static void FuseHFS_ll_getxattr(fuse_req_t req, fuse_ino_t ino, const char *name, size_t size
+#if (__FreeBSD__ >= 10)
+								, uint32_t position
+#endif
+								) {
+#if !(__FreeBSD__ >= 10)
+	uint32_t position = 0;
+#endif
+	llnode node;
+	hfsdirent ent;
+
+	if (ll_ctl(ino)) {
+		ll_reply_err(req, ENOATTR);
+		return;
+	}
+	if (node_get(ino, &node) == -1 || node_statat(&node, &ent) == -1) {
+		ll_reply_err(req, errno);
+		return;
+	}
+
+	if (strcmp(name, XATTR_FINDERINFO_NAME) == 0) {
+		char value[32];
+		finderinfo_get(&ent, value);
+		ll_reply_xattr(req, size, value, 32);
+		return;
+	} else if (strcmp(name, XATTR_RESOURCEFORK_NAME) == 0 && (!(ent.flags & HFS_ISDIR)) && ent.u.file.rsize) {
+		// resource fork
+		size_t len = position < ent.u.file.rsize ? ent.u.file.rsize - position : 0;
+		if (size == 0) {
+			fuse_reply_xattr(req, len);
+			return;
+		}
+		if (len > size) len = size;
+		char *value = malloc(len ? len : 1);
+		if (value == NULL) {
+			ll_reply_err(req, ENOMEM);
+			return;
+		}
+		hfsfile *fp = rsrc_get(ent.cnid);
+		if (fp == NULL) fp = rsrc_keep(ent.cnid, node_openat(&node));
+		if (fp == NULL) {
+			free(value);
+			ll_reply_err(req, errno);
+			return;
+		}
+		len = hfs_pread(fp, 1, value, len, position);
+		rsrc_put(fp);
+		if (len == (size_t)-1) ll_reply_err(req, errno);
+		else fuse_reply_buf(req, value, len);
+		free(value);
+		return;
+	}
+
+	ll_reply_err(req, ENOATTR);
+}
+
+static void FuseHFS_ll_setxattr(fuse_req_t req, fuse_ino_t ino, const char *name,
+								const char *value, size_t size, int flags
+#if (__FreeBSD__ >= 10)
+								, uint32_t position
+#endif
+								) {
+#if !(__FreeBSD__ >= 10)
+	uint32_t position = 0;
+#endif
+	dprintf("setxattr %lu %s %lu\n", ino, name, size);
+	llnode node;
+	hfsdirent ent;
+
+	if (_readonly) {
+		ll_reply_err(req, EPERM);
+		return;
+	}
+	if (node_get(ino, &node) == -1 || node_statat(&node, &ent) == -1) {
+		ll_reply_err(req, errno);
+		return;
+	}
+
+	if (strcmp(name, XATTR_FINDERINFO_NAME) == 0) {
+		if (size != 32) {
+			dprintf("setxattr: finder info is not 32 bytes\n");
+			ll_reply_err(req, ERANGE);
+			return;
+		}
+		finderinfo_set(&ent, value);
+		bless_system_folder(&ent);
+		if (hfs_setattrat(NULL, node.parid, node.name, &ent) == -1) {
+			ll_reply_err(req, errno);
+			return;
+		}
+	} else if (strcmp(name, XATTR_RESOURCEFORK_NAME) == 0 && (!(ent.flags & HFS_ISDIR))) {
+		// resource fork
+		hfsfile *fp = rsrc_get(ent.cnid);
+		if (fp == NULL) fp = rsrc_keep(ent.cnid, node_openat(&node));
+		if (fp == NULL) {
+			ll_reply_err(req, errno);
+			return;
+		}
+		int err = hfs_pwrite(fp, 1, value, size, position) == (unsigned long)-1 ? errno : 0;
+		// a write from the start replaces the fork, later chunks extend it
+		if (!err && position == 0 && rsrc_truncate(fp, size) == -1) err = errno;
+		rsrc_put(fp);
+		ll_reply_err(req, err);
+		return;
+	}
+	ll_reply_err(req, 0);
+}
+
+static void FuseHFS_ll_removexattr(fuse_req_t req, fuse_ino_t ino, const char *name) {
+	dprintf("removexattr %lu %s\n", ino, name);
+	llnode node;
+	hfsdirent ent;
+
+	if (_readonly) {
+		ll_reply_err(req, EPERM);
+		return;
+	}
+	if (node_get(ino, &node) == -1 || node_statat(&node, &ent) == -1) {
+		ll_reply_err(req, errno);
+		return;
+	}
+
+	if (strcmp(name, XATTR_FINDERINFO_NAME) == 0) {
+		// not really removing it
+		ll_reply_err(req, 0);
+	} else if (strcmp(name, XATTR_RESOURCEFORK_NAME) == 0 && (!(ent.flags & HFS_ISDIR))) {
+		// resource fork
+		hfsfile *fp = rsrc_get(ent.cnid);
+		if (fp == NULL) fp = rsrc_keep(ent.cnid, node_openat(&node));
+		if (fp == NULL) {
+			ll_reply_err(req, errno);
+			return;
+		}
+		int err = rsrc_truncate(fp, 0) == -1 ? errno : 0;
+		rsrc_put(fp);
+		ll_reply_err(req, err);
+	} else {
+		ll_reply_err(req, ENOATTR);
+	}
+}
+
+#if (__FreeBSD__ >= 10)
+
+static void FuseHFS_ll_setvolname(fuse_req_t req, const char *name) {
+	dprintf("setvolname %s\n", name);
+	char hfsname[HFS_MAX_VLEN+1];
+
+	if (_readonly) {
+		ll_reply_err(req, EPERM);
+		return;
+	}
+	if (utf8_to_hfs(name, hfsname, sizeof hfsname) == NULL) {
+		ll_reply_err(req, E2BIG);
+		return;
+	}
+
+	// rename volume
+	if (hfs_rename(NULL, _volname, hfsname)) {
+		ll_reply_err(req, EPERM);
+		return;
+	}
+	// update
+	strcpy(_volname, hfsname);
+	node_move(HFS_CNID_ROOTDIR, HFS_CNID_ROOTPAR, hfsname);
+	ll_reply_err(req, 0);
+}
+
+static void FuseHFS_ll_getxtimes(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi) {
+	dprintf("getxtimes %lu\n", ino);
+	struct timespec bkuptime, crtime;
+	hfsdirent ent;
+
+	if (node_stat(ino, &ent) == -1) {
+		ll_reply_err(req, errno);
+		return;
+	}
+	crtime.tv_sec = ent.crdate;
+	crtime.tv_nsec = 0;
+	bkuptime.tv_sec = ent.bkdate;
+	bkuptime.tv_nsec = 0;
+	fuse_reply_xtimes(req, &bkuptime, &crtime);
+}
+
+#endif
+
+#pragma mark Timing
+
+// each callback is wrapped to feed its latency and outcome to stats.c and the tracepoints
+#define TIMED(op, params, args) \
+static void timed_##op params { \
+	FUSEHFS_TRACE(op##__start, OP_##op, req); \
+	uint64_t start = stats_now(); \
+	FuseHFS_ll_##op args; \
+	int failed = stats_failed(); \
+	stats_record(OP_##op, start, failed); \
+	FUSEHFS_TRACE(op##__done, OP_##op, failed); \
+}
+
+TIMED(lookup, (fuse_req_t req, fuse_ino_t parent, const char *name), (req, parent, name))
+TIMED(forget, (fuse_req_t req, fuse_ino_t ino, unsigned long nlookup), (req, ino, nlookup))
+TIMED(getattr, (fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi), (req, ino, fi))
+TIMED(setattr, (fuse_req_t req, fuse_ino_t ino, struct stat *attr, int to_set,
+				struct fuse_file_info *fi), (req, ino, attr, to_set, fi))
+#if (__FreeBSD__ >= 10)
+#define OP_setattr_x OP_setattr
+TIMED(setattr_x, (fuse_req_t req, fuse_ino_t ino, struct setattr_x *attr, int to_set,
+				  struct fuse_file_info *fi), (req, ino, attr, to_set, fi))
+#endif
+TIMED(opendir, (fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi), (req, ino, fi))
+TIMED(readdir, (fuse_req_t req, fuse_ino_t ino, size_t size, off_t off,
+				struct fuse_file_info *fi), (req, ino, size, off, fi))
+TIMED(releasedir, (fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi), (req, ino, fi))
+TIMED(mknod, (fuse_req_t req, fuse_ino_t parent, const char *name, mode_t mode, dev_t rdev),
+	  (req, parent, name, mode, rdev))
+TIMED(mkdir, (fuse_req_t req, fuse_ino_t parent, const char *name, mode_t mode),
+	  (req, parent, name, mode))
+TIMED(unlink, (fuse_req_t req, fuse_ino_t parent, const char *name), (req, parent, name))
+TIMED(rmdir, (fuse_req_t req, fuse_ino_t parent, const char *name), (req, parent, name))
+TIMED(rename, (fuse_req_t req, fuse_ino_t parent, const char *name, fuse_ino_t newparent,
+			   const char *newname), (req, parent, name, newparent, newname))
+TIMED(create, (fuse_req_t req, fuse_ino_t parent, const char *name, mode_t mode,
+			   struct fuse_file_info *fi), (req, parent, name, mode, fi))
+TIMED(open, (fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi), (req, ino, fi))
+TIMED(read, (fuse_req_t req, fuse_ino_t ino, size_t size, off_t off,
+			 struct fuse_file_info *fi), (req, ino, size, off, fi))
+TIMED(write, (fuse_req_t req, fuse_ino_t ino, const char *buf, size_t size, off_t off,
+			  struct fuse_file_info *fi), (req, ino, buf, size, off, fi))
+TIMED(write_buf, (fuse_req_t req, fuse_ino_t ino, struct fuse_bufvec *bufv, off_t off,
+				  struct fuse_file_info *fi), (req, ino, bufv, off, fi))
+TIMED(release, (fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi), (req, ino, fi))
+TIMED(statfs, (fuse_req_t req, fuse_ino_t ino), (req, ino))
+TIMED(listxattr, (fuse_req_t req, fuse_ino_t ino, size_t size), (req, ino, size))
+#if (__FreeBSD__ >= 10)
+TIMED(getxattr, (fuse_req_t req, fuse_ino_t ino, const char *name, size_t size,
+				 uint32_t position), (req, ino, name, size, position))
+TIMED(setxattr, (fuse_req_t req, fuse_ino_t ino, const char *name, const char *value,
+				 size_t size, int flags, uint32_t position),
+	  (req, ino, name, value, size, flags, position))
+#else
+TIMED(getxattr, (fuse_req_t req, fuse_ino_t ino, const char *name, size_t size),
+	  (req, ino, name, size))
+TIMED(setxattr, (fuse_req_t req, fuse_ino_t ino, const char *name, const char *value,
+				 size_t size, int flags), (req, ino, name, value, size, flags))
+#endif
+TIMED(removexattr, (fuse_req_t req, fuse_ino_t ino, const char *name), (req, ino, name))
+#if (__FreeBSD__ >= 10)
+TIMED(setvolname, (fuse_req_t req, const char *name), (req, name))
+TIMED(getxtimes, (fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi), (req, ino, fi))
+#endif
+
+static struct fuse_lowlevel_ops FuseHFS_ll_operations = {
+	.init        = FuseHFS_ll_init,
+	.destroy     = FuseHFS_ll_destroy,
+	.lookup      = timed_lookup,
+	.forget      = timed_forget,
+	.getattr     = timed_getattr,
+	.setattr     = timed_setattr,
+	.opendir     = timed_opendir,
+	.readdir     = timed_readdir,
+	.releasedir  = timed_releasedir,
+	.mknod       = timed_mknod,
+	.mkdir       = timed_mkdir,
+	.unlink      = timed_unlink,
+	.rmdir       = timed_rmdir,
+	.rename      = timed_rename,
+	.create      = timed_create,
+	.open        = timed_open,
+	.read        = timed_read,
+	.write       = timed_write,
+	.write_buf   = timed_write_buf,
+	.release     = timed_release,
+	.statfs      = timed_statfs,
+	.listxattr   = timed_listxattr,
+	.getxattr    = timed_getxattr,
+	.setxattr    = timed_setxattr,
+	.removexattr = timed_removexattr,
+#if (__FreeBSD__ >= 10)
+	.setvolname  = timed_setvolname,
+	.getxtimes   = timed_getxtimes,
+	.setattr_x   = timed_setattr_x,
+#endif
+};
+
+// mount and serve requests until unmounted, like fuse_main() does for the high-level API
+int FuseHFS_ll_main(struct fuse_args *args, struct fusehfs_options *options) {
+	struct fuse_chan *ch;
+	struct fuse_session *se;
+	char *mountpoint;
+	int multithreaded, foreground, err = -1;
+
+	if (fuse_parse_cmdline(args, &mountpoint, &multithreaded, &foreground) == -1) return 1;
+
+	ch = fuse_mount(mountpoint, args);
+	if (ch == NULL) {
+		free(mountpoint);
+		return 1;
+	}
+
+	se = fuse_lowlevel_new(args, &FuseHFS_ll_operations, sizeof FuseHFS_ll_operations, options);
+	if (se != NULL) {
+		if (fuse_set_signal_handlers(se) != -1) {
+			fuse_session_add_chan(se, ch);
+			fuse_daemonize(foreground);
+			// requests are served concurrently unless mounted with -s
+			err = multithreaded ? fuse_session_loop_mt(se) : fuse_session_loop(se);
+			fuse_remove_signal_handlers(se);
+			fuse_session_remove_chan(ch);
+		}
+		fuse_session_destroy(se);
+	}
+	fuse_unmount(mountpoint, ch);
+	free(mountpoint);
+
+	return err ? 1 : 0;
+}
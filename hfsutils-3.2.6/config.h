@@ -73,6 +73,9 @@
 /* Define if you have the <unistd.h> header file.  */
 #define HAVE_UNISTD_H 1
 
+/* Define if you have the pthread library (-lpthread).  */
+#define HAVE_LIBPTHREAD 1
+
 /*****************************************************************************
  * End of automatically configured definitions                               *
  *****************************************************************************/
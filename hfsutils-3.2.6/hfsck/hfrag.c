@@ -0,0 +1,903 @@
+/*
+ * hfrag - tool for reporting fragmentation of HFS volumes
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/*
+ * Each b*-tree is read once, node by node in the order the nodes lie in
+ * its file, without following any links: first the extents tree, whose
+ * records are tallied by fork, then the catalog, whose file records are
+ * matched against that tally. The volume bitmap is already in memory.
+ *
+ * The exit status says what the volume could use, so scripts need not
+ * parse the report: 2 if defragmenting is advised, 4 if repacking is, 6
+ * if both, 0 if neither and 1 on error. Defragmenting is advised when more
+ * than the given share of nonempty forks have more than one extent, and
+ * repacking when either tree has more than one leaf node and its nodes
+ * are, on the whole, filled less than the given percentage.
+ */
+
+# include <stdio.h>
+# include <stdlib.h>
+# include <string.h>
+# include <unistd.h>
+# include <errno.h>
+
+# include "hfsck.h"
+# include "repack.h"
+# include "../suid.h"
+# include "../version.h"
+
+# define FR_TSV		0x0001
+# define FR_QUIET	0x0002
+# define FR_LIST	0x0004
+
+# define FR_DEFRAG	2	/* exit status bits */
+# define FR_REPACK	4
+
+# define FR_FRAG_DEF	10	/* percent of forks fragmented */
+# define FR_FILL_DEF	60	/* percent of b*-tree node space used */
+
+# define FR_MAXDEPTH	16	/* deeper than any real b*-tree */
+# define FR_NEXTS	18	/* extents per fork: 0, 1, 2, 3, 4-7, ... */
+# define FR_NRUNS	16	/* free run blocks: 1, 2-3, 4-7, ... */
+
+typedef struct {
+  unsigned long fnum;		/* file ID */
+  unsigned int fork;		/* fkData or fkRsrc */
+  unsigned long nexts;		/* extents in overflow records */
+} ovfl;
+
+typedef struct {
+  unsigned long nodes;		/* nodes at this height */
+  unsigned long nrecs;		/* live records in them */
+  unsigned long long used;	/* bytes their records take */
+} levelstat;
+
+typedef struct {
+  unsigned int depth;		/* height of the tree */
+  levelstat level[FR_MAXDEPTH + 1];	/* by height; 1 is the leaves */
+  unsigned long nmap;		/* map nodes (not counting the header) */
+  unsigned long nfree;		/* unallocated nodes */
+  unsigned long nexts;		/* extents of the tree's own file */
+} treestat;
+
+typedef struct {
+  int options;
+  ovfl *ovfl;			/* overflow extents by fork, sorted */
+  unsigned long novfl;
+
+  treestat ext, cat;
+
+  unsigned long nfiles;		/* file records */
+  unsigned long nempty;		/* forks with no blocks */
+  unsigned long nforks;		/* forks with blocks */
+  unsigned long nfrag;		/* forks with more than one extent */
+  unsigned long maxexts;	/* most extents in any fork */
+  unsigned long noverflow;	/* files using overflow records */
+  unsigned long exts[FR_NEXTS];	/* forks by extent count */
+
+  unsigned long nblocks;	/* allocation blocks on the volume */
+  unsigned long nfreeblks;	/* of which free */
+  unsigned long nruns;		/* runs of free blocks */
+  unsigned long largest;	/* blocks in the longest run */
+  unsigned long largestat;	/* where it starts */
+  unsigned long runs[FR_NRUNS];	/* free runs by length */
+  unsigned long runblks[FR_NRUNS];	/* free blocks in those runs */
+} fragstat;
+
+extern int optind;
+extern char *optarg;
+
+/*
+ * NAME:	usage()
+ * DESCRIPTION:	display usage message
+ */
+static
+int usage(char *argv[])
+{
+  fprintf(stderr, "Usage: %s [-t | -q] [-l] [-x frag%%] [-f fill%%]"
+	  " device-path [partition-no]\n", argv[0]);
+
+  return 1;
+}
+
+/*
+ * NAME:	nbits()
+ * DESCRIPTION:	return the number of significant bits in a number
+ */
+static
+unsigned int nbits(unsigned long n)
+{
+  unsigned int bits = 0;
+
+  while (n)
+    ++bits, n >>= 1;
+
+  return bits;
+}
+
+/*
+ * NAME:	extbucket()
+ * DESCRIPTION:	return the histogram bucket for a fork's extent count
+ */
+static
+unsigned int extbucket(unsigned long n)
+{
+  unsigned int b;
+
+  b = (n < 4) ? n : nbits(n) + 1;
+
+  return (b < FR_NEXTS) ? b : FR_NEXTS - 1;
+}
+
+/*
+ * NAME:	extlow()
+ * DESCRIPTION:	return the smallest extent count in a histogram bucket
+ */
+static
+unsigned long extlow(unsigned int b)
+{
+  return (b < 4) ? b : 1UL << (b - 2);
+}
+
+/*
+ * NAME:	exthigh()
+ * DESCRIPTION:	return the largest extent count in a histogram bucket
+ */
+static
+unsigned long exthigh(unsigned int b)
+{
+  return (b < 4) ? b : (1UL << (b - 1)) - 1;
+}
+
+/*
+ * NAME:	countexts()
+ * DESCRIPTION:	return the number of extents in use in an extent record
+ */
+static
+unsigned int countexts(const ExtDataRec *rec)
+{
+  unsigned int i, n = 0;
+
+  for (i = 0; i < 3; ++i)
+    {
+      if ((*rec)[i].xdrNumABlks)
+	++n;
+    }
+
+  return n;
+}
+
+/*
+ * NAME:	byfork()
+ * DESCRIPTION:	compare overflow tallies by file ID and fork
+ */
+static
+int byfork(const ovfl *o1, const ovfl *o2)
+{
+  if (o1->fnum != o2->fnum)
+    return (o1->fnum < o2->fnum) ? -1 : 1;
+
+  return (int) o1->fork - (int) o2->fork;
+}
+
+/*
+ * NAME:	findovfl()
+ * DESCRIPTION:	return the overflow extents of a fork
+ */
+static
+unsigned long findovfl(const fragstat *fs, unsigned long fnum,
+		       unsigned int fork)
+{
+  ovfl key, *o;
+
+  key.fnum = fnum;
+  key.fork = fork;
+
+  o = bsearch(&key, fs->ovfl, fs->novfl, sizeof(ovfl),
+	      (int (*)(const void *, const void *)) byfork);
+
+  return o ? o->nexts : 0;
+}
+
+/*
+ * NAME:	extleaf()
+ * DESCRIPTION:	tally one extents overflow record
+ */
+static
+int extleaf(fragstat *fs, const byte *rec)
+{
+  ExtKeyRec key;
+  ExtDataRec data;
+  ovfl *o;
+
+  r_unpackextkey(rec, &key);
+  r_unpackextdata(HFS_RECDATA(rec), &data);
+
+  if ((fs->novfl & (fs->novfl - 1)) == 0)
+    {
+      o = REALLOC(fs->ovfl, ovfl, fs->novfl ? fs->novfl * 2 : 64);
+      if (o == 0)
+	ERROR(ENOMEM, 0);
+
+      fs->ovfl = o;
+    }
+
+  o = &fs->ovfl[fs->novfl++];
+
+  o->fnum  = key.xkrFNum;
+  o->fork  = (unsigned char) key.xkrFkType;
+  o->nexts = countexts(&data);
+
+  return 0;
+
+fail:
+  return -1;
+}
+
+/*
+ * NAME:	mergeovfl()
+ * DESCRIPTION:	sort the overflow tally and combine each fork's records
+ */
+static
+void mergeovfl(fragstat *fs)
+{
+  unsigned long i, j;
+
+  if (fs->novfl == 0)
+    return;
+
+  qsort(fs->ovfl, fs->novfl, sizeof(ovfl),
+	(int (*)(const void *, const void *)) byfork);
+
+  for (i = 1, j = 0; i < fs->novfl; ++i)
+    {
+      if (byfork(&fs->ovfl[i], &fs->ovfl[j]) == 0)
+	fs->ovfl[j].nexts += fs->ovfl[i].nexts;
+      else
+	fs->ovfl[++j] = fs->ovfl[i];
+    }
+
+  fs->novfl = j + 1;
+}
+
+/*
+ * NAME:	tally()
+ * DESCRIPTION:	count one fork of a file; return its overflow extents
+ */
+static
+unsigned long tally(fragstat *fs, unsigned long fnum, unsigned int fork,
+		    const ExtDataRec *rec, unsigned long pylen)
+{
+  unsigned long over, n;
+
+  over = findovfl(fs, fnum, fork);
+  n    = countexts(rec) + over;
+
+  if (pylen == 0 && n == 0)
+    ++fs->nempty;
+  else
+    {
+      ++fs->nforks;
+
+      if (n > 1)
+	++fs->nfrag;
+      if (n > fs->maxexts)
+	fs->maxexts = n;
+    }
+
+  ++fs->exts[extbucket(n)];
+
+  return over;
+}
+
+/*
+ * NAME:	catleaf()
+ * DESCRIPTION:	tally the forks of one catalog record
+ */
+static
+int catleaf(fragstat *fs, const byte *ptr)
+{
+  CatKeyRec key;
+  CatDataRec data;
+  const ExtDataRec *rec[2];
+  unsigned long fnum, over[2];
+  int i;
+
+  r_unpackcatdata(HFS_RECDATA(ptr), &data);
+
+  if (data.cdrType != cdrFilRec)
+    return 0;
+
+  fnum = data.u.fil.filFlNum;
+
+  ++fs->nfiles;
+
+  rec[0] = &data.u.fil.filExtRec;
+  rec[1] = &data.u.fil.filRExtRec;
+
+  over[0] = tally(fs, fnum, fkData, rec[0], data.u.fil.filPyLen);
+  over[1] = tally(fs, fnum, fkRsrc, rec[1], data.u.fil.filRPyLen);
+
+  if (over[0] == 0 && over[1] == 0)
+    return 0;
+
+  ++fs->noverflow;
+
+  if (! (fs->options & FR_LIST))
+    return 0;
+
+  r_unpackcatkey(ptr, &key);
+
+  for (i = 0; i < 2; ++i)
+    {
+      if (over[i] == 0)
+	continue;
+
+      if (fs->options & FR_TSV)
+	printf("overflow\t%lu\t%s\t%lu\t%lu\t%s\n", fnum,
+	       i ? "rsrc" : "data", countexts(rec[i]) + over[i],
+	       (unsigned long) key.ckrParID, key.ckrCName);
+      else
+	printf("  %9lu  %-4s %9lu  %lu:%s\n", fnum,
+	       i ? "rsrc" : "data", countexts(rec[i]) + over[i],
+	       (unsigned long) key.ckrParID, key.ckrCName);
+    }
+
+  return 0;
+}
+
+/*
+ * NAME:	scantree()
+ * DESCRIPTION:	read every node of a b*-tree in file order
+ */
+static
+int scantree(fragstat *fs, btree *bt, treestat *ts,
+	     int (*leaf)(fragstat *, const byte *))
+{
+  unsigned long nnum;
+  levelstat *ls;
+  node n;
+  int i;
+
+  memset(ts, 0, sizeof(*ts));
+
+  if (bt->hdr.bthDepth > FR_MAXDEPTH)
+    ERROR(EIO, "b*-tree is too deep");
+
+  ts->depth = bt->hdr.bthDepth;
+  ts->nfree = bt->hdr.bthFree;
+
+  for (nnum = 1; nnum < bt->hdr.bthNNodes; ++nnum)
+    {
+      if (! BMTST(bt->map, nnum))
+	continue;
+
+      if (bt_getnode(&n, bt, nnum) == -1)
+	goto fail;
+
+      if (n.nd.ndType == ndMapNode)
+	{
+	  ++ts->nmap;
+	  continue;
+	}
+      else if (n.nd.ndType != ndIndxNode && n.nd.ndType != ndLeafNode)
+	ERROR(EIO, "unknown b*-tree node type");
+
+      if (n.nd.ndNHeight < 1 || n.nd.ndNHeight > (int) ts->depth ||
+	  (n.nd.ndNHeight == 1) != (n.nd.ndType == ndLeafNode))
+	ERROR(EIO, "b*-tree node has bad height");
+
+      ls = &ts->level[n.nd.ndNHeight];
+
+      ++ls->nodes;
+      ls->used += NODEUSED(n);
+
+      for (i = 0; i < n.nd.ndNRecs; ++i)
+	{
+	  const byte *rec;
+
+	  rec = HFS_NODEREC(n, i);
+
+	  if (HFS_RECKEYLEN(rec) == 0)
+	    continue;  /* deleted record */
+
+	  ++ls->nrecs;
+
+	  if (n.nd.ndType == ndLeafNode &&
+	      leaf && leaf(fs, rec) == -1)
+	    goto fail;
+	}
+    }
+
+  return 0;
+
+fail:
+  return -1;
+}
+
+/*
+ * NAME:	scanvbm()
+ * DESCRIPTION:	measure the runs of free blocks in the volume bitmap
+ */
+static
+void scanvbm(fragstat *fs, const hfsvol *vol)
+{
+  unsigned long blk, start, len;
+  unsigned int b;
+
+  fs->nblocks = vol->mdb.drNmAlBlks;
+
+  for (blk = 0; blk < fs->nblocks; )
+    {
+      if (BMTST(vol->vbm, blk))
+	{
+	  ++blk;
+	  continue;
+	}
+
+      for (start = blk; blk < fs->nblocks && ! BMTST(vol->vbm, blk); ++blk)
+	;
+
+      len = blk - start;
+      b   = nbits(len) - 1;
+
+      if (b >= FR_NRUNS)
+	b = FR_NRUNS - 1;
+
+      ++fs->runs[b];
+      fs->runblks[b] += len;
+
+      ++fs->nruns;
+      fs->nfreeblks += len;
+
+      if (len > fs->largest)
+	{
+	  fs->largest   = len;
+	  fs->largestat = start;
+	}
+    }
+}
+
+/*
+ * NAME:	scan()
+ * DESCRIPTION:	gather all fragmentation statistics for a volume
+ */
+static
+int scan(fragstat *fs, hfsvol *vol)
+{
+  if (scantree(fs, &vol->ext, &fs->ext, extleaf) == -1)
+    goto fail;
+
+  mergeovfl(fs);
+
+  fs->ext.nexts = countexts(&vol->mdb.drXTExtRec) +
+    findovfl(fs, HFS_CNID_EXT, fkData);
+
+  if (scantree(fs, &vol->cat, &fs->cat, catleaf) == -1)
+    goto fail;
+
+  fs->cat.nexts = countexts(&vol->mdb.drCTExtRec) +
+    findovfl(fs, HFS_CNID_CAT, fkData);
+
+  scanvbm(fs, vol);
+
+  return 0;
+
+fail:
+  return -1;
+}
+
+/*
+ * NAME:	pct()
+ * DESCRIPTION:	return a ratio as a whole percentage
+ */
+static
+unsigned int pct(unsigned long long n, unsigned long long d)
+{
+  return d ? (unsigned int) ((n * 100 + d / 2) / d) : 0;
+}
+
+/*
+ * NAME:	fill()
+ * DESCRIPTION:	return the percentage of a tree's index and leaf node
+ *		space its records use
+ */
+static
+unsigned int fill(const treestat *ts)
+{
+  unsigned long long used = 0, space = 0;
+  unsigned int h;
+
+  for (h = 1; h <= ts->depth; ++h)
+    {
+      used  += ts->level[h].used;
+      space += (unsigned long long) ts->level[h].nodes * NODESPACE;
+    }
+
+  return pct(used, space);
+}
+
+/*
+ * NAME:	advice()
+ * DESCRIPTION:	return the exit status bits for what a volume could use
+ */
+static
+int advice(const fragstat *fs, unsigned int maxfrag, unsigned int minfill)
+{
+  int result = 0;
+
+  if (fs->nfrag * 100 > (unsigned long long) maxfrag * fs->nforks)
+    result |= FR_DEFRAG;
+
+  if ((fs->ext.level[1].nodes > 1 && fill(&fs->ext) < minfill) ||
+      (fs->cat.level[1].nodes > 1 && fill(&fs->cat) < minfill))
+    result |= FR_REPACK;
+
+  return result;
+}
+
+/*
+ * NAME:	printtree()
+ * DESCRIPTION:	report the per-level statistics of one b*-tree
+ */
+static
+void printtree(const fragstat *fs, const char *name, const treestat *ts)
+{
+  const levelstat *ls;
+  unsigned int h;
+
+  if (fs->options & FR_TSV)
+    {
+      for (h = 1; h <= ts->depth; ++h)
+	{
+	  ls = &ts->level[h];
+
+	  printf("level\t%s\t%u\t%lu\t%lu\t%u\n", name, h, ls->nodes,
+		 ls->nrecs, pct(ls->used,
+				(unsigned long long) ls->nodes * NODESPACE));
+	}
+
+      printf("tree\t%s\tfill\t%u\n", name, fill(ts));
+      printf("tree\t%s\tmap\t%lu\n", name, ts->nmap);
+      printf("tree\t%s\tfree\t%lu\n", name, ts->nfree);
+      printf("tree\t%s\textents\t%lu\n", name, ts->nexts);
+
+      return;
+    }
+
+  printf("*** %s B*-tree: depth %u, %u%% full, %lu free node%s,"
+	 " %lu extent%s\n", name, ts->depth, fill(ts),
+	 ts->nfree, ts->nfree == 1 ? "" : "s",
+	 ts->nexts, ts->nexts == 1 ? "" : "s");
+
+  if (ts->depth == 0)
+    return;
+
+  printf("  %-8s %9s %9s %6s\n", "level", "nodes", "records", "fill");
+
+  for (h = ts->depth; h >= 1; --h)
+    {
+      ls = &ts->level[h];
+
+      printf("  %-8u %9lu %9lu %5u%%\n", h, ls->nodes, ls->nrecs,
+	     pct(ls->used, (unsigned long long) ls->nodes * NODESPACE));
+    }
+}
+
+/*
+ * NAME:	report()
+ * DESCRIPTION:	print the statistics gathered for a volume
+ */
+static
+void report(const fragstat *fs, const hfsvol *vol, int result)
+{
+  unsigned long alblksz = vol->mdb.drAlBlkSiz;
+  unsigned int b, top;
+
+  for (top = FR_NEXTS; top > 1 && fs->exts[top - 1] == 0; --top)
+    ;
+
+  if (fs->options & FR_TSV)
+    {
+      printf("volume\tblocks\t%lu\n", fs->nblocks);
+      printf("volume\tblocksize\t%lu\n", alblksz);
+      printf("volume\tfree\t%lu\n", fs->nfreeblks);
+
+      printf("files\ttotal\t%lu\n", fs->nfiles);
+      printf("files\toverflow\t%lu\n", fs->noverflow);
+
+      printf("forks\tempty\t%lu\n", fs->nempty);
+      printf("forks\ttotal\t%lu\n", fs->nforks);
+      printf("forks\tfragmented\t%lu\n", fs->nfrag);
+      printf("forks\tmaxextents\t%lu\n", fs->maxexts);
+
+      for (b = 0; b < top; ++b)
+	printf("forks\textents\t%lu\t%lu\t%lu\n",
+	       extlow(b), exthigh(b), fs->exts[b]);
+
+      printf("free\truns\t%lu\n", fs->nruns);
+      printf("free\tlargest\t%lu\t%lu\n", fs->largestat, fs->largest);
+
+      for (b = 0; b < FR_NRUNS; ++b)
+	{
+	  if (fs->runs[b])
+	    printf("free\tblocks\t%lu\t%lu\t%lu\t%lu\n", 1UL << b,
+		   (2UL << b) - 1, fs->runs[b], fs->runblks[b]);
+	}
+
+      printtree(fs, "extents", &fs->ext);
+      printtree(fs, "catalog", &fs->cat);
+
+      printf("advise\tdefrag\t%d\n", (result & FR_DEFRAG) != 0);
+      printf("advise\trepack\t%d\n", (result & FR_REPACK) != 0);
+
+      return;
+    }
+
+  printf("*** Volume \"%s\": %lu allocation blocks of %lu bytes,"
+	 " %lu free\n", vol->mdb.drVN, fs->nblocks, alblksz, fs->nfreeblks);
+
+  printf("*** %lu files, %lu using extents overflow records\n",
+	 fs->nfiles, fs->noverflow);
+  printf("*** %lu of %lu nonempty forks fragmented (%u%%), the worst"
+	 " into %lu extent%s\n", fs->nfrag, fs->nforks,
+	 pct(fs->nfrag, fs->nforks), fs->maxexts,
+	 fs->maxexts == 1 ? "" : "s");
+
+  printf("  %-11s %9s\n", "extents", "forks");
+
+  for (b = 0; b < top; ++b)
+    {
+      char label[24];
+
+      if (extlow(b) == exthigh(b))
+	sprintf(label, "%lu", extlow(b));
+      else
+	sprintf(label, "%lu-%lu", extlow(b), exthigh(b));
+
+      printf("  %-11s %9lu\n", label, fs->exts[b]);
+    }
+
+  printf("*** %lu free runs; the largest is %lu blocks (%u%%) at block"
+	 " %lu\n", fs->nruns, fs->largest, pct(fs->largest, fs->nfreeblks),
+	 fs->largestat);
+
+  if (fs->nruns)
+    printf("  %-11s %9s %9s\n", "run blocks", "runs", "blocks");
+
+  for (b = 0; b < FR_NRUNS; ++b)
+    {
+      char label[24];
+
+      if (fs->runs[b] == 0)
+	continue;
+
+      if (b == 0)
+	sprintf(label, "1");
+      else
+	sprintf(label, "%lu-%lu", 1UL << b, (2UL << b) - 1);
+
+      printf("  %-11s %9lu %9lu\n", label, fs->runs[b], fs->runblks[b]);
+    }
+
+  printtree(fs, "extents", &fs->ext);
+  printtree(fs, "catalog", &fs->cat);
+
+  printf("*** %s\n",
+	 result == (FR_DEFRAG | FR_REPACK) ? "Defragment and repack" :
+	 result == FR_DEFRAG ? "Defragment" :
+	 result == FR_REPACK ? "Repack" : "Nothing to do");
+}
+
+/*
+ * NAME:	main()
+ * DESCRIPTION:	program entry
+ */
+int main(int argc, char *argv[])
+{
+  char *path;
+  int nparts, pnum, result;
+  unsigned int maxfrag = FR_FRAG_DEF, minfill = FR_FILL_DEF;
+  fragstat fs;
+  hfsvol vol;
+
+  suid_init();
+
+  if (argc == 2)
+    {
+      if (strcmp(argv[1], "--version") == 0)
+	{
+	  printf("%s - %s\n", hfsutils_version, hfsutils_copyright);
+	  printf("`%s --license' for licensing information.\n", argv[0]);
+	  return 0;
+	}
+      else if (strcmp(argv[1], "--license") == 0)
+	{
+	  printf("\n%s", hfsutils_license);
+	  return 0;
+	}
+    }
+
+  memset(&fs, 0, sizeof(fs));
+
+  while (1)
+    {
+      int opt;
+
+      opt = getopt(argc, argv, "tqlx:f:");
+      if (opt == EOF)
+	break;
+
+      switch (opt)
+	{
+	case '?':
+	  return usage(argv);
+
+	case 't':
+	  fs.options |= FR_TSV;
+	  break;
+
+	case 'q':
+	  fs.options |= FR_QUIET;
+	  break;
+
+	case 'l':
+	  fs.options |= FR_LIST;
+	  break;
+
+	case 'x':
+	  maxfrag = atoi(optarg);
+	  if (maxfrag > 100)
+	    {
+	      fprintf(stderr, "%s: fragmented share must be between 0 and"
+		      " 100\n", argv[0]);
+	      return 1;
+	    }
+	  break;
+
+	case 'f':
+	  minfill = atoi(optarg);
+	  if (minfill > 100)
+	    {
+	      fprintf(stderr, "%s: fill factor must be between 0 and 100\n",
+		      argv[0]);
+	      return 1;
+	    }
+	  break;
+	}
+    }
+
+  if ((fs.options & FR_TSV) && (fs.options & FR_QUIET))
+    return usage(argv);
+
+  if (fs.options & FR_QUIET)
+    fs.options &= ~FR_LIST;
+
+  if (argc - optind < 1 ||
+      argc - optind > 2)
+    return usage(argv);
+
+  path = argv[optind];
+
+  suid_enable();
+  nparts = hfs_nparts(path);
+  suid_disable();
+
+  if (nparts == 0)
+    {
+      fprintf(stderr, "%s: partitioned medium contains no HFS partitions\n",
+	      argv[0]);
+      return 1;
+    }
+
+  if (argc - optind == 2)
+    {
+      pnum = atoi(argv[optind + 1]);
+
+      if (pnum < 0)
+	{
+	  fprintf(stderr, "%s: invalid partition number\n", argv[0]);
+	  return 1;
+	}
+
+      if (nparts == -1 && pnum > 0)
+	{
+	  fprintf(stderr, "%s: warning: ignoring partition number for"
+		  " non-partitioned medium\n", argv[0]);
+	  pnum = 0;
+	}
+      else if (nparts > 0 && pnum == 0)
+	{
+	  fprintf(stderr, "%s: cannot specify whole medium"
+		  " (has %d partition%s)\n", argv[0], nparts,
+		  nparts == 1 ? "" : "s");
+	  return 1;
+	}
+      else if (nparts > 0 && pnum > nparts)
+	{
+	  fprintf(stderr, "%s: invalid partition number (only %d available)\n",
+		  argv[0], nparts);
+	  return 1;
+	}
+    }
+  else
+    {
+      if (nparts > 1)
+	{
+	  fprintf(stderr, "%s: must specify partition number (%d available)\n",
+		  argv[0], nparts);
+	  return 1;
+	}
+      else if (nparts == -1)
+	pnum = 0;
+      else
+	pnum = 1;
+    }
+
+  v_init(&vol, 0);
+
+  suid_enable();
+  result = v_open(&vol, path, HFS_MODE_RDONLY);
+  suid_disable();
+
+  if (result == -1)
+    {
+      perror(path);
+      return 1;
+    }
+
+  vol.flags |= HFS_VOL_READONLY;
+
+  if (v_geometry(&vol, pnum) == -1 ||
+      v_mount(&vol) == -1)
+    {
+      perror(path);
+      v_close(&vol);
+      return 1;
+    }
+
+  if ((fs.options & FR_LIST) && ! (fs.options & FR_TSV))
+    printf("*** Forks using extents overflow records\n"
+	   "  %9s  %-4s %9s  %s\n", "file ID", "fork", "extents",
+	   "parent:name");
+
+  if (scan(&fs, &vol) == -1)
+    {
+      fprintf(stderr, "%s: %s\n", argv[0], hfs_error ? hfs_error
+	      : strerror(errno));
+
+      FREE(fs.ovfl);
+      v_close(&vol);
+      return 1;
+    }
+
+  result = advice(&fs, maxfrag, minfill);
+
+  if (! (fs.options & FR_QUIET))
+    report(&fs, &vol, result);
+
+  FREE(fs.ovfl);
+
+  if (v_close(&vol) == -1)
+    {
+      perror("closing volume");
+      return 1;
+    }
+
+  return result;
+}
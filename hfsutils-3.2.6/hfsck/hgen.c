@@ -0,0 +1,1133 @@
+/*
+ * hgen - tool for generating synthetic HFS volumes
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/*
+ * A volume is planned in memory and then written in one pass: it is
+ * formatted as usual, its catalog and extents files are grown to the size
+ * the plan needs, and the records are spooled in key order and packed
+ * bottom-up by the same code hrepack uses. Nothing goes through
+ * bt_insert(), so a volume of a million files takes seconds.
+ *
+ * The folders form a complete tree: every folder above the given depth has
+ * the given number of subfolders. Files land in folders at random. Name
+ * lengths are uniform over their range, made longer where that is needed
+ * to keep names unique. Fork lengths are log-uniform over their range: a
+ * power of two is picked evenly, then a length within it. A split fork is
+ * cut into extents with a small free gap between each, so free space is
+ * fragmented along with the files. Fork contents are left zero.
+ *
+ * The same seed and parameters always plan the same volume.
+ */
+
+# include <stdio.h>
+# include <stdlib.h>
+# include <string.h>
+# include <unistd.h>
+# include <fcntl.h>
+# include <errno.h>
+
+# include "hfsck.h"
+# include "repack.h"
+# include "../version.h"
+
+# define GEN_MAXFOLDERS	(1UL << 20)	/* more would exhaust memory first */
+# define GEN_MAXFORK	(1UL << 30)	/* well inside a fork's signed length */
+# define GEN_MAXEXTS	255		/* extents per split fork */
+# define GEN_MAXGAP	3		/* blocks left free after an extent */
+# define GEN_MAXVOL	(1ULL << 41)	/* the largest HFS volume */
+
+typedef struct {
+  char name[HFS_MAX_FLEN + 1];	/* catalog name */
+  unsigned long parent;		/* index of the enclosing folder */
+  unsigned long size[2];	/* data and resource fork lengths */
+  unsigned char want[2];	/* extents each fork is to be cut into */
+} entry;
+
+typedef struct {
+  unsigned long nfiles;		/* files to create */
+  unsigned int fanout;		/* subfolders in each folder */
+  unsigned int depth;		/* levels of subfolders */
+  unsigned int namemin, namemax;	/* name length range */
+  unsigned long sizemin, sizemax;	/* fork length range */
+  unsigned int rsrc;		/* percentage of files with a resource fork */
+  unsigned int frag;		/* percentage of forks to split */
+  unsigned int maxexts;		/* most extents a split fork is cut into */
+  unsigned int fill;		/* b*-tree node fill percentage */
+
+  unsigned long nfolders;	/* folders, the root first, breadth first */
+  entry *ents;			/* folders, then files */
+  unsigned long *first;		/* each folder's first entry in kids */
+  unsigned long *kids;		/* entries grouped by folder, sorted by name */
+
+  hfsvol *vol;			/* volume being written */
+  unsigned long nextcnid;	/* next file ID to hand out */
+  unsigned int next;		/* next free allocation block */
+  unsigned long nforks;		/* nonempty forks */
+  unsigned long nsplit;		/* forks written as more than one extent */
+  unsigned long nexts;		/* extents written */
+  unsigned long noverflow;	/* extents overflow records written */
+} gen;
+
+typedef struct {
+  unsigned long nodes;		/* nodes begun */
+  unsigned int nrecs;		/* records in the last of them */
+  size_t used;			/* bytes used in the last of them */
+} packer;
+
+extern int optind;
+extern char *optarg;
+
+static unsigned long long seed;
+static const entry *sorting;
+
+/*
+ * NAME:	usage()
+ * DESCRIPTION:	display usage message
+ */
+static
+int usage(char *argv[])
+{
+  fprintf(stderr, "Usage: %s [-s size-MB] [-l label] [-n files] [-f fanout]"
+	  " [-d depth]\n"
+	  "\t[-N name-len[:max]] [-z fork-bytes[:max]] [-r rsrc%%]"
+	  " [-x split%%]\n"
+	  "\t[-e max-extents] [-F fill%%] [-S seed] image-path\n", argv[0]);
+
+  return 1;
+}
+
+/*
+ * NAME:	rnd()
+ * DESCRIPTION:	return a pseudo-random number less than n (xorshift64)
+ */
+static
+unsigned long rnd(unsigned long n)
+{
+  seed ^= seed << 13;
+  seed ^= seed >> 7;
+  seed ^= seed << 17;
+
+  return n ? (unsigned long) ((seed >> 11) % n) : 0;
+}
+
+/*
+ * NAME:	range()
+ * DESCRIPTION:	parse "N" or "MIN:MAX"
+ */
+static
+int range(const char *arg, unsigned long *min, unsigned long *max)
+{
+  char *end;
+
+  *min = strtoul(arg, &end, 0);
+  *max = *min;
+
+  if (*end == ':')
+    *max = strtoul(end + 1, &end, 0);
+
+  return (end == arg || *end || *max < *min) ? -1 : 0;
+}
+
+/*
+ * NAME:	nbits()
+ * DESCRIPTION:	return the number of significant bits in a number
+ */
+static
+unsigned int nbits(unsigned long n)
+{
+  unsigned int bits = 0;
+
+  while (n)
+    ++bits, n >>= 1;
+
+  return bits;
+}
+
+/*
+ * NAME:	forksize()
+ * DESCRIPTION:	choose a fork length
+ */
+static
+unsigned long forksize(const gen *g)
+{
+  unsigned int lo, hi, bits;
+  unsigned long size;
+
+  lo = nbits(g->sizemin);
+  hi = nbits(g->sizemax);
+
+  bits = lo + rnd(hi - lo + 1);
+  if (bits == 0)
+    return 0;
+
+  size = (1UL << (bits - 1)) + rnd(1UL << (bits - 1));
+
+  if (size < g->sizemin)
+    size = g->sizemin;
+  else if (size > g->sizemax)
+    size = g->sizemax;
+
+  return size;
+}
+
+/*
+ * NAME:	makename()
+ * DESCRIPTION:	compose a name unique among those with other ordinals
+ */
+static
+void makename(char *name, unsigned long ordinal, unsigned int len)
+{
+  static const char letters[] =
+    "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ";
+  char digits[16];
+  unsigned int n = 0, i;
+
+  /* the ordinal ends the name in base 36, after the last space */
+
+  do
+    digits[n++] = "0123456789abcdefghijklmnopqrstuvwxyz"[ordinal % 36];
+  while (ordinal /= 36);
+
+  if (len > HFS_MAX_FLEN)
+    len = HFS_MAX_FLEN;
+
+  if (len >= n + 2)
+    {
+      for (i = 0; i < len - n - 1; ++i)
+	*name++ = letters[rnd(sizeof(letters) - 1)];
+
+      *name++ = ' ';
+    }
+
+  while (n)
+    *name++ = digits[--n];
+
+  *name = 0;
+}
+
+/*
+ * NAME:	byname()
+ * DESCRIPTION:	comparison function for qsort of entries by catalog order
+ */
+static
+int byname(const unsigned long *i1, const unsigned long *i2)
+{
+  return d_relstring(sorting[*i1].name, sorting[*i2].name);
+}
+
+/*
+ * NAME:	plan()
+ * DESCRIPTION:	lay out every folder and file in memory
+ */
+static
+int plan(gen *g)
+{
+  unsigned long *ordinal = 0, level, nents, i;
+  entry *e;
+
+  /* a complete tree of folders, so folder i's parent is (i - 1) / fanout */
+
+  g->nfolders = 1;
+
+  for (i = 0, level = 1; i < g->depth && g->fanout; ++i)
+    {
+      if (level > GEN_MAXFOLDERS / g->fanout)
+	ERROR(EINVAL, "too many folders; reduce fanout or depth");
+
+      level       *= g->fanout;
+      g->nfolders += level;
+
+      if (g->nfolders > GEN_MAXFOLDERS)
+	ERROR(EINVAL, "too many folders; reduce fanout or depth");
+    }
+
+  nents = g->nfolders + g->nfiles;
+
+  g->ents  = ALLOC(entry, nents);
+  g->first = ALLOC(unsigned long, g->nfolders + 1);
+  g->kids  = ALLOC(unsigned long, nents);
+  ordinal  = ALLOC(unsigned long, g->nfolders);
+
+  if (g->ents == 0 || g->first == 0 || g->kids == 0 || ordinal == 0)
+    ERROR(ENOMEM, 0);
+
+  memset(ordinal, 0, g->nfolders * sizeof(*ordinal));
+  memset(g->first, 0, (g->nfolders + 1) * sizeof(*g->first));
+
+  for (i = 0; i < nents; ++i)
+    {
+      e = &g->ents[i];
+
+      if (i == 0)
+	e->parent = 0;
+      else if (i < g->nfolders)
+	e->parent = (i - 1) / g->fanout;
+      else
+	e->parent = rnd(g->nfolders);
+
+      makename(e->name, ordinal[e->parent]++,
+	       g->namemin + rnd(g->namemax - g->namemin + 1));
+
+      e->size[0] = e->size[1] = 0;
+      e->want[0] = e->want[1] = 1;
+
+      if (i < g->nfolders)
+	continue;
+
+      e->size[0] = forksize(g);
+      if (rnd(100) < g->rsrc)
+	e->size[1] = forksize(g);
+
+      if (rnd(100) < g->frag)
+	e->want[0] = 2 + rnd(g->maxexts - 1);
+      if (e->size[1] && rnd(100) < g->frag)
+	e->want[1] = 2 + rnd(g->maxexts - 1);
+    }
+
+  /* group the entries by folder, each group in catalog order */
+
+  for (i = 0; i < g->nfolders; ++i)
+    {
+      if (ordinal[i] > 0xffff)
+	ERROR(EINVAL, "too many entries in one folder; raise fanout or depth");
+    }
+
+  for (i = 1; i < nents; ++i)
+    ++g->first[g->ents[i].parent + 1];
+
+  for (i = 0; i < g->nfolders; ++i)
+    g->first[i + 1] += g->first[i];
+
+  memset(ordinal, 0, g->nfolders * sizeof(*ordinal));
+
+  for (i = 1; i < nents; ++i)
+    {
+      unsigned long parent = g->ents[i].parent;
+
+      g->kids[g->first[parent] + ordinal[parent]++] = i;
+    }
+
+  sorting = g->ents;
+
+  for (i = 0; i < g->nfolders; ++i)
+    qsort(g->kids + g->first[i], g->first[i + 1] - g->first[i],
+	  sizeof(*g->kids),
+	  (int (*)(const void *, const void *)) byname);
+
+  FREE(ordinal);
+
+  return 0;
+
+fail:
+  FREE(ordinal);
+
+  return -1;
+}
+
+/*
+ * NAME:	forkexts()
+ * DESCRIPTION:	return the number of extents a fork will be written as
+ */
+static
+unsigned int forkexts(const entry *e, int k, unsigned long alblksz)
+{
+  unsigned long nblocks;
+
+  nblocks = (e->size[k] + alblksz - 1) / alblksz;
+
+  return nblocks < e->want[k] ? nblocks : e->want[k];
+}
+
+/*
+ * NAME:	datablocks()
+ * DESCRIPTION:	return the allocation blocks every fork needs, gaps included
+ */
+static
+unsigned long datablocks(const gen *g, unsigned long alblksz)
+{
+  unsigned long need = 0, i;
+  unsigned int nexts;
+  const entry *e;
+  int k;
+
+  for (i = g->nfolders; i < g->nfolders + g->nfiles; ++i)
+    {
+      e = &g->ents[i];
+
+      for (k = 0; k < 2; ++k)
+	{
+	  nexts = forkexts(e, k, alblksz);
+
+	  need += (e->size[k] + alblksz - 1) / alblksz;
+	  if (nexts > 1)
+	    need += (nexts - 1) * GEN_MAXGAP;
+	}
+    }
+
+  return need;
+}
+
+/*
+ * NAME:	pack()
+ * DESCRIPTION:	account for one record as rp_build() would place it
+ */
+static
+void pack(packer *p, unsigned int reclen, unsigned int fill)
+{
+  size_t used = p->used + reclen + 2;
+
+  if (p->nodes == 0 || p->nrecs >= HFS_MAX_NRECS || used > NODESPACE ||
+      (p->nrecs >= 2 && used * 100 > NODESPACE * fill))
+    {
+      ++p->nodes;
+      p->nrecs = 0;
+      used = reclen + 2;
+    }
+
+  ++p->nrecs;
+  p->used = used;
+}
+
+/*
+ * NAME:	treenodes()
+ * DESCRIPTION:	return the nodes a tree needs, its leaves included
+ */
+static
+unsigned long treenodes(const packer *leaves, unsigned int idxlen,
+			unsigned int fill)
+{
+  unsigned long total, n, i;
+  packer p;
+
+  for (total = n = leaves->nodes; n > 1; total += n)
+    {
+      memset(&p, 0, sizeof(p));
+
+      for (i = 0; i < n; ++i)
+	pack(&p, idxlen, fill);
+
+      n = p.nodes;
+    }
+
+  return total;
+}
+
+/*
+ * NAME:	catreclen()
+ * DESCRIPTION:	return the packed length of a catalog record
+ */
+static
+unsigned int catreclen(unsigned int namelen, unsigned int datalen)
+{
+  unsigned int keylen;
+
+  keylen = 0x05 + (namelen + 1) + ((namelen + 1) & 1);
+
+  return ((1 + keylen + 1) & ~1) + datalen;
+}
+
+/*
+ * NAME:	treebytes()
+ * DESCRIPTION:	return the bytes both trees will take, packed in key order
+ */
+static
+unsigned long long treebytes(const gen *g)
+{
+  packer cat, ext;
+  unsigned long folder, i, n;
+  const entry *e;
+  int k;
+
+  memset(&cat, 0, sizeof(cat));
+  memset(&ext, 0, sizeof(ext));
+
+  /* the same order as emit(), with the longest label for the root */
+
+  pack(&cat, catreclen(HFS_MAX_VLEN, 70), g->fill);
+
+  for (folder = 0; folder < g->nfolders; ++folder)
+    {
+      pack(&cat, catreclen(0, 46), g->fill);
+
+      for (i = g->first[folder]; i < g->first[folder + 1]; ++i)
+	{
+	  e = &g->ents[g->kids[i]];
+
+	  pack(&cat, catreclen(strlen(e->name),
+			       g->kids[i] < g->nfolders ? 70 : 102), g->fill);
+
+	  if (g->kids[i] < g->nfolders)
+	    continue;
+
+	  for (k = 0; k < 2; ++k)
+	    {
+	      for (n = 3; n < e->want[k]; n += 3)
+		pack(&ext, 8 + 12, g->fill);
+	    }
+	}
+    }
+
+  /* index records carry the longest key of each tree */
+
+  return (treenodes(&cat, 38 + 4, g->fill) +
+	  treenodes(&ext,  8 + 4, g->fill)) * (unsigned long long) HFS_BLOCKSZ;
+}
+
+/*
+ * NAME:	fitsize()
+ * DESCRIPTION:	choose a volume size, in bytes, with room for the plan
+ */
+static
+unsigned long long fitsize(const gen *g)
+{
+  unsigned long long tree, size, need;
+  unsigned long vlen, lpa, alblksz, nalblks, i;
+
+  tree = treebytes(g);
+
+  for (i = g->nfolders, size = tree; i < g->nfolders + g->nfiles; ++i)
+    size += g->ents[i].size[0] + g->ents[i].size[1];
+
+  size = (size + size / 8 + (1 << 20) + 511) & ~511ULL;
+
+  /* larger blocks leave fewer to go round; past 2T there are no more */
+
+  for ( ; size < GEN_MAXVOL; size = (size + size / 8 + 511) & ~511ULL)
+    {
+      vlen    = size >> HFS_BLOCKSZ_BITS;
+      lpa     = 1 + ((vlen - 6) >> 16);
+      alblksz = lpa << HFS_BLOCKSZ_BITS;
+      nalblks = (vlen - 8) / lpa - ((vlen / lpa + 0x0fff) >> 12);
+
+      /* the trees, plus the clumps hfs_format() gives them */
+
+      need = tree / alblksz + 2 + 2 * (nalblks / 128) +
+	datablocks(g, alblksz);
+
+      if (need + need / 16 <= nalblks)
+	return size;
+    }
+
+  return 0;
+}
+
+/*
+ * NAME:	place()
+ * DESCRIPTION:	allocate a fork's blocks as a run of extents
+ */
+static
+void place(gen *g, unsigned int nblocks, unsigned int nexts,
+	   ExtDescriptor *exts)
+{
+  hfsvol *vol = g->vol;
+  unsigned int i, len, avg, left = nblocks, abn;
+
+  for (i = 0; i < nexts; ++i)
+    {
+      if (i == nexts - 1)
+	len = left;
+      else
+	{
+	  avg = left / (nexts - i);
+	  len = 1 + rnd(2 * avg - 1);
+
+	  if (len > left - (nexts - 1 - i))
+	    len = left - (nexts - 1 - i);
+	}
+
+      exts[i].xdrStABN    = g->next;
+      exts[i].xdrNumABlks = len;
+
+      for (abn = g->next; abn < g->next + len; ++abn)
+	BMSET(vol->vbm, abn);
+
+      vol->mdb.drFreeBks -= len;
+
+      g->next += len;
+      left    -= len;
+
+      /* a gap keeps the next extent from continuing this one */
+
+      if (i < nexts - 1)
+	g->next += 1 + rnd(GEN_MAXGAP);
+    }
+}
+
+/*
+ * NAME:	putfork()
+ * DESCRIPTION:	lay out one fork of a file record, spooling its overflow
+ */
+static
+int putfork(gen *g, FILE *ext, const entry *e, int k, CatDataRec *data,
+	    int dry)
+{
+  ExtDescriptor exts[GEN_MAXEXTS];
+  ExtDataRec *extrec, rec;
+  ExtKeyRec key;
+  UInteger *stblk;
+  LongInt *lglen, *pylen;
+  byte record[HFS_MAX_EXTRECLEN];
+  unsigned int reclen, nblocks, nexts, fabn, i, j;
+
+  if (k == 0)
+    {
+      extrec = &data->u.fil.filExtRec;
+      stblk  = &data->u.fil.filStBlk;
+      lglen  = &data->u.fil.filLgLen;
+      pylen  = &data->u.fil.filPyLen;
+    }
+  else
+    {
+      extrec = &data->u.fil.filRExtRec;
+      stblk  = &data->u.fil.filRStBlk;
+      lglen  = &data->u.fil.filRLgLen;
+      pylen  = &data->u.fil.filRPyLen;
+    }
+
+  nblocks = (e->size[k] + g->vol->mdb.drAlBlkSiz - 1) /
+    g->vol->mdb.drAlBlkSiz;
+  nexts   = forkexts(e, k, g->vol->mdb.drAlBlkSiz);
+
+  memset(exts, 0, sizeof(exts));
+
+  if (! dry && nexts)
+    {
+      place(g, nblocks, nexts, exts);
+
+      ++g->nforks;
+      g->nexts += nexts;
+      if (nexts > 1)
+	++g->nsplit;
+    }
+
+  *lglen = e->size[k];
+  *pylen = nblocks * g->vol->mdb.drAlBlkSiz;
+  *stblk = exts[0].xdrStABN;
+
+  for (i = 0, fabn = 0; i < 3; ++i)
+    {
+      (*extrec)[i] = exts[i];
+      fabn += exts[i].xdrNumABlks;
+    }
+
+  /* the rest go three to a record, keyed by where they start in the fork */
+
+  for (i = 3; i < nexts; i += 3)
+    {
+      memset(&rec, 0, sizeof(rec));
+
+      r_makeextkey(&key, k ? fkRsrc : fkData, data->u.fil.filFlNum, fabn);
+
+      for (j = 0; j < 3 && i + j < nexts; ++j)
+	{
+	  rec[j] = exts[i + j];
+	  fabn  += exts[i + j].xdrNumABlks;
+	}
+
+      r_packextrec(&key, &rec, record, &reclen);
+
+      if (rp_spool(ext, record, reclen) == -1)
+	goto fail;
+
+      if (! dry)
+	++g->noverflow;
+    }
+
+  return 0;
+
+fail:
+  return -1;
+}
+
+/*
+ * NAME:	cnid()
+ * DESCRIPTION:	return the directory ID of a folder
+ */
+static
+unsigned long cnid(unsigned long folder)
+{
+  return folder ? 15 + folder : HFS_CNID_ROOTDIR;
+}
+
+/*
+ * NAME:	putdir()
+ * DESCRIPTION:	spool a folder's directory record
+ */
+static
+int putdir(gen *g, FILE *cat, unsigned long parid, unsigned long folder,
+	   const char *name)
+{
+  CatKeyRec key;
+  CatDataRec data;
+  byte record[HFS_MAX_CATRECLEN];
+  unsigned int reclen;
+
+  memset(&data, 0, sizeof(data));
+
+  data.cdrType        = cdrDirRec;
+  data.u.dir.dirVal   = g->first[folder + 1] - g->first[folder];
+  data.u.dir.dirDirID = cnid(folder);
+  data.u.dir.dirCrDat = g->vol->mdb.drCrDate;
+  data.u.dir.dirMdDat = data.u.dir.dirCrDat;
+
+  r_makecatkey(&key, parid, name);
+  r_packcatrec(&key, &data, record, &reclen);
+
+  return rp_spool(cat, record, reclen);
+}
+
+/*
+ * NAME:	emit()
+ * DESCRIPTION:	spool every catalog and overflow record in key order
+ */
+static
+int emit(gen *g, FILE *cat, FILE *ext, int dry)
+{
+  CatKeyRec key;
+  CatDataRec data;
+  byte record[HFS_MAX_CATRECLEN];
+  unsigned int reclen;
+  unsigned long folder, i;
+  const entry *e;
+
+  g->nextcnid = cnid(g->nfolders);  /* first ID after the last folder */
+
+  g->nforks = g->nsplit = g->nexts = g->noverflow = 0;
+
+  /* the root's record is the one keyed under its parent */
+
+  if (putdir(g, cat, HFS_CNID_ROOTPAR, 0, g->vol->mdb.drVN) == -1)
+    goto fail;
+
+  /* folder IDs ascend with their index, so each group follows the last */
+
+  for (folder = 0; folder < g->nfolders; ++folder)
+    {
+      memset(&data, 0, sizeof(data));
+
+      data.cdrType          = cdrThdRec;
+      data.u.dthd.thdParID  = folder ?
+	cnid(g->ents[folder].parent) : HFS_CNID_ROOTPAR;
+      strcpy(data.u.dthd.thdCName, folder ?
+	     g->ents[folder].name : g->vol->mdb.drVN);
+
+      r_makecatkey(&key, cnid(folder), "");
+      r_packcatrec(&key, &data, record, &reclen);
+
+      if (rp_spool(cat, record, reclen) == -1)
+	goto fail;
+
+      for (i = g->first[folder]; i < g->first[folder + 1]; ++i)
+	{
+	  e = &g->ents[g->kids[i]];
+
+	  if (g->kids[i] < g->nfolders)
+	    {
+	      if (putdir(g, cat, cnid(folder), g->kids[i], e->name) == -1)
+		goto fail;
+
+	      continue;
+	    }
+
+	  /* files are numbered, and so laid out, in catalog order */
+
+	  memset(&data, 0, sizeof(data));
+
+	  data.cdrType          = cdrFilRec;
+	  data.u.fil.filFlNum   = g->nextcnid++;
+	  data.u.fil.filCrDat   = g->vol->mdb.drCrDate;
+	  data.u.fil.filMdDat   = data.u.fil.filCrDat;
+
+	  if (putfork(g, ext, e, 0, &data, dry) == -1 ||
+	      putfork(g, ext, e, 1, &data, dry) == -1)
+	    goto fail;
+
+	  r_makecatkey(&key, cnid(folder), e->name);
+	  r_packcatrec(&key, &data, record, &reclen);
+
+	  if (rp_spool(cat, record, reclen) == -1)
+	    goto fail;
+	}
+    }
+
+  return 0;
+
+fail:
+  return -1;
+}
+
+/*
+ * NAME:	grow()
+ * DESCRIPTION:	extend a b*-tree file to hold a number of free nodes
+ */
+static
+int grow(btree *bt, unsigned long nnodes)
+{
+  hfsvol *vol = bt->f.vol;
+  ULongInt *clump, saved;
+  unsigned long more;
+
+  clump = (bt == &vol->ext) ? &vol->mdb.drXTClpSiz : &vol->mdb.drCTClpSiz;
+  saved = *clump;
+
+  while (bt->hdr.bthFree < nnodes)
+    {
+      /* ask for it all as one clump, with room for new map nodes */
+
+      more = nnodes - bt->hdr.bthFree;
+      more += more / (HFS_MAPXSZ * 8) + 2;
+
+      *clump = (more * bt->hdr.bthNodeSize + vol->mdb.drAlBlkSiz - 1) /
+	vol->mdb.drAlBlkSiz * vol->mdb.drAlBlkSiz;
+
+      if (bt_space(bt, nnodes) == -1)
+	{
+	  *clump = saved;
+	  return -1;
+	}
+    }
+
+  *clump = saved;
+
+  return 0;
+}
+
+/*
+ * NAME:	generate()
+ * DESCRIPTION:	write the planned folders and files to a mounted volume
+ */
+static
+int generate(gen *g, hfsvol *vol, rpstat *catst, rpstat *extst)
+{
+  FILE *cat = 0, *ext = 0;
+  unsigned long need, i;
+
+  g->vol = vol;
+
+  /* a first pass only measures the records, so the trees can be sized */
+
+  cat = tmpfile();
+  ext = tmpfile();
+  if (cat == 0 || ext == 0)
+    ERROR(errno, "error creating temporary record stream");
+
+  if (emit(g, cat, ext, 1) == -1 ||
+      rp_size(&vol->ext, ext, g->fill, extst) == -1 ||
+      rp_size(&vol->cat, cat, g->fill, catst) == -1)
+    goto fail;
+
+  if (v_dirty(vol) == -1 ||
+      grow(&vol->ext, extst->nleaf + extst->nindex) == -1 ||
+      grow(&vol->cat, catst->nleaf + catst->nindex) == -1)
+    goto fail;
+
+  /* the extents tree is replaced, so nothing may have been put there */
+
+  if (vol->ext.hdr.bthNRecs)
+    ERROR(EIO, "catalog file needs overflow extents");
+
+  /* the forks go after the trees, in one sweep */
+
+  g->next = vol->mdb.drAllocPtr;
+
+  need = datablocks(g, vol->mdb.drAlBlkSiz);
+
+  if (need > vol->mdb.drNmAlBlks - g->next)
+    ERROR(ENOSPC, "volume too small for the planned files");
+
+  fclose(cat);
+  fclose(ext);
+
+  cat = tmpfile();
+  ext = tmpfile();
+  if (cat == 0 || ext == 0)
+    ERROR(errno, "error creating temporary record stream");
+
+  if (emit(g, cat, ext, 0) == -1 ||
+      rp_build(&vol->ext, ext, g->fill, extst) == -1 ||
+      rp_build(&vol->cat, cat, g->fill, catst) == -1)
+    goto fail;
+
+  fclose(cat);
+  fclose(ext);
+
+  vol->mdb.drAllocPtr = g->next;
+  vol->mdb.drNxtCNID  = g->nextcnid;
+  vol->mdb.drFilCnt   = g->nfiles;
+  vol->mdb.drDirCnt   = g->nfolders - 1;
+  vol->mdb.drNmFls    = 0;
+  vol->mdb.drNmRtDirs = 0;
+
+  for (i = g->first[0]; i < g->first[1]; ++i)
+    {
+      if (g->kids[i] < g->nfolders)
+	++vol->mdb.drNmRtDirs;
+      else
+	++vol->mdb.drNmFls;
+    }
+
+  vol->flags |= HFS_VOL_UPDATE_MDB | HFS_VOL_UPDATE_ALTMDB |
+    HFS_VOL_UPDATE_VBM;
+
+  return 0;
+
+fail:
+  if (cat)
+    fclose(cat);
+  if (ext)
+    fclose(ext);
+
+  return -1;
+}
+
+/*
+ * NAME:	report()
+ * DESCRIPTION:	print one line of b*-tree statistics
+ */
+static
+void report(const char *label, const rpstat *st)
+{
+  printf("  %-8s %7u %9lu %9lu %9lu %9lu\n", label, st->depth,
+	 st->nindex, st->nleaf, st->nfree, st->nrecs);
+}
+
+/*
+ * NAME:	main()
+ * DESCRIPTION:	program entry
+ */
+int main(int argc, char *argv[])
+{
+  const char *path, *label = "Untitled";
+  unsigned long long size = 0;
+  unsigned long min, max;
+  rpstat catst, extst;
+  hfsvol vol;
+  gen g;
+  int fd;
+
+  if (argc == 2)
+    {
+      if (strcmp(argv[1], "--version") == 0)
+	{
+	  printf("%s - %s\n", hfsutils_version, hfsutils_copyright);
+	  printf("`%s --license' for licensing information.\n", argv[0]);
+	  return 0;
+	}
+      else if (strcmp(argv[1], "--license") == 0)
+	{
+	  printf("\n%s", hfsutils_license);
+	  return 0;
+	}
+    }
+
+  memset(&g, 0, sizeof(g));
+
+  g.nfiles  = 10000;
+  g.fanout  = 8;
+  g.depth   = 3;
+  g.namemin = 8;
+  g.namemax = HFS_MAX_FLEN;
+  g.sizemin = 0;
+  g.sizemax = 256 * 1024;
+  g.rsrc    = 10;
+  g.frag    = 0;
+  g.maxexts = 8;
+  g.fill    = RP_FILL_DEF;
+
+  seed = 1;
+
+  while (1)
+    {
+      int opt;
+
+      opt = getopt(argc, argv, "s:l:n:f:d:N:z:r:x:e:F:S:");
+      if (opt == EOF)
+	break;
+
+      switch (opt)
+	{
+	case '?':
+	  return usage(argv);
+
+	case 's':
+	  size = strtoull(optarg, 0, 0) << 20;
+	  break;
+
+	case 'l':
+	  label = optarg;
+	  break;
+
+	case 'n':
+	  g.nfiles = strtoul(optarg, 0, 0);
+	  break;
+
+	case 'f':
+	  g.fanout = atoi(optarg);
+	  break;
+
+	case 'd':
+	  g.depth = atoi(optarg);
+	  break;
+
+	case 'N':
+	  if (range(optarg, &min, &max) == -1 ||
+	      min < 1 || max > HFS_MAX_FLEN)
+	    {
+	      fprintf(stderr, "%s: name lengths must be between 1 and %d\n",
+		      argv[0], HFS_MAX_FLEN);
+	      return 1;
+	    }
+
+	  g.namemin = min;
+	  g.namemax = max;
+	  break;
+
+	case 'z':
+	  if (range(optarg, &min, &max) == -1 || max > GEN_MAXFORK)
+	    {
+	      fprintf(stderr, "%s: fork lengths must be at most %lu\n",
+		      argv[0], GEN_MAXFORK);
+	      return 1;
+	    }
+
+	  g.sizemin = min;
+	  g.sizemax = max;
+	  break;
+
+	case 'r':
+	  g.rsrc = atoi(optarg);
+	  break;
+
+	case 'x':
+	  g.frag = atoi(optarg);
+	  break;
+
+	case 'e':
+	  g.maxexts = atoi(optarg);
+	  if (g.maxexts < 2 || g.maxexts > GEN_MAXEXTS)
+	    {
+	      fprintf(stderr, "%s: extents per split fork must be between"
+		      " 2 and %d\n", argv[0], GEN_MAXEXTS);
+	      return 1;
+	    }
+	  break;
+
+	case 'F':
+	  g.fill = atoi(optarg);
+	  if (g.fill < RP_FILL_MIN || g.fill > RP_FILL_MAX)
+	    {
+	      fprintf(stderr, "%s: fill factor must be between %d and %d\n",
+		      argv[0], RP_FILL_MIN, RP_FILL_MAX);
+	      return 1;
+	    }
+	  break;
+
+	case 'S':
+	  seed = strtoull(optarg, 0, 0);
+	  break;
+	}
+    }
+
+  if (argc - optind != 1)
+    return usage(argv);
+
+  path = argv[optind];
+
+  if (g.depth && g.fanout == 0)
+    g.depth = 0;
+
+  /* xorshift never leaves zero */
+
+  seed = seed * 0x9e3779b97f4a7c15ULL | 1;
+
+  if (plan(&g) == -1)
+    {
+      fprintf(stderr, "%s: %s\n", argv[0], hfs_error ? hfs_error
+	      : strerror(errno));
+      return 1;
+    }
+
+  if (size == 0)
+    size = fitsize(&g);
+
+  if (size == 0)
+    {
+      fprintf(stderr, "%s: the forks need more than the 65535 allocation"
+	      " blocks of any HFS volume\n", argv[0]);
+      return 1;
+    }
+
+  fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+  if (fd == -1 ||
+      ftruncate(fd, size) == -1 ||
+      close(fd) == -1)
+    {
+      perror(path);
+      return 1;
+    }
+
+  if (hfs_format(path, 0, 0, label, 0, 0) == -1)
+    {
+      fprintf(stderr, "%s: %s: %s\n", argv[0], path, hfs_error ? hfs_error
+	      : strerror(errno));
+      return 1;
+    }
+
+  v_init(&vol, 0);
+
+  if (v_open(&vol, path, HFS_MODE_RDWR) == -1 ||
+      v_geometry(&vol, 0) == -1 ||
+      v_mount(&vol) == -1)
+    {
+      perror(path);
+      v_close(&vol);
+      return 1;
+    }
+
+  if (generate(&g, &vol, &catst, &extst) == -1)
+    {
+      fprintf(stderr, "%s: %s\n", argv[0], hfs_error ? hfs_error
+	      : strerror(errno));
+
+      vol.flags &= ~HFS_VOL_MOUNTED;
+      v_close(&vol);
+      return 1;
+    }
+
+  printf("*** Generated \"%s\": %lu files in %lu folders, %llu MB\n",
+	 vol.mdb.drVN, g.nfiles, g.nfolders, size >> 20);
+  printf("  %lu extents in %lu forks, %lu split, %lu overflow records\n",
+	 g.nexts, g.nforks, g.nsplit, g.noverflow);
+  printf("  %u of %u allocation blocks of %lu bytes free\n",
+	 vol.mdb.drFreeBks, vol.mdb.drNmAlBlks,
+	 (unsigned long) vol.mdb.drAlBlkSiz);
+
+  printf("  %-8s %7s %9s %9s %9s %9s\n", "", "depth",
+	 "index", "leaf", "free", "records");
+
+  report("catalog", &catst);
+  report("extents", &extst);
+
+  if (v_close(&vol) == -1)
+    {
+      perror("closing volume");
+      return 1;
+    }
+
+  return 0;
+}
@@ -0,0 +1,278 @@
+/*
+ * hrepack - tool for rebuilding the B*-trees of HFS volumes
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+# include <stdio.h>
+# include <stdlib.h>
+# include <string.h>
+# include <unistd.h>
+# include <errno.h>
+
+# include "hfsck.h"
+# include "repack.h"
+# include "../suid.h"
+# include "../version.h"
+
+# define RP_EXTENTS	0x0001
+# define RP_CATALOG	0x0002
+# define RP_DRYRUN	0x0100
+
+extern int optind;
+extern char *optarg;
+
+/*
+ * NAME:	usage()
+ * DESCRIPTION:	display usage message
+ */
+static
+int usage(char *argv[])
+{
+  fprintf(stderr, "Usage: %s [-n] [-c | -e] [-f fill%%] device-path"
+	  " [partition-no]\n", argv[0]);
+
+  return 1;
+}
+
+/*
+ * NAME:	report()
+ * DESCRIPTION:	print one line of b*-tree statistics
+ */
+static
+void report(const char *label, const rpstat *st)
+{
+  printf("  %-8s %7u %9lu %9lu %9lu %9lu\n", label, st->depth,
+	 st->nindex, st->nleaf, st->nfree, st->nrecs);
+}
+
+/*
+ * NAME:	dotree()
+ * DESCRIPTION:	report on and optionally rebuild one b*-tree
+ */
+static
+int dotree(btree *bt, int options, unsigned int fill)
+{
+  rpstat before, after;
+
+  printf("*** %s %s B*-tree\n",
+	 (options & RP_DRYRUN) ? "Examining" : "Repacking", bt->f.name);
+
+  if (options & RP_DRYRUN)
+    {
+      if (rp_stat(bt, &before) == -1)
+	return -1;
+    }
+  else if (rp_repack(bt, fill, &before, &after) == -1)
+    return -1;
+
+  printf("  %-8s %7s %9s %9s %9s %9s\n", "", "depth",
+	 "index", "leaf", "free", "records");
+
+  report("before", &before);
+
+  if (! (options & RP_DRYRUN))
+    report("after", &after);
+
+  return 0;
+}
+
+/*
+ * NAME:	main()
+ * DESCRIPTION:	program entry
+ */
+int main(int argc, char *argv[])
+{
+  char *path;
+  int nparts, pnum, result, options;
+  unsigned int fill = RP_FILL_DEF;
+  hfsvol vol;
+
+  suid_init();
+
+  if (argc == 2)
+    {
+      if (strcmp(argv[1], "--version") == 0)
+	{
+	  printf("%s - %s\n", hfsutils_version, hfsutils_copyright);
+	  printf("`%s --license' for licensing information.\n", argv[0]);
+	  return 0;
+	}
+      else if (strcmp(argv[1], "--license") == 0)
+	{
+	  printf("\n%s", hfsutils_license);
+	  return 0;
+	}
+    }
+
+  options = RP_EXTENTS | RP_CATALOG;
+
+  while (1)
+    {
+      int opt;
+
+      opt = getopt(argc, argv, "ncef:");
+      if (opt == EOF)
+	break;
+
+      switch (opt)
+	{
+	case '?':
+	  return usage(argv);
+
+	case 'n':
+	  options |= RP_DRYRUN;
+	  break;
+
+	case 'c':
+	  options &= ~RP_EXTENTS;
+	  break;
+
+	case 'e':
+	  options &= ~RP_CATALOG;
+	  break;
+
+	case 'f':
+	  fill = atoi(optarg);
+	  if (fill < RP_FILL_MIN || fill > RP_FILL_MAX)
+	    {
+	      fprintf(stderr, "%s: fill factor must be between %d and %d\n",
+		      argv[0], RP_FILL_MIN, RP_FILL_MAX);
+	      return 1;
+	    }
+	  break;
+	}
+    }
+
+  if (! (options & (RP_EXTENTS | RP_CATALOG)) ||
+      argc - optind < 1 ||
+      argc - optind > 2)
+    return usage(argv);
+
+  path = argv[optind];
+
+  suid_enable();
+  nparts = hfs_nparts(path);
+  suid_disable();
+
+  if (nparts == 0)
+    {
+      fprintf(stderr, "%s: partitioned medium contains no HFS partitions\n",
+	      argv[0]);
+      return 1;
+    }
+
+  if (argc - optind == 2)
+    {
+      pnum = atoi(argv[optind + 1]);
+
+      if (pnum < 0)
+	{
+	  fprintf(stderr, "%s: invalid partition number\n", argv[0]);
+	  return 1;
+	}
+
+      if (nparts == -1 && pnum > 0)
+	{
+	  fprintf(stderr, "%s: warning: ignoring partition number for"
+		  " non-partitioned medium\n", argv[0]);
+	  pnum = 0;
+	}
+      else if (nparts > 0 && pnum == 0)
+	{
+	  fprintf(stderr, "%s: cannot specify whole medium"
+		  " (has %d partition%s)\n", argv[0], nparts,
+		  nparts == 1 ? "" : "s");
+	  return 1;
+	}
+      else if (nparts > 0 && pnum > nparts)
+	{
+	  fprintf(stderr, "%s: invalid partition number (only %d available)\n",
+		  argv[0], nparts);
+	  return 1;
+	}
+    }
+  else
+    {
+      if (nparts > 1)
+	{
+	  fprintf(stderr, "%s: must specify partition number (%d available)\n",
+		  argv[0], nparts);
+	  return 1;
+	}
+      else if (nparts == -1)
+	pnum = 0;
+      else
+	pnum = 1;
+    }
+
+  v_init(&vol, 0);
+
+  suid_enable();
+  result = v_open(&vol, path, (options & RP_DRYRUN) ?
+		  HFS_MODE_RDONLY : HFS_MODE_RDWR);
+  suid_disable();
+
+  if (result == -1)
+    {
+      perror(path);
+      return 1;
+    }
+
+  if (options & RP_DRYRUN)
+    vol.flags |= HFS_VOL_READONLY;
+
+  if (v_geometry(&vol, pnum) == -1 ||
+      v_mount(&vol) == -1)
+    {
+      perror(path);
+      v_close(&vol);
+      return 1;
+    }
+
+  if (! (options & RP_DRYRUN) && (vol.flags & HFS_VOL_READONLY))
+    {
+      fprintf(stderr, "%s: %s is locked; cannot repack\n", argv[0], path);
+      v_close(&vol);
+      return 1;
+    }
+
+  /*
+   * The catalog file may have overflow extents, so the extents tree is
+   * rebuilt first and left alone while the catalog is read and rewritten.
+   */
+
+  if ((! (options & RP_DRYRUN) && v_dirty(&vol) == -1) ||
+      ((options & RP_EXTENTS) && dotree(&vol.ext, options, fill) == -1) ||
+      ((options & RP_CATALOG) && dotree(&vol.cat, options, fill) == -1))
+    {
+      fprintf(stderr, "%s: %s\n", argv[0], hfs_error ? hfs_error
+	      : strerror(errno));
+
+      /* leave the volume marked in use so it is scavenged when mounted */
+
+      vol.flags &= ~HFS_VOL_MOUNTED;
+      v_close(&vol);
+      return 1;
+    }
+
+  if (v_close(&vol) == -1)
+    {
+      perror("closing volume");
+      return 1;
+    }
+
+  return 0;
+}
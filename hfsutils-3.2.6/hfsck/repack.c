@@ -0,0 +1,503 @@
+/*
+ * hrepack - tool for rebuilding the B*-trees of HFS volumes
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+# include <stdio.h>
+# include <string.h>
+# include <errno.h>
+
+# include "hfsck.h"
+
+# include "repack.h"
+
+typedef struct {
+  unsigned long count;		/* nodes in the level */
+  unsigned long nrecs;		/* records in those nodes */
+  unsigned long first;		/* leftmost node */
+  unsigned long last;		/* rightmost node */
+} level;
+
+/*
+ * NAME:	rp->spool()
+ * DESCRIPTION:	append a record to a temporary record stream
+ */
+int rp_spool(FILE *stream, const byte *record, unsigned int reclen)
+{
+  if (putc(reclen >> 8, stream) == EOF ||
+      putc(reclen & 0xff, stream) == EOF ||
+      fwrite(record, 1, reclen, stream) != reclen)
+    ERROR(errno, "error writing temporary record stream");
+
+  return 0;
+
+fail:
+  return -1;
+}
+
+/*
+ * NAME:	unspool()
+ * DESCRIPTION:	fetch the next record from a temporary record stream
+ */
+static
+int unspool(FILE *stream, byte *record, unsigned int *reclen)
+{
+  int hi, lo;
+
+  hi = getc(stream);
+  if (hi == EOF)
+    return 0;
+
+  lo = getc(stream);
+  if (lo == EOF)
+    ERROR(EIO, "truncated temporary record stream");
+
+  *reclen = (hi << 8) | lo;
+
+  if (*reclen > HFS_MAX_RECLEN ||
+      fread(record, 1, *reclen, stream) != *reclen)
+    ERROR(EIO, "truncated temporary record stream");
+
+  return 1;
+
+fail:
+  return -1;
+}
+
+/*
+ * NAME:	readleaves()
+ * DESCRIPTION:	walk the leaf chain in order, optionally spooling each record
+ */
+static
+int readleaves(btree *bt, FILE *stream, rpstat *st)
+{
+  byte key1[HFS_MAX_KEYLEN], key2[HFS_MAX_KEYLEN];
+  void *prev = key1, *this = key2, *tmp;
+  unsigned long nnum, count = 0;
+  node n;
+  int i, first = 1;
+
+  st->nleaf = 0;
+  st->nrecs = 0;
+
+  for (nnum = bt->hdr.bthFNode; nnum; nnum = n.nd.ndFLink)
+    {
+      if (++count > bt->hdr.bthNNodes)
+	ERROR(EIO, "b*-tree leaf chain loops");
+
+      if (bt_getnode(&n, bt, nnum) == -1)
+	goto fail;
+
+      if (n.nd.ndType != ndLeafNode)
+	ERROR(EIO, "non-leaf node in b*-tree leaf chain");
+
+      ++st->nleaf;
+
+      for (i = 0; i < n.nd.ndNRecs; ++i)
+	{
+	  const byte *rec;
+
+	  rec = HFS_NODEREC(n, i);
+
+	  if (HFS_RECKEYLEN(rec) == 0)
+	    continue;  /* deleted record */
+
+	  bt->keyunpack(rec, this);
+
+	  if (! first && bt->keycompare(prev, this) >= 0)
+	    ERROR(EIO, "b*-tree leaf records out of order");
+
+	  if (stream && rp_spool(stream, rec, HFS_RECLEN(n, i)) == -1)
+	    goto fail;
+
+	  ++st->nrecs;
+
+	  tmp = prev, prev = this, this = tmp;
+	  first = 0;
+	}
+    }
+
+  return 0;
+
+fail:
+  return -1;
+}
+
+/*
+ * NAME:	countmap()
+ * DESCRIPTION:	return the number of map nodes chained from the header
+ */
+static
+long countmap(btree *bt)
+{
+  unsigned long nnum;
+  long count = 0;
+  node n;
+
+  for (nnum = bt->hdrnd.nd.ndFLink; nnum; nnum = n.nd.ndFLink)
+    {
+      if ((unsigned long) count >= bt->hdr.bthNNodes)
+	ERROR(EIO, "b*-tree map chain loops");
+
+      if (bt_getnode(&n, bt, nnum) == -1)
+	goto fail;
+
+      ++count;
+    }
+
+  return count;
+
+fail:
+  return -1;
+}
+
+/*
+ * NAME:	rp->stat()
+ * DESCRIPTION:	gather node usage statistics for a b*-tree
+ */
+int rp_stat(btree *bt, rpstat *st)
+{
+  long nmap;
+  unsigned long used;
+
+  nmap = countmap(bt);
+  if (nmap == -1 ||
+      readleaves(bt, 0, st) == -1)
+    goto fail;
+
+  st->depth = bt->hdr.bthDepth;
+  st->nmap  = nmap;
+  st->nfree = bt->hdr.bthFree;
+
+  used = bt->hdr.bthNNodes - bt->hdr.bthFree;
+
+  if (used < 1 + st->nmap + st->nleaf)
+    ERROR(EIO, "b*-tree free node count is inconsistent");
+
+  st->nindex = used - 1 - st->nmap - st->nleaf;
+
+  return 0;
+
+fail:
+  return -1;
+}
+
+/*
+ * NAME:	resetmap()
+ * DESCRIPTION:	mark every node free except the header and map nodes
+ */
+static
+int resetmap(btree *bt)
+{
+  unsigned long nnum, used = 0;
+  node n;
+
+  memset(bt->map, 0, bt->mapsz);
+
+  BMSET(bt->map, 0);
+  ++used;
+
+  for (nnum = bt->hdrnd.nd.ndFLink; nnum; nnum = n.nd.ndFLink)
+    {
+      BMSET(bt->map, nnum);
+      ++used;
+
+      if (bt_getnode(&n, bt, nnum) == -1)
+	goto fail;
+    }
+
+  bt->hdr.bthFree = bt->hdr.bthNNodes - used;
+  bt->fhint       = 0;
+
+  bt->flags |= HFS_BT_UPDATE_HDR;
+
+  return 0;
+
+fail:
+  return -1;
+}
+
+/*
+ * NAME:	fits()
+ * DESCRIPTION:	return 1 iff a record may be appended under the fill limit
+ */
+static
+int fits(const node *np, unsigned int reclen, unsigned int fill)
+{
+  size_t used = NODEUSED(*np) + reclen + 2;
+
+  if (np->nd.ndNRecs >= HFS_MAX_NRECS || used > NODESPACE)
+    return 0;
+
+  /* always take two records, so each level is smaller than the last */
+
+  return np->nd.ndNRecs < 2 || used * 100 <= NODESPACE * fill;
+}
+
+/*
+ * NAME:	finish()
+ * DESCRIPTION:	write a completed node and spool its index record
+ */
+static
+int finish(node *np, FILE *up, int dry)
+{
+  byte record[HFS_MAX_RECLEN];
+  unsigned int reclen;
+
+  if (! dry && bt_putnode(np) == -1)
+    goto fail;
+
+  n_index(np, record, &reclen);
+
+  return rp_spool(up, record, reclen);
+
+fail:
+  return -1;
+}
+
+/*
+ * NAME:	newnode()
+ * DESCRIPTION:	start the next node of a level
+ */
+static
+int newnode(node *np, btree *bt, int type, int height, int dry, level *lv)
+{
+  n_init(np, bt, type, height);
+
+  /* a dry run only counts; its nodes are numbered but never allocated */
+
+  if (dry)
+    np->nnum = lv->count;
+  else if (n_new(np) == -1)
+    return -1;
+
+  ++lv->count;
+
+  return 0;
+}
+
+/*
+ * NAME:	buildlevel()
+ * DESCRIPTION:	pack a sorted record stream into one level of linked nodes
+ */
+static
+int buildlevel(btree *bt, FILE *down, FILE *up, int type, int height,
+	       unsigned int fill, int dry, level *lv)
+{
+  byte record[HFS_MAX_RECLEN];
+  unsigned int reclen;
+  node n, next;
+  int result, open = 0;
+
+  lv->count = 0;
+  lv->nrecs = 0;
+  lv->first = 0;
+  lv->last  = 0;
+
+  rewind(down);
+
+  while ((result = unspool(down, record, &reclen)) == 1)
+    {
+      if (open && ! fits(&n, reclen, fill))
+	{
+	  if (newnode(&next, bt, type, height, dry, lv) == -1)
+	    goto fail;
+
+	  n.nd.ndFLink    = next.nnum;
+	  next.nd.ndBLink = n.nnum;
+
+	  if (finish(&n, up, dry) == -1)
+	    goto fail;
+
+	  n = next;
+	}
+      else if (! open)
+	{
+	  if (newnode(&n, bt, type, height, dry, lv) == -1)
+	    goto fail;
+
+	  lv->first = n.nnum;
+	  open = 1;
+	}
+
+      memcpy(HFS_NODEREC(n, n.nd.ndNRecs), record, reclen);
+      n.roff[n.nd.ndNRecs + 1] = n.roff[n.nd.ndNRecs] + reclen;
+      ++n.nd.ndNRecs;
+
+      ++lv->nrecs;
+    }
+
+  if (result == -1)
+    goto fail;
+
+  if (open)
+    {
+      if (finish(&n, up, dry) == -1)
+	goto fail;
+
+      lv->last = n.nnum;
+    }
+
+  return 0;
+
+fail:
+  return -1;
+}
+
+/*
+ * NAME:	build()
+ * DESCRIPTION:	pack a sorted leaf record stream into a whole b*-tree
+ */
+static
+int build(btree *bt, FILE *leaves, unsigned int fill, int dry, rpstat *st)
+{
+  FILE *down = leaves, *up;
+  level lv;
+  int height;
+
+  up = tmpfile();
+  if (up == 0)
+    ERROR(errno, "error creating temporary record stream");
+
+  if (buildlevel(bt, down, up, ndLeafNode, 1, fill, dry, &lv) == -1)
+    goto fail;
+
+  st->nleaf  = lv.count;
+  st->nindex = 0;
+  st->nrecs  = lv.nrecs;
+
+  if (! dry)
+    {
+      bt->hdr.bthFNode = lv.first;
+      bt->hdr.bthLNode = lv.last;
+    }
+
+  /* each pass consumes the index records spooled by the level below */
+
+  for (height = 1; lv.count > 1; ++height)
+    {
+      if (down != leaves)
+	fclose(down);
+
+      down = up;
+
+      up = tmpfile();
+      if (up == 0)
+	ERROR(errno, "error creating temporary record stream");
+
+      if (buildlevel(bt, down, up, ndIndxNode, height + 1, fill, dry,
+		     &lv) == -1)
+	goto fail;
+
+      st->nindex += lv.count;
+    }
+
+  st->depth = st->nrecs ? height : 0;
+
+  if (! dry)
+    {
+      bt->hdr.bthDepth = st->depth;
+      bt->hdr.bthRoot  = lv.last;
+      bt->hdr.bthNRecs = st->nrecs;
+
+      bt->flags |= HFS_BT_UPDATE_HDR;
+
+      if (bt_writehdr(bt) == -1)
+	goto fail;
+    }
+
+  if (down != leaves)
+    fclose(down);
+
+  fclose(up);
+
+  return 0;
+
+fail:
+  if (down != leaves)
+    fclose(down);
+  if (up)
+    fclose(up);
+
+  return -1;
+}
+
+/*
+ * NAME:	rp->size()
+ * DESCRIPTION:	count the nodes rp_build() would use for a record stream
+ */
+int rp_size(btree *bt, FILE *leaves, unsigned int fill, rpstat *st)
+{
+  st->nmap  = 0;
+  st->nfree = 0;
+
+  return build(bt, leaves, fill, 1, st);
+}
+
+/*
+ * NAME:	rp->build()
+ * DESCRIPTION:	replace a b*-tree's contents with a sorted leaf record stream
+ */
+int rp_build(btree *bt, FILE *leaves, unsigned int fill, rpstat *st)
+{
+  long nmap;
+
+  nmap = countmap(bt);
+  if (nmap == -1 ||
+      resetmap(bt) == -1 ||
+      build(bt, leaves, fill, 0, st) == -1)
+    goto fail;
+
+  st->nmap  = nmap;
+  st->nfree = bt->hdr.bthFree;
+
+  return 0;
+
+fail:
+  return -1;
+}
+
+/*
+ * NAME:	rp->repack()
+ * DESCRIPTION:	rebuild a b*-tree bottom-up with nodes filled to a percentage
+ */
+int rp_repack(btree *bt, unsigned int fill, rpstat *before, rpstat *after)
+{
+  FILE *down;
+
+  if (rp_stat(bt, before) == -1)
+    goto fail;
+
+  /* stream every live leaf record out before any node is reused */
+
+  down = tmpfile();
+  if (down == 0)
+    ERROR(errno, "error creating temporary record stream");
+
+  if (readleaves(bt, down, after) == -1 ||
+      rp_build(bt, down, fill, after) == -1)
+    {
+      fclose(down);
+      goto fail;
+    }
+
+  fclose(down);
+
+  return 0;
+
+fail:
+  return -1;
+}
@@ -0,0 +1,46 @@
+/*
+ * hrepack - tool for rebuilding the B*-trees of HFS volumes
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+typedef struct {
+  unsigned int depth;		/* number of levels in the tree */
+  unsigned long nindex;		/* index nodes in use */
+  unsigned long nleaf;		/* leaf nodes in use */
+  unsigned long nmap;		/* map nodes (not counting the header) */
+  unsigned long nfree;		/* unallocated nodes */
+  unsigned long nrecs;		/* live leaf records */
+} rpstat;
+
+/* bytes a node can hold for records, including their offsets */
+
+# define NODESPACE	(HFS_BLOCKSZ - 0x00e - 2)
+
+/* bytes used by the records of a node, including their offsets */
+
+# define NODEUSED(n)	\
+  ((size_t) ((n).roff[(n).nd.ndNRecs] - 0x00e + 2 * (n).nd.ndNRecs))
+
+# define RP_FILL_MIN	50
+# define RP_FILL_MAX	100
+# define RP_FILL_DEF	90
+
+int rp_spool(FILE *, const byte *, unsigned int);
+
+int rp_stat(btree *, rpstat *);
+int rp_size(btree *, FILE *, unsigned int, rpstat *);
+int rp_build(btree *, FILE *, unsigned int, rpstat *);
+int rp_repack(btree *, unsigned int, rpstat *, rpstat *);
@@ -26,39 +26,73 @@
 # include <stdlib.h>
 # include <string.h>
 # include <errno.h>
+# include <time.h>
 
 # include "libhfs.h"
 # include "volume.h"
 # include "block.h"
+# include "data.h"
 # include "os.h"
 
 # define INUSE(b)	((b)->flags & HFS_BUCKET_INUSE)
 # define DIRTY(b)	((b)->flags & HFS_BUCKET_DIRTY)
 
 /*
- * NAME:	block->init()
- * DESCRIPTION:	initialize a volume's block cache
+ * NAME:	freecache()
+ * DESCRIPTION:	dispose of a block cache and its tables
  */
-int b_init(hfsvol *vol)
+static
+void freecache(bcache *cache)
 {
-  bcache *cache;
-  int i;
+  if (cache == 0)
+    return;
 
-  ASSERT(vol->cache == 0);
+  FREE(cache->chain);
+  FREE(cache->hash);
+  FREE(cache->pool);
+
+  FREE(cache);
+}
+
+/*
+ * NAME:	newcache()
+ * DESCRIPTION:	construct an empty block cache with the given number of buckets
+ */
+static
+bcache *newcache(hfsvol *vol, unsigned int size, unsigned int readahead)
+{
+  bcache *cache;
+  unsigned int i;
 
   cache = ALLOC(bcache, 1);
   if (cache == 0)
     ERROR(ENOMEM, 0);
 
-  vol->cache = cache;
+  /* keep hash chains about four buckets long */
+
+  for (cache->hashsz = HFS_HASHSZ; cache->hashsz < size / 4; )
+    cache->hashsz <<= 1;
+
+  cache->size      = size;
+  cache->readahead = readahead;
+
+  cache->chain = ALLOC(bucket, size);
+  cache->hash  = ALLOC(bucket *, cache->hashsz);
+  cache->pool  = ALLOC(block, size);
+
+  if (cache->chain == 0 || cache->hash == 0 || cache->pool == 0)
+    {
+      freecache(cache);
+      ERROR(ENOMEM, 0);
+    }
 
   cache->vol    = vol;
-  cache->tail   = &cache->chain[HFS_CACHESZ - 1];
+  cache->tail   = &cache->chain[size - 1];
 
   cache->hits   = 0;
   cache->misses = 0;
 
-  for (i = 0; i < HFS_CACHESZ; ++i)
+  for (i = 0; i < size; ++i)
     {
       bucket *b = &cache->chain[i];
 
@@ -78,9 +112,147 @@ int b_init(hfsvol *vol)
   cache->chain[0].cprev = cache->tail;
   cache->tail->cnext    = &cache->chain[0];
 
-  for (i = 0; i < HFS_HASHSZ; ++i)
+  for (i = 0; i < cache->hashsz; ++i)
     cache->hash[i] = 0;
 
+  return cache;
+
+fail:
+  return 0;
+}
+
+/*
+ * NAME:	usecs()
+ * DESCRIPTION:	return a monotonic time in microseconds
+ */
+static
+unsigned long long usecs(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (unsigned long long) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/*
+ * NAME:	tracerec()
+ * DESCRIPTION:	append one record to a volume's block trace
+ */
+static
+void tracerec(hfsvol *vol, int op, unsigned long bnum, unsigned int len,
+	      int flags)
+{
+  btrace *trace = vol->trace;
+  byte rec[HFS_TRACE_RECSZ];
+  unsigned long long now, delta;
+
+  pthread_mutex_lock(&trace->lock);
+
+  now   = usecs();
+  delta = now - trace->last;
+
+  trace->last = now;
+
+  d_putul(rec + 0, delta > 0xffffffffUL ? 0xffffffffUL : delta);
+  d_putul(rec + 4, bnum);
+  d_putuw(rec + 8, len);
+
+  rec[10] = op;
+  rec[11] = flags;
+
+  /* keep going after a failed write; b_settrace() reports it */
+
+  if (fwrite(rec, HFS_TRACE_RECSZ, 1, trace->file) != 1 &&
+      trace->error == 0)
+    trace->error = errno ? errno : EIO;
+
+  pthread_mutex_unlock(&trace->lock);
+}
+
+/*
+ * NAME:	block->settrace()
+ * DESCRIPTION:	finish any block trace, then start a new one if file is given
+ */
+int b_settrace(hfsvol *vol, FILE *file)
+{
+  btrace *trace;
+  byte hdr[HFS_TRACE_HDRSZ];
+  int err;
+
+  if (vol->trace)
+    {
+      trace = vol->trace;
+      vol->trace = 0;
+
+      if (fclose(trace->file) == EOF && trace->error == 0)
+	trace->error = errno;
+
+      pthread_mutex_destroy(&trace->lock);
+
+      err = trace->error;
+      FREE(trace);
+
+      if (err)
+	ERROR(err, "error writing block trace");
+    }
+
+  if (file == 0)
+    return 0;
+
+  /* the stream is the trace's from here on, and closed with it */
+
+  trace = ALLOC(btrace, 1);
+  if (trace == 0)
+    {
+      fclose(file);
+      ERROR(ENOMEM, 0);
+    }
+
+  trace->file = file;
+
+  d_putul(hdr +  0, HFS_TRACE_MAGIC);
+  d_putuw(hdr +  4, HFS_TRACE_VERSION);
+  d_putuw(hdr +  6, HFS_TRACE_RECSZ);
+  d_putul(hdr +  8, vol->vlen);
+  d_putul(hdr + 12, vol->cache ? vol->cache->size : 0);
+  d_putuw(hdr + 16, vol->cache ? vol->cache->readahead : 0);
+  d_putuw(hdr + 18, 0);
+  d_putul(hdr + 20, time(0));
+
+  if (fwrite(hdr, HFS_TRACE_HDRSZ, 1, trace->file) != 1)
+    {
+      err = errno ? errno : EIO;
+      fclose(trace->file);
+      FREE(trace);
+      ERROR(err, "error writing block trace");
+    }
+
+  pthread_mutex_init(&trace->lock, 0);
+
+  trace->last  = usecs();
+  trace->error = 0;
+
+  vol->trace = trace;
+
+  return 0;
+
+fail:
+  return -1;
+}
+
+/*
+ * NAME:	block->init()
+ * DESCRIPTION:	initialize a volume's block cache
+ */
+int b_init(hfsvol *vol)
+{
+  ASSERT(vol->cache == 0);
+
+  vol->cache = newcache(vol, HFS_CACHESZ, HFS_READAHEAD);
+  if (vol->cache == 0)
+    goto fail;
+
   return 0;
 
 fail:
@@ -110,7 +282,7 @@ void b_dumpcache(const bcache *cache)
 
   fprintf(stderr, "BLOCK CACHE DUMP:\n");
 
-  for (i = 0, b = cache->tail->cnext; i < HFS_CACHESZ; ++i, b = b->cnext)
+  for (i = 0, b = cache->tail->cnext; i < cache->size; ++i, b = b->cnext)
     {
       if (INUSE(b))
 	{
@@ -126,7 +298,7 @@ void b_dumpcache(const bcache *cache)
 
   fprintf(stderr, "BLOCK HASH DUMP:\n");
 
-  for (i = 0; i < HFS_HASHSZ; ++i)
+  for (i = 0; i < cache->hashsz; ++i)
     {
       int seen = 0;
 
@@ -319,16 +491,25 @@ int dobuckets(hfsvol *vol, bucket **chain, unsigned int len,
 int b_flush(hfsvol *vol)
 {
   bcache *cache = vol->cache;
-  bucket *chain[HFS_CACHESZ];
-  int i;
+  bucket **chain;
+  unsigned int i;
+  int result;
 
   if (cache == 0 || (vol->flags & HFS_VOL_READONLY))
     goto done;
 
-  for (i = 0; i < HFS_CACHESZ; ++i)
+  chain = ALLOC(bucket *, cache->size);
+  if (chain == 0)
+    ERROR(ENOMEM, 0);
+
+  for (i = 0; i < cache->size; ++i)
     chain[i] = &cache->chain[i];
 
-  if (flushbuckets(vol, chain, HFS_CACHESZ) == -1)
+  result = flushbuckets(vol, chain, cache->size);
+
+  FREE(chain);
+
+  if (result == -1)
     goto fail;
 
 done:
@@ -343,6 +524,49 @@ fail:
   return -1;
 }
 
+/*
+ * NAME:	block->flushrange()
+ * DESCRIPTION:	commit dirty cache blocks within a run of logical blocks
+ */
+int b_flushrange(hfsvol *vol, unsigned long bnum, unsigned long count)
+{
+  bcache *cache = vol->cache;
+  bucket **chain;
+  unsigned int i, len = 0;
+  int result = 0;
+
+  if (cache == 0 || (vol->flags & HFS_VOL_READONLY))
+    goto done;
+
+  chain = ALLOC(bucket *, cache->size);
+  if (chain == 0)
+    ERROR(ENOMEM, 0);
+
+  pthread_mutex_lock(&vol->lock);
+
+  for (i = 0; i < cache->size; ++i)
+    {
+      bucket *b = &cache->chain[i];
+
+      if (INUSE(b) && DIRTY(b) &&
+	  b->bnum >= bnum && b->bnum - bnum < count)
+	chain[len++] = b;
+    }
+
+  if (len > 0)
+    result = flushbuckets(vol, chain, len);
+
+  pthread_mutex_unlock(&vol->lock);
+
+  FREE(chain);
+
+done:
+  return result;
+
+fail:
+  return -1;
+}
+
 /*
  * NAME:	block->finish()
  * DESCRIPTION:	commit and free a volume's block cache
@@ -360,13 +584,77 @@ int b_finish(hfsvol *vol)
 
   result = b_flush(vol);
 
-  FREE(vol->cache);
+  freecache(vol->cache);
   vol->cache = 0;
 
 done:
   return result;
 }
 
+/*
+ * NAME:	block->resize()
+ * DESCRIPTION:	replace a volume's block cache with an empty one of a new size
+ */
+int b_resize(hfsvol *vol, unsigned int size, unsigned int readahead)
+{
+  bcache *cache;
+
+  if (size < HFS_MINCACHESZ || size > HFS_MAXCACHESZ)
+    ERROR(EINVAL, "block cache size out of range");
+
+  if (readahead >= HFS_BLOCKBUFSZ)
+    ERROR(EINVAL, "readahead out of range");
+
+  if (vol->cache == 0)
+    ERROR(EINVAL, "volume has no block cache");
+
+  /* everything dirty must reach the medium before the old buckets go */
+
+  if (b_flush(vol) == -1)
+    goto fail;
+
+  cache = newcache(vol, size, readahead);
+  if (cache == 0)
+    goto fail;
+
+  cache->hits   = vol->cache->hits;
+  cache->misses = vol->cache->misses;
+
+  freecache(vol->cache);
+  vol->cache = cache;
+
+  if (vol->trace)
+    tracerec(vol, HFS_TRACE_RESET, size, readahead, 0);
+
+  return 0;
+
+fail:
+  return -1;
+}
+
+/*
+ * NAME:	block->census()
+ * DESCRIPTION:	count the buckets in use and those waiting to be written
+ */
+void b_census(const bcache *cache, unsigned int *used, unsigned int *dirty)
+{
+  unsigned int i;
+
+  *used = *dirty = 0;
+
+  for (i = 0; i < cache->size; ++i)
+    {
+      const bucket *b = &cache->chain[i];
+
+      if (INUSE(b))
+	{
+	  ++*used;
+	  if (DIRTY(b))
+	    ++*dirty;
+	}
+    }
+}
+
 /*
  * NAME:	findbucket()
  * DESCRIPTION:	locate a bucket in the cache, and/or its hash slot
@@ -376,7 +664,7 @@ bucket *findbucket(bcache *cache, unsigned long bnum, bucket ***hslot)
 {
   bucket *b;
 
-  *hslot = &cache->hash[bnum & (HFS_HASHSZ - 1)];
+  *hslot = &cache->hash[bnum & (cache->hashsz - 1)];
 
   for (b = **hslot; b; b = b->hnext)
     {
@@ -387,6 +675,22 @@ bucket *findbucket(bcache *cache, unsigned long bnum, bucket ***hslot)
   return b;
 }
 
+/*
+ * NAME:	tracelb()
+ * DESCRIPTION:	record a logical block request, noting whether it will hit
+ */
+static
+void tracelb(hfsvol *vol, int op, unsigned long bnum)
+{
+  bucket **hslot;
+  int flags = 0;
+
+  if (vol->cache && findbucket(vol->cache, bnum, &hslot))
+    flags |= HFS_TRACE_HIT;
+
+  tracerec(vol, op, bnum, 1, flags);
+}
+
 /*
  * NAME:	reuse()
  * DESCRIPTION:	free a bucket for reuse, flushing if necessary
@@ -440,6 +744,11 @@ void cplace(bcache *cache, bucket *b)
   for (p = cache->tail->cnext; p->count > 1; p = p->cnext)
     --p->count;
 
+  /* every bucket ahead of b is requested more often; it stays put */
+
+  if (p == b)
+    return;
+
   b->cnext->cprev = b->cprev;
   b->cprev->cnext = b->cnext;
 
@@ -494,6 +803,7 @@ bucket *getbucket(bcache *cache, unsigned long bnum, int fill)
       /* cache hit; move towards head of cache chain */
 
       ++cache->hits;
+      TRACE(cache__hit, cache->vol, bnum);
 
       if (++b->count > b->cprev->count &&
 	  b != cache->tail->cnext)
@@ -518,6 +828,7 @@ bucket *getbucket(bcache *cache, unsigned long bnum, int fill)
       /* cache miss; reuse least-used cache bucket */
 
       ++cache->misses;
+      TRACE(cache__miss, cache->vol, bnum, fill);
 
       b = cache->tail;
 
@@ -532,7 +843,7 @@ bucket *getbucket(bcache *cache, unsigned long bnum, int fill)
 	  slots[len++] = hslot;
 
 	  for (bptr = b->cprev;
-	       len < (HFS_BLOCKBUFSZ >> 1) && ++bnum < cache->vol->vlen;
+	       len <= cache->readahead && ++bnum < cache->vol->vlen;
 	       bptr = bptr->cprev)
 	    {
 	      if (findbucket(cache, bnum, &hslot))
@@ -545,6 +856,8 @@ bucket *getbucket(bcache *cache, unsigned long bnum, int fill)
 	      slots[len++] = hslot;
 	    }
 
+	  TRACE(cache__fill, cache->vol, chain[0]->bnum, len);
+
 	  if (fillbuckets(cache->vol, chain, len) == -1)
 	    goto fail;
 
@@ -589,6 +902,11 @@ int b_readpb(hfsvol *vol, unsigned long bnum, block *bp, unsigned int blen)
     fprintf(stderr, "\n");
 # endif
 
+  TRACE(readpb, vol, bnum, blen);
+
+  if (vol->trace)
+    tracerec(vol, HFS_TRACE_READPB, bnum, blen, 0);
+
   nblocks = os_seek(&vol->priv, bnum);
   if (nblocks == (unsigned long) -1)
     goto fail;
@@ -600,12 +918,18 @@ int b_readpb(hfsvol *vol, unsigned long bnum, block *bp, unsigned int blen)
   if (nblocks == (unsigned long) -1)
     goto fail;
 
+  COUNT(vol, nread, nblocks * HFS_BLOCKSZ);
+
   if (nblocks != blen)
     ERROR(EIO, "incomplete block read");
 
+  TRACE(readpb__done, vol, bnum, blen, 0);
+
   return 0;
 
 fail:
+  TRACE(readpb__done, vol, bnum, blen, -1);
+
   return -1;
 }
 
@@ -627,6 +951,11 @@ int b_writepb(hfsvol *vol, unsigned long bnum, const block *bp,
     fprintf(stderr, "\n");
 # endif
 
+  TRACE(writepb, vol, bnum, blen);
+
+  if (vol->trace)
+    tracerec(vol, HFS_TRACE_WRITEPB, bnum, blen, 0);
+
   nblocks = os_seek(&vol->priv, bnum);
   if (nblocks == (unsigned long) -1)
     goto fail;
@@ -638,12 +967,18 @@ int b_writepb(hfsvol *vol, unsigned long bnum, const block *bp,
   if (nblocks == (unsigned long) -1)
     goto fail;
 
+  COUNT(vol, nwritten, nblocks * HFS_BLOCKSZ);
+
   if (nblocks != blen)
     ERROR(EIO, "incomplete block write");
 
+  TRACE(writepb__done, vol, bnum, blen, 0);
+
   return 0;
 
 fail:
+  TRACE(writepb__done, vol, bnum, blen, -1);
+
   return -1;
 }
 
@@ -656,24 +991,36 @@ int b_readlb(hfsvol *vol, unsigned long bnum, block *bp)
   if (vol->vlen > 0 && bnum >= vol->vlen)
     ERROR(EIO, "read nonexistent logical block");
 
+  /* the cache and the medium's seek pointer are shared by all readers */
+
+  pthread_mutex_lock(&vol->lock);
+
+  if (vol->trace)
+    tracelb(vol, HFS_TRACE_READLB, bnum);
+
   if (vol->cache)
     {
       bucket *b;
 
       b = getbucket(vol->cache, bnum, 1);
       if (b == 0)
-	goto fail;
+	goto unlock;
 
       memcpy(bp, b->data, HFS_BLOCKSZ);
     }
   else
     {
       if (b_readpb(vol, vol->vstart + bnum, bp, 1) == -1)
-	goto fail;
+	goto unlock;
     }
 
+  pthread_mutex_unlock(&vol->lock);
+
   return 0;
 
+unlock:
+  pthread_mutex_unlock(&vol->lock);
+
 fail:
   return -1;
 }
@@ -687,13 +1034,18 @@ int b_writelb(hfsvol *vol, unsigned long bnum, const block *bp)
   if (vol->vlen > 0 && bnum >= vol->vlen)
     ERROR(EIO, "write nonexistent logical block");
 
+  pthread_mutex_lock(&vol->lock);
+
+  if (vol->trace)
+    tracelb(vol, HFS_TRACE_WRITELB, bnum);
+
   if (vol->cache)
     {
       bucket *b;
 
       b = getbucket(vol->cache, bnum, 0);
       if (b == 0)
-	goto fail;
+	goto unlock;
 
       if (! INUSE(b) ||
 	  memcmp(b->data, bp, HFS_BLOCKSZ) != 0)
@@ -705,11 +1057,16 @@ int b_writelb(hfsvol *vol, unsigned long bnum, const block *bp)
   else
     {
       if (b_writepb(vol, vol->vstart + bnum, bp, 1) == -1)
-	goto fail;
+	goto unlock;
     }
 
+  pthread_mutex_unlock(&vol->lock);
+
   return 0;
 
+unlock:
+  pthread_mutex_unlock(&vol->lock);
+
 fail:
   return -1;
 }
@@ -21,7 +21,11 @@
 
 int b_init(hfsvol *);
 int b_flush(hfsvol *);
+int b_flushrange(hfsvol *, unsigned long, unsigned long);
 int b_finish(hfsvol *);
+int b_resize(hfsvol *, unsigned int, unsigned int);
+void b_census(const bcache *, unsigned int *, unsigned int *);
+int b_settrace(hfsvol *, FILE *);
 
 int b_readpb(hfsvol *, unsigned long, block *, unsigned int);
 int b_writepb(hfsvol *, unsigned long, const block *, unsigned int);
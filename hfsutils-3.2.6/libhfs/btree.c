@@ -59,8 +59,17 @@ int bt_getnode(node *np, btree *bt, unsigned long nnum)
   else if (bt->map && ! BMTST(bt->map, nnum))
     ERROR(EIO, "read unallocated b*-tree node");
 
+  /* concurrent readers share the tree file's extent cache */
+
+  pthread_mutex_lock(&bt->f.lock);
+
   if (f_getblock(&bt->f, nnum, bp) == -1)
-    goto fail;
+    {
+      pthread_mutex_unlock(&bt->f.lock);
+      goto fail;
+    }
+
+  pthread_mutex_unlock(&bt->f.lock);
 
   ptr = *bp;
 
@@ -129,6 +138,8 @@ int bt_putnode(node *np)
   while (i--)
     d_storeuw(&ptr, np->roff[i]);
 
+  ++bt->writes;
+
   return f_putblock(&bt->f, np->nnum, bp);
 
 fail:
@@ -217,7 +228,8 @@ int bt_readhdr(btree *bt)
       nnum = n.nd.ndFLink;
     }
 
-  bt->map = map;
+  bt->map   = map;
+  bt->fhint = 0;
 
   return 0;
 
@@ -490,6 +502,8 @@ int bt_insert(btree *bt, const byte *record, unsigned int reclen)
 
   memcpy(newrec, record, reclen);
 
+  TRACE(btree__insert, bt->f.vol, bt->f.cat.u.fil.filFlNum, root.nnum, reclen);
+
   if (insertx(&root, newrec, &reclen) == -1)
     goto fail;
 
@@ -509,6 +523,9 @@ int bt_insert(btree *bt, const byte *record, unsigned int reclen)
       ++bt->hdr.bthDepth;
       bt->hdr.bthRoot = root.nnum;
 
+      TRACE(btree__newroot, bt->f.vol, bt->f.cat.u.fil.filFlNum,
+	    root.nnum, bt->hdr.bthDepth);
+
       bt->flags |= HFS_BT_UPDATE_HDR;
 
       /* insert index records for new root */
@@ -659,10 +676,15 @@ int bt_search(btree *bt, const byte *key, node *np)
   if (nnum == 0)
     ERROR(ENOENT, 0);
 
+  COUNT(bt->f.vol, searches, 1);
+  TRACE(btree__search, bt->f.vol, bt->f.cat.u.fil.filFlNum, nnum);
+
   while (1)
     {
       const byte *rec;
 
+      COUNT(bt->f.vol, levels, 1);
+
       if (bt_getnode(np, bt, nnum) == -1)
 	{
 	  found = -1;
@@ -696,5 +718,8 @@ int bt_search(btree *bt, const byte *key, node *np)
 
 done:
 fail:
+  TRACE(btree__search__done, bt->f.vol, bt->f.cat.u.fil.filFlNum,
+	nnum, found);
+
   return found;
 }
@@ -92,6 +92,8 @@ void f_init(hfsfile *file, hfsvol *vol, long cnid, const char *name)
 
   file->flags = 0;
 
+  pthread_mutex_init(&file->lock, 0);
+
   file->prev  = 0;
   file->next  = 0;
 }
@@ -107,9 +109,33 @@ void f_selectfork(hfsfile *file, int fork)
   memcpy(&file->ext, fork == fkData ?
 	 &file->cat.u.fil.filExtRec : &file->cat.u.fil.filRExtRec,
 	 sizeof(ExtDataRec));
+  memcpy(&file->oext, fork == fkData ?
+	 &file->cat.u.fil.filRExtRec : &file->cat.u.fil.filExtRec,
+	 sizeof(ExtDataRec));
+
+  file->fabn  = 0;
+  file->ofabn = 0;
+  file->pos   = 0;
+}
+
+/*
+ * NAME:	file->swapfork()
+ * DESCRIPTION:	switch to the other fork, keeping each fork's extent cursor
+ */
+void f_swapfork(hfsfile *file)
+{
+  ExtDataRec ext;
+  unsigned int fabn;
+
+  file->fork = (file->fork == fkData) ? fkRsrc : fkData;
 
-  file->fabn = 0;
-  file->pos  = 0;
+  memcpy(&ext, &file->ext, sizeof(ExtDataRec));
+  memcpy(&file->ext, &file->oext, sizeof(ExtDataRec));
+  memcpy(&file->oext, &ext, sizeof(ExtDataRec));
+
+  fabn        = file->fabn;
+  file->fabn  = file->ofabn;
+  file->ofabn = fabn;
 }
 
 /*
@@ -140,20 +166,16 @@ void f_getptrs(hfsfile *file, ExtDataRec **extrec,
 }
 
 /*
- * NAME:	file->doblock()
- * DESCRIPTION:	read or write a numbered block from a file
+ * NAME:	locate()
+ * DESCRIPTION:	find the allocation block holding a file allocation block
  */
-int f_doblock(hfsfile *file, unsigned long num, block *bp,
-	      int (*func)(hfsvol *, unsigned int, unsigned int, block *))
+static
+int locate(hfsfile *file, unsigned int abnum,
+	   unsigned int *anum, unsigned int *count)
 {
-  unsigned int abnum;
-  unsigned int blnum;
   unsigned int fabn;
   int i;
 
-  abnum = num / file->vol->lpa;
-  blnum = num % file->vol->lpa;
-
   /* locate the appropriate extent record */
 
   fabn = file->fabn;
@@ -179,7 +201,13 @@ int f_doblock(hfsfile *file, unsigned long num, block *bp,
 	  n = file->ext[i].xdrNumABlks;
 
 	  if (abnum < n)
-	    return func(file->vol, file->ext[i].xdrStABN + abnum, blnum, bp);
+	    {
+	      *anum = file->ext[i].xdrStABN + abnum;
+	      if (count)
+		*count = n - abnum;
+
+	      return 0;
+	    }
 
 	  fabn  += n;
 	  abnum -= n;
@@ -195,6 +223,41 @@ fail:
   return -1;
 }
 
+/*
+ * NAME:	file->doblock()
+ * DESCRIPTION:	read or write a numbered block from a file
+ */
+int f_doblock(hfsfile *file, unsigned long num, block *bp,
+	      int (*func)(hfsvol *, unsigned int, unsigned int, block *))
+{
+  unsigned int anum;
+
+  if (locate(file, num / file->vol->lpa, &anum, 0) == -1)
+    return -1;
+
+  TRACE(file__block, file->vol, file->cat.u.fil.filFlNum, file->fork,
+	num, anum);
+
+  return func(file->vol, anum, num % file->vol->lpa, bp);
+}
+
+/*
+ * NAME:	file->run()
+ * DESCRIPTION:	map a numbered block to a logical block and its contiguous run
+ */
+long f_run(hfsfile *file, unsigned long num, unsigned long *lbnum)
+{
+  hfsvol *vol = file->vol;
+  unsigned int anum, count;
+
+  if (locate(file, num / vol->lpa, &anum, &count) == -1)
+    return -1;
+
+  *lbnum = vol->mdb.drAlBlSt + anum * vol->lpa + num % vol->lpa;
+
+  return count * vol->lpa - num % vol->lpa;
+}
+
 /*
  * NAME:	file->addextent()
  * DESCRIPTION:	add an extent to a file
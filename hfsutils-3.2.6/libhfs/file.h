@@ -26,6 +26,7 @@ enum {
 
 void f_init(hfsfile *, hfsvol *, long, const char *);
 void f_selectfork(hfsfile *, int);
+void f_swapfork(hfsfile *);
 void f_getptrs(hfsfile *, ExtDataRec **, ULongInt **, ULongInt **);
 
 int f_doblock(hfsfile *, unsigned long, block *,
@@ -38,6 +39,8 @@ int f_doblock(hfsfile *, unsigned long, block *,
 	      (int (*)(hfsvol *, unsigned int, unsigned int, block *))  \
 	      b_writeab)
 
+long f_run(hfsfile *, unsigned long, unsigned long *);
+
 int f_addextent(hfsfile *, ExtDescriptor *);
 long f_alloc(hfsfile *);
 
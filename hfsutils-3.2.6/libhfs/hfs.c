@@ -38,15 +38,34 @@
 # include "node.h"
 # include "record.h"
 # include "volume.h"
+# include "lookup.h"
+# include "os.h"
 # include "../bootblocks.h"
 
-const char *hfs_error = "no error";	/* static error string */
+__thread
+const char *hfs_error = "no error";	/* per-thread error string */
 
 hfsvol *hfs_mounts;			/* linked list of mounted volumes */
 
 static
 hfsvol *curvol;				/* current volume */
 
+/*
+ * Calls that only read hold this lock shared and may run concurrently;
+ * calls that change anything hold it exclusively. One lock covers every
+ * mounted volume, since a pathname may name any of them.
+ */
+static
+pthread_rwlock_t hfs_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+# define SHARED()	pthread_rwlock_rdlock(&hfs_lock)
+# define EXCLUSIVE()	pthread_rwlock_wrlock(&hfs_lock)
+# define RELEASE()	pthread_rwlock_unlock(&hfs_lock)
+
+static void unlinkdir(hfsdir *);
+static int closefile(hfsfile *);
+static void freshen(hfsvol *, CatDataRec *);
+
 /*
  * NAME:	validvname()
  * DESCRIPTION:	return true if parameter is a valid volume name
@@ -93,6 +112,34 @@ fail:
   return -1;
 }
 
+/*
+ * NAME:	catlookup()
+ * DESCRIPTION:	find the catalog record for a name in a directory
+ */
+static
+int catlookup(hfsvol *vol, unsigned long parid, const char *name,
+	      CatDataRec *data, char *cname, node *np)
+{
+  int found;
+
+  if (*name == 0)
+    ERROR(ENOENT, "empty name");
+
+  if (strlen(name) > HFS_MAX_FLEN)
+    ERROR(ENAMETOOLONG, 0);
+
+  found = v_catsearch(vol, parid, name, data, cname, np);
+  if (found == -1)
+    goto fail;
+  else if (! found)
+    ERROR(ENOENT, 0);
+
+  return 0;
+
+fail:
+  return -1;
+}
+
 /* High-Level Volume Routines ============================================== */
 
 /*
@@ -103,6 +150,8 @@ hfsvol *hfs_mount(const char *path, int pnum, int mode)
 {
   hfsvol *vol, *check;
 
+  EXCLUSIVE();
+
   /* see if the volume is already mounted */
 
   for (check = hfs_mounts; check; check = check->next)
@@ -168,27 +217,33 @@ done:
   ++vol->refs;
   curvol = vol;
 
+  RELEASE();
+
   return vol;
 
 fail:
   if (vol)
     {
       v_close(vol);
+      pthread_mutex_destroy(&vol->lock);
       FREE(vol);
     }
 
+  RELEASE();
+
   return 0;
 }
 
 /*
- * NAME:	hfs->flush()
- * DESCRIPTION:	flush all pending changes to an HFS volume
+ * NAME:	flush()
+ * DESCRIPTION:	flush all pending changes to a volume (lock held)
  */
-int hfs_flush(hfsvol *vol)
+static
+int flush(hfsvol *vol)
 {
   hfsfile *file;
 
-  if (getvol(&vol) == -1)
+  if (v_flushattrs(vol) == -1)
     goto fail;
 
   for (file = vol->files; file; file = file->next)
@@ -206,6 +261,25 @@ fail:
   return -1;
 }
 
+/*
+ * NAME:	hfs->flush()
+ * DESCRIPTION:	flush all pending changes to an HFS volume
+ */
+int hfs_flush(hfsvol *vol)
+{
+  int result;
+
+  EXCLUSIVE();
+
+  result = getvol(&vol);
+  if (result == 0)
+    result = flush(vol);
+
+  RELEASE();
+
+  return result;
+}
+
 /*
  * NAME:	hfs->flushall()
  * DESCRIPTION:	flush all pending changes to all mounted HFS volumes
@@ -214,8 +288,12 @@ void hfs_flushall(void)
 {
   hfsvol *vol;
 
+  EXCLUSIVE();
+
   for (vol = hfs_mounts; vol; vol = vol->next)
-    hfs_flush(vol);
+    flush(vol);
+
+  RELEASE();
 }
 
 /*
@@ -226,12 +304,18 @@ int hfs_umount(hfsvol *vol)
 {
   int result = 0;
 
+  EXCLUSIVE();
+
   if (getvol(&vol) == -1)
     goto fail;
 
+  if (v_flushattrs(vol) == -1)
+    result = -1;
+
   if (--vol->refs)
     {
-      result = v_flush(vol);
+      if (v_flush(vol) == -1)
+	result = -1;
       goto done;
     }
 
@@ -239,15 +323,12 @@ int hfs_umount(hfsvol *vol)
 
   while (vol->files)
     {
-      if (hfs_close(vol->files) == -1)
+      if (closefile(vol->files) == -1)
 	result = -1;
     }
 
   while (vol->dirs)
-    {
-      if (hfs_closedir(vol->dirs) == -1)
-	result = -1;
-    }
+    unlinkdir(vol->dirs);
 
   /* close medium */
 
@@ -266,12 +347,17 @@ int hfs_umount(hfsvol *vol)
   if (vol == curvol)
     curvol = 0;
 
+  pthread_mutex_destroy(&vol->lock);
   FREE(vol);
 
 done:
+  RELEASE();
+
   return result;
 
 fail:
+  RELEASE();
+
   return -1;
 }
 
@@ -293,16 +379,22 @@ hfsvol *hfs_getvol(const char *name)
 {
   hfsvol *vol;
 
-  if (name == 0)
-    return curvol;
+  SHARED();
 
-  for (vol = hfs_mounts; vol; vol = vol->next)
+  if (name == 0)
+    vol = curvol;
+  else
     {
-      if (d_relstring(name, vol->mdb.drVN) == 0)
-	return vol;
+      for (vol = hfs_mounts; vol; vol = vol->next)
+	{
+	  if (d_relstring(name, vol->mdb.drVN) == 0)
+	    break;
+	}
     }
 
-  return 0;
+  RELEASE();
+
+  return vol;
 }
 
 /*
@@ -311,7 +403,9 @@ hfsvol *hfs_getvol(const char *name)
  */
 void hfs_setvol(hfsvol *vol)
 {
+  EXCLUSIVE();
   curvol = vol;
+  RELEASE();
 }
 
 /*
@@ -320,6 +414,8 @@ void hfs_setvol(hfsvol *vol)
  */
 int hfs_vstat(hfsvol *vol, hfsvolent *ent)
 {
+  SHARED();
+
   if (getvol(&vol) == -1)
     goto fail;
 
@@ -345,18 +441,189 @@ int hfs_vstat(hfsvol *vol, hfsvolent *ent)
 
   ent->blessed   = vol->mdb.drFndrInfo[0];
 
+  RELEASE();
+
+  return 0;
+
+fail:
+  RELEASE();
+
+  return -1;
+}
+
+/*
+ * NAME:	hfs->vstats()
+ * DESCRIPTION:	return volume activity counters
+ */
+int hfs_vstats(hfsvol *vol, hfsvolstats *stats)
+{
+  SHARED();
+
+  if (getvol(&vol) == -1)
+    goto fail;
+
+  pthread_mutex_lock(&vol->lock);
+
+  *stats = vol->stats;
+
+  if (vol->cache)
+    {
+      stats->bhits     = vol->cache->hits;
+      stats->bmisses   = vol->cache->misses;
+      stats->cachesz   = vol->cache->size;
+      stats->readahead = vol->cache->readahead;
+
+      b_census(vol->cache, &stats->cacheused, &stats->cachedirty);
+    }
+
+  if (vol->lookup)
+    {
+      stats->lhits      = vol->lookup->hits + vol->lookup->neghits;
+      stats->lmisses    = vol->lookup->misses;
+      stats->lookupsz   = HFS_LOOKUPSZ;
+      stats->lookupused = lk_census(vol->lookup);
+    }
+
+  stats->pending = vol->npattrs;
+
+  pthread_mutex_unlock(&vol->lock);
+
+  /* the bitmap only changes under the exclusive lock */
+
+  stats->alblocks    = vol->mdb.drNmAlBlks;
+  stats->freeblocks  = vol->mdb.drFreeBks;
+  stats->largestfree = v_largestfree(vol);
+  stats->allocptr    = vol->mdb.drAllocPtr;
+
+  RELEASE();
+
+  return 0;
+
+fail:
+  RELEASE();
+
+  return -1;
+}
+
+/*
+ * NAME:	hfs->setcache()
+ * DESCRIPTION:	resize a volume's block cache and set its readahead
+ */
+int hfs_setcache(hfsvol *vol, unsigned int size, unsigned int readahead)
+{
+  EXCLUSIVE();
+
+  if (getvol(&vol) == -1 ||
+      b_resize(vol, size, readahead) == -1)
+    goto fail;
+
+  RELEASE();
+
+  return 0;
+
+fail:
+  RELEASE();
+
+  return -1;
+}
+
+/*
+ * NAME:	hfs->dropcaches()
+ * DESCRIPTION:	write out all pending changes, then empty a volume's caches
+ */
+int hfs_dropcaches(hfsvol *vol)
+{
+  EXCLUSIVE();
+
+  if (getvol(&vol) == -1 ||
+      flush(vol) == -1)
+    goto fail;
+
+  if (vol->cache &&
+      b_resize(vol, vol->cache->size, vol->cache->readahead) == -1)
+    goto fail;
+
+  lk_purge(vol);
+
+  RELEASE();
+
   return 0;
 
 fail:
+  RELEASE();
+
   return -1;
 }
 
+/*
+ * NAME:	settrace()
+ * DESCRIPTION:	hand a volume a stream for its block trace, or stop (file 0)
+ */
+static
+int settrace(hfsvol *vol, FILE *file)
+{
+  EXCLUSIVE();
+
+  if (getvol(&vol) == -1)
+    {
+      if (file)
+	fclose(file);
+
+      goto fail;
+    }
+
+  if (b_settrace(vol, file) == -1)
+    goto fail;
+
+  RELEASE();
+
+  return 0;
+
+fail:
+  RELEASE();
+
+  return -1;
+}
+
+/*
+ * NAME:	hfs->settrace()
+ * DESCRIPTION:	record a volume's block I/O to a file, or stop (path 0)
+ */
+int hfs_settrace(hfsvol *vol, const char *path)
+{
+  FILE *file = 0;
+
+  if (path)
+    {
+      file = fopen(path, "wb");
+      if (file == 0)
+	ERROR(errno, "can't open block trace");
+    }
+
+  return settrace(vol, file);
+
+fail:
+  return -1;
+}
+
+/*
+ * NAME:	hfs->settracefile()
+ * DESCRIPTION:	record a volume's block I/O to an open stream, which the
+ *		volume then owns and closes
+ */
+int hfs_settracefile(hfsvol *vol, FILE *file)
+{
+  return settrace(vol, file);
+}
+
 /*
  * NAME:	hfs->vsetattr()
  * DESCRIPTION:	change volume attributes
  */
 int hfs_vsetattr(hfsvol *vol, hfsvolent *ent)
 {
+  EXCLUSIVE();
+
   if (getvol(&vol) == -1)
     goto fail;
 
@@ -382,9 +649,13 @@ int hfs_vsetattr(hfsvol *vol, hfsvolent *ent)
 
   vol->flags |= HFS_VOL_UPDATE_MDB;
 
+  RELEASE();
+
   return 0;
 
 fail:
+  RELEASE();
+
   return -1;
 }
 
@@ -398,6 +669,8 @@ int hfs_chdir(hfsvol *vol, const char *path)
 {
   CatDataRec data;
 
+  EXCLUSIVE();
+
   if (getvol(&vol) == -1 ||
       v_resolve(&vol, path, &data, 0, 0, 0) <= 0)
     goto fail;
@@ -407,9 +680,13 @@ int hfs_chdir(hfsvol *vol, const char *path)
 
   vol->cwd = data.u.dir.dirDirID;
 
+  RELEASE();
+
   return 0;
 
 fail:
+  RELEASE();
+
   return -1;
 }
 
@@ -419,10 +696,16 @@ fail:
  */
 unsigned long hfs_getcwd(hfsvol *vol)
 {
-  if (getvol(&vol) == -1)
-    return 0;
+  unsigned long cwd = 0;
+
+  SHARED();
 
-  return vol->cwd;
+  if (getvol(&vol) != -1)
+    cwd = vol->cwd;
+
+  RELEASE();
+
+  return cwd;
 }
 
 /*
@@ -431,6 +714,8 @@ unsigned long hfs_getcwd(hfsvol *vol)
  */
 int hfs_setcwd(hfsvol *vol, unsigned long id)
 {
+  EXCLUSIVE();
+
   if (getvol(&vol) == -1)
     goto fail;
 
@@ -445,9 +730,13 @@ int hfs_setcwd(hfsvol *vol, unsigned long id)
   vol->cwd = id;
 
 done:
+  RELEASE();
+
   return 0;
 
 fail:
+  RELEASE();
+
   return -1;
 }
 
@@ -459,6 +748,8 @@ int hfs_dirinfo(hfsvol *vol, unsigned long *id, char *name)
 {
   CatDataRec thread;
 
+  SHARED();
+
   if (getvol(&vol) == -1 ||
       v_getdthread(vol, *id, &thread, 0) <= 0)
     goto fail;
@@ -468,40 +759,123 @@ int hfs_dirinfo(hfsvol *vol, unsigned long *id, char *name)
   if (name)
     strcpy(name, thread.u.dthd.thdCName);
 
+  RELEASE();
+
   return 0;
 
 fail:
+  RELEASE();
+
   return -1;
 }
 
 /*
- * NAME:	hfs->opendir()
- * DESCRIPTION:	prepare to read the contents of a directory
+ * NAME:	linkdir()
+ * DESCRIPTION:	add a directory handle to its volume's list
  */
-hfsdir *hfs_opendir(hfsvol *vol, const char *path)
+static
+hfsdir *linkdir(hfsvol *vol, hfsdir *dir)
+{
+  pthread_mutex_lock(&vol->lock);
+
+  dir->prev = 0;
+  dir->next = vol->dirs;
+
+  if (vol->dirs)
+    vol->dirs->prev = dir;
+
+  vol->dirs = dir;
+
+  pthread_mutex_unlock(&vol->lock);
+
+  return dir;
+}
+
+/*
+ * NAME:	unlinkdir()
+ * DESCRIPTION:	remove a directory handle from its volume's list and free it
+ */
+static
+void unlinkdir(hfsdir *dir)
+{
+  hfsvol *vol = dir->vol;
+
+  pthread_mutex_lock(&vol->lock);
+
+  if (dir->prev)
+    dir->prev->next = dir->next;
+  if (dir->next)
+    dir->next->prev = dir->prev;
+  if (dir == vol->dirs)
+    vol->dirs = dir->next;
+
+  pthread_mutex_unlock(&vol->lock);
+
+  FREE(dir);
+}
+
+/*
+ * NAME:	opendirid()
+ * DESCRIPTION:	open a directory handle given its ID (lock held)
+ */
+static
+hfsdir *opendirid(hfsvol *vol, unsigned long id)
 {
   hfsdir *dir = 0;
   CatKeyRec key;
-  CatDataRec data;
-  byte pkey[HFS_CATKEYLEN];
-
-  if (getvol(&vol) == -1)
-    goto fail;
+  CatDataRec thread;
+  const byte *ptr;
+  int found;
 
   dir = ALLOC(hfsdir, 1);
   if (dir == 0)
     ERROR(ENOMEM, 0);
 
-  dir->vol = vol;
+  dir->vol   = vol;
+  dir->dirid = id;
+  dir->vptr  = 0;
 
-  if (*path == 0)
-    {
-      /* meta-directory containing root dirs from all mounted volumes */
+  /* the directory's thread record is where its contents begin */
 
-      dir->dirid = 0;
-      dir->vptr  = hfs_mounts;
-    }
-  else
+  r_makecatkey(&key, dir->dirid, "");
+  r_packcatkey(&key, dir->pkey, 0);
+
+  dir->writes = vol->cat.writes;
+
+  found = bt_search(&vol->cat, dir->pkey, &dir->n);
+  if (found == -1)
+    goto fail;
+  else if (! found)
+    ERROR(ENOENT, 0);
+
+  ptr = HFS_NODEREC(dir->n, dir->n.rnum);
+  r_unpackcatdata(HFS_RECDATA(ptr), &thread);
+
+  if (thread.cdrType != cdrThdRec)
+    ERROR(ENOTDIR, 0);
+
+  return linkdir(vol, dir);
+
+fail:
+  FREE(dir);
+  return 0;
+}
+
+/*
+ * NAME:	hfs->opendir()
+ * DESCRIPTION:	prepare to read the contents of a directory
+ */
+hfsdir *hfs_opendir(hfsvol *vol, const char *path)
+{
+  hfsdir *dir = 0;
+  CatDataRec data;
+
+  SHARED();
+
+  if (getvol(&vol) == -1)
+    goto fail;
+
+  if (*path)
     {
       if (v_resolve(&vol, path, &data, 0, 0, 0) <= 0)
 	goto fail;
@@ -509,31 +883,53 @@ hfsdir *hfs_opendir(hfsvol *vol, const char *path)
       if (data.cdrType != cdrDirRec)
 	ERROR(ENOTDIR, 0);
 
-      dir->dirid = data.u.dir.dirDirID;
-      dir->vptr  = 0;
+      dir = opendirid(vol, data.u.dir.dirDirID);
 
-      r_makecatkey(&key, dir->dirid, "");
-      r_packcatkey(&key, pkey, 0);
+      RELEASE();
 
-      if (bt_search(&vol->cat, pkey, &dir->n) <= 0)
-	goto fail;
+      return dir;
     }
 
-  dir->prev = 0;
-  dir->next = vol->dirs;
+  /* meta-directory containing root dirs from all mounted volumes */
 
-  if (vol->dirs)
-    vol->dirs->prev = dir;
+  dir = ALLOC(hfsdir, 1);
+  if (dir == 0)
+    ERROR(ENOMEM, 0);
 
-  vol->dirs = dir;
+  dir->vol   = vol;
+  dir->dirid = 0;
+  dir->vptr  = hfs_mounts;
+
+  linkdir(vol, dir);
+
+  RELEASE();
 
   return dir;
 
 fail:
-  FREE(dir);
+  RELEASE();
+
   return 0;
 }
 
+/*
+ * NAME:	hfs->opendirid()
+ * DESCRIPTION:	prepare to read the contents of a directory given its ID
+ */
+hfsdir *hfs_opendirid(hfsvol *vol, unsigned long id)
+{
+  hfsdir *dir = 0;
+
+  SHARED();
+
+  if (getvol(&vol) != -1)
+    dir = opendirid(vol, id);
+
+  RELEASE();
+
+  return dir;
+}
+
 /*
  * NAME:	hfs->readdir()
  * DESCRIPTION:	return the next entry in the directory
@@ -544,6 +940,8 @@ int hfs_readdir(hfsdir *dir, hfsdirent *ent)
   CatDataRec data;
   const byte *ptr;
 
+  SHARED();
+
   if (dir->dirid == 0)
     {
       hfsvol *vol;
@@ -573,6 +971,29 @@ int hfs_readdir(hfsdir *dir, hfsdirent *ent)
   if (dir->n.rnum == -1)
     ERROR(ENOENT, "no more entries");
 
+  /*
+   * The copy of the node may be out of date if the catalog has changed
+   * since it was read: records may have moved to a new sibling, or the
+   * next node may have been freed. Find the last record returned again.
+   */
+
+  if (dir->n.nnum == 0 || dir->writes != dir->vol->cat.writes)
+    {
+      dir->writes = dir->vol->cat.writes;
+
+      if (bt_search(&dir->vol->cat, dir->pkey, &dir->n) == -1)
+	{
+	  dir->n.nnum = 0;
+	  goto fail;
+	}
+
+      if (dir->n.nd.ndType != ndLeafNode)
+	{
+	  dir->n.rnum = -1;
+	  ERROR(ENOENT, "no more entries");
+	}
+    }
+
   while (1)
     {
       ++dir->n.rnum;
@@ -585,9 +1006,11 @@ int hfs_readdir(hfsdir *dir, hfsdirent *ent)
 	      ERROR(ENOENT, "no more entries");
 	    }
 
+	  /* try again from the last record returned on the next call */
+
 	  if (bt_getnode(&dir->n, dir->n.bt, dir->n.nd.ndFLink) == -1)
 	    {
-	      dir->n.rnum = -1;
+	      dir->n.nnum = 0;
 	      goto fail;
 	    }
 
@@ -610,7 +1033,16 @@ int hfs_readdir(hfsdir *dir, hfsdirent *ent)
 	{
 	case cdrDirRec:
 	case cdrFilRec:
+	  /* a listing is usually followed by a lookup of each entry */
+
+	  if (dir->vol->lookup)
+	    lk_store(dir->vol, key.ckrParID, key.ckrCName, &data);
+
+	  freshen(dir->vol, &data);
 	  r_unpackdirent(key.ckrParID, key.ckrCName, &data, ent);
+
+	  memcpy(dir->pkey, ptr, HFS_RECKEYLEN(ptr) + 1);
+
 	  goto done;
 
 	case cdrThdRec:
@@ -624,9 +1056,13 @@ int hfs_readdir(hfsdir *dir, hfsdirent *ent)
     }
 
 done:
+  RELEASE();
+
   return 0;
 
 fail:
+  RELEASE();
+
   return -1;
 }
 
@@ -636,16 +1072,9 @@ fail:
  */
 int hfs_closedir(hfsdir *dir)
 {
-  hfsvol *vol = dir->vol;
-
-  if (dir->prev)
-    dir->prev->next = dir->next;
-  if (dir->next)
-    dir->next->prev = dir->prev;
-  if (dir == vol->dirs)
-    vol->dirs = dir->next;
-
-  FREE(dir);
+  SHARED();
+  unlinkdir(dir);
+  RELEASE();
 
   return 0;
 }
@@ -667,6 +1096,8 @@ hfsfile *hfs_create(hfsvol *vol, const char *path,
   unsigned reclen;
   int found;
 
+  EXCLUSIVE();
+
   if (getvol(&vol) == -1)
     goto fail;
 
@@ -710,6 +1141,9 @@ hfsfile *hfs_create(hfsvol *vol, const char *path,
   r_makecatkey(&key, file->parid, file->name);
   r_packcatrec(&key, &file->cat, record, &reclen);
 
+  if (vol->lookup)
+    lk_forget(vol, file->parid, file->name);
+
   if (bt_insert(&vol->cat, record, reclen) == -1 ||
       v_adjvalence(vol, file->parid, 0, 1) == -1)
     goto fail;
@@ -723,34 +1157,31 @@ hfsfile *hfs_create(hfsvol *vol, const char *path,
 
   vol->files = file;
 
+  RELEASE();
+
   return file;
 
 fail:
   FREE(file);
+  RELEASE();
+
   return 0;
 }
 
 /*
- * NAME:	hfs->open()
- * DESCRIPTION:	prepare a file for I/O
+ * NAME:	openfile()
+ * DESCRIPTION:	package a file whose catalog record has been found for I/O
  */
-hfsfile *hfs_open(hfsvol *vol, const char *path)
+static
+hfsfile *openfile(hfsvol *vol, hfsfile *file)
 {
-  hfsfile *file = 0;
   hfsfile *f = 0;
-
-  if (getvol(&vol) == -1)
-    ERROR(ENODEV, 0);
-
-  file = ALLOC(hfsfile, 1);
-  if (file == 0)
-    ERROR(ENOMEM, 0);
-
-  if (v_resolve(&vol, path, &file->cat, &file->parid, file->name, 0) <= 0)
-	ERROR(ENOENT, 0);
+  pattr *pa;
 
   if (file->cat.cdrType != cdrFilRec)
     ERROR(EISDIR, 0);
+
+  pthread_mutex_lock(&vol->lock);
 	
   // see if it's already open
   for(f = vol->files; f; f = f->next) {
@@ -759,17 +1190,24 @@ hfsfile *hfs_open(hfsvol *vol, const char *path)
 		  FREE(file);
 		  file = f;
 		  file->refs++;
-		  printf("REOPEN: file %s now has %d refs\n", path, file->refs);
+		  printf("REOPEN: file %s now has %d refs\n", file->name, file->refs);
+		  pthread_mutex_unlock(&vol->lock);
 		  return file;
 	  }
   }
 
-  /* package file handle for user */
+  /* package file handle for user, with any deferred attributes */
+
+  pa = v_findattrs(vol, file->cat.u.fil.filFlNum);
+  if (pa)
+    r_packdirent(&file->cat, &pa->ent);
+
   file->refs  = 1;
   file->vol   = vol;
   file->flags = 0;
 
   f_selectfork(file, fkData);
+  pthread_mutex_init(&file->lock, 0);
 
   file->prev = 0;
   file->next = vol->files;
@@ -779,10 +1217,80 @@ hfsfile *hfs_open(hfsvol *vol, const char *path)
 
   vol->files = file;
 
+  pthread_mutex_unlock(&vol->lock);
+
+  return file;
+
+fail:
+  FREE(file);
+  return 0;
+}
+
+/*
+ * NAME:	hfs->open()
+ * DESCRIPTION:	prepare a file for I/O
+ */
+hfsfile *hfs_open(hfsvol *vol, const char *path)
+{
+  hfsfile *file = 0;
+
+  SHARED();
+
+  if (getvol(&vol) == -1)
+    ERROR(ENODEV, 0);
+
+  file = ALLOC(hfsfile, 1);
+  if (file == 0)
+    ERROR(ENOMEM, 0);
+
+  if (v_resolve(&vol, path, &file->cat, &file->parid, file->name, 0) <= 0)
+	ERROR(ENOENT, 0);
+
+  file = openfile(vol, file);
+
+  RELEASE();
+
   return file;
 
 fail:
   FREE(file);
+  RELEASE();
+
+  return 0;
+}
+
+/*
+ * NAME:	hfs->openat()
+ * DESCRIPTION:	prepare a file for I/O given its parent ID and name
+ */
+hfsfile *hfs_openat(hfsvol *vol, unsigned long parid, const char *name)
+{
+  hfsfile *file = 0;
+
+  SHARED();
+
+  if (getvol(&vol) == -1)
+    ERROR(ENODEV, 0);
+
+  file = ALLOC(hfsfile, 1);
+  if (file == 0)
+    ERROR(ENOMEM, 0);
+
+  if (catlookup(vol, parid, name, &file->cat, file->name, 0) == -1)
+    goto fail;
+
+  file->parid = parid;
+
+  file = openfile(vol, file);
+
+  RELEASE();
+
+  return file;
+
+fail:
+  FREE(file);
+  RELEASE();
+
   return 0;
 }
 
@@ -795,6 +1303,9 @@ int hfs_isopen(hfsvol *vol, const char *path)
 {
 	hfsfile *file = 0;
 	hfsfile *f = 0;
+	int result = 0;
+	
+	SHARED();
 	
 	if (getvol(&vol) == -1)
 		ERROR(ENODEV, 0);
@@ -812,13 +1323,20 @@ int hfs_isopen(hfsvol *vol, const char *path)
 	// see if it's already open
 	ULongInt num = file->cat.u.fil.filFlNum;
 	FREE(file);
+	pthread_mutex_lock(&vol->lock);
 	for(f = vol->files; f; f = f->next) {
-		if (f->cat.u.fil.filFlNum == num) return 1;
+		if (f->cat.u.fil.filFlNum == num) {
+			result = 1;
+			break;
+		}
 	}
-	return 0;
+	pthread_mutex_unlock(&vol->lock);
+	RELEASE();
+	return result;
 	
 fail:
 	FREE(file);
+	RELEASE();
 	return -1;
 }
 
@@ -830,10 +1348,19 @@ int hfs_setfork(hfsfile *file, int fork)
 {
   int result = 0;
 
+  EXCLUSIVE();
+
   if (f_trunc(file) == -1)
     result = -1;
 
-  f_selectfork(file, fork ? fkRsrc : fkData);
+  /* each fork keeps its place in its extents */
+
+  if ((fork ? fkRsrc : fkData) != file->fork)
+    f_swapfork(file);
+
+  file->pos = 0;
+
+  RELEASE();
 
   return result;
 }
@@ -848,51 +1375,194 @@ int hfs_getfork(hfsfile *file)
 }
 
 /*
- * NAME:	hfs->read()
- * DESCRIPTION:	read from an open file
+ * NAME:	readfork()
+ * DESCRIPTION:	read from the selected fork at *pos, advancing it (lock held)
+ */
+static
+unsigned long readfork(hfsfile *file, void *buf, unsigned long len,
+		       unsigned long *pos)
+{
+  ULongInt *lglen, count;
+  byte *ptr = buf;
+
+  f_getptrs(file, 0, &lglen, 0);
+
+  if (*pos >= *lglen)
+    len = 0;
+  else if (*pos + len > *lglen)
+    len = *lglen - *pos;
+
+  count = len;
+  while (count)
+    {
+      unsigned long bnum, offs, chunk;
+
+      bnum  = *pos >> HFS_BLOCKSZ_BITS;
+      offs  = *pos & (HFS_BLOCKSZ - 1);
+
+      chunk = HFS_BLOCKSZ - offs;
+      if (chunk > count)
+	chunk = count;
+
+      if (offs == 0 && chunk == HFS_BLOCKSZ)
+	{
+	  if (f_getblock(file, bnum, (block *) ptr) == -1)
+	    goto fail;
+	}
+      else
+	{
+	  block b;
+
+	  if (f_getblock(file, bnum, &b) == -1)
+	    goto fail;
+
+	  memcpy(ptr, b + offs, chunk);
+	}
+
+      ptr += chunk;
+
+      *pos  += chunk;
+      count -= chunk;
+    }
+
+  return len;
+
+fail:
+  return -1;
+}
+
+/*
+ * NAME:	hfs->read()
+ * DESCRIPTION:	read from an open file
+ */
+unsigned long hfs_read(hfsfile *file, void *buf, unsigned long len)
+{
+  SHARED();
+  pthread_mutex_lock(&file->lock);
+
+  len = readfork(file, buf, len, &file->pos);
+
+  pthread_mutex_unlock(&file->lock);
+  RELEASE();
+
+  return len;
+}
+
+/*
+ * NAME:	hfs->pread()
+ * DESCRIPTION:	read from either fork at an offset, leaving the seek pointer
+ */
+unsigned long hfs_pread(hfsfile *file, int fork, void *buf,
+			unsigned long len, unsigned long off)
+{
+  int other;
+
+  SHARED();
+  pthread_mutex_lock(&file->lock);
+
+  other = ((fork ? fkRsrc : fkData) != file->fork);
+
+  if (other)
+    f_swapfork(file);
+
+  len = readfork(file, buf, len, &off);
+
+  if (other)
+    f_swapfork(file);
+
+  pthread_mutex_unlock(&file->lock);
+  RELEASE();
+
+  return len;
+}
+
+/*
+ * NAME:	hfs->pin()
+ * DESCRIPTION:	keep a file's blocks where hfs_pmap() finds them
+ */
+int hfs_pin(hfsfile *file)
+{
+  SHARED();
+
+  return 0;
+}
+
+/*
+ * NAME:	hfs->unpin()
+ * DESCRIPTION:	let a pinned file be written, truncated, or deleted again
+ */
+int hfs_unpin(hfsfile *file)
+{
+  RELEASE();
+
+  return 0;
+}
+
+/*
+ * NAME:	hfs->pmap()
+ * DESCRIPTION:	locate a contiguous part of either fork on the medium
  */
-unsigned long hfs_read(hfsfile *file, void *buf, unsigned long len)
+unsigned long hfs_pmap(hfsfile *file, int fork, unsigned long len,
+		       unsigned long off, int *fd, unsigned long long *where)
 {
-  ULongInt *lglen, count;
-  byte *ptr = buf;
+  hfsvol *vol = file->vol;
+  ULongInt *lglen;
+  int other;
 
-  f_getptrs(file, 0, &lglen, 0);
+  /*
+   * The caller holds the file with hfs_pin(), and reads the run before
+   * hfs_unpin(); otherwise the blocks could be freed and reused, or the
+   * cache could get ahead of the medium, in the meantime.
+   */
 
-  if (file->pos + len > *lglen)
-    len = *lglen - file->pos;
+  *fd = os_fd(&vol->priv);
+  if (*fd == -1)
+    ERROR(EINVAL, "medium cannot be read directly");
 
-  count = len;
-  while (count)
+  pthread_mutex_lock(&file->lock);
+
+  other = ((fork ? fkRsrc : fkData) != file->fork);
+
+  if (other)
+    f_swapfork(file);
+
+  f_getptrs(file, 0, &lglen, 0);
+
+  if (off >= *lglen)
+    len = 0;
+  else
     {
-      unsigned long bnum, offs, chunk;
+      unsigned long lbnum, offs;
+      long count;
 
-      bnum  = file->pos >> HFS_BLOCKSZ_BITS;
-      offs  = file->pos & (HFS_BLOCKSZ - 1);
+      if (off + len > *lglen)
+	len = *lglen - off;
 
-      chunk = HFS_BLOCKSZ - offs;
-      if (chunk > count)
-	chunk = count;
+      offs  = off & (HFS_BLOCKSZ - 1);
+      count = f_run(file, off >> HFS_BLOCKSZ_BITS, &lbnum);
 
-      if (offs == 0 && chunk == HFS_BLOCKSZ)
-	{
-	  if (f_getblock(file, bnum, (block *) ptr) == -1)
-	    goto fail;
-	}
+      if (count == -1)
+	len = -1;
       else
 	{
-	  block b;
+	  if (len > ((unsigned long) count << HFS_BLOCKSZ_BITS) - offs)
+	    len = ((unsigned long) count << HFS_BLOCKSZ_BITS) - offs;
 
-	  if (f_getblock(file, bnum, &b) == -1)
-	    goto fail;
+	  /* the medium must hold what the cache does before it is read */
 
-	  memcpy(ptr, b + offs, chunk);
+	  if (b_flushrange(vol, lbnum,
+			   (offs + len + HFS_BLOCKSZ - 1) >> HFS_BLOCKSZ_BITS) == -1)
+	    len = -1;
+
+	  *where = ((unsigned long long) (vol->vstart + lbnum)
+		    << HFS_BLOCKSZ_BITS) + offs;
 	}
+    }
 
-      ptr += chunk;
+  if (other)
+    f_swapfork(file);
 
-      file->pos += chunk;
-      count     -= chunk;
-    }
+  pthread_mutex_unlock(&file->lock);
 
   return len;
 
@@ -901,17 +1571,16 @@ fail:
 }
 
 /*
- * NAME:	hfs->write()
- * DESCRIPTION:	write to an open file
+ * NAME:	writefork()
+ * DESCRIPTION:	write to the selected fork at *pos, advancing it (lock held)
  */
-unsigned long hfs_write(hfsfile *file, const void *buf, unsigned long len)
+static
+unsigned long writefork(hfsfile *file, const void *buf, unsigned long len,
+			unsigned long *pos)
 {
   ULongInt *lglen, *pylen, count;
   const byte *ptr = buf;
 
-  if (file->vol->flags & HFS_VOL_READONLY)
-    ERROR(EROFS, 0);
-
   f_getptrs(file, 0, &lglen, &pylen);
 
   count = len;
@@ -928,14 +1597,14 @@ unsigned long hfs_write(hfsfile *file, const void *buf, unsigned long len)
     {
       unsigned long bnum, offs, chunk;
 
-      bnum  = file->pos >> HFS_BLOCKSZ_BITS;
-      offs  = file->pos & (HFS_BLOCKSZ - 1);
+      bnum  = *pos >> HFS_BLOCKSZ_BITS;
+      offs  = *pos & (HFS_BLOCKSZ - 1);
 
       chunk = HFS_BLOCKSZ - offs;
       if (chunk > count)
 	chunk = count;
 
-      if (file->pos + chunk > *pylen)
+      if (*pos + chunk > *pylen)
 	{
 	  if (bt_space(&file->vol->ext, 1) == -1 ||
 	      f_alloc(file) == -1)
@@ -962,17 +1631,106 @@ unsigned long hfs_write(hfsfile *file, const void *buf, unsigned long len)
 
       ptr += chunk;
 
-      file->pos += chunk;
-      count     -= chunk;
+      *pos  += chunk;
+      count -= chunk;
 
-      if (file->pos > *lglen)
-	*lglen = file->pos;
+      if (*pos > *lglen)
+	*lglen = *pos;
     }
+
+  return len;
+
+fail:
+  return -1;
+}
+
+/*
+ * NAME:	hfs->write()
+ * DESCRIPTION:	write to an open file
+ */
+unsigned long hfs_write(hfsfile *file, const void *buf, unsigned long len)
+{
+  EXCLUSIVE();
+
+  if (file->vol->flags & HFS_VOL_READONLY)
+    ERROR(EROFS, 0);
+
+  len = writefork(file, buf, len, &file->pos);
   
     f_flush(file);
+
+  RELEASE();
+
+  return len;
+
+fail:
+  RELEASE();
+
+  return -1;
+}
+
+/*
+ * NAME:	hfs->pwrite()
+ * DESCRIPTION:	write to either fork at an offset, leaving the seek pointer
+ */
+unsigned long hfs_pwrite(hfsfile *file, int fork, const void *buf,
+			 unsigned long len, unsigned long off)
+{
+  static const block zero;
+  ULongInt *lglen;
+  unsigned long pos;
+  int other;
+
+  EXCLUSIVE();
+
+  if (file->vol->flags & HFS_VOL_READONLY)
+    ERROR(EROFS, 0);
+
+  other = ((fork ? fkRsrc : fkData) != file->fork);
+
+  if (other)
+    f_swapfork(file);
+
+  f_getptrs(file, 0, &lglen, 0);
+
+  /* fill any gap past the end of the fork with zeros */
+
+  for (pos = *lglen; pos < off; )
+    {
+      unsigned long chunk;
+
+      chunk = HFS_BLOCKSZ - (pos & (HFS_BLOCKSZ - 1));
+      if (chunk > off - pos)
+	chunk = off - pos;
+
+      if (writefork(file, zero, chunk, &pos) == (unsigned long) -1)
+	break;
+    }
+
+  if (pos < off)
+    len = -1;
+  else
+    len = writefork(file, buf, len, &off);
+
+  /* the other fork keeps no preallocated blocks, as if it were switched out */
+
+  if (other)
+    {
+      if (f_trunc(file) == -1)
+	len = -1;
+
+      f_swapfork(file);
+    }
+
+  f_flush(file);
+
+  RELEASE();
+
   return len;
 
 fail:
+  RELEASE();
+
   return -1;
 }
 
@@ -984,6 +1742,8 @@ int hfs_truncate(hfsfile *file, unsigned long len)
 {
   ULongInt *lglen;
 
+  EXCLUSIVE();
+
   f_getptrs(file, 0, &lglen, 0);
 
   if (*lglen > len)
@@ -1001,9 +1761,13 @@ int hfs_truncate(hfsfile *file, unsigned long len)
     }
     f_flush(file);
 
+  RELEASE();
+
   return 0;
 
 fail:
+  RELEASE();
+
   return -1;
 }
 
@@ -1015,6 +1779,9 @@ unsigned long hfs_seek(hfsfile *file, long offset, int from)
 {
   ULongInt *lglen, newpos;
 
+  SHARED();
+  pthread_mutex_lock(&file->lock);
+
   f_getptrs(file, 0, &lglen, 0);
 
   switch (from)
@@ -1046,19 +1813,27 @@ unsigned long hfs_seek(hfsfile *file, long offset, int from)
 
   file->pos = newpos;
 
+  pthread_mutex_unlock(&file->lock);
+  RELEASE();
+
   return newpos;
 
 fail:
+  pthread_mutex_unlock(&file->lock);
+  RELEASE();
+
   return -1;
 }
 
 /*
- * NAME:	hfs->close()
- * DESCRIPTION:	close a file
+ * NAME:	closefile()
+ * DESCRIPTION:	drop a reference to a file, closing it with the last (lock held)
  */
-int hfs_close(hfsfile *file)
+static
+int closefile(hfsfile *file)
 {
   hfsvol *vol = file->vol;
+  pattr *pa;
   int result = 0;
 
   if (--(file->refs)) {
@@ -1066,6 +1841,15 @@ int hfs_close(hfsfile *file)
 	printf("file %s still has %d refs\n", file->name, file->refs);
 	return 0;
   }
+
+  /* the handle holds any deferred attributes; write them with it */
+
+  pa = v_findattrs(vol, file->cat.u.fil.filFlNum);
+  if (pa)
+    {
+      v_dropattrs(vol, pa);
+      file->flags |= HFS_FILE_UPDATE_CATREC;
+    }
 	
   if (f_trunc(file) == -1 ||
       f_flush(file) == -1)
@@ -1078,13 +1862,88 @@ int hfs_close(hfsfile *file)
   if (file == vol->files)
     vol->files = file->next;
 
+  pthread_mutex_destroy(&file->lock);
   FREE(file);
 
   return result;
 }
 
+/*
+ * NAME:	hfs->close()
+ * DESCRIPTION:	close a file
+ */
+int hfs_close(hfsfile *file)
+{
+  int result;
+
+  EXCLUSIVE();
+  result = closefile(file);
+  RELEASE();
+
+  return result;
+}
+
 /* High-Level Catalog Routines ============================================= */
 
+/*
+ * NAME:	recid()
+ * DESCRIPTION:	return the CNID of a file or directory record
+ */
+static
+unsigned long recid(const CatDataRec *data)
+{
+  switch (data->cdrType)
+    {
+    case cdrDirRec:
+      return data->u.dir.dirDirID;
+
+    case cdrFilRec:
+      return data->u.fil.filFlNum;
+    }
+
+  return 0;
+}
+
+/*
+ * NAME:	freshen()
+ * DESCRIPTION:	bring a catalog record up to date with changes not yet written
+ */
+static
+void freshen(hfsvol *vol, CatDataRec *data)
+{
+  hfsfile *file = 0;
+  pattr *pa;
+
+  /* an open handle may carry fork changes not yet written to the catalog;
+     handles are only freed under the exclusive lock, so this one stays */
+
+  if (data->cdrType == cdrFilRec)
+    {
+      pthread_mutex_lock(&vol->lock);
+
+      for (file = vol->files; file; file = file->next)
+	{
+	  if (file->cat.u.fil.filFlNum == data->u.fil.filFlNum)
+	    break;
+	}
+
+      pthread_mutex_unlock(&vol->lock);
+    }
+
+  if (file)
+    {
+      pthread_mutex_lock(&file->lock);
+      *data = file->cat;
+      pthread_mutex_unlock(&file->lock);
+    }
+
+  /* deferred attributes change only under the exclusive lock */
+
+  pa = v_findattrs(vol, recid(data));
+  if (pa)
+    r_packdirent(data, &pa->ent);
+}
+
 /*
  * NAME:	hfs->stat()
  * DESCRIPTION:	return catalog information for an arbitrary path
@@ -1095,15 +1954,51 @@ int hfs_stat(hfsvol *vol, const char *path, hfsdirent *ent)
   unsigned long parid;
   char name[HFS_MAX_FLEN + 1];
 
+  SHARED();
+
   if (getvol(&vol) == -1 ||
       v_resolve(&vol, path, &data, &parid, name, 0) <= 0)
     goto fail;
 
+  freshen(vol, &data);
   r_unpackdirent(parid, name, &data, ent);
 
+  RELEASE();
+
+  return 0;
+
+fail:
+  RELEASE();
+
+  return -1;
+}
+
+/*
+ * NAME:	hfs->statat()
+ * DESCRIPTION:	return catalog information given a parent ID and name
+ */
+int hfs_statat(hfsvol *vol, unsigned long parid, const char *name,
+	       hfsdirent *ent)
+{
+  CatDataRec data;
+  char cname[HFS_MAX_FLEN + 1];
+
+  SHARED();
+
+  if (getvol(&vol) == -1 ||
+      catlookup(vol, parid, name, &data, cname, 0) == -1)
+    goto fail;
+
+  freshen(vol, &data);
+  r_unpackdirent(parid, cname, &data, ent);
+
+  RELEASE();
+
   return 0;
 
 fail:
+  RELEASE();
+
   return -1;
 }
 
@@ -1113,11 +2008,51 @@ fail:
  */
 int hfs_fstat(hfsfile *file, hfsdirent *ent)
 {
+  SHARED();
   r_unpackdirent(file->parid, file->name, &file->cat, ent);
+  RELEASE();
 
   return 0;
 }
 
+/*
+ * NAME:	deferattr()
+ * DESCRIPTION:	change attributes, writing them to the catalog later (lock held)
+ */
+static
+int deferattr(hfsvol *vol, unsigned long parid, const char *name,
+	      const CatDataRec *data, const hfsdirent *ent)
+{
+  hfsfile *file;
+
+  if (vol->flags & HFS_VOL_READONLY)
+    ERROR(EROFS, 0);
+
+  /*
+   * Metadata calls tend to come several to a file; each record is written
+   * once, by hfs_flush(), hfs_umount(), or the last close of the file. An
+   * open handle takes the attributes too, or it would write its old ones
+   * back when flushed.
+   */
+
+  if (data->cdrType == cdrFilRec)
+    {
+      for (file = vol->files; file; file = file->next)
+	{
+	  if (file->cat.u.fil.filFlNum == data->u.fil.filFlNum)
+	    {
+	      r_packdirent(&file->cat, ent);
+	      break;
+	    }
+	}
+    }
+
+  return v_deferattrs(vol, parid, name, recid(data), ent);
+
+fail:
+  return -1;
+}
+
 /*
  * NAME:	hfs->setattr()
  * DESCRIPTION:	change a file's attributes
@@ -1125,20 +2060,54 @@ int hfs_fstat(hfsfile *file, hfsdirent *ent)
 int hfs_setattr(hfsvol *vol, const char *path, const hfsdirent *ent)
 {
   CatDataRec data;
-  node n;
+  unsigned long parid;
+  char name[HFS_MAX_FLEN + 1];
+  int result;
+
+  EXCLUSIVE();
 
   if (getvol(&vol) == -1 ||
-      v_resolve(&vol, path, &data, 0, 0, &n) <= 0)
+      v_resolve(&vol, path, &data, &parid, name, 0) <= 0)
     goto fail;
 
-  if (vol->flags & HFS_VOL_READONLY)
-    ERROR(EROFS, 0);
+  result = deferattr(vol, parid, name, &data, ent);
+
+  RELEASE();
+
+  return result;
+
+fail:
+  RELEASE();
+
+  return -1;
+}
+
+/*
+ * NAME:	hfs->setattrat()
+ * DESCRIPTION:	change attributes given a parent ID and name
+ */
+int hfs_setattrat(hfsvol *vol, unsigned long parid, const char *name,
+		  const hfsdirent *ent)
+{
+  CatDataRec data;
+  char cname[HFS_MAX_FLEN + 1];
+  int result;
+
+  EXCLUSIVE();
+
+  if (getvol(&vol) == -1 ||
+      catlookup(vol, parid, name, &data, cname, 0) == -1)
+    goto fail;
+
+  result = deferattr(vol, parid, cname, &data, ent);
 
-  r_packdirent(&data, ent);
+  RELEASE();
 
-  return v_putcatrec(&data, &n);
+  return result;
 
 fail:
+  RELEASE();
+
   return -1;
 }
 
@@ -1148,6 +2117,10 @@ fail:
  */
 int hfs_fsetattr(hfsfile *file, const hfsdirent *ent)
 {
+  pattr *pa;
+
+  EXCLUSIVE();
+
   if (file->vol->flags & HFS_VOL_READONLY)
     ERROR(EROFS, 0);
 
@@ -1155,9 +2128,17 @@ int hfs_fsetattr(hfsfile *file, const hfsdirent *ent)
 
   file->flags |= HFS_FILE_UPDATE_CATREC;
 
+  pa = v_findattrs(file->vol, file->cat.u.fil.filFlNum);
+  if (pa)
+    pa->ent = *ent;
+
+  RELEASE();
+
   return 0;
 
 fail:
+  RELEASE();
+
   return -1;
 }
 
@@ -1170,7 +2151,9 @@ int hfs_mkdir(hfsvol *vol, const char *path)
   CatDataRec data;
   unsigned long parid;
   char name[HFS_MAX_FLEN + 1];
-  int found;
+  int found, result;
+
+  EXCLUSIVE();
 
   if (getvol(&vol) == -1)
     goto fail;
@@ -1188,9 +2171,15 @@ int hfs_mkdir(hfsvol *vol, const char *path)
   if (vol->flags & HFS_VOL_READONLY)
     ERROR(EROFS, 0);
 
-  return v_mkdir(vol, parid, name);
+  result = v_mkdir(vol, parid, name);
+
+  RELEASE();
+
+  return result;
 
 fail:
+  RELEASE();
+
   return -1;
 }
 
@@ -1206,7 +2195,12 @@ int hfs_rmdir(hfsvol *vol, const char *path)
   char name[HFS_MAX_FLEN + 1];
   byte pkey[HFS_CATKEYLEN];
 
+  EXCLUSIVE();
+
+  /* records are about to move or go; write deferred attributes first */
+
   if (getvol(&vol) == -1 ||
+      v_flushattrs(vol) == -1 ||
       v_resolve(&vol, path, &data, &parid, name, 0) <= 0)
     goto fail;
 
@@ -1227,6 +2221,9 @@ int hfs_rmdir(hfsvol *vol, const char *path)
   r_makecatkey(&key, parid, name);
   r_packcatkey(&key, pkey, 0);
 
+  if (vol->lookup)
+    lk_forget(vol, parid, name);
+
   if (bt_delete(&vol->cat, pkey) == -1)
     goto fail;
 
@@ -1235,13 +2232,20 @@ int hfs_rmdir(hfsvol *vol, const char *path)
   r_makecatkey(&key, data.u.dir.dirDirID, "");
   r_packcatkey(&key, pkey, 0);
 
+  if (vol->lookup)
+    lk_forget(vol, data.u.dir.dirDirID, "");
+
   if (bt_delete(&vol->cat, pkey) == -1 ||
       v_adjvalence(vol, parid, 1, -1) == -1)
     goto fail;
 
+  RELEASE();
+
   return 0;
 
 fail:
+  RELEASE();
+
   return -1;
 }
 
@@ -1256,7 +2260,12 @@ int hfs_delete(hfsvol *vol, const char *path)
   byte pkey[HFS_CATKEYLEN];
   int found;
 
+  EXCLUSIVE();
+
+  /* records are about to move or go; write deferred attributes first */
+
   if (getvol(&vol) == -1 ||
+      v_flushattrs(vol) == -1 ||
       v_resolve(&vol, path, &file.cat, &file.parid, file.name, 0) <= 0)
     goto fail;
 
@@ -1290,6 +2299,9 @@ int hfs_delete(hfsvol *vol, const char *path)
   r_makecatkey(&key, file.parid, file.name);
   r_packcatkey(&key, pkey, 0);
 
+  if (vol->lookup)
+    lk_forget(vol, file.parid, file.name);
+
   if (bt_delete(&vol->cat, pkey) == -1 ||
       v_adjvalence(vol, file.parid, 0, -1) == -1)
     goto fail;
@@ -1305,13 +2317,20 @@ int hfs_delete(hfsvol *vol, const char *path)
       r_makecatkey(&key, file.cat.u.fil.filFlNum, "");
       r_packcatkey(&key, pkey, 0);
 
+      if (vol->lookup)
+	lk_forget(vol, file.cat.u.fil.filFlNum, "");
+
       if (bt_delete(&vol->cat, pkey) == -1)
 	goto fail;
     }
 
+  RELEASE();
+
   return 0;
 
 fail:
+  RELEASE();
+
   return -1;
 }
 
@@ -1331,7 +2350,12 @@ int hfs_rename(hfsvol *vol, const char *srcpath, const char *dstpath)
   int found, isdir, moving;
   node n;
 
+  EXCLUSIVE();
+
+  /* records are about to move or go; write deferred attributes first */
+
   if (getvol(&vol) == -1 ||
+      v_flushattrs(vol) == -1 ||
       v_resolve(&vol, srcpath, &src, &srcid, srcname, 0) <= 0)
     goto fail;
 
@@ -1427,6 +2451,12 @@ int hfs_rename(hfsvol *vol, const char *srcpath, const char *dstpath)
   r_makecatkey(&key, srcid, srcname);
   r_packcatkey(&key, record, 0);
 
+  if (vol->lookup)
+    {
+      lk_forget(vol, srcid, srcname);
+      lk_forget(vol, dstid, dstname);
+    }
+
   if (bt_delete(&vol->cat, record) == -1)
     goto fail;
 
@@ -1477,9 +2507,13 @@ int hfs_rename(hfsvol *vol, const char *srcpath, const char *dstpath)
     }
 
 done:
+  RELEASE();
+
   return 0;
 
 fail:
+  RELEASE();
+
   return -1;
 }
 
@@ -19,6 +19,7 @@
  * $Id: hfs.h,v 1.11 1998/11/02 22:09:01 rob Exp $
  */
 
+# include <stdio.h>
 # include <time.h>
 
 # define HFS_BLOCKSZ		512
@@ -51,6 +52,36 @@ typedef struct {
   unsigned long blessed;	/* CNID of MacOS System Folder */
 } hfsvolent;
 
+typedef struct {
+  unsigned long bhits;		/* block cache hits */
+  unsigned long bmisses;	/* block cache misses */
+
+  unsigned long lhits;		/* catalog lookup cache hits */
+  unsigned long lmisses;	/* catalog lookup cache misses */
+
+  unsigned long searches;	/* B*-tree searches */
+  unsigned long levels;		/* nodes visited by those searches */
+  unsigned long extsearches;	/* extents overflow searches */
+
+  unsigned long long nread;	/* bytes read from the medium */
+  unsigned long long nwritten;	/* bytes written to the medium */
+
+  unsigned int cachesz;		/* blocks the block cache can hold */
+  unsigned int cacheused;	/* blocks it holds now */
+  unsigned int cachedirty;	/* of those, blocks not yet written */
+  unsigned int readahead;	/* blocks read beyond each miss */
+
+  unsigned int lookupsz;	/* entries the lookup cache can hold */
+  unsigned int lookupused;	/* entries it holds now */
+
+  unsigned int pending;		/* setattr changes not yet written */
+
+  unsigned long alblocks;	/* allocation blocks on the volume */
+  unsigned long freeblocks;	/* of those, blocks not in use */
+  unsigned long largestfree;	/* longest run of unused blocks */
+  unsigned long allocptr;	/* where the next allocation search starts */
+} hfsvolstats;
+
 typedef struct {
   char name[HFS_MAX_FLEN + 1];	/* catalog name (MacOS Standard Roman) */
   int flags;			/* bit flags */
@@ -118,7 +149,7 @@ typedef struct {
 # define HFS_FNDR_ISINVISIBLE		(1 << 14)
 # define HFS_FNDR_ISALIAS		(1 << 15)
 
-extern const char *hfs_error;
+extern __thread const char *hfs_error;
 extern const unsigned char hfs_charorder[];
 
 # define HFS_MODE_RDONLY	0
@@ -145,6 +176,11 @@ void hfs_setvol(hfsvol *);
 
 int hfs_vstat(hfsvol *, hfsvolent *);
 int hfs_vsetattr(hfsvol *, hfsvolent *);
+int hfs_vstats(hfsvol *, hfsvolstats *);
+int hfs_setcache(hfsvol *, unsigned int, unsigned int);
+int hfs_dropcaches(hfsvol *);
+int hfs_settrace(hfsvol *, const char *);
+int hfs_settracefile(hfsvol *, FILE *);
 
 int hfs_chdir(hfsvol *, const char *);
 unsigned long hfs_getcwd(hfsvol *);
@@ -152,22 +188,33 @@ int hfs_setcwd(hfsvol *, unsigned long);
 int hfs_dirinfo(hfsvol *, unsigned long *, char *);
 
 hfsdir *hfs_opendir(hfsvol *, const char *);
+hfsdir *hfs_opendirid(hfsvol *, unsigned long);
 int hfs_readdir(hfsdir *, hfsdirent *);
 int hfs_closedir(hfsdir *);
 
 hfsfile *hfs_create(hfsvol *, const char *, const char *, const char *);
 hfsfile *hfs_open(hfsvol *, const char *);
+hfsfile *hfs_openat(hfsvol *, unsigned long, const char *);
 int hfs_setfork(hfsfile *, int);
 int hfs_getfork(hfsfile *);
 unsigned long hfs_read(hfsfile *, void *, unsigned long);
 unsigned long hfs_write(hfsfile *, const void *, unsigned long);
+unsigned long hfs_pread(hfsfile *, int, void *, unsigned long, unsigned long);
+unsigned long hfs_pwrite(hfsfile *, int, const void *,
+			 unsigned long, unsigned long);
+int hfs_pin(hfsfile *);
+int hfs_unpin(hfsfile *);
+unsigned long hfs_pmap(hfsfile *, int, unsigned long, unsigned long,
+		       int *, unsigned long long *);
 int hfs_truncate(hfsfile *, unsigned long);
 unsigned long hfs_seek(hfsfile *, long, int);
 int hfs_close(hfsfile *);
 
 int hfs_stat(hfsvol *, const char *, hfsdirent *);
+int hfs_statat(hfsvol *, unsigned long, const char *, hfsdirent *);
 int hfs_fstat(hfsfile *, hfsdirent *);
 int hfs_setattr(hfsvol *, const char *, const hfsdirent *);
+int hfs_setattrat(hfsvol *, unsigned long, const char *, const hfsdirent *);
 int hfs_fsetattr(hfsfile *, const hfsdirent *);
 
 int hfs_mkdir(hfsvol *, const char *);
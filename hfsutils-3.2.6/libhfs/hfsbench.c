@@ -0,0 +1,559 @@
+/*
+ * libhfs - library for reading and writing Macintosh HFS volumes
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/*
+ * hfsbench formats a scratch image with hfs_format() and times the library
+ * against it. Each result is one tab-separated line:
+ *
+ *   test  count  unit  seconds  per-second
+ *
+ * Lines beginning with '#' are comments, so the output can be appended to
+ * a file per commit and compared with cut, awk or a spreadsheet. With -t,
+ * the block I/O of everything after the mount tests is written to a trace
+ * for hfscachesim.
+ */
+
+# ifdef HAVE_CONFIG_H
+#  include "config.h"
+# endif
+
+# ifdef HAVE_UNISTD_H
+#  include <unistd.h>
+# endif
+
+# ifdef HAVE_FCNTL_H
+#  include <fcntl.h>
+# endif
+
+# include <stdio.h>
+# include <stdlib.h>
+# include <string.h>
+# include <errno.h>
+# include <time.h>
+
+# include "hfs.h"
+# include "version.h"
+
+# define CHUNKSZ	65536
+# define RANDSZ		4096
+
+extern char *optarg;
+extern int optind;
+
+static const char *argv0;
+
+static unsigned long imagesz = 64;	/* megabytes */
+static unsigned long seqsz   = 16;	/* megabytes */
+static unsigned long nrand   = 2000;
+static unsigned long nfiles  = 1000;
+static unsigned int  depth   = 32;
+static unsigned long nmounts = 50;
+
+static unsigned long seed = 1;
+
+static const char *tracepath = 0;
+
+static char buf[CHUNKSZ];
+
+/*
+ * NAME:	usage()
+ * DESCRIPTION:	display usage message
+ */
+static
+void usage(void)
+{
+  fprintf(stderr, "Usage: %s [-k] [-s image-MB] [-z file-MB] [-r random-ops]\n"
+	  "       [-f files] [-d depth] [-m mounts] [-t block-trace] image-path\n",
+	  argv0);
+}
+
+/*
+ * NAME:	fail()
+ * DESCRIPTION:	report a library error and give up
+ */
+static
+void fail(const char *what)
+{
+  fprintf(stderr, "%s: %s: %s\n", argv0, what,
+	  hfs_error ? hfs_error : strerror(errno));
+  exit(1);
+}
+
+/*
+ * NAME:	now()
+ * DESCRIPTION:	return a monotonic time in seconds
+ */
+static
+double now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * NAME:	report()
+ * DESCRIPTION:	print one result line
+ */
+static
+void report(const char *test, unsigned long count, const char *unit,
+	    double secs)
+{
+  printf("%s\t%lu\t%s\t%.6f\t%.1f\n", test, count, unit, secs,
+	 secs > 0 ? count / secs : 0.0);
+  fflush(stdout);
+}
+
+/*
+ * NAME:	rnd()
+ * DESCRIPTION:	return a repeatable pseudo-random number
+ */
+static
+unsigned long rnd(void)
+{
+  seed = seed * 1103515245 + 12345;
+
+  return (seed >> 16) & 0x7fffffff;
+}
+
+/*
+ * NAME:	mkimage()
+ * DESCRIPTION:	create and format a scratch image of the configured size
+ */
+static
+void mkimage(const char *path)
+{
+  int fd;
+  double start;
+
+  fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd == -1 || ftruncate(fd, (off_t) imagesz << 20) == -1)
+    fail(path);
+
+  close(fd);
+
+  start = now();
+
+  if (hfs_format(path, 0, 0, "Bench", 0, 0) == -1)
+    fail("hfs_format");
+
+  report("format", imagesz << 20, "bytes", now() - start);
+}
+
+/*
+ * NAME:	mountumount()
+ * DESCRIPTION:	time mounting and unmounting an idle volume
+ */
+static
+void mountumount(const char *path)
+{
+  hfsvol *vol;
+  double mount = 0, umount = 0, start;
+  unsigned long i;
+
+  for (i = 0; i < nmounts; ++i)
+    {
+      start = now();
+      vol = hfs_mount(path, 0, HFS_MODE_RDWR);
+      if (vol == 0)
+	fail("hfs_mount");
+
+      mount += now() - start;
+
+      start = now();
+      if (hfs_umount(vol) == -1)
+	fail("hfs_umount");
+
+      umount += now() - start;
+    }
+
+  report("mount", nmounts, "mounts", mount);
+  report("umount", nmounts, "umounts", umount);
+}
+
+/*
+ * NAME:	sequential()
+ * DESCRIPTION:	write one large file in big chunks, then read it back cold
+ */
+static
+void sequential(hfsvol *vol)
+{
+  hfsfile *file;
+  unsigned long total = seqsz << 20, done;
+  double start;
+
+  memset(buf, 0xa5, sizeof(buf));
+
+  start = now();
+
+  file = hfs_create(vol, ":seq", "BINA", "hfsb");
+  if (file == 0)
+    fail("hfs_create");
+
+  for (done = 0; done < total; done += CHUNKSZ)
+    {
+      if (hfs_write(file, buf, CHUNKSZ) != CHUNKSZ)
+	fail("hfs_write");
+    }
+
+  if (hfs_close(file) == -1 ||
+      hfs_flush(vol) == -1)
+    fail("hfs_close");
+
+  report("seqwrite", total, "bytes", now() - start);
+
+  if (hfs_dropcaches(vol) == -1)
+    fail("hfs_dropcaches");
+
+  start = now();
+
+  file = hfs_open(vol, ":seq");
+  if (file == 0)
+    fail("hfs_open");
+
+  for (done = 0; done < total; done += CHUNKSZ)
+    {
+      if (hfs_read(file, buf, CHUNKSZ) != CHUNKSZ)
+	fail("hfs_read");
+    }
+
+  if (hfs_close(file) == -1)
+    fail("hfs_close");
+
+  report("seqread", total, "bytes", now() - start);
+}
+
+/*
+ * NAME:	randomio()
+ * DESCRIPTION:	read and then overwrite small blocks at random offsets
+ */
+static
+void randomio(hfsvol *vol)
+{
+  hfsfile *file;
+  unsigned long nblocks = (seqsz << 20) / RANDSZ, i;
+  double start;
+
+  if (hfs_dropcaches(vol) == -1)
+    fail("hfs_dropcaches");
+
+  file = hfs_open(vol, ":seq");
+  if (file == 0)
+    fail("hfs_open");
+
+  start = now();
+
+  for (i = 0; i < nrand; ++i)
+    {
+      if (hfs_seek(file, rnd() % nblocks * RANDSZ, HFS_SEEK_SET) == (unsigned long) -1 ||
+	  hfs_read(file, buf, RANDSZ) != RANDSZ)
+	fail("hfs_read");
+    }
+
+  report("randread", nrand, "ops", now() - start);
+
+  start = now();
+
+  for (i = 0; i < nrand; ++i)
+    {
+      if (hfs_seek(file, rnd() % nblocks * RANDSZ, HFS_SEEK_SET) == (unsigned long) -1 ||
+	  hfs_write(file, buf, RANDSZ) != RANDSZ)
+	fail("hfs_write");
+    }
+
+  if (hfs_close(file) == -1 ||
+      hfs_flush(vol) == -1)
+    fail("hfs_close");
+
+  report("randwrite", nrand, "ops", now() - start);
+
+  if (hfs_delete(vol, ":seq") == -1)
+    fail("hfs_delete");
+}
+
+/*
+ * NAME:	listdir()
+ * DESCRIPTION:	list a directory from start to finish
+ */
+static
+unsigned long listdir(hfsvol *vol, const char *path)
+{
+  hfsdir *dir;
+  hfsdirent ent;
+  unsigned long count = 0;
+
+  dir = hfs_opendir(vol, path);
+  if (dir == 0)
+    fail("hfs_opendir");
+
+  while (hfs_readdir(dir, &ent) == 0)
+    ++count;
+
+  if (hfs_closedir(dir) == -1)
+    fail("hfs_closedir");
+
+  return count;
+}
+
+/*
+ * NAME:	namespace()
+ * DESCRIPTION:	create, list, stat, rename and delete many files in one folder
+ */
+static
+void namespace(hfsvol *vol)
+{
+  hfsfile *file;
+  hfsdirent ent;
+  char name[HFS_MAX_FLEN + 8], other[HFS_MAX_FLEN + 8];
+  unsigned long i;
+  double start;
+
+  if (hfs_mkdir(vol, ":dir") == -1)
+    fail("hfs_mkdir");
+
+  start = now();
+
+  for (i = 0; i < nfiles; ++i)
+    {
+      sprintf(name, ":dir:file %06lu", i);
+
+      file = hfs_create(vol, name, "TEXT", "hfsb");
+      if (file == 0 ||
+	  hfs_close(file) == -1)
+	fail("hfs_create");
+    }
+
+  if (hfs_flush(vol) == -1)
+    fail("hfs_flush");
+
+  report("create", nfiles, "files", now() - start);
+
+  if (hfs_dropcaches(vol) == -1)
+    fail("hfs_dropcaches");
+
+  start = now();
+
+  if (listdir(vol, ":dir") != nfiles)
+    fail("hfs_readdir");
+
+  report("readdir_cold", nfiles, "entries", now() - start);
+
+  start = now();
+
+  for (i = 0; i < 10; ++i)
+    listdir(vol, ":dir");
+
+  report("readdir", nfiles * 10, "entries", now() - start);
+
+  start = now();
+
+  for (i = 0; i < nfiles; ++i)
+    {
+      sprintf(name, ":dir:file %06lu", rnd() % nfiles);
+
+      if (hfs_stat(vol, name, &ent) == -1)
+	fail("hfs_stat");
+    }
+
+  report("stat", nfiles, "lookups", now() - start);
+
+  start = now();
+
+  for (i = 0; i < nfiles; ++i)
+    {
+      sprintf(name, ":dir:file %06lu", i);
+      sprintf(other, ":dir:renamed %06lu", i);
+
+      if (hfs_rename(vol, name, other) == -1)
+	fail("hfs_rename");
+    }
+
+  if (hfs_flush(vol) == -1)
+    fail("hfs_flush");
+
+  report("rename", nfiles, "files", now() - start);
+
+  start = now();
+
+  for (i = 0; i < nfiles; ++i)
+    {
+      sprintf(name, ":dir:renamed %06lu", i);
+
+      if (hfs_delete(vol, name) == -1)
+	fail("hfs_delete");
+    }
+
+  if (hfs_flush(vol) == -1)
+    fail("hfs_flush");
+
+  report("delete", nfiles, "files", now() - start);
+
+  if (hfs_rmdir(vol, ":dir") == -1)
+    fail("hfs_rmdir");
+}
+
+/*
+ * NAME:	deeplookup()
+ * DESCRIPTION:	resolve a path many folders deep, warm and cold
+ */
+static
+void deeplookup(hfsvol *vol)
+{
+  char *path, *end;
+  hfsdirent ent;
+  unsigned int i;
+  unsigned long n, count = nfiles;
+  double start;
+
+  path = malloc(depth * 8 + 1);
+  if (path == 0)
+    fail("malloc");
+
+  for (end = path, i = 0; i < depth; ++i)
+    {
+      end += sprintf(end, ":lvl%03u", i);
+
+      if (hfs_mkdir(vol, path) == -1)
+	fail("hfs_mkdir");
+    }
+
+  if (hfs_flush(vol) == -1)
+    fail("hfs_flush");
+
+  start = now();
+
+  for (n = 0; n < count; ++n)
+    {
+      if (hfs_stat(vol, path, &ent) == -1)
+	fail("hfs_stat");
+    }
+
+  report("deeplookup", count, "lookups", now() - start);
+
+  count = count / 10 + 1;
+
+  start = now();
+
+  for (n = 0; n < count; ++n)
+    {
+      if (hfs_dropcaches(vol) == -1 ||
+	  hfs_stat(vol, path, &ent) == -1)
+	fail("hfs_stat");
+    }
+
+  report("deeplookup_cold", count, "lookups", now() - start);
+
+  free(path);
+}
+
+/*
+ * NAME:	main()
+ * DESCRIPTION:	program entry
+ */
+int main(int argc, char *argv[])
+{
+  const char *path;
+  hfsvol *vol;
+  int opt, keep = 0;
+
+  argv0 = argv[0];
+
+  while ((opt = getopt(argc, argv, "ks:z:r:f:d:m:t:")) != EOF)
+    {
+      switch (opt)
+	{
+	case 'k':
+	  keep = 1;
+	  break;
+
+	case 's':
+	  imagesz = strtoul(optarg, 0, 0);
+	  break;
+
+	case 'z':
+	  seqsz = strtoul(optarg, 0, 0);
+	  break;
+
+	case 'r':
+	  nrand = strtoul(optarg, 0, 0);
+	  break;
+
+	case 'f':
+	  nfiles = strtoul(optarg, 0, 0);
+	  break;
+
+	case 'd':
+	  depth = strtoul(optarg, 0, 0);
+	  break;
+
+	case 'm':
+	  nmounts = strtoul(optarg, 0, 0);
+	  break;
+
+	case 't':
+	  tracepath = optarg;
+	  break;
+
+	default:
+	  usage();
+	  return 1;
+	}
+    }
+
+  if (argc - optind != 1 || imagesz == 0 || seqsz == 0 || seqsz >= imagesz ||
+      nfiles == 0 || depth == 0)
+    {
+      usage();
+      return 1;
+    }
+
+  path = argv[optind];
+
+  printf("# hfsbench %s: image %luM, file %luM, %lu random ops, "
+	 "%lu files, depth %u, %lu mounts\n", libhfs_version,
+	 imagesz, seqsz, nrand, nfiles, depth, nmounts);
+  if (getenv("HFS_SLOWMEDIUM"))
+    printf("# medium: %s (if built with OS=slow)\n", getenv("HFS_SLOWMEDIUM"));
+
+  printf("# test\tcount\tunit\tseconds\tper_second\n");
+
+  mkimage(path);
+  mountumount(path);
+
+  vol = hfs_mount(path, 0, HFS_MODE_RDWR);
+  if (vol == 0)
+    fail("hfs_mount");
+
+  if (tracepath && hfs_settrace(vol, tracepath) == -1)
+    fail(tracepath);
+
+  sequential(vol);
+  randomio(vol);
+  namespace(vol);
+  deeplookup(vol);
+
+  if (hfs_umount(vol) == -1)
+    fail("hfs_umount");
+
+  if (! keep)
+    unlink(path);
+
+  return 0;
+}
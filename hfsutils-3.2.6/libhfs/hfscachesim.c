@@ -0,0 +1,1089 @@
+/*
+ * libhfs - library for reading and writing Macintosh HFS volumes
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/*
+ * hfscachesim replays a block trace written by hfs_settrace() (or by
+ * hfsbench -t) against simulated block caches of several sizes and
+ * replacement policies. Only the logical block requests are replayed, so
+ * the image the trace came from isn't needed. Each result is one
+ * tab-separated line:
+ *
+ *   policy  size  accesses  hits  hit_rate  read_hit_rate  blocks_read
+ *
+ * where size is in 512-byte blocks and blocks_read counts every block the
+ * simulated cache fetches, readahead included. Lines beginning with '#'
+ * are comments; each policy's lines, in order of size, are its hit-rate
+ * curve. The policies are:
+ *
+ *   libhfs  the library's own (see getbucket() in block.c): a hit moves a
+ *           bucket up the chain past those requested less often, and a
+ *           miss reuses the tail
+ *   lru     least recently used
+ *   fifo    first in, first out; hits don't reorder anything
+ *   clock   second chance: a hand sweeps the buckets, clearing reference
+ *           bits, and takes the first bucket not referenced since
+ *   opt     Belady's MIN, which evicts the block requested again furthest
+ *           in the future; no replacement policy can do better
+ *
+ * In every policy, a read miss is followed by up to -r blocks of readahead,
+ * stopping at the first block already cached, as in getbucket().
+ * A RESET in the trace (hfs_setcache(), hfs_dropcaches()) empties every
+ * simulated cache but leaves its size alone.
+ */
+
+# ifdef HAVE_CONFIG_H
+#  include "config.h"
+# endif
+
+# ifdef HAVE_UNISTD_H
+#  include <unistd.h>
+# endif
+
+# include <stdio.h>
+# include <stdlib.h>
+# include <string.h>
+# include <errno.h>
+
+# include "libhfs.h"
+# include "data.h"
+
+# define NONE		((unsigned long) -1)
+
+extern char *optarg;
+extern int optind;
+
+typedef struct {
+  unsigned long bnum;		/* logical block number */
+  unsigned long next;		/* index of the next request for it, or NONE */
+  unsigned long id;		/* which of the distinct blocks it is */
+  int op;			/* HFS_TRACE_READLB, _WRITELB, or _RESET */
+} request;
+
+typedef struct _entry_ {
+  int inuse;			/* holds a block */
+  unsigned long bnum;		/* which one */
+  unsigned long count;		/* libhfs: requests; clock: reference bit */
+  unsigned long next;		/* opt: index of its next request */
+
+  struct _entry_ *cnext;	/* next entry in chain (towards tail) */
+  struct _entry_ *cprev;	/* previous entry in chain */
+  struct _entry_ *hnext;	/* next entry in hash chain */
+} entry;
+
+typedef struct {
+  unsigned long next;
+  entry *e;
+} hentry;
+
+typedef struct _simcache_ simcache;
+
+typedef struct {
+  const char *name;
+  void (*hit)(simcache *, entry *, unsigned long);
+  unsigned long (*miss)(simcache *, unsigned long, int, unsigned long);
+} policy;
+
+struct _simcache_ {
+  const policy *policy;
+  unsigned int size;		/* number of entries */
+  unsigned int readahead;	/* blocks read beyond a miss */
+
+  entry *pool;			/* all entries */
+  entry *tail;			/* end of chain */
+  entry *hand;			/* clock: next entry to consider */
+  unsigned int nused;		/* opt: entries handed out so far */
+
+  entry **hash;			/* hash table of entries in use */
+  unsigned int hashsz;		/* number of hash slots (a power of 2) */
+
+  hentry *heap;			/* opt: entries by next request, latest first */
+  unsigned long nheap;		/* number of heap entries */
+  unsigned long heapsz;		/* number allocated */
+
+  unsigned long accesses;	/* logical block requests */
+  unsigned long hits;		/* of those, found in cache */
+  unsigned long reads;		/* read requests */
+  unsigned long readhits;	/* of those, found in cache */
+  unsigned long blocksread;	/* blocks fetched, readahead included */
+};
+
+static const char *argv0;
+
+static request *reqs;		/* the trace's logical requests and resets */
+static unsigned long nreqs;
+
+static unsigned long vlen;	/* blocks in the traced volume */
+static unsigned int tcachesz;	/* block cache size when tracing began */
+static unsigned int treadahead;	/* and its readahead */
+
+static unsigned long nops[HFS_TRACE_RESET + 1];	/* records of each kind */
+static unsigned long pblocks[2];	/* physical blocks read, written */
+static unsigned long thits;		/* logical requests that hit */
+static unsigned long distinct;		/* logical blocks requested */
+
+static unsigned long *keys;	/* hash table of requested blocks, plus one */
+static unsigned long *ids;	/* and their ids */
+static unsigned long mapsz;	/* number of slots (a power of 2) */
+
+static unsigned long *first;	/* first request for each id */
+static unsigned long *upcoming;	/* next request for each id, as replayed */
+static double seconds;			/* time the trace covers */
+
+/*
+ * NAME:	usage()
+ * DESCRIPTION:	display usage message
+ */
+static
+void usage(void)
+{
+  fprintf(stderr, "Usage: %s [-s size,...] [-p policy,...] [-r readahead]"
+	  " trace-path\n", argv0);
+  fprintf(stderr, "Policies: libhfs, lru, fifo, clock, opt\n");
+}
+
+/*
+ * NAME:	fail()
+ * DESCRIPTION:	report an error and give up
+ */
+static
+void fail(const char *what, const char *why)
+{
+  fprintf(stderr, "%s: %s: %s\n", argv0, what, why ? why : strerror(errno));
+  exit(1);
+}
+
+/*
+ * NAME:	grow()
+ * DESCRIPTION:	enlarge an array, giving up if there is no memory
+ */
+static
+void *grow(void *ptr, unsigned long *count, size_t size)
+{
+  *count = *count ? *count * 2 : 1024;
+
+  ptr = realloc(ptr, *count * size);
+  if (ptr == 0)
+    fail("realloc", 0);
+
+  return ptr;
+}
+
+/*
+ * NAME:	loadtrace()
+ * DESCRIPTION:	read a block trace, keeping its logical requests
+ */
+static
+void loadtrace(const char *path)
+{
+  FILE *file;
+  unsigned char hdr[HFS_TRACE_HDRSZ], rec[256];
+  unsigned int recsz;
+  unsigned long allocated = 0;
+  int op;
+
+  file = fopen(path, "rb");
+  if (file == 0)
+    fail(path, 0);
+
+  if (fread(hdr, HFS_TRACE_HDRSZ, 1, file) != 1 ||
+      d_getul(hdr) != HFS_TRACE_MAGIC)
+    fail(path, "not a block trace");
+
+  if (d_getuw(hdr + 4) != HFS_TRACE_VERSION)
+    fail(path, "unsupported block trace version");
+
+  /* later versions may add fields to the end of each record */
+
+  recsz = d_getuw(hdr + 6);
+  if (recsz < HFS_TRACE_RECSZ || recsz > sizeof(rec))
+    fail(path, "bad record size");
+
+  vlen       = d_getul(hdr + 8);
+  tcachesz   = d_getul(hdr + 12);
+  treadahead = d_getuw(hdr + 16);
+
+  while (fread(rec, recsz, 1, file) == 1)
+    {
+      op = rec[10];
+      if (op > HFS_TRACE_RESET)
+	fail(path, "unknown operation in trace");
+
+      ++nops[op];
+      seconds += d_getul(rec) / 1e6;
+
+      switch (op)
+	{
+	case HFS_TRACE_READPB:
+	case HFS_TRACE_WRITEPB:
+	  pblocks[op - HFS_TRACE_READPB] += d_getuw(rec + 8);
+	  continue;
+
+	case HFS_TRACE_READLB:
+	case HFS_TRACE_WRITELB:
+	  if (rec[11] & HFS_TRACE_HIT)
+	    ++thits;
+	  break;
+	}
+
+      if (nreqs == allocated)
+	reqs = grow(reqs, &allocated, sizeof(request));
+
+      reqs[nreqs].bnum = d_getul(rec + 4);
+      reqs[nreqs].next = NONE;
+      reqs[nreqs].op   = op;
+
+      ++nreqs;
+    }
+
+  if (ferror(file))
+    fail(path, 0);
+
+  fclose(file);
+}
+
+/*
+ * NAME:	slot()
+ * DESCRIPTION:	locate a block's slot in the hash table of requested blocks
+ */
+static
+unsigned long slot(unsigned long bnum)
+{
+  unsigned long i;
+
+  for (i = (bnum * 2654435761UL) & (mapsz - 1);
+       keys[i] && keys[i] != bnum + 1;
+       i = (i + 1) & (mapsz - 1))
+    ;
+
+  return i;
+}
+
+/*
+ * NAME:	nextuses()
+ * DESCRIPTION:	number the distinct blocks and link requests for each
+ */
+static
+void nextuses(void)
+{
+  unsigned long *last, i, n;
+
+  for (mapsz = 1024; mapsz < nreqs * 2; mapsz <<= 1)
+    ;
+
+  keys = calloc(mapsz, sizeof(*keys));
+  ids  = calloc(mapsz, sizeof(*ids));
+  last = calloc(mapsz, sizeof(*last));
+  if (keys == 0 || ids == 0 || last == 0)
+    fail("calloc", 0);
+
+  /* walk backwards, remembering where each block is requested next */
+
+  for (i = nreqs; i-- > 0; )
+    {
+      if (reqs[i].op == HFS_TRACE_RESET)
+	continue;
+
+      n = slot(reqs[i].bnum);
+
+      if (keys[n])
+	reqs[i].next = last[n];
+      else
+	{
+	  keys[n] = reqs[i].bnum + 1;
+	  ids[n]  = distinct++;
+	}
+
+      reqs[i].id = ids[n];
+      last[n]    = i;
+    }
+
+  first    = malloc((distinct + 1) * sizeof(*first));
+  upcoming = malloc((distinct + 1) * sizeof(*upcoming));
+  if (first == 0 || upcoming == 0)
+    fail("malloc", 0);
+
+  for (n = 0; n < mapsz; ++n)
+    {
+      if (keys[n])
+	first[ids[n]] = last[n];
+    }
+
+  free(last);
+}
+
+/*
+ * NAME:	nextuse()
+ * DESCRIPTION:	return when a block will next be requested, or NONE
+ */
+static
+unsigned long nextuse(unsigned long bnum)
+{
+  unsigned long n = slot(bnum);
+
+  return keys[n] ? upcoming[ids[n]] : NONE;
+}
+
+/*
+ * NAME:	emptysim()
+ * DESCRIPTION:	return a simulated cache to its newly built state
+ */
+static
+void emptysim(simcache *c)
+{
+  unsigned int i;
+
+  for (i = 0; i < c->size; ++i)
+    {
+      entry *e = &c->pool[i];
+
+      e->inuse = 0;
+      e->bnum  = 0;
+      e->count = 0;
+      e->next  = NONE;
+
+      e->cnext = e + 1;
+      e->cprev = e - 1;
+      e->hnext = 0;
+    }
+
+  c->tail = &c->pool[c->size - 1];
+
+  c->pool[0].cprev = c->tail;
+  c->tail->cnext   = &c->pool[0];
+
+  c->hand  = &c->pool[0];
+  c->nused = 0;
+  c->nheap = 0;
+
+  for (i = 0; i < c->hashsz; ++i)
+    c->hash[i] = 0;
+}
+
+/*
+ * NAME:	newsim()
+ * DESCRIPTION:	construct an empty simulated cache
+ */
+static
+simcache *newsim(const policy *p, unsigned int size, unsigned int readahead)
+{
+  simcache *c;
+
+  c = calloc(1, sizeof(*c));
+  if (c == 0)
+    fail("calloc", 0);
+
+  for (c->hashsz = HFS_HASHSZ; c->hashsz < size / 4; )
+    c->hashsz <<= 1;
+
+  c->policy    = p;
+  c->size      = size;
+  c->readahead = readahead;
+
+  c->pool = calloc(size, sizeof(entry));
+  c->hash = calloc(c->hashsz, sizeof(entry *));
+  if (c->pool == 0 || c->hash == 0)
+    fail("calloc", 0);
+
+  emptysim(c);
+
+  return c;
+}
+
+/*
+ * NAME:	freesim()
+ * DESCRIPTION:	dispose of a simulated cache
+ */
+static
+void freesim(simcache *c)
+{
+  free(c->pool);
+  free(c->hash);
+  free(c->heap);
+  free(c);
+}
+
+/*
+ * NAME:	find()
+ * DESCRIPTION:	locate the entry holding a block, if any
+ */
+static
+entry *find(simcache *c, unsigned long bnum)
+{
+  entry *e;
+
+  for (e = c->hash[bnum & (c->hashsz - 1)]; e; e = e->hnext)
+    {
+      if (e->bnum == bnum)
+	break;
+    }
+
+  return e;
+}
+
+/*
+ * NAME:	reuse()
+ * DESCRIPTION:	give an entry a new block, dropping the old one
+ */
+static
+void reuse(simcache *c, entry *e, unsigned long bnum)
+{
+  entry **slot;
+
+  if (e->inuse)
+    {
+      for (slot = &c->hash[e->bnum & (c->hashsz - 1)]; *slot != e;
+	   slot = &(*slot)->hnext)
+	;
+
+      *slot = e->hnext;
+    }
+
+  slot = &c->hash[bnum & (c->hashsz - 1)];
+
+  e->inuse = 1;
+  e->bnum  = bnum;
+  e->hnext = *slot;
+  *slot    = e;
+}
+
+/*
+ * NAME:	tohead()
+ * DESCRIPTION:	move an entry to the head of the chain
+ */
+static
+void tohead(simcache *c, entry *e)
+{
+  /* the chain is a ring; the head is whatever follows the tail */
+
+  if (e == c->tail)
+    {
+      c->tail = e->cprev;
+      return;
+    }
+
+  if (e == c->tail->cnext)
+    return;
+
+  e->cprev->cnext = e->cnext;
+  e->cnext->cprev = e->cprev;
+
+  e->cprev = c->tail;
+  e->cnext = c->tail->cnext;
+
+  c->tail->cnext->cprev = e;
+  c->tail->cnext = e;
+}
+
+/*
+ * NAME:	readahead()
+ * DESCRIPTION:	fetch the blocks after a read miss until one is cached
+ */
+static
+unsigned long readahead(simcache *c, unsigned long bnum,
+			entry *(*victim)(simcache *),
+			void (*place)(simcache *, entry *))
+{
+  unsigned long count = 0;
+  entry *e;
+
+  while (count < c->readahead && ++bnum < vlen && find(c, bnum) == 0)
+    {
+      e = victim(c);
+      reuse(c, e, bnum);
+      place(c, e);
+
+      ++count;
+    }
+
+  return count;
+}
+
+/*
+ * NAME:	tail()
+ * DESCRIPTION:	choose the entry at the tail of the chain
+ */
+static
+entry *tail(simcache *c)
+{
+  return c->tail;
+}
+
+/*
+ * NAME:	lruhit()
+ * DESCRIPTION:	make a requested entry the most recently used
+ */
+static
+void lruhit(simcache *c, entry *e, unsigned long i)
+{
+  tohead(c, e);
+}
+
+/*
+ * NAME:	lrumiss()
+ * DESCRIPTION:	replace the least recently used entry (also fifo)
+ */
+static
+unsigned long lrumiss(simcache *c, unsigned long bnum, int fill,
+		      unsigned long i)
+{
+  entry *e = c->tail;
+
+  reuse(c, e, bnum);
+  tohead(c, e);
+
+  return fill ? 1 + readahead(c, bnum, tail, tohead) : 0;
+}
+
+/*
+ * NAME:	fifohit()
+ * DESCRIPTION:	leave a requested entry where it is
+ */
+static
+void fifohit(simcache *c, entry *e, unsigned long i)
+{
+}
+
+/*
+ * NAME:	stay()
+ * DESCRIPTION:	leave a newly filled entry where it is
+ */
+static
+void stay(simcache *c, entry *e)
+{
+}
+
+/*
+ * NAME:	clockhit()
+ * DESCRIPTION:	mark a requested entry referenced
+ */
+static
+void clockhit(simcache *c, entry *e, unsigned long i)
+{
+  e->count = 1;
+}
+
+/*
+ * NAME:	clockhand()
+ * DESCRIPTION:	sweep to the first entry not referenced since the last pass
+ */
+static
+entry *clockhand(simcache *c)
+{
+  entry *e;
+
+  while (c->hand->inuse && c->hand->count)
+    {
+      c->hand->count = 0;
+      c->hand = c->hand->cnext;
+    }
+
+  e = c->hand;
+  c->hand = e->cnext;
+
+  /* a new block counts as referenced */
+
+  e->count = 1;
+
+  return e;
+}
+
+/*
+ * NAME:	clockmiss()
+ * DESCRIPTION:	replace the entry the clock hand stops at
+ */
+static
+unsigned long clockmiss(simcache *c, unsigned long bnum, int fill,
+			unsigned long i)
+{
+  /* entries never move; the chain is only the order the hand visits */
+
+  reuse(c, clockhand(c), bnum);
+
+  return fill ? 1 + readahead(c, bnum, clockhand, stay) : 0;
+}
+
+/*
+ * NAME:	cplace()
+ * DESCRIPTION:	place an entry as block.c's cplace() places a bucket
+ */
+static
+void cplace(simcache *c, entry *b)
+{
+  entry *p;
+
+  for (p = c->tail->cnext; p->count > 1; p = p->cnext)
+    --p->count;
+
+  if (p == b)
+    return;
+
+  b->cnext->cprev = b->cprev;
+  b->cprev->cnext = b->cnext;
+
+  if (c->tail == b)
+    c->tail = b->cprev;
+
+  b->cprev = p->cprev;
+  b->cnext = p;
+
+  p->cprev->cnext = b;
+  p->cprev = b;
+}
+
+/*
+ * NAME:	libhfshit()
+ * DESCRIPTION:	move a requested entry up past one requested less often
+ */
+static
+void libhfshit(simcache *c, entry *b, unsigned long i)
+{
+  entry *p;
+
+  if (++b->count > b->cprev->count &&
+      b != c->tail->cnext)
+    {
+      p = b->cprev;
+
+      p->cprev->cnext = b;
+      b->cnext->cprev = p;
+
+      p->cnext = b->cnext;
+      b->cprev = p->cprev;
+
+      p->cprev = b;
+      b->cnext = p;
+
+      if (c->tail == b)
+	c->tail = p;
+    }
+}
+
+/*
+ * NAME:	libhfsmiss()
+ * DESCRIPTION:	reuse the tail, reading ahead into the entries before it
+ */
+static
+unsigned long libhfsmiss(simcache *c, unsigned long bnum, int fill,
+			 unsigned long i)
+{
+  entry *b, *bptr, *chain[HFS_BLOCKBUFSZ];
+  unsigned int len = 0, count = 0;
+
+  b = c->tail;
+
+  reuse(c, b, bnum);
+  b->count = 1;
+
+  if (fill)
+    {
+      chain[len++] = b;
+
+      for (bptr = b->cprev;
+	   len <= c->readahead && ++bnum < vlen;
+	   bptr = bptr->cprev)
+	{
+	  if (find(c, bnum))
+	    break;
+
+	  reuse(c, bptr, bnum);
+	  bptr->count = 1;
+
+	  chain[len++] = bptr;
+	}
+
+      count = len;
+
+      while (--len)
+	cplace(c, chain[len]);
+    }
+
+  cplace(c, b);
+
+  return count;
+}
+
+/*
+ * NAME:	heappush()
+ * DESCRIPTION:	note when an entry's block is next requested
+ */
+static
+void heappush(simcache *c, entry *e)
+{
+  unsigned long n, parent;
+  hentry h;
+
+  if (c->nheap == c->heapsz)
+    c->heap = grow(c->heap, &c->heapsz, sizeof(hentry));
+
+  h.next = e->next;
+  h.e    = e;
+
+  for (n = c->nheap++; n > 0; n = parent)
+    {
+      parent = (n - 1) / 2;
+      if (c->heap[parent].next >= h.next)
+	break;
+
+      c->heap[n] = c->heap[parent];
+    }
+
+  c->heap[n] = h;
+}
+
+/*
+ * NAME:	heappop()
+ * DESCRIPTION:	remove the heap entry for the latest next request
+ */
+static
+hentry heappop(simcache *c)
+{
+  hentry top = c->heap[0], h;
+  unsigned long n = 0, child;
+
+  h = c->heap[--c->nheap];
+
+  while ((child = 2 * n + 1) < c->nheap)
+    {
+      if (child + 1 < c->nheap &&
+	  c->heap[child + 1].next > c->heap[child].next)
+	++child;
+
+      if (h.next >= c->heap[child].next)
+	break;
+
+      c->heap[n] = c->heap[child];
+      n = child;
+    }
+
+  c->heap[n] = h;
+
+  return top;
+}
+
+/*
+ * NAME:	optplace()
+ * DESCRIPTION:	file a newly filled entry by when its block is needed next
+ */
+static
+void optplace(simcache *c, entry *e)
+{
+  unsigned int n;
+
+  e->next = nextuse(e->bnum);
+
+  /* superseded heap entries are skipped when popped; keep them few */
+
+  if (c->nheap >= 4 * c->size)
+    {
+      c->nheap = 0;
+
+      for (n = 0; n < c->nused; ++n)
+	{
+	  if (&c->pool[n] != e && c->pool[n].inuse)
+	    heappush(c, &c->pool[n]);
+	}
+    }
+
+  heappush(c, e);
+}
+
+/*
+ * NAME:	opthit()
+ * DESCRIPTION:	refile a requested entry by when its block is needed next
+ */
+static
+void opthit(simcache *c, entry *e, unsigned long i)
+{
+  optplace(c, e);
+}
+
+/*
+ * NAME:	optvictim()
+ * DESCRIPTION:	choose a free entry, or the one needed furthest ahead
+ */
+static
+entry *optvictim(simcache *c)
+{
+  hentry h;
+
+  if (c->nused < c->size)
+    return &c->pool[c->nused++];
+
+  do
+    h = heappop(c);
+  while (h.e->next != h.next);
+
+  return h.e;
+}
+
+/*
+ * NAME:	optmiss()
+ * DESCRIPTION:	replace the entry whose block is needed furthest ahead
+ */
+static
+unsigned long optmiss(simcache *c, unsigned long bnum, int fill,
+		      unsigned long i)
+{
+  entry *e = optvictim(c);
+
+  reuse(c, e, bnum);
+  optplace(c, e);
+
+  return fill ? 1 + readahead(c, bnum, optvictim, optplace) : 0;
+}
+
+static const policy policies[] = {
+  { "libhfs", libhfshit, libhfsmiss },
+  { "lru",    lruhit,    lrumiss    },
+  { "fifo",   fifohit,   lrumiss    },
+  { "clock",  clockhit,  clockmiss  },
+  { "opt",    opthit,    optmiss    },
+  { 0 }
+};
+
+/*
+ * NAME:	simulate()
+ * DESCRIPTION:	replay the trace through one cache and print its line
+ */
+static
+void simulate(const policy *p, unsigned int size, unsigned int ra)
+{
+  simcache *c;
+  unsigned long i;
+  entry *e;
+  int read;
+
+  c = newsim(p, size, ra);
+
+  memcpy(upcoming, first, distinct * sizeof(*upcoming));
+
+  for (i = 0; i < nreqs; ++i)
+    {
+      if (reqs[i].op == HFS_TRACE_RESET)
+	{
+	  emptysim(c);
+	  continue;
+	}
+
+      read = (reqs[i].op == HFS_TRACE_READLB);
+
+      /* from here on, this block is next wanted at its following request */
+
+      upcoming[reqs[i].id] = reqs[i].next;
+
+      ++c->accesses;
+      if (read)
+	++c->reads;
+
+      e = find(c, reqs[i].bnum);
+      if (e)
+	{
+	  ++c->hits;
+	  if (read)
+	    ++c->readhits;
+
+	  p->hit(c, e, i);
+	}
+      else
+	c->blocksread += p->miss(c, reqs[i].bnum, read, i);
+    }
+
+  printf("%s\t%u\t%lu\t%lu\t%.4f\t%.4f\t%lu\n", p->name, size,
+	 c->accesses, c->hits,
+	 c->accesses ? (double) c->hits / c->accesses : 0.0,
+	 c->reads ? (double) c->readhits / c->reads : 0.0,
+	 c->blocksread);
+
+  freesim(c);
+}
+
+/*
+ * NAME:	addsize()
+ * DESCRIPTION:	insert a cache size into a sorted list, once
+ */
+static
+void addsize(unsigned int *sizes, int *count, unsigned int size)
+{
+  int i, j;
+
+  for (i = 0; i < *count && sizes[i] < size; ++i)
+    ;
+
+  if (i < *count && sizes[i] == size)
+    return;
+
+  for (j = (*count)++; j > i; --j)
+    sizes[j] = sizes[j - 1];
+
+  sizes[i] = size;
+}
+
+/*
+ * NAME:	listed()
+ * DESCRIPTION:	return 1 iff name is one of the comma-separated words in list
+ */
+static
+int listed(const char *list, const char *name)
+{
+  size_t len = strlen(name);
+
+  while (list)
+    {
+      if (strncmp(list, name, len) == 0 &&
+	  (list[len] == ',' || list[len] == 0))
+	return 1;
+
+      list = strchr(list, ',');
+      if (list)
+	++list;
+    }
+
+  return 0;
+}
+
+/*
+ * NAME:	main()
+ * DESCRIPTION:	program entry
+ */
+int main(int argc, char *argv[])
+{
+  const char *policylist = 0, *sizelist = 0, *path;
+  const policy *p;
+  unsigned int sizes[64], size, ra;
+  int nsizes = 0, opt, i, rflag = 0;
+  char *end;
+
+  argv0 = argv[0];
+  ra    = 0;
+
+  while ((opt = getopt(argc, argv, "s:p:r:")) != EOF)
+    {
+      switch (opt)
+	{
+	case 's':
+	  sizelist = optarg;
+	  break;
+
+	case 'p':
+	  policylist = optarg;
+	  break;
+
+	case 'r':
+	  ra    = strtoul(optarg, 0, 0);
+	  rflag = 1;
+	  break;
+
+	default:
+	  usage();
+	  return 1;
+	}
+    }
+
+  if (argc - optind != 1)
+    {
+      usage();
+      return 1;
+    }
+
+  path = argv[optind];
+
+  loadtrace(path);
+  nextuses();
+
+  if (! rflag)
+    ra = treadahead;
+
+  if (ra >= HFS_BLOCKBUFSZ)
+    fail("-r", "readahead out of range");
+
+  if (sizelist)
+    {
+      for (end = (char *) sizelist; *end && nsizes < 64; )
+	{
+	  size = strtoul(end, &end, 0);
+	  if (size <= ra || (*end && *end != ','))
+	    fail(sizelist, "bad cache size");
+
+	  addsize(sizes, &nsizes, size);
+
+	  if (*end)
+	    ++end;
+	}
+    }
+  else
+    {
+      /* powers of two until everything requested fits */
+
+      for (size = HFS_MINCACHESZ; size <= HFS_MAXCACHESZ; size <<= 1)
+	{
+	  addsize(sizes, &nsizes, size);
+	  if (size >= distinct)
+	    break;
+	}
+
+      if (tcachesz > ra && tcachesz <= HFS_MAXCACHESZ)
+	addsize(sizes, &nsizes, tcachesz);
+    }
+
+  if (policylist)
+    {
+      int words = 1, known = 0;
+
+      for (end = (char *) policylist; *end; ++end)
+	words += (*end == ',');
+
+      for (p = policies; p->name; ++p)
+	known += listed(policylist, p->name);
+
+      if (known != words)
+	fail(policylist, "unknown policy");
+    }
+
+  printf("# hfscachesim: %s, %.3f seconds, %lu logical reads, "
+	 "%lu logical writes, %lu distinct blocks\n", path, seconds,
+	 nops[HFS_TRACE_READLB], nops[HFS_TRACE_WRITELB], distinct);
+  printf("# medium: %lu reads (%lu blocks), %lu writes (%lu blocks); "
+	 "%lu resets\n", nops[HFS_TRACE_READPB], pblocks[0],
+	 nops[HFS_TRACE_WRITEPB], pblocks[1], nops[HFS_TRACE_RESET]);
+  printf("# traced cache: %u blocks, readahead %u, %lu hits (%.1f%%); "
+	 "simulated readahead %u\n", tcachesz, treadahead, thits,
+	 nreqs ? 100.0 * thits / (nops[HFS_TRACE_READLB] +
+				 nops[HFS_TRACE_WRITELB]) : 0.0, ra);
+  printf("# policy\tsize\taccesses\thits\thit_rate\tread_hit_rate\t"
+	 "blocks_read\n");
+  fflush(stdout);
+
+  for (p = policies; p->name; ++p)
+    {
+      if (policylist && ! listed(policylist, p->name))
+	continue;
+
+      for (i = 0; i < nsizes; ++i)
+	simulate(p, sizes[i], ra);
+
+      fflush(stdout);
+    }
+
+  free(reqs);
+  free(keys);
+  free(ids);
+  free(first);
+  free(upcoming);
+
+  return 0;
+}
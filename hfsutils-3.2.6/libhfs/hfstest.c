@@ -0,0 +1,547 @@
+/*
+ * libhfs - library for reading and writing Macintosh HFS volumes
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/*
+ * hfstest formats a scratch image and checks that what the library keeps
+ * in memory -- deferred attributes, the lookup caches, preallocated blocks
+ * -- agrees with what a later call sees and with what reaches the medium.
+ * Each check prints one line, "ok" or "FAIL" and a description; the exit
+ * status is 1 if any check failed.
+ */
+
+# ifdef HAVE_CONFIG_H
+#  include "config.h"
+# endif
+
+# ifdef HAVE_UNISTD_H
+#  include <unistd.h>
+# endif
+
+# ifdef HAVE_FCNTL_H
+#  include <fcntl.h>
+# endif
+
+# include <stdio.h>
+# include <stdlib.h>
+# include <string.h>
+# include <errno.h>
+# include <time.h>
+
+# include "hfs.h"
+
+# define IMAGESZ	4		/* megabytes */
+
+# define OLDDATE	1000000000	/* an arbitrary time in the past */
+
+static const char *argv0;
+static const char *path;
+
+static int failures;
+
+static char buf[32768];
+
+/*
+ * NAME:	fail()
+ * DESCRIPTION:	report an unexpected library error and give up
+ */
+static
+void fail(const char *what)
+{
+  fprintf(stderr, "%s: %s: %s\n", argv0, what,
+	  hfs_error ? hfs_error : strerror(errno));
+  exit(1);
+}
+
+/*
+ * NAME:	check()
+ * DESCRIPTION:	report the outcome of one check
+ */
+static
+void check(int ok, const char *what)
+{
+  printf("%s\t%s\n", ok ? "ok" : "FAIL", what);
+
+  if (! ok)
+    ++failures;
+}
+
+/*
+ * NAME:	mkimage()
+ * DESCRIPTION:	create, format and mount a scratch image
+ */
+static
+hfsvol *mkimage(void)
+{
+  hfsvol *vol;
+  int fd;
+
+  fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd == -1 || ftruncate(fd, (off_t) IMAGESZ << 20) == -1)
+    fail(path);
+
+  close(fd);
+
+  if (hfs_format(path, 0, 0, "Test", 0, 0) == -1)
+    fail("hfs_format");
+
+  vol = hfs_mount(path, 0, HFS_MODE_RDWR);
+  if (vol == 0)
+    fail("hfs_mount");
+
+  return vol;
+}
+
+/*
+ * NAME:	remount()
+ * DESCRIPTION:	unmount a volume and mount it again, so nothing is cached
+ */
+static
+hfsvol *remount(hfsvol *vol)
+{
+  if (hfs_umount(vol) == -1)
+    fail("hfs_umount");
+
+  vol = hfs_mount(path, 0, HFS_MODE_RDWR);
+  if (vol == 0)
+    fail("hfs_mount");
+
+  return vol;
+}
+
+/*
+ * NAME:	mkfile()
+ * DESCRIPTION:	create a file holding len copies of a byte
+ */
+static
+void mkfile(hfsvol *vol, const char *name, int byte, unsigned long len)
+{
+  hfsfile *file;
+
+  memset(buf, byte, sizeof(buf));
+
+  file = hfs_create(vol, name, "BINA", "hfst");
+  if (file == 0)
+    fail("hfs_create");
+
+  while (len)
+    {
+      unsigned long chunk = len < sizeof(buf) ? len : sizeof(buf);
+
+      if (hfs_write(file, buf, chunk) != chunk)
+	fail("hfs_write");
+
+      len -= chunk;
+    }
+
+  if (hfs_close(file) == -1)
+    fail("hfs_close");
+}
+
+/*
+ * NAME:	exists()
+ * DESCRIPTION:	return true if a path can be looked up
+ */
+static
+int exists(hfsvol *vol, const char *name)
+{
+  hfsdirent ent;
+
+  return hfs_stat(vol, name, &ent) == 0;
+}
+
+/*
+ * NAME:	cnid()
+ * DESCRIPTION:	return the catalog node ID of a path, or 0
+ */
+static
+unsigned long cnid(hfsvol *vol, const char *name)
+{
+  hfsdirent ent;
+
+  return hfs_stat(vol, name, &ent) == 0 ? ent.cnid : 0;
+}
+
+/*
+ * NAME:	dirattrs()
+ * DESCRIPTION:	check the attributes set on :dir by setattrs()
+ */
+static
+void dirattrs(hfsvol *vol, time_t mddate, const char *when)
+{
+  hfsdirent ent;
+  char what[100];
+
+  if (hfs_stat(vol, ":dir", &ent) == -1)
+    fail("hfs_stat");
+
+  sprintf(what, "directory dates and Finder info %s", when);
+  check(ent.crdate == OLDDATE && ent.bkdate == OLDDATE + 1 &&
+	ent.fdflags == HFS_FNDR_HASBEENINITED &&
+	ent.fdlocation.v == 12 && ent.fdlocation.h == 34, what);
+
+  sprintf(what, "directory modified by the create %s", when);
+  check(ent.mddate == mddate && ent.u.dir.valence == 1, what);
+}
+
+/*
+ * NAME:	fileattrs()
+ * DESCRIPTION:	check the attributes set on :dir:file by setattrs()
+ */
+static
+void fileattrs(hfsvol *vol, const char *when)
+{
+  hfsdirent ent;
+  char what[100];
+
+  if (hfs_stat(vol, ":dir:file", &ent) == -1)
+    fail("hfs_stat");
+
+  sprintf(what, "file type, creator and flags %s", when);
+  check(strcmp(ent.u.file.type, "TEXT") == 0 &&
+	strcmp(ent.u.file.creator, "ttxt") == 0 &&
+	ent.fdflags == HFS_FNDR_HASBEENINITED, what);
+
+  sprintf(what, "file written after setattr keeps its size %s", when);
+  check(ent.u.file.dsize == 1000, what);
+}
+
+/*
+ * NAME:	setattrs()
+ * DESCRIPTION:	check that deferred attribute changes are seen and kept
+ */
+static
+void setattrs(void)
+{
+  hfsvol *vol;
+  hfsfile *file;
+  hfsdirent ent;
+  time_t start;
+
+  vol = mkimage();
+
+  if (hfs_mkdir(vol, ":dir") == -1 ||
+      hfs_stat(vol, ":dir", &ent) == -1)
+    fail(":dir");
+
+  ent.crdate       = OLDDATE;
+  ent.mddate       = OLDDATE;
+  ent.bkdate       = OLDDATE + 1;
+  ent.fdflags      = HFS_FNDR_HASBEENINITED;
+  ent.fdlocation.v = 12;
+  ent.fdlocation.h = 34;
+
+  if (hfs_setattr(vol, ":dir", &ent) == -1)
+    fail("hfs_setattr");
+
+  if (hfs_stat(vol, ":dir", &ent) == -1)
+    fail("hfs_stat");
+
+  check(ent.crdate == OLDDATE && ent.mddate == OLDDATE &&
+	ent.fdlocation.v == 12, "setattr is seen by the next stat");
+
+  /* adding an entry changes the directory's record under the deferral */
+
+  start = time(0);
+
+  mkfile(vol, ":dir:file", 0, 0);
+
+  if (hfs_stat(vol, ":dir", &ent) == -1)
+    fail("hfs_stat");
+
+  check(ent.mddate >= start, "create in a directory updates its date");
+
+  dirattrs(vol, ent.mddate, "before flush");
+
+  /* a file's attributes, then a write through a handle opened after them */
+
+  if (hfs_stat(vol, ":dir:file", &ent) == -1)
+    fail("hfs_stat");
+
+  strcpy(ent.u.file.type, "TEXT");
+  strcpy(ent.u.file.creator, "ttxt");
+  ent.fdflags = HFS_FNDR_HASBEENINITED;
+
+  if (hfs_setattr(vol, ":dir:file", &ent) == -1)
+    fail("hfs_setattr");
+
+  memset(buf, 'x', 1000);
+
+  file = hfs_open(vol, ":dir:file");
+  if (file == 0 ||
+      hfs_write(file, buf, 1000) != 1000 ||
+      hfs_close(file) == -1)
+    fail(":dir:file");
+
+  fileattrs(vol, "before flush");
+
+  if (hfs_stat(vol, ":dir", &ent) == -1)
+    fail("hfs_stat");
+
+  if (hfs_flush(vol) == -1)
+    fail("hfs_flush");
+
+  dirattrs(vol, ent.mddate, "after flush");
+  fileattrs(vol, "after flush");
+
+  vol = remount(vol);
+
+  dirattrs(vol, ent.mddate, "after remount");
+  fileattrs(vol, "after remount");
+
+  if (hfs_umount(vol) == -1)
+    fail("hfs_umount");
+}
+
+/*
+ * NAME:	lookups()
+ * DESCRIPTION:	check that renames and deletes are seen by later lookups
+ */
+static
+void lookups(void)
+{
+  hfsvol *vol;
+  unsigned long id;
+  int pass;
+
+  vol = mkimage();
+
+  if (hfs_mkdir(vol, ":dir") == -1)
+    fail("hfs_mkdir");
+
+  mkfile(vol, ":old", 0, 0);
+  mkfile(vol, ":dir:inner", 0, 0);
+
+  /* fill the caches with the names about to change, found and not found */
+
+  id = cnid(vol, ":old");
+  exists(vol, ":new");
+  exists(vol, ":dir:inner");
+  exists(vol, ":moved:inner");
+
+  if (hfs_rename(vol, ":old", ":new") == -1)
+    fail("hfs_rename");
+
+  check(! exists(vol, ":old") && ! exists(vol, ":OLD"),
+	"renamed file is gone under its old name");
+  check(cnid(vol, ":new") == id && cnid(vol, ":NEW") == id,
+	"renamed file is found under its new name");
+
+  if (hfs_rename(vol, ":new", ":dir:new") == -1)
+    fail("hfs_rename");
+
+  check(! exists(vol, ":new"), "moved file is gone from its old directory");
+  check(cnid(vol, ":dir:new") == id, "moved file is found in its new one");
+
+  if (hfs_rename(vol, ":dir", ":moved") == -1)
+    fail("hfs_rename");
+
+  check(! exists(vol, ":dir:inner") && ! exists(vol, ":dir"),
+	"renamed directory is gone under its old name");
+  check(exists(vol, ":moved:inner") && cnid(vol, ":moved:new") == id,
+	"renamed directory's contents are found under its new name");
+
+  if (hfs_delete(vol, ":moved:new") == -1)
+    fail("hfs_delete");
+
+  check(! exists(vol, ":moved:new"), "deleted file is gone");
+
+  mkfile(vol, ":moved:new", 0, 0);
+
+  check(exists(vol, ":moved:new") && cnid(vol, ":moved:new") != id,
+	"file created again under a deleted name is a new file");
+
+  if (hfs_delete(vol, ":moved:new") == -1 ||
+      hfs_delete(vol, ":moved:inner") == -1 ||
+      hfs_rmdir(vol, ":moved") == -1)
+    fail(":moved");
+
+  check(! exists(vol, ":moved") && ! exists(vol, ":moved:inner"),
+	"removed directory and its old contents are gone");
+
+  if (hfs_mkdir(vol, ":moved") == -1)
+    fail("hfs_mkdir");
+
+  check(exists(vol, ":moved") && ! exists(vol, ":moved:inner"),
+	"directory made again under a removed name is empty");
+
+  /* the same answers from the medium alone */
+
+  for (pass = 0; pass < 2; ++pass)
+    {
+      vol = remount(vol);
+
+      check(! exists(vol, ":old") && ! exists(vol, ":new") &&
+	    ! exists(vol, ":dir") && ! exists(vol, ":dir:inner") &&
+	    exists(vol, ":moved") && ! exists(vol, ":moved:new"),
+	    pass ? "names after a second remount" : "names after remount");
+    }
+
+  if (hfs_umount(vol) == -1)
+    fail("hfs_umount");
+}
+
+/*
+ * NAME:	zeros()
+ * DESCRIPTION:	return true if a buffer holds only zero bytes
+ */
+static
+int zeros(const char *buf, unsigned long len)
+{
+  while (len--)
+    {
+      if (*buf++)
+	return 0;
+    }
+
+  return 1;
+}
+
+/*
+ * NAME:	forkdata()
+ * DESCRIPTION:	check a fork holds zeros with one 4-byte string at an offset
+ */
+static
+void forkdata(hfsfile *file, int fork, unsigned long off, const char *str,
+	      const char *what)
+{
+  unsigned long len = off + 4;
+
+  check(len <= sizeof(buf) &&
+	hfs_pread(file, fork, buf, sizeof(buf), 0) == len &&
+	zeros(buf, off) && memcmp(buf + off, str, 4) == 0, what);
+}
+
+/*
+ * NAME:	pwrites()
+ * DESCRIPTION:	check writes past the end of either fork
+ */
+static
+void pwrites(void)
+{
+  hfsvol *vol;
+  hfsvolent vs;
+  hfsfile *file;
+  hfsdirent ent;
+  unsigned long long before;
+
+  vol = mkimage();
+
+  if (hfs_vstat(vol, &vs) == -1)
+    fail("hfs_vstat");
+
+  before = vs.freebytes;
+
+  /* leave old data in the free blocks the gaps will be given */
+
+  mkfile(vol, ":junk", 0xa5, 65536);
+
+  if (hfs_delete(vol, ":junk") == -1)
+    fail("hfs_delete");
+
+  file = hfs_create(vol, ":file", "BINA", "hfst");
+  if (file == 0)
+    fail("hfs_create");
+
+  /* the data fork is the handle's own; the resource fork is the other */
+
+  if (hfs_pwrite(file, 0, "DATA", 4, 10000) != 4 ||
+      hfs_pwrite(file, 1, "RSRC", 4, 3000) != 4)
+    fail("hfs_pwrite");
+
+  if (hfs_fstat(file, &ent) == -1)
+    fail("hfs_fstat");
+
+  check(ent.u.file.dsize == 10004 && ent.u.file.rsize == 3004,
+	"fork sizes after writes past the end");
+
+  /* and the other way around */
+
+  if (hfs_setfork(file, 1) == -1 ||
+      hfs_pwrite(file, 0, "MORE", 4, 20000) != 4 ||
+      hfs_pwrite(file, 1, "RSRC", 4, 3000) != 4)
+    fail("hfs_pwrite");
+
+  forkdata(file, 1, 3000, "RSRC", "resource fork reads back before close");
+
+  if (hfs_close(file) == -1)
+    fail("hfs_close");
+
+  vol = remount(vol);
+
+  if (hfs_stat(vol, ":file", &ent) == -1)
+    fail("hfs_stat");
+
+  check(ent.u.file.dsize == 20004 && ent.u.file.rsize == 3004,
+	"fork sizes after remount");
+
+  file = hfs_open(vol, ":file");
+  if (file == 0)
+    fail("hfs_open");
+
+  check(hfs_pread(file, 0, buf, sizeof(buf), 0) == 20004 &&
+	zeros(buf, 10000) && memcmp(buf + 10000, "DATA", 4) == 0 &&
+	zeros(buf + 10004, 9996) && memcmp(buf + 20000, "MORE", 4) == 0,
+	"data fork gaps read as zeros after remount");
+
+  forkdata(file, 1, 3000, "RSRC", "resource fork gap reads as zeros after remount");
+
+  if (hfs_close(file) == -1)
+    fail("hfs_close");
+
+  /* no blocks are left allocated to either fork once it's gone */
+
+  if (hfs_delete(vol, ":file") == -1)
+    fail("hfs_delete");
+
+  vol = remount(vol);
+
+  if (hfs_vstat(vol, &vs) == -1)
+    fail("hfs_vstat");
+
+  check(vs.freebytes == before, "free space is restored by the delete");
+
+  if (hfs_umount(vol) == -1)
+    fail("hfs_umount");
+}
+
+/*
+ * NAME:	main()
+ * DESCRIPTION:	program entry
+ */
+int main(int argc, char *argv[])
+{
+  argv0 = argv[0];
+
+  if (argc != 2)
+    {
+      fprintf(stderr, "Usage: %s image-path\n", argv0);
+      return 1;
+    }
+
+  path = argv[1];
+
+  setattrs();
+  lookups();
+  pwrites();
+
+  unlink(path);
+
+  printf("%s\n", failures ? "Some checks failed." : "All checks passed.");
+
+  return failures != 0;
+}
@@ -19,6 +19,9 @@
  * $Id: libhfs.h,v 1.7 1998/11/02 22:09:02 rob Exp $
  */
 
+# include <stdio.h>
+# include <pthread.h>
+
 # include "hfs.h"
 # include "apple.h"
 
@@ -76,6 +79,10 @@ typedef struct _bucket_ {
 # define HFS_CACHESZ		128
 # define HFS_HASHSZ		32
 # define HFS_BLOCKBUFSZ		16
+# define HFS_READAHEAD		((HFS_BLOCKBUFSZ >> 1) - 1)
+
+# define HFS_MINCACHESZ		(HFS_BLOCKBUFSZ * 2)
+# define HFS_MAXCACHESZ		65536
 
 typedef struct {
   struct _hfsvol_ *vol;		/* volume to which cache belongs */
@@ -84,12 +91,91 @@ typedef struct {
   unsigned int hits;		/* number of cache hits */
   unsigned int misses;		/* number of cache misses */
 
-  bucket chain[HFS_CACHESZ];	/* cache bucket chain */
-  bucket *hash[HFS_HASHSZ];	/* hash table for bucket chain */
+  unsigned int size;		/* number of buckets */
+  unsigned int hashsz;		/* number of hash slots (a power of 2) */
+  unsigned int readahead;	/* blocks read beyond a miss */
+
+  bucket *chain;		/* cache bucket chain */
+  bucket **hash;		/* hash table for bucket chain */
 
-  block pool[HFS_CACHESZ];	/* physical blocks in cache */
+  block *pool;			/* physical blocks in cache */
 } bcache;
 
+/*
+ * A block trace (see hfs_settrace()) is a header followed by one fixed-size
+ * record per call to b_readlb(), b_writelb(), b_readpb() or b_writepb(),
+ * all fields big-endian:
+ *
+ *   header  magic (4)  version (2)  record size (2)  volume blocks (4)
+ *           cache size (4)  readahead (2)  reserved (2)  start time (4)
+ *   record  microseconds since previous record (4)  block (4)
+ *           length (2)  operation (1)  flags (1)
+ *
+ * Logical blocks are volume-relative; physical blocks are medium-relative.
+ * A RESET record follows each b_resize(), with the new cache size as its
+ * block and the new readahead as its length.
+ */
+
+# define HFS_TRACE_MAGIC	0x42545243	/* "BTRC" */
+# define HFS_TRACE_VERSION	1
+# define HFS_TRACE_HDRSZ	24
+# define HFS_TRACE_RECSZ	12
+
+# define HFS_TRACE_READLB	0
+# define HFS_TRACE_WRITELB	1
+# define HFS_TRACE_READPB	2
+# define HFS_TRACE_WRITEPB	3
+# define HFS_TRACE_RESET	4
+
+# define HFS_TRACE_HIT		0x01	/* logical block was in the cache */
+
+typedef struct {
+  FILE *file;			/* where records are written */
+  pthread_mutex_t lock;		/* serializes records from all threads */
+  unsigned long long last;	/* time of previous record, microseconds */
+  int error;			/* errno of the first failed write */
+} btrace;
+
+typedef struct _lentry_ {
+  int flags;			/* bit flags */
+
+  unsigned long parid;		/* parent directory ID */
+  char name[HFS_MAX_FLEN + 1];	/* name as stored in the catalog */
+  CatDataRec data;		/* catalog record contents (unless negative) */
+
+  struct _lentry_ *cnext;	/* next entry in LRU chain */
+  struct _lentry_ *cprev;	/* previous entry in LRU chain */
+
+  struct _lentry_ *hnext;	/* next entry in hash chain */
+  struct _lentry_ **hprev;	/* previous entry's pointer to this entry */
+} lentry;
+
+# define HFS_LENTRY_INUSE	0x01
+# define HFS_LENTRY_NEGATIVE	0x02	/* no such record in the catalog */
+
+# define HFS_LOOKUPSZ		256
+# define HFS_LHASHSZ		64
+
+typedef struct {
+  lentry *tail;			/* least recently used entry */
+
+  unsigned int hits;		/* number of cache hits */
+  unsigned int misses;		/* number of cache misses */
+  unsigned int neghits;		/* hits that found a name absent */
+
+  lentry chain[HFS_LOOKUPSZ];	/* cache entry chain */
+  lentry *hash[HFS_LHASHSZ];	/* hash table for entry chain */
+} lcache;
+
+typedef struct {
+  unsigned long id;		/* CNID of the file or directory */
+  unsigned long parid;		/* parent directory ID */
+  char name[HFS_MAX_FLEN + 1];	/* name as stored in the catalog */
+  hfsdirent ent;		/* attributes not yet written */
+} pattr;
+
+# define HFS_PATTRSZ		64
+
 # define HFS_MAP1SZ  256
 # define HFS_MAPXSZ  492
 
@@ -134,11 +220,15 @@ struct _hfsfile_ {
   CatDataRec cat;		/* catalog information */
   ExtDataRec ext;		/* current extent record */
   unsigned int fabn;		/* starting file allocation block number */
+  ExtDataRec oext;		/* current extent record of the other fork */
+  unsigned int ofabn;		/* and its starting allocation block number */
   int fork;			/* current selected fork for I/O */
   unsigned long pos;		/* current file seek pointer */
   int flags;			/* bit flags */
   int refs;
 
+  pthread_mutex_t lock;		/* guards fork, pos, and extent cache */
+
   struct _hfsfile_ *prev;
   struct _hfsfile_ *next;
 };
@@ -162,6 +252,8 @@ struct _hfsdir_ {
   unsigned long dirid;		/* directory ID of interest (or 0) */
 
   node n;			/* current B*-tree node */
+  unsigned long writes;		/* catalog writes when n was read */
+  byte pkey[HFS_CATKEYLEN];	/* key of the last record returned */
   struct _hfsvol_ *vptr;	/* current volume pointer */
 
   struct _hfsdir_ *prev;
@@ -177,6 +269,8 @@ typedef struct _btree_ {
   BTHdrRec hdr;			/* header record */
   byte *map;			/* usage bitmap */
   unsigned long mapsz;		/* number of bytes in bitmap */
+  unsigned long fhint;		/* no free nodes are numbered below this */
+  unsigned long writes;		/* nodes written, so copies can tell they're old */
   int flags;			/* bit flags */
 
   keyunpackfunc keyunpack;	/* key unpacking function */
@@ -195,6 +289,13 @@ struct _hfsvol_ {
   unsigned int lpa;	/* number of logical blocks per allocation block */
 
   bcache *cache;	/* cache of recently used blocks */
+  lcache *lookup;	/* cache of recently resolved catalog names */
+  btrace *trace;	/* block I/O trace being written, if any */
+
+  pattr pattrs[HFS_PATTRSZ];	/* attribute changes deferred by setattr */
+  int npattrs;		/* number of them */
+
+  hfsvolstats stats;	/* activity counters (see hfs_vstats()) */
 
   MDB mdb;		/* master directory block */
   block *vbm;		/* volume bitmap */
@@ -209,6 +310,8 @@ struct _hfsvol_ {
   hfsfile *files;	/* list of open files */
   hfsdir *dirs;		/* list of open directories */
 
+  pthread_mutex_t lock;	/* guards caches and lists shared by readers */
+
   struct _hfsvol_ *prev;
   struct _hfsvol_ *next;
 };
@@ -224,4 +327,26 @@ struct _hfsvol_ {
 
 # define HFS_VOL_OPT_MASK	0xff00
 
+/* readers update counters concurrently */
+
+# define COUNT(vol, field, n)	__sync_fetch_and_add(&(vol)->stats.field, (n))
+
+/*
+ * Static tracepoints. Where <sys/sdt.h> is available each TRACE() is a
+ * single nop plus an ELF note naming the probe "libhfs:name" and where to
+ * find its arguments, for perf, bpftrace or systemtap to attach to at run
+ * time; elsewhere it compiles to nothing and its arguments are never
+ * evaluated. The first argument is always the volume.
+ */
+
+# if defined(HAVE_SYS_SDT_H)
+#  include <sys/sdt.h>
+# endif
+
+# ifdef STAP_PROBEV
+#  define TRACE(name, ...)	STAP_PROBEV(libhfs, name, __VA_ARGS__)
+# else
+#  define TRACE(name, ...)	((void) 0)
+# endif
+
 extern hfsvol *hfs_mounts;
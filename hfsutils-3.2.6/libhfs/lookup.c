@@ -0,0 +1,353 @@
+/*
+ * libhfs - library for reading and writing Macintosh HFS volumes
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+# ifdef HAVE_CONFIG_H
+#  include "config.h"
+# endif
+
+# include <stdlib.h>
+# include <string.h>
+# include <errno.h>
+
+# include "libhfs.h"
+# include "lookup.h"
+# include "data.h"
+
+# define INUSE(e)	((e)->flags & HFS_LENTRY_INUSE)
+# define NEGATIVE(e)	((e)->flags & HFS_LENTRY_NEGATIVE)
+
+/*
+ * NAME:	empty()
+ * DESCRIPTION:	mark every entry of a lookup cache unused
+ */
+static
+void empty(lcache *cache)
+{
+  int i;
+
+  cache->tail = &cache->chain[HFS_LOOKUPSZ - 1];
+
+  for (i = 0; i < HFS_LOOKUPSZ; ++i)
+    {
+      lentry *e = &cache->chain[i];
+
+      e->flags = 0;
+
+      e->cnext = e + 1;
+      e->cprev = e - 1;
+
+      e->hnext = 0;
+      e->hprev = 0;
+    }
+
+  cache->chain[0].cprev = cache->tail;
+  cache->tail->cnext    = &cache->chain[0];
+
+  for (i = 0; i < HFS_LHASHSZ; ++i)
+    cache->hash[i] = 0;
+}
+
+/*
+ * NAME:	lookup->init()
+ * DESCRIPTION:	initialize a volume's catalog lookup cache
+ */
+int lk_init(hfsvol *vol)
+{
+  lcache *cache;
+
+  ASSERT(vol->lookup == 0);
+
+  cache = ALLOC(lcache, 1);
+  if (cache == 0)
+    ERROR(ENOMEM, 0);
+
+  vol->lookup = cache;
+
+  cache->hits    = 0;
+  cache->misses  = 0;
+  cache->neghits = 0;
+
+  empty(cache);
+
+  return 0;
+
+fail:
+  return -1;
+}
+
+/*
+ * NAME:	lookup->finish()
+ * DESCRIPTION:	dispose of a volume's catalog lookup cache
+ */
+void lk_finish(hfsvol *vol)
+{
+  FREE(vol->lookup);
+  vol->lookup = 0;
+}
+
+/*
+ * NAME:	lookup->purge()
+ * DESCRIPTION:	forget every cached catalog key
+ */
+void lk_purge(hfsvol *vol)
+{
+  if (vol->lookup == 0)
+    return;
+
+  pthread_mutex_lock(&vol->lock);
+  empty(vol->lookup);
+  pthread_mutex_unlock(&vol->lock);
+}
+
+/*
+ * NAME:	lookup->census()
+ * DESCRIPTION:	count the entries in use
+ */
+unsigned int lk_census(const lcache *cache)
+{
+  unsigned int used = 0;
+  int i;
+
+  for (i = 0; i < HFS_LOOKUPSZ; ++i)
+    {
+      if (INUSE(&cache->chain[i]))
+	++used;
+    }
+
+  return used;
+}
+
+/*
+ * NAME:	hash()
+ * DESCRIPTION:	hash a catalog key the way d_relstring() compares names
+ */
+static
+unsigned int hash(unsigned long parid, const char *name)
+{
+  unsigned long h = parid;
+
+  while (*name)
+    h = h * 31 + hfs_charorder[(unsigned char) *name++];
+
+  return h & (HFS_LHASHSZ - 1);
+}
+
+/*
+ * NAME:	find()
+ * DESCRIPTION:	locate the entry for a catalog key, if cached
+ */
+static
+lentry *find(lcache *cache, unsigned long parid, const char *name)
+{
+  lentry *e;
+
+  for (e = cache->hash[hash(parid, name)]; e; e = e->hnext)
+    {
+      if (e->parid == parid && d_relstring(e->name, name) == 0)
+	return e;
+    }
+
+  return 0;
+}
+
+/*
+ * NAME:	unhash()
+ * DESCRIPTION:	remove an entry from its hash chain
+ */
+static
+void unhash(lentry *e)
+{
+  if (e->hprev)
+    {
+      *e->hprev = e->hnext;
+      if (e->hnext)
+	e->hnext->hprev = e->hprev;
+
+      e->hnext = 0;
+      e->hprev = 0;
+    }
+}
+
+/*
+ * NAME:	touch()
+ * DESCRIPTION:	make an entry the most recently used
+ */
+static
+void touch(lcache *cache, lentry *e)
+{
+  if (e == cache->tail)
+    {
+      cache->tail = e->cprev;
+      return;
+    }
+
+  if (e == cache->tail->cnext)
+    return;
+
+  e->cprev->cnext = e->cnext;
+  e->cnext->cprev = e->cprev;
+
+  e->cprev = cache->tail;
+  e->cnext = cache->tail->cnext;
+
+  cache->tail->cnext->cprev = e;
+  cache->tail->cnext        = e;
+}
+
+/*
+ * NAME:	lookup->find()
+ * DESCRIPTION:	return 1 if a key is cached, setting found and catalog data
+ */
+int lk_find(hfsvol *vol, unsigned long parid, const char *name,
+	    CatDataRec *data, char *cname, int *found)
+{
+  lcache *cache = vol->lookup;
+  lentry *e;
+
+  /* readers share the cache, and even a hit reorders the LRU chain */
+
+  pthread_mutex_lock(&vol->lock);
+
+  e = find(cache, parid, name);
+  if (e == 0)
+    {
+      ++cache->misses;
+      pthread_mutex_unlock(&vol->lock);
+
+      return 0;
+    }
+
+  ++cache->hits;
+
+  touch(cache, e);
+
+  if (NEGATIVE(e))
+    {
+      ++cache->neghits;
+      *found = 0;
+    }
+  else
+    {
+      if (data)
+	*data = e->data;
+      if (cname)
+	strcpy(cname, e->name);
+
+      *found = 1;
+    }
+
+  pthread_mutex_unlock(&vol->lock);
+
+  return 1;
+}
+
+/*
+ * NAME:	lookup->store()
+ * DESCRIPTION:	cache the catalog data found for a key, or its absence (0)
+ */
+void lk_store(hfsvol *vol, unsigned long parid, const char *cname,
+	      const CatDataRec *data)
+{
+  lcache *cache = vol->lookup;
+  lentry *e, **hp;
+
+  pthread_mutex_lock(&vol->lock);
+
+  e = find(cache, parid, cname);
+  if (e == 0)
+    {
+      /* recycle the least recently used entry */
+
+      e = cache->tail;
+      unhash(e);
+
+      e->parid = parid;
+
+      hp = &cache->hash[hash(parid, cname)];
+
+      e->hprev = hp;
+      e->hnext = *hp;
+      if (*hp)
+	(*hp)->hprev = &e->hnext;
+
+      *hp = e;
+    }
+
+  strcpy(e->name, cname);
+
+  if (data)
+    {
+      e->flags = HFS_LENTRY_INUSE;
+      e->data  = *data;
+    }
+  else
+    e->flags = HFS_LENTRY_INUSE | HFS_LENTRY_NEGATIVE;
+
+  touch(cache, e);
+
+  pthread_mutex_unlock(&vol->lock);
+}
+
+/*
+ * NAME:	lookup->update()
+ * DESCRIPTION:	refresh the catalog data for a key, if cached
+ */
+void lk_update(hfsvol *vol, unsigned long parid, const char *cname,
+	       const CatDataRec *data)
+{
+  lentry *e;
+
+  pthread_mutex_lock(&vol->lock);
+
+  e = find(vol->lookup, parid, cname);
+  if (e)
+    {
+      e->flags = HFS_LENTRY_INUSE;
+      e->data  = *data;
+
+      strcpy(e->name, cname);
+    }
+
+  pthread_mutex_unlock(&vol->lock);
+}
+
+/*
+ * NAME:	lookup->forget()
+ * DESCRIPTION:	drop a key from the cache after its record is added or removed
+ */
+void lk_forget(hfsvol *vol, unsigned long parid, const char *name)
+{
+  lcache *cache = vol->lookup;
+  lentry *e;
+
+  pthread_mutex_lock(&vol->lock);
+
+  e = find(cache, parid, name);
+  if (e)
+    {
+      unhash(e);
+      e->flags = 0;
+
+      /* make the entry the first to be recycled */
+
+      touch(cache, e);
+      cache->tail = e;
+    }
+
+  pthread_mutex_unlock(&vol->lock);
+}
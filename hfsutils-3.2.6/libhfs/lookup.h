@@ -0,0 +1,28 @@
+/*
+ * libhfs - library for reading and writing Macintosh HFS volumes
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+int lk_init(hfsvol *);
+void lk_finish(hfsvol *);
+void lk_purge(hfsvol *);
+unsigned int lk_census(const lcache *);
+
+int lk_find(hfsvol *, unsigned long, const char *,
+	    CatDataRec *, char *, int *);
+void lk_store(hfsvol *, unsigned long, const char *, const CatDataRec *);
+void lk_update(hfsvol *, unsigned long, const char *, const CatDataRec *);
+void lk_forget(hfsvol *, unsigned long, const char *);
@@ -65,6 +65,42 @@ void n_init(node *np, btree *bt, int type, int height)
   memset(&np->data, 0, sizeof(np->data));
 }
 
+/*
+ * NAME:	findfree()
+ * DESCRIPTION:	locate the first unused node at or after a given node number
+ */
+static
+unsigned long findfree(const btree *bt, unsigned long num)
+{
+  const byte *map = bt->map;
+  unsigned long nnodes = bt->hdr.bthNNodes;
+  unsigned long long word;
+
+  /* step bit by bit up to a 64-bit boundary */
+
+  while (num < nnodes && (num & 0x3f) && BMTST(map, num))
+    ++num;
+
+  if (num >= nnodes || ! BMTST(map, num))
+    return num;
+
+  /* skip whole words of allocated nodes */
+
+  while (num + 64 <= nnodes)
+    {
+      memcpy(&word, map + (num >> 3), sizeof(word));
+      if (word != ~0ULL)
+	break;
+
+      num += 64;
+    }
+
+  while (num < nnodes && BMTST(map, num))
+    ++num;
+
+  return num;
+}
+
 /*
  * NAME:	node->new()
  * DESCRIPTION:	allocate a new b*-tree node
@@ -77,11 +113,11 @@ int n_new(node *np)
   if (bt->hdr.bthFree == 0)
     ERROR(EIO, "b*-tree full");
 
-  num = 0;
-  while (num < bt->hdr.bthNNodes && BMTST(bt->map, num))
-    ++num;
+  num = findfree(bt, bt->fhint);
+  if (num >= bt->hdr.bthNNodes && bt->fhint > 0)
+    num = findfree(bt, 0);  /* stale hint; rescan from the start */
 
-  if (num == bt->hdr.bthNNodes)
+  if (num >= bt->hdr.bthNNodes)
     ERROR(EIO, "free b*-tree node not found");
 
   np->nnum = num;
@@ -89,6 +125,8 @@ int n_new(node *np)
   BMSET(bt->map, num);
   --bt->hdr.bthFree;
 
+  bt->fhint = num + 1;
+
   bt->flags |= HFS_BT_UPDATE_HDR;
 
   return 0;
@@ -137,6 +175,9 @@ int n_free(node *np)
   BMCLR(bt->map, np->nnum);
   ++bt->hdr.bthFree;
 
+  if (np->nnum < bt->fhint)
+    bt->fhint = np->nnum;
+
   bt->flags |= HFS_BT_UPDATE_HDR;
 
   return 0;
@@ -265,6 +306,9 @@ int split(node *left, byte *record, unsigned int *reclen)
   left->nd.ndFLink  = right->nnum;
   right->nd.ndBLink = left->nnum;
 
+  TRACE(node__split, bt->f.vol, bt->f.cat.u.fil.filFlNum,
+	left->nnum, right->nnum, left->nd.ndNRecs);
+
   /* divide all records evenly between the two nodes */
 
   mark = (NODEUSED(*left) + 2 * left->nd.ndNRecs + *reclen + 2) >> 1;
@@ -393,6 +437,9 @@ int join(node *left, node *right, byte *record, int *flag)
 {
   int i, offset;
 
+  TRACE(node__join, left->bt->f.vol, left->bt->f.cat.u.fil.filFlNum,
+	left->nnum, right->nnum, right->nd.ndNRecs);
+
   /* copy records and offsets */
 
   memcpy(HFS_NODEREC(*left, left->nd.ndNRecs),
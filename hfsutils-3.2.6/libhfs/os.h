@@ -23,6 +23,7 @@ int os_open(void **, const char *, int);
 int os_close(void **);
 
 int os_same(void **, const char *);
+int os_fd(void **);
 
 unsigned long os_seek(void **, unsigned long);
 unsigned long os_read(void **, void *, unsigned long);
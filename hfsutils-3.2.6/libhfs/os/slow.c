@@ -0,0 +1,367 @@
+/*
+ * libhfs - library for reading and writing Macintosh HFS volumes
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/*
+ * A medium that is slow on purpose, so that caching, readahead and request
+ * coalescing can be measured on a fast disk as if the image were somewhere
+ * slower. It wraps unix.c: every transfer really happens, and then the
+ * caller waits
+ *
+ *   latency + seek + bytes / bandwidth
+ *
+ * where seek is nothing when a transfer starts where the previous one
+ * ended, and otherwise grows from the minimum seek time to the maximum
+ * with the square root of the distance, as a disk arm's does, reaching the
+ * maximum across the whole medium. Requests are served one at a time.
+ *
+ * The environment variable HFS_SLOWMEDIUM sets the figures when a medium
+ * is opened: a profile name, or any of
+ *
+ *   latency=US  bandwidth=KB/S  seek=MIN-US:MAX-US
+ *
+ * or both, separated by commas; e.g. "hdd" or "net,latency=20000". When it
+ * is unset or empty nothing is added. Build libhfs with
+ *
+ *   rm -f os.c && make OS=slow
+ *
+ * and the same way with OS=unix to go back.
+ */
+
+/* the real medium, under other names */
+
+# define os_open	unix_open
+# define os_close	unix_close
+# define os_same	unix_same
+# define os_fd		unix_fd
+# define os_seek	unix_seek
+# define os_read	unix_read
+# define os_write	unix_write
+
+# include "os/unix.c"
+
+# undef os_open
+# undef os_close
+# undef os_same
+# undef os_fd
+# undef os_seek
+# undef os_read
+# undef os_write
+
+# include <stdlib.h>
+# include <string.h>
+# include <time.h>
+
+# include "os.h"
+
+typedef struct {
+  const char *name;
+  unsigned long latency;	/* microseconds per request */
+  unsigned long bandwidth;	/* kilobytes per second, or 0 for no limit */
+  unsigned long seekmin;	/* microseconds to move any distance at all */
+  unsigned long seekmax;	/* microseconds to cross the whole medium */
+} profile;
+
+static const profile profiles[] = {
+  /* name	latency	bandwidth	seekmin	seekmax */
+
+  { "none",	     0,	     0,	     0,	     0 },
+  { "floppy",	100000,	    45,	  3000, 240000 },  /* 1.44M, 300 rpm */
+  { "cdrom",	 25000,	   600,	 80000, 250000 },  /* 4x */
+  { "hdd",	  4170,	100000,	   800,  18000 },  /* 7200 rpm */
+  { "net",	  2000,	 11000,	     0,	     0 },  /* 100 Mbit/s, 2 ms away */
+  { 0 }
+};
+
+typedef struct {
+  void *priv;			/* unix.c's descriptor */
+  profile p;			/* figures in effect */
+
+  unsigned long size;		/* blocks on the medium */
+  unsigned long pos;		/* block the next transfer starts at */
+  unsigned long last;		/* block after the previous transfer */
+  unsigned long long idle;	/* when the medium is next idle, microseconds */
+} slowmedium;
+
+/*
+ * NAME:	usecs()
+ * DESCRIPTION:	return a monotonic time in microseconds
+ */
+static
+unsigned long long usecs(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (unsigned long long) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/*
+ * NAME:	isqrt()
+ * DESCRIPTION:	return the integer square root of a number
+ */
+static
+unsigned long long isqrt(unsigned long long n)
+{
+  unsigned long long x = n, y;
+
+  if (n < 2)
+    return n;
+
+  for (y = (x + 1) / 2; y < x; y = (x + n / x) / 2)
+    x = y;
+
+  return x;
+}
+
+/*
+ * NAME:	setfigures()
+ * DESCRIPTION:	fill in a medium's figures from the environment
+ */
+static
+int setfigures(profile *p)
+{
+  const char *env;
+  const profile *q;
+  char *spec, *word, *end;
+
+  *p = profiles[0];
+
+  env = getenv("HFS_SLOWMEDIUM");
+  if (env == 0 || *env == 0)
+    return 0;
+
+  spec = strdup(env);
+  if (spec == 0)
+    ERROR(ENOMEM, 0);
+
+  for (word = strtok(spec, ","); word; word = strtok(0, ","))
+    {
+      if (strncmp(word, "latency=", 8) == 0)
+	p->latency = strtoul(word + 8, &end, 0);
+      else if (strncmp(word, "bandwidth=", 10) == 0)
+	p->bandwidth = strtoul(word + 10, &end, 0);
+      else if (strncmp(word, "seek=", 5) == 0)
+	{
+	  p->seekmin = strtoul(word + 5, &end, 0);
+	  p->seekmax = p->seekmin;
+
+	  if (*end == ':')
+	    p->seekmax = strtoul(end + 1, &end, 0);
+	}
+      else
+	{
+	  for (q = profiles; q->name && strcmp(q->name, word) != 0; ++q)
+	    ;
+
+	  if (q->name == 0)
+	    break;
+
+	  *p  = *q;
+	  end = word + strlen(word);
+	}
+
+      if (*end || p->seekmax < p->seekmin)
+	break;
+    }
+
+  free(spec);
+
+  if (word)
+    ERROR(EINVAL, "bad HFS_SLOWMEDIUM setting");
+
+  return 0;
+
+fail:
+  return -1;
+}
+
+/*
+ * NAME:	charge()
+ * DESCRIPTION:	charge a transfer's time and wait until it would be done
+ */
+static
+void charge(slowmedium *m, unsigned long len)
+{
+  unsigned long long cost, now, dist;
+  struct timespec ts;
+
+  cost = m->p.latency;
+
+  if (m->pos != m->last && m->size > 0)
+    {
+      dist = m->pos > m->last ? m->pos - m->last : m->last - m->pos;
+      if (dist > m->size)
+	dist = m->size;
+
+      /* the fraction of a full stroke, as a square root in 1/1024ths */
+
+      cost += m->p.seekmin + (m->p.seekmax - m->p.seekmin) *
+	isqrt((dist << 20) / m->size) / 1024;
+    }
+
+  if (m->p.bandwidth)
+    cost += ((unsigned long long) len << HFS_BLOCKSZ_BITS) * 1000000 /
+      ((unsigned long long) m->p.bandwidth << 10);
+
+  m->pos += len;
+  m->last = m->pos;
+
+  /* time already lost elsewhere pays toward the next request */
+
+  now = usecs();
+  if (m->idle < now)
+    m->idle = now;
+
+  m->idle += cost;
+
+  while (now < m->idle)
+    {
+      ts.tv_sec  = (m->idle - now) / 1000000;
+      ts.tv_nsec = (m->idle - now) % 1000000 * 1000;
+
+      nanosleep(&ts, 0);
+
+      now = usecs();
+    }
+}
+
+/*
+ * NAME:	os->open()
+ * DESCRIPTION:	open and lock a new descriptor from the given path and mode
+ */
+int os_open(void **priv, const char *path, int mode)
+{
+  slowmedium *m;
+
+  m = ALLOC(slowmedium, 1);
+  if (m == 0)
+    ERROR(ENOMEM, 0);
+
+  if (setfigures(&m->p) == -1 ||
+      unix_open(&m->priv, path, mode) == -1)
+    {
+      FREE(m);
+      return -1;
+    }
+
+  /* the seek time is scaled to the size of the medium */
+
+  m->size = unix_seek(&m->priv, -1);
+  if (m->size == (unsigned long) -1)
+    m->size = 0;
+
+  m->pos  = 0;
+  m->last = 0;
+  m->idle = 0;
+
+  *priv = m;
+
+  return 0;
+
+fail:
+  return -1;
+}
+
+/*
+ * NAME:	os->close()
+ * DESCRIPTION:	close an open descriptor
+ */
+int os_close(void **priv)
+{
+  slowmedium *m = *priv;
+  int result;
+
+  *priv = (void *) -1;
+
+  result = unix_close(&m->priv);
+
+  FREE(m);
+
+  return result;
+}
+
+/*
+ * NAME:	os->same()
+ * DESCRIPTION:	return 1 iff path is same as the open descriptor
+ */
+int os_same(void **priv, const char *path)
+{
+  slowmedium *m = *priv;
+
+  return unix_same(&m->priv, path);
+}
+
+/*
+ * NAME:	os->fd()
+ * DESCRIPTION:	return a descriptor others may read directly, or -1
+ */
+int os_fd(void **priv)
+{
+  /* reading around us would skip the wait */
+
+  return -1;
+}
+
+/*
+ * NAME:	os->seek()
+ * DESCRIPTION:	set a descriptor's seek pointer (offset in blocks)
+ */
+unsigned long os_seek(void **priv, unsigned long offset)
+{
+  slowmedium *m = *priv;
+  unsigned long result;
+
+  result = unix_seek(&m->priv, offset);
+  if (result != (unsigned long) -1)
+    m->pos = result;
+
+  return result;
+}
+
+/*
+ * NAME:	os->read()
+ * DESCRIPTION:	read blocks from an open descriptor
+ */
+unsigned long os_read(void **priv, void *buf, unsigned long len)
+{
+  slowmedium *m = *priv;
+  unsigned long result;
+
+  result = unix_read(&m->priv, buf, len);
+  if (result != (unsigned long) -1)
+    charge(m, result);
+
+  return result;
+}
+
+/*
+ * NAME:	os->write()
+ * DESCRIPTION:	write blocks to an open descriptor
+ */
+unsigned long os_write(void **priv, const void *buf, unsigned long len)
+{
+  slowmedium *m = *priv;
+  unsigned long result;
+
+  result = unix_write(&m->priv, buf, len);
+  if (result != (unsigned long) -1)
+    charge(m, result);
+
+  return result;
+}
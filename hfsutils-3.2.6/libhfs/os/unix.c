@@ -133,6 +133,15 @@ fail:
   return -1;
 }
 
+/*
+ * NAME:	os->fd()
+ * DESCRIPTION:	return a descriptor others may read directly, or -1
+ */
+int os_fd(void **priv)
+{
+  return (int) *priv;
+}
+
 /*
  * NAME:	os->seek()
  * DESCRIPTION:	set a descriptor's seek pointer (offset in blocks)
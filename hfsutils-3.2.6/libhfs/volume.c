@@ -37,6 +37,7 @@
 # include "file.h"
 # include "btree.h"
 # include "record.h"
+# include "lookup.h"
 # include "os.h"
 
 /*
@@ -57,6 +58,11 @@ void v_init(hfsvol *vol, int flags)
   vol->lpa        = 0;
 
   vol->cache      = 0;
+  vol->lookup     = 0;
+  vol->trace      = 0;
+  vol->npattrs    = 0;
+
+  memset(&vol->stats, 0, sizeof(vol->stats));
 
   vol->vbm        = 0;
   vol->vbmsz      = 0;
@@ -65,6 +71,8 @@ void v_init(hfsvol *vol, int flags)
 
   ext->map        = 0;
   ext->mapsz      = 0;
+  ext->fhint      = 0;
+  ext->writes     = 0;
   ext->flags      = 0;
 
   ext->keyunpack  = (keyunpackfunc)  r_unpackextkey;
@@ -74,6 +82,8 @@ void v_init(hfsvol *vol, int flags)
 
   cat->map        = 0;
   cat->mapsz      = 0;
+  cat->fhint      = 0;
+  cat->writes     = 0;
   cat->flags      = 0;
 
   cat->keyunpack  = (keyunpackfunc)  r_unpackcatkey;
@@ -85,6 +95,8 @@ void v_init(hfsvol *vol, int flags)
   vol->files      = 0;
   vol->dirs       = 0;
 
+  pthread_mutex_init(&vol->lock, 0);
+
   vol->prev       = 0;
   vol->next       = 0;
 }
@@ -109,6 +121,11 @@ int v_open(hfsvol *vol, const char *path, int mode)
       b_init(vol) != -1)
     vol->flags |= HFS_VOL_USINGCACHE;
 
+  /* likewise the catalog lookup cache */
+
+  if (! (vol->flags & HFS_OPT_NOCACHE))
+    lk_init(vol);
+
   return 0;
 
 fail:
@@ -192,6 +209,10 @@ int v_close(hfsvol *vol)
       b_finish(vol) == -1)
     result = -1;
 
+  if (vol->trace &&
+      b_settrace(vol, 0) == -1)
+    result = -1;
+
   if (os_close(&vol->priv) == -1)
     result = -1;
 
@@ -204,6 +225,8 @@ int v_close(hfsvol *vol)
   vol->vbm   = 0;
   vol->vbmsz = 0;
 
+  lk_finish(vol);
+
   FREE(vol->ext.map);
   FREE(vol->cat.map);
 
@@ -489,32 +512,54 @@ int v_catsearch(hfsvol *vol, unsigned long parid, const char *name,
 		CatDataRec *data, char *cname, node *np)
 {
   CatKeyRec key;
+  CatDataRec rec;
   byte pkey[HFS_CATKEYLEN];
   const byte *ptr;
   node n;
-  int found;
+  int found, caching;
+
+  /*
+   * Thread records are cached like any other key (CNID, ""); only lookups
+   * that need the node itself bypass the cache.
+   */
+
+  caching = (vol->lookup != 0);
 
   if (np == 0)
-    np = &n;
+    {
+      if (caching && lk_find(vol, parid, name, data, cname, &found))
+	return found;
+
+      np = &n;
+    }
 
   r_makecatkey(&key, parid, name);
   r_packcatkey(&key, pkey, 0);
 
   found = bt_search(&vol->cat, pkey, np);
+  if (found == 0 && caching && strlen(name) <= HFS_MAX_FLEN)
+    lk_store(vol, parid, name, 0);
+
   if (found <= 0)
     return found;
 
   ptr = HFS_NODEREC(*np, np->rnum);
 
+  if (data == 0 && caching)
+    data = &rec;
+
+  if (cname || caching)
+    r_unpackcatkey(ptr, &key);
+
   if (cname)
-    {
-      r_unpackcatkey(ptr, &key);
-      strcpy(cname, key.ckrCName);
-    }
+    strcpy(cname, key.ckrCName);
 
   if (data)
     r_unpackcatdata(HFS_RECDATA(ptr), data);
 
+  if (caching)
+    lk_store(vol, parid, key.ckrCName, data);
+
   return 1;
 }
 
@@ -539,6 +584,8 @@ int v_extsearch(hfsfile *file, unsigned int fabn,
   r_makeextkey(&key, file->fork, file->cat.u.fil.filFlNum, fabn);
   r_packextkey(&key, pkey, 0);
 
+  COUNT(file->vol, extsearches, 1);
+
   /* in case bt_search() clobbers these */
 
   memcpy(&extsave, &file->ext, sizeof(ExtDataRec));
@@ -590,6 +637,7 @@ fail:
  */
 int v_putcatrec(const CatDataRec *data, node *np)
 {
+  hfsvol *vol = np->bt->f.vol;
   byte pdata[HFS_CATDATALEN], *ptr;
   unsigned int len = 0;
 
@@ -598,7 +646,111 @@ int v_putcatrec(const CatDataRec *data, node *np)
   ptr = HFS_NODEREC(*np, np->rnum);
   memcpy(HFS_RECDATA(ptr), pdata, len);
 
-  return bt_putnode(np);
+  if (bt_putnode(np) == -1)
+    goto fail;
+
+  if (vol->lookup)
+    {
+      CatKeyRec key;
+
+      r_unpackcatkey(ptr, &key);
+      lk_update(vol, key.ckrParID, key.ckrCName, data);
+    }
+
+  return 0;
+
+fail:
+  return -1;
+}
+
+/*
+ * NAME:	vol->findattrs()
+ * DESCRIPTION:	return the deferred attribute change for a CNID, if any
+ */
+pattr *v_findattrs(hfsvol *vol, unsigned long id)
+{
+  int i;
+
+  for (i = 0; i < vol->npattrs; ++i)
+    {
+      if (vol->pattrs[i].id == id)
+	return &vol->pattrs[i];
+    }
+
+  return 0;
+}
+
+/*
+ * NAME:	vol->deferattrs()
+ * DESCRIPTION:	remember new attributes for a catalog record to write later
+ */
+int v_deferattrs(hfsvol *vol, unsigned long parid, const char *name,
+		 unsigned long id, const hfsdirent *ent)
+{
+  pattr *pa;
+
+  pa = v_findattrs(vol, id);
+  if (pa == 0)
+    {
+      if (vol->npattrs == HFS_PATTRSZ &&
+	  v_flushattrs(vol) == -1)
+	goto fail;
+
+      pa = &vol->pattrs[vol->npattrs++];
+
+      pa->id    = id;
+      pa->parid = parid;
+      strcpy(pa->name, name);
+    }
+
+  pa->ent = *ent;
+
+  return 0;
+
+fail:
+  return -1;
+}
+
+/*
+ * NAME:	vol->dropattrs()
+ * DESCRIPTION:	forget a deferred attribute change
+ */
+void v_dropattrs(hfsvol *vol, pattr *pa)
+{
+  *pa = vol->pattrs[--vol->npattrs];
+}
+
+/*
+ * NAME:	vol->flushattrs()
+ * DESCRIPTION:	write all deferred attribute changes to the catalog
+ */
+int v_flushattrs(hfsvol *vol)
+{
+  CatDataRec data;
+  node n;
+  int i, found, result = 0;
+
+  for (i = 0; i < vol->npattrs; ++i)
+    {
+      pattr *pa = &vol->pattrs[i];
+
+      /* only the attributes are replaced; the rest of the record is current */
+
+      found = v_catsearch(vol, pa->parid, pa->name, &data, 0, &n);
+      if (found == -1)
+	result = -1;
+      if (found <= 0)
+	continue;
+
+      r_packdirent(&data, &pa->ent);
+
+      if (v_putcatrec(&data, &n) == -1)
+	result = -1;
+    }
+
+  vol->npattrs = 0;
+
+  return result;
 }
 
 /*
@@ -693,6 +845,8 @@ int v_allocblocks(hfsvol *vol, ExtDescriptor *blocks)
   blocks->xdrStABN    = foundat;
   blocks->xdrNumABlks = found;
 
+  TRACE(alloc, vol, request, foundat, found);
+
   if (v_dirty(vol) == -1)
     goto fail;
 
@@ -753,6 +907,28 @@ fail:
   return -1;
 }
 
+/*
+ * NAME:	vol->largestfree()
+ * DESCRIPTION:	return the length of the longest run of unused blocks
+ */
+unsigned int v_largestfree(hfsvol *vol)
+{
+  unsigned int pt, run = 0, best = 0;
+
+  if (vol->vbm == 0)
+    return 0;
+
+  for (pt = 0; pt < vol->mdb.drNmAlBlks; ++pt)
+    {
+      if (BMTST(vol->vbm, pt))
+	run = 0;
+      else if (++run > best)
+	best = run;
+    }
+
+  return best;
+}
+
 /*
  * NAME:	vol->resolve()
  * DESCRIPTION:	translate a pathname; return catalog information
@@ -920,6 +1096,7 @@ int v_adjvalence(hfsvol *vol, unsigned long parid, int isdir, int adj)
 {
   node n;
   CatDataRec data;
+  pattr *pa;
   int result = 0;
 
   if (isdir)
@@ -948,6 +1125,12 @@ int v_adjvalence(hfsvol *vol, unsigned long parid, int isdir, int adj)
   data.u.dir.dirVal  += adj;
   data.u.dir.dirMdDat = d_mtime(time(0));
 
+  /* deferred attributes would otherwise put back an older date later */
+
+  pa = v_findattrs(vol, parid);
+  if (pa)
+    pa->ent.mddate = d_ltime(data.u.dir.dirMdDat);
+
   result = v_putcatrec(&data, &n);
 
 done:
@@ -996,6 +1179,9 @@ int v_mkdir(hfsvol *vol, unsigned long parid, const char *name)
   r_makecatkey(&key, parid, name);
   r_packcatrec(&key, &data, record, &reclen);
 
+  if (vol->lookup)
+    lk_forget(vol, parid, name);
+
   if (bt_insert(&vol->cat, record, reclen) == -1)
     goto fail;
 
@@ -1012,6 +1198,9 @@ int v_mkdir(hfsvol *vol, unsigned long parid, const char *name)
   r_makecatkey(&key, id, "");
   r_packcatrec(&key, &data, record, &reclen);
 
+  if (vol->lookup)
+    lk_forget(vol, id, "");
+
   if (bt_insert(&vol->cat, record, reclen) == -1 ||
       v_adjvalence(vol, parid, 1, 1) == -1)
     goto fail;
@@ -49,10 +49,17 @@ int v_getthread(hfsvol *, unsigned long, CatDataRec *, node *, int);
     v_getthread(vol, id, thread, np, cdrFThdRec)
 
 int v_putcatrec(const CatDataRec *, node *);
+
+pattr *v_findattrs(hfsvol *, unsigned long);
+int v_deferattrs(hfsvol *, unsigned long, const char *,
+		 unsigned long, const hfsdirent *);
+void v_dropattrs(hfsvol *, pattr *);
+int v_flushattrs(hfsvol *);
 int v_putextrec(const ExtDataRec *, node *);
 
 int v_allocblocks(hfsvol *, ExtDescriptor *);
 int v_freeblocks(hfsvol *, const ExtDescriptor *);
+unsigned int v_largestfree(hfsvol *);
 
 int v_resolve(hfsvol **, const char *, CatDataRec *, unsigned long *, char *, node *);
 
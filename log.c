@@ -11,12 +11,17 @@
 #include <stdio.h>
 #include <fcntl.h>
 #include <string.h>
+#include <strings.h>
 #include <unistd.h>
 #include <sys/errno.h>
 #include <sys/stat.h>
 #include <time.h>
 #include <pwd.h>
 #include <limits.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <pthread.h>
 
 #include "log.h"
 
@@ -24,9 +29,9 @@
 #define MEGABYTE 1 << 20
 #define NUM_MEGS_LOG 10
 
+static char logpath[PATH_MAX];
+
 int log_to_file() {
-    char logpath[PATH_MAX];
-    
     // you can't write to /Library any more, so use ~/Library instead
     char *home = getpwuid(MAC_FIRST_USER)->pw_dir;
     if (strlen(home) + strlen(LOGPATH) >= PATH_MAX)
@@ -53,7 +58,8 @@ int log_to_file() {
     if (dup2(log, STDERR_FILENO) < 0)
         fprintf(stderr, "stderr dup2 errno: %d\n", errno);
     fflush(stderr);
-    return log;
+    close(log);
+    return STDERR_FILENO;
 }
 
 void log_invoking_command(char *filename, int argc, char *argv[]) {
@@ -66,3 +72,296 @@ void log_invoking_command(char *filename, int argc, char *argv[]) {
     fprintf(stderr, "\n");
     fflush(stderr);
 }
+
+#pragma mark Leveled logging
+
+// Each thread formats into its own single-producer ring; the drain thread is
+// the only consumer, so neither side takes a lock on the way through. A ring
+// that fills up drops messages (counted in _dropped) rather than blocking the
+// filesystem on the log. Rings are never freed: when a thread exits its ring
+// is marked unused and the next new thread picks it up.
+
+#define LOG_RINGSZ  (64 * 1024)
+#define LOG_MSGMAX  1024
+#define LOG_DRAINMS 50
+
+#ifdef DEBUG
+int log_level = LOGLEVEL_DEBUG;
+#else
+int log_level = LOGLEVEL_INFO;
+#endif
+
+typedef struct {
+    uint32_t len;                   // text bytes following the header
+    uint32_t level;
+    struct timespec ts;
+} logrecord;
+
+typedef struct logring {
+    struct logring *next;
+    int used;
+    uint64_t head;                  // advanced by the owning thread
+    uint64_t tail;                  // advanced by the drain
+    char buf[LOG_RINGSZ];
+} logring;
+
+#define LOAD(p)     __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define STORE(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+
+static const char *_level_names[LOGLEVEL_COUNT] = { "error", "warn", "info", "debug" };
+
+static logring *_rings;
+static __thread logring *_ring;
+static pthread_key_t _ring_key;
+static pthread_once_t _ring_once = PTHREAD_ONCE_INIT;
+static unsigned long _dropped, _reported;
+
+static pthread_mutex_t _drain_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t _drain_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t _drainer;
+static int _running;
+static int _stopping;
+
+static void ring_release(void *arg) {
+    logring *ring = arg;
+    STORE(&ring->used, 0);
+}
+
+static void ring_key_init(void) {
+    pthread_key_create(&_ring_key, ring_release);
+}
+
+static logring * ring_get(void) {
+    logring *ring;
+
+    if (_ring)
+        return _ring;
+    pthread_once(&_ring_once, ring_key_init);
+
+    for (ring = LOAD(&_rings); ring; ring = ring->next) {
+        if (!LOAD(&ring->used) && __sync_bool_compare_and_swap(&ring->used, 0, 1))
+            break;
+    }
+    if (!ring) {
+        ring = calloc(1, sizeof(*ring));
+        if (!ring)
+            return NULL;
+        ring->used = 1;
+        do
+            ring->next = LOAD(&_rings);
+        while (!__sync_bool_compare_and_swap(&_rings, ring->next, ring));
+    }
+    pthread_setspecific(_ring_key, ring);
+    return _ring = ring;
+}
+
+static void ring_put(logring *ring, uint64_t pos, const void *data, size_t len) {
+    size_t off = pos % LOG_RINGSZ, first = LOG_RINGSZ - off;
+    if (first > len) first = len;
+    memcpy(ring->buf + off, data, first);
+    memcpy(ring->buf, (const char *)data + first, len - first);
+}
+
+static void ring_get_bytes(const logring *ring, uint64_t pos, void *data, size_t len) {
+    size_t off = pos % LOG_RINGSZ, first = LOG_RINGSZ - off;
+    if (first > len) first = len;
+    memcpy(data, ring->buf + off, first);
+    memcpy((char *)data + first, ring->buf, len - first);
+}
+
+void log_write(int level, const char *fmt, ...) {
+    char msg[LOG_MSGMAX];
+    va_list ap;
+    logrecord rec;
+    logring *ring;
+    int len;
+
+    va_start(ap, fmt);
+    if (!LOAD(&_running) || !(ring = ring_get())) {
+        vfprintf(stderr, fmt, ap);
+        va_end(ap);
+        return;
+    }
+    len = vsnprintf(msg, sizeof(msg), fmt, ap);
+    va_end(ap);
+    if (len < 0)
+        return;
+    if (len >= (int)sizeof(msg))
+        len = sizeof(msg) - 1;
+
+    rec.len = len;
+    rec.level = level;
+    clock_gettime(CLOCK_REALTIME, &rec.ts);
+
+    uint64_t head = ring->head, fill = head - LOAD(&ring->tail);
+    if (LOG_RINGSZ - fill < sizeof(rec) + len) {
+        __sync_fetch_and_add(&_dropped, 1);
+        return;
+    }
+    ring_put(ring, head, &rec, sizeof(rec));
+    ring_put(ring, head + sizeof(rec), msg, len);
+    STORE(&ring->head, head + sizeof(rec) + len);
+
+    // don't wait out the poll interval with the ring half full
+    if (fill < LOG_RINGSZ / 2 && fill + sizeof(rec) + len >= LOG_RINGSZ / 2)
+        pthread_cond_signal(&_drain_cond);
+}
+
+// start over in a fresh file once the current one passes the size cap,
+// keeping one previous generation alongside it
+static void rotate(void) {
+    char oldpath[PATH_MAX + 4];
+    struct stat st;
+
+    if (!logpath[0] || fstat(STDERR_FILENO, &st) != 0 || !S_ISREG(st.st_mode))
+        return;
+    if (st.st_size <= NUM_MEGS_LOG * MEGABYTE)
+        return;
+
+    snprintf(oldpath, sizeof(oldpath), "%s.old", logpath);
+    if (rename(logpath, oldpath) != 0)
+        return;
+    int log = open(logpath, O_CREAT | O_WRONLY | O_APPEND, S_IRUSR | S_IWUSR);
+    if (log < 0)
+        return;
+    chown(logpath, MAC_FIRST_USER, -1);
+    dup2(log, STDERR_FILENO);
+    close(log);
+}
+
+static void emit(char *out, size_t *used, const char *data, size_t len) {
+    if (*used + len > LOG_RINGSZ) {
+        write(STDERR_FILENO, out, *used);
+        *used = 0;
+    }
+    memcpy(out + *used, data, len);
+    *used += len;
+}
+
+// Merge the rings oldest record first and write them in large batches.
+// Called with _drain_lock held, which makes the caller the only consumer.
+static void drain(void) {
+    static char out[LOG_RINGSZ];
+    size_t used = 0;
+    unsigned long dropped;
+
+    for (;;) {
+        logring *ring, *oldest = NULL;
+        logrecord rec, best;
+
+        for (ring = LOAD(&_rings); ring; ring = ring->next) {
+            if (ring->tail == LOAD(&ring->head))
+                continue;
+            ring_get_bytes(ring, ring->tail, &rec, sizeof(rec));
+            if (!oldest || rec.ts.tv_sec < best.ts.tv_sec ||
+                (rec.ts.tv_sec == best.ts.tv_sec && rec.ts.tv_nsec < best.ts.tv_nsec)) {
+                oldest = ring;
+                best = rec;
+            }
+        }
+        if (!oldest)
+            break;
+
+        char line[LOG_MSGMAX + 64];
+        struct tm tm;
+        time_t secs = best.ts.tv_sec;
+        localtime_r(&secs, &tm);
+        size_t n = strftime(line, sizeof(line), "%H:%M:%S", &tm);
+        n += snprintf(line + n, sizeof(line) - n, ".%03ld %-5s ",
+                      best.ts.tv_nsec / 1000000, _level_names[best.level]);
+        ring_get_bytes(oldest, oldest->tail + sizeof(best), line + n, best.len);
+        n += best.len;
+        if (line[n - 1] != '\n')
+            line[n++] = '\n';
+        STORE(&oldest->tail, oldest->tail + sizeof(best) + best.len);
+        emit(out, &used, line, n);
+    }
+
+    dropped = LOAD(&_dropped) - _reported;
+    if (dropped) {
+        _reported += dropped;
+        char line[64];
+        int n = snprintf(line, sizeof(line), "[log.c]\tdropped %lu messages\n", dropped);
+        emit(out, &used, line, n);
+    }
+    if (used) {
+        fflush(stderr);
+        write(STDERR_FILENO, out, used);
+        rotate();
+    }
+}
+
+static void * drainer(void *arg) {
+    pthread_mutex_lock(&_drain_lock);
+    while (!_stopping) {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_nsec += LOG_DRAINMS * 1000000L;
+        if (ts.tv_nsec >= 1000000000L) {
+            ts.tv_sec++;
+            ts.tv_nsec -= 1000000000L;
+        }
+        pthread_cond_timedwait(&_drain_cond, &_drain_lock, &ts);
+        drain();
+    }
+    pthread_mutex_unlock(&_drain_lock);
+    return NULL;
+}
+
+void log_set_level(int level) {
+    if (level < LOGLEVEL_ERROR) level = LOGLEVEL_ERROR;
+    if (level > LOGLEVEL_DEBUG) level = LOGLEVEL_DEBUG;
+    log_level = level;
+}
+
+// accepts a level's name or its number; -1 if it is neither
+int log_parse_level(const char *name) {
+    char *end;
+    long n = strtol(name, &end, 10);
+    if (end != name && *end == 0)
+        return n >= LOGLEVEL_ERROR && n < LOGLEVEL_COUNT ? (int)n : -1;
+    for (int i = 0; i < LOGLEVEL_COUNT; i++) {
+        if (strcasecmp(name, _level_names[i]) == 0)
+            return i;
+    }
+    return -1;
+}
+
+const char *log_level_name(int level) {
+    return level >= LOGLEVEL_ERROR && level < LOGLEVEL_COUNT ? _level_names[level] : "?";
+}
+
+unsigned long log_dropped(void) {
+    return LOAD(&_dropped);
+}
+
+void log_start(void) {
+    if (LOAD(&_running))
+        return;
+    fflush(stderr);
+    _stopping = 0;
+    if (pthread_create(&_drainer, NULL, drainer, NULL) != 0) {
+        perror("pthread_create");
+        return;
+    }
+    STORE(&_running, 1);
+}
+
+// write out everything logged so far before returning
+void log_flush(void) {
+    pthread_mutex_lock(&_drain_lock);
+    drain();
+    pthread_mutex_unlock(&_drain_lock);
+}
+
+void log_stop(void) {
+    if (!LOAD(&_running))
+        return;
+    pthread_mutex_lock(&_drain_lock);
+    _stopping = 1;
+    pthread_cond_signal(&_drain_cond);
+    pthread_mutex_unlock(&_drain_lock);
+    pthread_join(_drainer, NULL);
+    STORE(&_running, 0);
+    log_flush();
+}
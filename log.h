@@ -16,4 +16,34 @@
 int log_to_file();
 void log_invoking_command(char *filename, int argc, char *argv[]);
 
+// Leveled logging. Messages at or below log_level are formatted into a
+// per-thread ring and written out by a background thread started with
+// log_start(); before that (and after log_stop()) they go straight to stderr.
+// A disabled level costs one compare: the arguments are never evaluated.
+enum {
+    LOGLEVEL_ERROR,
+    LOGLEVEL_WARN,
+    LOGLEVEL_INFO,
+    LOGLEVEL_DEBUG,
+    LOGLEVEL_COUNT
+};
+
+extern int log_level;
+
+#define log_msg(level, args...) \
+    do { if ((level) <= log_level) log_write((level), args); } while (0)
+#define log_error(args...) log_msg(LOGLEVEL_ERROR, args)
+#define log_warn(args...)  log_msg(LOGLEVEL_WARN, args)
+#define log_info(args...)  log_msg(LOGLEVEL_INFO, args)
+#define log_debug(args...) log_msg(LOGLEVEL_DEBUG, args)
+
+void log_write(int level, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+void log_set_level(int level);
+int log_parse_level(const char *name);
+const char *log_level_name(int level);
+unsigned long log_dropped(void);
+void log_start(void);
+void log_flush(void);
+void log_stop(void);
+
 #endif /* _log_h */
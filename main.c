@@ -53,6 +53,7 @@
 #include <unistd.h>
 #include <string.h>
 #include <iconv.h>
+#include <pthread.h>
 #include <libhfs/hfs.h>
 
 #include "log.h"
@@ -75,6 +76,10 @@ enum {
 	KEY_HELP,
 	KEY_ENCODING,
 	KEY_READONLY,
+	KEY_HIGHLEVEL,
+	KEY_REJECT,
+	KEY_REJECT_LIST,
+	KEY_LOGLEVEL,
 };
 
 static struct fuse_opt FuseHFS_opts[] = {
@@ -84,6 +89,10 @@ static struct fuse_opt FuseHFS_opts[] = {
 	FUSE_OPT_KEY("--help",		KEY_HELP),
 	FUSE_OPT_KEY("--encoding=",	KEY_ENCODING),
 	FUSE_OPT_KEY("--readonly",	KEY_READONLY),
+	FUSE_OPT_KEY("--highlevel",	KEY_HIGHLEVEL),
+	FUSE_OPT_KEY("--reject",	KEY_REJECT),
+	FUSE_OPT_KEY("--reject=",	KEY_REJECT_LIST),
+	FUSE_OPT_KEY("--loglevel=",	KEY_LOGLEVEL),
 	FUSE_OPT_END
 };
 
@@ -118,11 +127,29 @@ static int FuseHFS_opt_proc(void *data, const char *arg, int key, struct fuse_ar
 			fprintf(stderr, "FuseHFS %s, (c)2010 namedfork.net namedfork.net\n", FUSEHFS_VERSION);
 			exit(1);
 		case KEY_HELP:
-			fprintf(stderr, "usage: fusefs_hfs [fuse options] device mountpoint\n");
+			fprintf(stderr, "usage: fusefs_hfs [fuse options] [--encoding=name] [--readonly] [--highlevel] [--reject[=pattern,...]] [--loglevel=error|warn|info|debug] device mountpoint\n");
 			exit(0);
 		case KEY_READONLY:
 			options.readonly = 1;
 			return 0;
+		case KEY_HIGHLEVEL:
+			options.highlevel = 1;
+			return 0;
+		case KEY_REJECT:
+			free(options.reject);
+			options.reject = strdup(FUSEHFS_REJECT_DEFAULT);
+			return 0;
+		case KEY_REJECT_LIST:
+			free(options.reject);
+			options.reject = strdup(arg+9);
+			return 0;
+		case KEY_LOGLEVEL:
+			if (log_parse_level(arg+11) == -1) {
+				fprintf(stderr, "unknown log level: %s\n", arg+11);
+				exit(1);
+			}
+			log_set_level(log_parse_level(arg+11));
+			return 0;
 	}
 	return 0;
 }
@@ -187,7 +214,6 @@ int main(int argc, char* argv[], char* envp[], char** exec_path) {
 		options.readonly = 1;
 		fuse_opt_add_arg(&args, "-oro");
 	}
-	fuse_opt_add_arg(&args, "-s");
 	hfs_umount(NULL);
 
 	// MacFUSE options
@@ -200,7 +226,6 @@ int main(int argc, char* argv[], char* envp[], char** exec_path) {
     strncpy(volnameOption+10, volname, sizeof(volnameOption) - 10);
 	free(volname);
     fuse_opt_add_arg(&args, volnameOption);
-    fuse_opt_add_arg(&args, "-s");
     fuse_opt_add_arg(&args, "-ofstypename=hfs");
     if (is_root()) fuse_opt_add_arg(&args, "-oallow_other"); // this option requires privileges
     fuse_opt_add_arg(&args, "-odefer_permissions");
@@ -210,6 +235,7 @@ int main(int argc, char* argv[], char* envp[], char** exec_path) {
     fuse_opt_add_arg(&args, fsnameOption);
     free(fsnameOption);
     //fuse_opt_add_arg(&args, "-debug");
+    fuse_opt_add_arg(&args, "-oiosize=" FUSEHFS_IOSIZE_STR); // large reads and writes, see fusehfs_conn()
     fuse_opt_add_arg(&args, "-olocal"); // full effect uncertain, but necessary to display it at as a local drive
                                         // rather than a server, which assures better unmounting (fully ejecting disk image)
                                         // https://github.com/osxfuse/osxfuse/wiki/Mount-options
@@ -219,7 +245,15 @@ int main(int argc, char* argv[], char* envp[], char** exec_path) {
     char *macfuse_mode = getenv("OSXFUSE_MACFUSE_MODE");
     fprintf(stderr, FILENAME "MacFUSE mode: %s\n", macfuse_mode);
 
-	int ret = fuse_main(args.argc, args.argv, &FuseHFS_operations, &options);
+	// the low-level frontend is keyed by catalog node ID; --highlevel uses the path-based one
+	int ret;
+	if (options.highlevel) {
+		// the low-level frontend passes these with each reply instead
+		fuse_opt_add_arg(&args, "-oattr_timeout=" ATTR_TIMEOUT_STR ",entry_timeout=" ENTRY_TIMEOUT_STR);
+		ret = fuse_main(args.argc, args.argv, &FuseHFS_operations, &options);
+	} else {
+		ret = FuseHFS_ll_main(&args, &options);
+	}
 	    
     log_to_file(); // macFUSE apparently messes with stderr so you have to set this again
     fprintf(stderr, FILENAME "Quitting fusefs_hfs, returning %d\n\n", ret);
@@ -0,0 +1,209 @@
+//
+//  stats.c
+//  FuseHFS
+//
+//  Both frontends wrap their callbacks to count calls and failures and to
+//  sort each call's latency into a log2 histogram. The tallies, together
+//  with libhfs's own counters (hfs_vstats()), are written to the log when
+//  the process gets SIGUSR1 and once more at unmount:
+//
+//      kill -USR1 $(pgrep fusefs_hfs)
+//
+//  The same report can be read at any time from /.fusehfs/stats in the mount.
+//
+//  Licensed under GPLv2: https://www.gnu.org/licenses/gpl-2.0.html
+//
+#include "common.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <libhfs/hfs.h>
+
+#include "log.h"
+#include "stats.h"
+
+#define FILENAME "[stats.c]\t"
+
+typedef struct {
+	uint64_t calls;
+	uint64_t errors;
+	uint64_t ns;
+	uint64_t max_ns;
+	uint64_t buckets[STATS_BUCKETS];
+} opstats;
+
+#define FUSEHFS_OP_NAME(name) #name,
+static const char *_op_names[OP_COUNT] = { FUSEHFS_OPS(FUSEHFS_OP_NAME) };
+
+// updated with atomic adds; a dump may see one call half counted
+static opstats _ops[OP_COUNT];
+
+static __thread int _failed;
+
+uint64_t stats_now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int bucket(uint64_t ns) {
+	uint64_t us = ns / 1000;
+	if (us == 0) return 0;
+	int n = 64 - __builtin_clzll(us);
+	return n < STATS_BUCKETS ? n : STATS_BUCKETS - 1;
+}
+
+void stats_record(int op, uint64_t start, int failed) {
+	uint64_t ns = stats_now() - start;
+	opstats *s = &_ops[op];
+
+	__sync_fetch_and_add(&s->calls, 1);
+	if (failed) __sync_fetch_and_add(&s->errors, 1);
+	__sync_fetch_and_add(&s->ns, ns);
+	__sync_fetch_and_add(&s->buckets[bucket(ns)], 1);
+
+	uint64_t max = s->max_ns;
+	while (ns > max && !__sync_bool_compare_and_swap(&s->max_ns, max, ns))
+		max = s->max_ns;
+}
+
+void stats_error(void) {
+	_failed = 1;
+}
+
+int stats_failed(void) {
+	int failed = _failed;
+	_failed = 0;
+	return failed;
+}
+
+// upper bound in microseconds of the bucket holding the given fraction of calls
+static uint64_t percentile(const opstats *s, uint64_t calls, double fraction) {
+	uint64_t want = (uint64_t)(calls * fraction), seen = 0;
+	int n;
+	for (n = 0; n < STATS_BUCKETS - 1; n++) {
+		seen += s->buckets[n];
+		if (seen > want) break;
+	}
+	return (uint64_t)1 << n;
+}
+
+static double percent(unsigned long part, unsigned long whole) {
+	return whole ? 100.0 * part / whole : 0.0;
+}
+
+// each line starts with prefix, so the log can tell where it came from
+void stats_print(FILE *out, const char *prefix) {
+	int n, b;
+
+	fprintf(out, "%s%-12s %10s %8s %10s %10s %10s %10s\n",
+			prefix, "op", "calls", "errors", "avg us", "p50 <us", "p99 <us", "max us");
+	for (n = 0; n < OP_COUNT; n++) {
+		opstats s = _ops[n];
+		if (s.calls == 0) continue;
+		fprintf(out, "%s%-12s %10llu %8llu %10llu %10llu %10llu %10llu\n", prefix, _op_names[n],
+				(unsigned long long)s.calls, (unsigned long long)s.errors,
+				(unsigned long long)(s.ns / s.calls / 1000),
+				(unsigned long long)percentile(&s, s.calls, 0.5),
+				(unsigned long long)percentile(&s, s.calls, 0.99),
+				(unsigned long long)(s.max_ns / 1000));
+
+		// the histogram itself, skipping empty buckets
+		char line[1024];
+		int len = 0;
+		line[0] = 0;	// a dump can land between the calls and bucket increments
+		for (b = 0; b < STATS_BUCKETS && len < (int)sizeof(line); b++) {
+			if (s.buckets[b] == 0) continue;
+			len += snprintf(line + len, sizeof(line) - len, " <%llu:%llu",
+							(unsigned long long)1 << b, (unsigned long long)s.buckets[b]);
+		}
+		fprintf(out, "%s%-12s%s\n", prefix, "", line);
+	}
+
+	hfsvolstats vs;
+	if (hfs_vstats(NULL, &vs) == 0) {
+		fprintf(out, "%sblock cache: %u of %u blocks in use, %u dirty, readahead %u; "
+				"%lu hits, %lu misses (%.1f%% hits)\n", prefix,
+				vs.cacheused, vs.cachesz, vs.cachedirty, vs.readahead,
+				vs.bhits, vs.bmisses, percent(vs.bhits, vs.bhits + vs.bmisses));
+		fprintf(out, "%slookup cache: %u of %u entries in use; %lu hits, %lu misses (%.1f%% hits)\n", prefix,
+				vs.lookupused, vs.lookupsz, vs.lhits, vs.lmisses, percent(vs.lhits, vs.lhits + vs.lmisses));
+		fprintf(out, "%spending setattr: %u\n", prefix, vs.pending);
+		fprintf(out, "%sallocator: %lu of %lu blocks free, longest free run %lu, next search at %lu\n", prefix,
+				vs.freeblocks, vs.alblocks, vs.largestfree, vs.allocptr);
+		fprintf(out, "%sb-tree: %lu searches, %lu nodes visited; %lu extents overflow searches\n", prefix,
+				vs.searches, vs.levels, vs.extsearches);
+		fprintf(out, "%smedium: %llu bytes read, %llu bytes written\n", prefix,
+				vs.nread, vs.nwritten);
+	}
+	fprintf(out, "%slog: level %s, %lu messages dropped\n", prefix, log_level_name(log_level), log_dropped());
+}
+
+void stats_dump(void) {
+	log_flush();	// so the report lands after everything logged before it
+	stats_print(stderr, FILENAME);
+	fflush(stderr);
+}
+
+#pragma mark SIGUSR1
+
+// the handler only pokes a pipe; the dump happens on an ordinary thread
+static int _pipe[2] = { -1, -1 };
+static pthread_t _dumper;
+static struct sigaction _old_usr1;
+
+static void on_usr1(int sig) {
+	int saved = errno;
+	char c = 'd';
+	write(_pipe[1], &c, 1);
+	errno = saved;
+}
+
+static void * dumper(void *arg) {
+	char c;
+	while (read(_pipe[0], &c, 1) == 1 || errno == EINTR) {
+		if (c == 'q') break;
+		if (c == 'd') stats_dump();
+		c = 0;
+	}
+	return NULL;
+}
+
+void stats_start(void) {
+	if (pipe(_pipe) == -1) {
+		perror("pipe");
+		return;
+	}
+	if (pthread_create(&_dumper, NULL, dumper, NULL) != 0) {
+		perror("pthread_create");
+		close(_pipe[0]);
+		close(_pipe[1]);
+		_pipe[0] = _pipe[1] = -1;
+		return;
+	}
+
+	struct sigaction sa;
+	memset(&sa, 0, sizeof sa);
+	sa.sa_handler = on_usr1;
+	sigemptyset(&sa.sa_mask);
+	sa.sa_flags = SA_RESTART;
+	sigaction(SIGUSR1, &sa, &_old_usr1);
+}
+
+void stats_stop(void) {
+	if (_pipe[1] != -1) {
+		sigaction(SIGUSR1, &_old_usr1, NULL);
+		char c = 'q';
+		write(_pipe[1], &c, 1);
+		pthread_join(_dumper, NULL);
+		close(_pipe[0]);
+		close(_pipe[1]);
+		_pipe[0] = _pipe[1] = -1;
+	}
+	stats_dump();
+}
@@ -0,0 +1,56 @@
+//
+//  stats.h
+//  FuseHFS
+//
+//  Per-operation call counts and latency histograms for both frontends.
+//
+//  Licensed under GPLv2: https://www.gnu.org/licenses/gpl-2.0.html
+//
+
+#ifndef _stats_h
+#define _stats_h
+
+#include <stdint.h>
+#include <stdio.h>
+
+// every operation either frontend serves; statfs_x is counted as statfs
+#define FUSEHFS_OPS(X) \
+	X(lookup) X(forget) X(getattr) X(fgetattr) X(setattr) \
+	X(opendir) X(readdir) X(releasedir) \
+	X(mknod) X(mkdir) X(unlink) X(rmdir) X(rename) X(create) \
+	X(open) X(read) X(write) X(read_buf) X(write_buf) X(release) X(statfs) \
+	X(listxattr) X(getxattr) X(setxattr) X(removexattr) \
+	X(truncate) X(ftruncate) X(chmod) X(chown) X(utimens) \
+	X(setvolname) X(getxtimes) X(setcrtime) X(setchgtime) X(setbkuptime)
+
+#define FUSEHFS_OP_ENUM(name) OP_##name,
+enum { FUSEHFS_OPS(FUSEHFS_OP_ENUM) OP_COUNT };
+
+// latency buckets: bucket 0 is under 1us, bucket n covers [2^(n-1), 2^n) us,
+// and the last one takes everything slower
+#define STATS_BUCKETS 24
+
+uint64_t stats_now(void);
+void stats_record(int op, uint64_t start, int failed);
+
+// the low-level frontend replies instead of returning, so it marks failures
+void stats_error(void);
+int stats_failed(void);
+
+// static tracepoints "fusehfs:<op>__start" and "fusehfs:<op>__done" around each
+// callback, built like libhfs's TRACE(): nops where <sys/sdt.h> exists, nothing elsewhere
+#ifdef HAVE_SYS_SDT_H
+#include <sys/sdt.h>
+#endif
+#ifdef STAP_PROBEV
+#define FUSEHFS_TRACE(name, args...) STAP_PROBEV(fusehfs, name, args)
+#else
+#define FUSEHFS_TRACE(name, args...) ((void) 0)
+#endif
+
+void stats_print(FILE *out, const char *prefix);
+void stats_dump(void);
+void stats_start(void);
+void stats_stop(void);
+
+#endif /* _stats_h */